@@ -12,8 +12,10 @@
 #include "HTN.h"
 #include "HTNPlan.h"
 #include "HTNDecorator.h"
+#include "HTNDelegates.h"
 #include "HTNTask.h"
 #include "Nodes/HTNNode_If.h"
+#include "Utility/HTNProfiler.h"
 #include "WorldStateProxy.h"
 
 #if HTN_DEBUG_PLANNING && ENABLE_VISUAL_LOG
@@ -37,7 +39,7 @@ namespace
 		FORCEINLINE bool operator()(const TSharedPtr<FHTNPlan>& A, const TSharedPtr<FHTNPlan>& B) const
 		{
 			return A.IsValid() && B.IsValid() ?
-				A->Cost < B->Cost :
+				A->GetMinTotalCost() < B->GetMinTotalCost() :
 				B.IsValid();
 		}
 	};
@@ -76,7 +78,10 @@ TSharedRef<FHTNPlan> FHTNPlanningContext::MakePlanCopyWithAddedStep(FHTNPlanStep
 
 int32 FHTNPlanningContext::AddLevel(FHTNPlan& NewPlan, UHTN* HTN, const FHTNPlanStepID& ParentStepID) const
 {
-	return NewPlan.Levels.Add(MakeShared<FHTNPlanLevel>(HTN, WorldStateAfterEnteringDecorators, ParentStepID));
+	const TSharedRef<FHTNPlanLevel> Level = MakeShared<FHTNPlanLevel>(HTN, WorldStateAfterEnteringDecorators, ParentStepID);
+	Level->MinCost = HTN ? HTN->GetStaticAnalysis().MinCost : 0;
+	Level->PlanCostAtLevelStart = NewPlan.Cost;
+	return NewPlan.Levels.Add(Level);
 }
 
 int32 FHTNPlanningContext::AddInlineLevel(FHTNPlan& NewPlan, const FHTNPlanStepID& ParentStepID) const
@@ -114,6 +119,10 @@ void FHTNPlanningContext::SubmitCandidatePlan(const TSharedRef<FHTNPlan>& Candid
 	{
 		PlanningTask->SubmitCandidatePlan(CandidatePlan, AddingNode.Get(), AddedStepDescription);
 	}
+	else
+	{
+		++PlanningTask->Stats.NumPrunedCandidates;
+	}
 }
 
 UAITask_MakeHTNPlan::UAITask_MakeHTNPlan(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer),
@@ -124,8 +133,12 @@ UAITask_MakeHTNPlan::UAITask_MakeHTNPlan(const FObjectInitializer& ObjectInitial
 	CurrentPlanStepID(FHTNPlanStepID::None),
 	NextNodesIndex(0),
 	CurrentTask(nullptr),
+	CurrentLatentCreatePlanStepsID(INDEX_NONE),
+	NextLatentCreatePlanStepsID(0),
+	PlanningStartCycles(0),
 	bIsWaitingForTaskToProducePlanSteps(false),
-	bWasCancelled(false)
+	bWasCancelled(false),
+	bStubLatentCreatePlanSteps(false)
 {
 	bIsPausable = false;
 }
@@ -154,6 +167,10 @@ void UAITask_MakeHTNPlan::Clear()
 	BlockedPlans.Reset();
 	FinishedPlan = nullptr;
 	NextPriorityMarker = 1;
+	Stats.Reset();
+	NodePlanningCaches.Reset();
+	PendingLatentCreatePlanSteps.Reset();
+	bIsWaitingForTaskToProducePlanSteps = false;
 
 #if HTN_DEBUG_PLANNING
 	DebugInfo.Reset();
@@ -163,46 +180,123 @@ void UAITask_MakeHTNPlan::Clear()
 
 void UAITask_MakeHTNPlan::SubmitPlanStep(const UHTNTask* Task, TSharedPtr<FBlackboardWorldState> WorldState, int32 Cost, const FString& Description)
 {
-	if (ensure(CurrentTask && Task == CurrentTask))
+	// Called from CreatePlanSteps
+	if (CurrentTask && Task == CurrentTask && CurrentLatentCreatePlanStepsID == INDEX_NONE)
 	{
 		PossibleStepsBuffer.Emplace(FHTNPlanStep(CurrentTask, WorldState, Cost), Description);
 	}
+	// Called by a latent task
+	else if (FHTNPendingLatentCreatePlanSteps* const Pending = FindPendingLatentCreatePlanSteps(Task))
+	{
+		SubmitLatentPlanStep(Pending->ID, WorldState, Cost, Description);
+	}
+	else
+	{
+		ensureMsgf(IsFinished(), TEXT("SubmitPlanStep called with task %s, which is neither producing plan steps right now nor latently."), *GetNameSafe(Task));
+	}
 }
 
-void UAITask_MakeHTNPlan::WaitForLatentCreatePlanSteps(const UHTNTask* Task)
+int32 UAITask_MakeHTNPlan::WaitForLatentCreatePlanSteps(const UHTNTask* Task, bool bAllowPlanningToContinue)
 {
-	if (ensure(CurrentTask && Task == CurrentTask))
+	if (!ensure(CurrentTask && Task == CurrentTask) || 
+		!ensureMsgf(CurrentLatentCreatePlanStepsID == INDEX_NONE, TEXT("WaitForLatentCreatePlanSteps called twice by task %s"), *Task->GetNodeName()))
+	{
+		return CurrentLatentCreatePlanStepsID;
+	}
+
+	++Stats.NumLatentWaits;
+	FHTNPendingLatentCreatePlanSteps& Pending = PendingLatentCreatePlanSteps.AddDefaulted_GetRef();
+	Pending.ID = NextLatentCreatePlanStepsID++;
+	Pending.Task = CurrentTask;
+	Pending.Plan = CurrentPlanToExpand;
+	Pending.PlanStepID = CurrentPlanStepID;
+	Pending.WorldStateAfterEnteredDecorators = WorldStateAfterEnteredDecorators;
+	Pending.bBlocksPlanning = !bAllowPlanningToContinue;
+	// Any steps the task submits later are ignored, since by then planning will have finished.
+	Pending.bFinished = bStubLatentCreatePlanSteps;
+	
+	// Steps submitted before going latent are kept with the rest.
+	Pending.PossibleSteps = MoveTemp(PossibleStepsBuffer);
+	PossibleStepsBuffer.Reset();
+
+	// While parked, the plan still blocks lower-priority plans, same as if it was in the frontier.
+	AddBlockingPriorityMarkersOf(*CurrentPlanToExpand);
+	
+	CurrentLatentCreatePlanStepsID = Pending.ID;
+	return Pending.ID;
+}
+
+void UAITask_MakeHTNPlan::SubmitLatentPlanStep(int32 LatentCreatePlanStepsID, TSharedPtr<FBlackboardWorldState> WorldState, int32 Cost, const FString& Description)
+{
+	// When stubbed, the task was already finished with the steps it submitted before going latent.
+	if (bStubLatentCreatePlanSteps)
 	{
-		bIsWaitingForTaskToProducePlanSteps = true;
+		return;
+	}
+
+	if (FHTNPendingLatentCreatePlanSteps* const Pending = FindPendingLatentCreatePlanSteps(LatentCreatePlanStepsID))
+	{
+		if (ensureMsgf(!Pending->bFinished, TEXT("SubmitLatentPlanStep called by task %s after FinishLatentCreatePlanSteps"), *Pending->Task->GetNodeName()))
+		{
+			Pending->PossibleSteps.Emplace(FHTNPlanStep(Pending->Task, WorldState, Cost), Description);
+		}
+	}
+	else
+	{
+		ensureMsgf(IsFinished(), TEXT("SubmitLatentPlanStep called with unknown ID %i"), LatentCreatePlanStepsID);
 	}
 }
 
-void UAITask_MakeHTNPlan::FinishLatentCreatePlanSteps(const UHTNTask* Task)
+void UAITask_MakeHTNPlan::FinishLatentCreatePlanSteps(int32 LatentCreatePlanStepsID)
 {
 	SCOPE_CYCLE_COUNTER(STAT_AI_HTN_Planning);
+
+	// Planning may have already finished without needing the results of this task.
+	if (WasCancelled() || IsFinished())
+	{
+		return;
+	}
 	
-	if (!WasCancelled() && ensure(CurrentTask && Task == CurrentTask))
+	FHTNPendingLatentCreatePlanSteps* const Pending = FindPendingLatentCreatePlanSteps(LatentCreatePlanStepsID);
+	if (bStubLatentCreatePlanSteps && Pending)
 	{
-		if (ensureMsgf(bIsWaitingForTaskToProducePlanSteps, TEXT("FinishLatentCreatePlanSteps called with task %s even though the planner is not waiting for latent CreatePlanSteps. Did you not call WaitForLatentCreatePlanSteps or called FinishLatentCreatePlanSteps twice?"), *Task->GetNodeName()))
-		{
-			bIsWaitingForTaskToProducePlanSteps = false;
-#if HTN_DEBUG_PLANNING
-			const auto DidProduceAnyPlans = [&, NumPlansBefore = GetNumCandidatePlans()]() -> bool { return GetNumCandidatePlans() >= NumPlansBefore; };
-#endif
-			OnTaskFinishedProducingCandidateSteps(CurrentTask);
+		// Already marked as finished by WaitForLatentCreatePlanSteps.
+		return;
+	}
+	
+	if (ensureMsgf(Pending && !Pending->bFinished, TEXT("FinishLatentCreatePlanSteps called with ID %i even though the planner is not waiting for it. Did you not call WaitForLatentCreatePlanSteps or called FinishLatentCreatePlanSteps twice?"), LatentCreatePlanStepsID))
+	{
+		Pending->bFinished = true;
 #if HTN_DEBUG_PLANNING
-			if (!DidProduceAnyPlans())
-			{
-				SAVE_PLANNING_STEP_FAILURE(CurrentTask, NodePlanningFailureReason.IsEmpty() ? TEXT("Failed to produce any plan steps") : NodePlanningFailureReason);
-			}
+		Pending->FailureReason = NodePlanningFailureReason;
+		NodePlanningFailureReason.Reset();
 #endif
-			// Move to the next possible node
-			NextNodesIndex += 1;
+
+		// If this is called while planning (e.g. the task finished right away), the results will be picked up by DoPlanning.
+		if (bIsWaitingForTaskToProducePlanSteps)
+		{
 			DoPlanning();
 		}
 	}
 }
 
+void UAITask_MakeHTNPlan::FinishLatentCreatePlanSteps(const UHTNTask* Task)
+{
+	if (WasCancelled() || IsFinished())
+	{
+		return;
+	}
+	
+	if (const FHTNPendingLatentCreatePlanSteps* const Pending = FindPendingLatentCreatePlanSteps(Task))
+	{
+		FinishLatentCreatePlanSteps(Pending->ID);
+	}
+	else
+	{
+		ensureMsgf(false, TEXT("FinishLatentCreatePlanSteps called with task %s even though the planner is not waiting for latent CreatePlanSteps. Did you not call WaitForLatentCreatePlanSteps or called FinishLatentCreatePlanSteps twice?"), *GetNameSafe(Task));
+	}
+}
+
 void UAITask_MakeHTNPlan::Activate()
 {
 	SCOPE_CYCLE_COUNTER(STAT_AI_HTN_Planning);
@@ -212,9 +306,19 @@ void UAITask_MakeHTNPlan::Activate()
 	check(IsValid(BlackboardComponent));
 
 	Clear();
+	PlanningStartCycles = FPlatformTime::Cycles64();
+	const FHTNPlanningStatsScope StatsScope(Stats);
 
-	const TSharedRef<FBlackboardWorldState> WorldStateAtPlanStart = MakeShared<FBlackboardWorldState>(*BlackboardComponent);
-	Frontier.HeapPush(MakeShared<FHTNPlan>(TopLevelHTN, WorldStateAtPlanStart), FCompareHTNPlanCosts());
+	const TSharedRef<FBlackboardWorldState> WorldStateAtPlanStart = OwnerComponent->MakeBlackboardWorldState();
+	FHTNDelegates::OnPlanningStarted.Broadcast(*OwnerComponent, *TopLevelHTN, *WorldStateAtPlanStart);
+	if (TopLevelHTN->GetStaticAnalysis().bIsInfeasible)
+	{
+		UE_VLOG(OwnerComponent->GetOwner(), LogHTN, Warning, TEXT("HTN %s can never produce a plan"), *TopLevelHTN->GetName());
+	}
+	else
+	{
+		Frontier.HeapPush(MakeShared<FHTNPlan>(TopLevelHTN, WorldStateAtPlanStart), FCompareHTNPlanCosts());
+	}
 	
 	DoPlanning();
 }
@@ -223,9 +327,15 @@ void UAITask_MakeHTNPlan::OnDestroy(bool bInOwnerFinished)
 {
 	SCOPE_CYCLE_COUNTER(STAT_AI_HTN_Planning);
 	
+	Stats.WallTimeSeconds = FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - PlanningStartCycles);
+	Stats.bFoundPlan = FoundPlan();
+	Stats.bWasCancelled = WasCancelled();
+
 	ClearIntermediateState();
 	Frontier.Reset();
 	BlockedPlans.Reset();
+	NodePlanningCaches.Reset();
+	PendingLatentCreatePlanSteps.Reset();
 
 #if HTN_DEBUG_PLANNING
 	if (FoundPlan())
@@ -249,22 +359,58 @@ void UAITask_MakeHTNPlan::DoPlanning()
 	SCOPE_CYCLE_COUNTER(STAT_AI_HTN_Planning);
 	
 	check(!FinishedPlan.IsValid());
+	const FHTNPlanningStatsScope StatsScope(Stats);
 
-	while (!bIsWaitingForTaskToProducePlanSteps)
+	bIsWaitingForTaskToProducePlanSteps = false;
+	while (true)
 	{
+		ProcessFinishedLatentCreatePlanSteps();
+		if (IsBlockedByLatentCreatePlanSteps())
+		{
+			bIsWaitingForTaskToProducePlanSteps = true;
+			return;
+		}
+		
 		if (!CurrentPlanToExpand.IsValid())
 		{
 			CurrentPlanToExpand = DequeueCurrentBestPlan();
 			if (!CurrentPlanToExpand.IsValid())
 			{
+				// Parked plans might still produce new candidate plans.
+				if (PendingLatentCreatePlanSteps.Num())
+				{
+					bIsWaitingForTaskToProducePlanSteps = true;
+					return;
+				}
+				
 				// Planning failed
 				ensureAsRuntimeWarning(BlockedPlans.Num() == 0);
 				EndTask();
 				return;
 			}
+			++Stats.NumExpandedPlans;
+
+			// TODO make the MaxPlanLength a config var on the htn component.
+			if (GetTotalNumSteps(*CurrentPlanToExpand) > 100)
+			{
+				Stats.bExceededMaxPlanLength = true;
+				UE_VLOG(OwnerComponent->GetOwner(), LogHTN, Error, TEXT("Max plan length exceeded, planning failed"));
+				EndTask();
+				return;
+			}
 			
 			if (CurrentPlanToExpand->IsComplete())
 			{
+				// A parked plan might still turn out cheaper than this one, so put it back and wait.
+				if (CanPendingLatentCreatePlanStepsProducePlanCheaperThan(CurrentPlanToExpand->Cost))
+				{
+					AddBlockingPriorityMarkersOf(*CurrentPlanToExpand);
+					Frontier.HeapPush(CurrentPlanToExpand, FCompareHTNPlanCosts());
+					CurrentPlanToExpand = nullptr;
+					bIsWaitingForTaskToProducePlanSteps = true;
+					return;
+				}
+				
 				// Planning succeeded
 				FinishedPlan = CurrentPlanToExpand;
 				EndTask();
@@ -286,13 +432,6 @@ TSharedPtr<FHTNPlan> UAITask_MakeHTNPlan::DequeueCurrentBestPlan()
 		check(Plan.IsValid());
 
 		RemoveBlockingPriorityMarkersOf(*Plan);
-
-		// TODO make the MaxPlanLength a config var on the htn component.
-		if (GetTotalNumSteps(*Plan) > 100)
-		{
-			UE_VLOG(OwnerComponent->GetOwner(), LogHTN, Error, TEXT("Max plan length exceeded, planning failed"));
-			return nullptr;
-		}
 		return Plan;
 	}
 
@@ -322,28 +461,30 @@ void UAITask_MakeHTNPlan::MakeExpansionsOfCurrentPlan()
 		UHTNStandaloneNode* const Node = NextNodes[NextNodesIndex];
 		if (Node->MaxRecursionLimit > 0 && CurrentPlanToExpand->GetRecursionCount(Node) >= Node->MaxRecursionLimit)
 		{
+			++Stats.NumPrunedCandidates;
 			continue;
 		}
 		
 		MakeExpansionsOfCurrentPlan(WorldState, Node);
-		if (bIsWaitingForTaskToProducePlanSteps || FinishedPlan.IsValid())
+		if (FinishedPlan.IsValid())
 		{
 			break;
 		}
+		
+		// Continue with the next node once the blocking task finishes.
+		if (IsBlockedByLatentCreatePlanSteps())
+		{
+			++NextNodesIndex;
+			UE_VLOG_UELOG(OwnerComponent->GetOwner(), LogHTN, VeryVerbose, TEXT("Planning task %s is waiting for task \"%s\" to produce plan steps.\nRecorded planspace traversal so far:\n(Note that results may be misleading if the visual logger wasn't recording for the entire duration of planning)\n%s"),
+				*GetName(),
+				*Node->GetNodeName(),
+				*DebugInfo.ToString()
+			);
+			return;
+		}
 	}
 
-	if (!bIsWaitingForTaskToProducePlanSteps)
-	{
-		ClearIntermediateState();
-	}
-	else
-	{
-		UE_VLOG_UELOG(OwnerComponent->GetOwner(), LogHTN, VeryVerbose, TEXT("Planning task %s is waiting for task \"%s\" to produce plan steps.\nRecorded planspace traversal so far:\n(Note that results may be misleading if the visual logger wasn't recording for the entire duration of planning)\n%s"),
-			*GetName(),
-			CurrentTask ? *CurrentTask->GetNodeName() : TEXT("[missing task]"),
-			*DebugInfo.ToString()
-		);
-	}
+	ClearIntermediateState();
 }
 
 void UAITask_MakeHTNPlan::MakeExpansionsOfCurrentPlan(const TSharedPtr<FBlackboardWorldState>& WorldState, UHTNStandaloneNode* Node)
@@ -354,12 +495,14 @@ void UAITask_MakeHTNPlan::MakeExpansionsOfCurrentPlan(const TSharedPtr<FBlackboa
 	// Initialize the node with asset if hasn't been initialized with an asset already.
 	// This is to make sure that blackboard keys are resolved etc before planning reaches the node.
 	Node->InitializeFromAsset(*TopLevelHTN);
+	HTN_PROFILER_SCOPE(*OwnerComponent, Node, EHTNProfilerPhase::PlanExpansion);
 
 	SET_NODE_FAILURE_REASON(TEXT(""));
 	
 	const bool bDecoratorsPassed = EnterDecorators(*CurrentPlanToExpand, CurrentPlanStepID, *WorldState, Node, WorldStateAfterEnteredDecorators);
 	if (!WorldStateAfterEnteredDecorators.IsValid() || (!bDecoratorsPassed && !Node->IsA(UHTNNode_If::StaticClass())))
 	{
+		++Stats.NumPrunedCandidates;
 		SAVE_PLANNING_STEP_FAILURE(Node, NodePlanningFailureReason);
 		return;
 	}
@@ -370,15 +513,19 @@ void UAITask_MakeHTNPlan::MakeExpansionsOfCurrentPlan(const TSharedPtr<FBlackboa
 
 	CurrentTask = Cast<UHTNTask>(Node);
 	// Adding primitive task. Make as many new plans as there are possible ways to perform the task.
+	bool bIsTaskLatent = false;
 	if (CurrentTask)
 	{
 		PossibleStepsBuffer.Reset();
-		check(!bIsWaitingForTaskToProducePlanSteps);
+		CurrentLatentCreatePlanStepsID = INDEX_NONE;
 		CurrentTask->CreatePlanSteps(*OwnerComponent, *this, WorldStateAfterEnteredDecorators.ToSharedRef());
-		if (!bIsWaitingForTaskToProducePlanSteps)
+		bIsTaskLatent = CurrentLatentCreatePlanStepsID != INDEX_NONE;
+		CurrentLatentCreatePlanStepsID = INDEX_NONE;
+		if (!bIsTaskLatent)
 		{
 			OnTaskFinishedProducingCandidateSteps(CurrentTask);
 		}
+		CurrentTask = nullptr;
 	}
 	else
 	{
@@ -391,7 +538,7 @@ void UAITask_MakeHTNPlan::MakeExpansionsOfCurrentPlan(const TSharedPtr<FBlackboa
 	}
 
 #if HTN_DEBUG_PLANNING
-	if (!bIsWaitingForTaskToProducePlanSteps && !DidProduceAnyPlans())
+	if (!bIsTaskLatent && !DidProduceAnyPlans())
 	{
 		SAVE_PLANNING_STEP_FAILURE(Node, NodePlanningFailureReason.IsEmpty() ? TEXT("Failed to produce any plan steps") : NodePlanningFailureReason);
 	}
@@ -438,16 +585,99 @@ void UAITask_MakeHTNPlan::OnTaskFinishedProducingCandidateSteps(UHTNTask* Task)
 		{
 			SubmitCandidatePlan(NewPlan, Task, StepDescription);
 		}
+		else
+		{
+			++Stats.NumPrunedCandidates;
+		}
 	}
 
 	PossibleStepsBuffer.Reset();
 	CurrentTask = nullptr;
 }
 
+FHTNPendingLatentCreatePlanSteps* UAITask_MakeHTNPlan::FindPendingLatentCreatePlanSteps(int32 LatentCreatePlanStepsID)
+{
+	return PendingLatentCreatePlanSteps.FindByPredicate([&](const FHTNPendingLatentCreatePlanSteps& Pending) 
+	{ 
+		return Pending.ID == LatentCreatePlanStepsID; 
+	});
+}
+
+FHTNPendingLatentCreatePlanSteps* UAITask_MakeHTNPlan::FindPendingLatentCreatePlanSteps(const UHTNTask* Task)
+{
+	FHTNPendingLatentCreatePlanSteps* Result = nullptr;
+	for (FHTNPendingLatentCreatePlanSteps& Pending : PendingLatentCreatePlanSteps)
+	{
+		if (Pending.Task == Task && !Pending.bFinished)
+		{
+			if (!ensureMsgf(!Result, TEXT("Task %s has multiple latent CreatePlanSteps in flight. Use the ID returned by WaitForLatentCreatePlanSteps to tell them apart."), *Task->GetNodeName()))
+			{
+				break;
+			}
+			Result = &Pending;
+		}
+	}
+
+	return Result;
+}
+
+void UAITask_MakeHTNPlan::ProcessFinishedLatentCreatePlanSteps()
+{
+	for (int32 Index = 0; Index < PendingLatentCreatePlanSteps.Num();)
+	{
+		if (!PendingLatentCreatePlanSteps[Index].bFinished)
+		{
+			++Index;
+			continue;
+		}
+
+		FHTNPendingLatentCreatePlanSteps Finished = MoveTemp(PendingLatentCreatePlanSteps[Index]);
+		PendingLatentCreatePlanSteps.RemoveAt(Index);
+		RemoveBlockingPriorityMarkersOf(*Finished.Plan);
+
+		// Temporarily restore the state the planner was in when the task started producing plan steps.
+		TGuardValue<TSharedPtr<FHTNPlan>> PlanGuard(CurrentPlanToExpand, Finished.Plan);
+		TGuardValue<FHTNPlanStepID> StepIDGuard(CurrentPlanStepID, Finished.PlanStepID);
+		TGuardValue<TSharedPtr<FBlackboardWorldState>> WorldStateGuard(WorldStateAfterEnteredDecorators, Finished.WorldStateAfterEnteredDecorators);
+		TGuardValue<UHTNTask*> TaskGuard(CurrentTask, Finished.Task);
+		TGuardValue<TArray<TPair<FHTNPlanStep, FString>>> StepsGuard(PossibleStepsBuffer, MoveTemp(Finished.PossibleSteps));
+		
+#if HTN_DEBUG_PLANNING
+		const int32 NumPlansBefore = GetNumCandidatePlans();
+#endif
+		OnTaskFinishedProducingCandidateSteps(Finished.Task);
+#if HTN_DEBUG_PLANNING
+		if (GetNumCandidatePlans() <= NumPlansBefore)
+		{
+			SAVE_PLANNING_STEP_FAILURE(Finished.Task, Finished.FailureReason.IsEmpty() ? TEXT("Failed to produce any plan steps") : Finished.FailureReason);
+		}
+#endif
+	}
+}
+
+bool UAITask_MakeHTNPlan::IsBlockedByLatentCreatePlanSteps() const
+{
+	return Algo::AnyOf(PendingLatentCreatePlanSteps, [](const FHTNPendingLatentCreatePlanSteps& Pending) 
+	{ 
+		return Pending.bBlocksPlanning && !Pending.bFinished; 
+	});
+}
+
+bool UAITask_MakeHTNPlan::CanPendingLatentCreatePlanStepsProducePlanCheaperThan(int32 Cost) const
+{
+	// Costs are never negative, so plans made from a parked plan can't be cheaper than the parked plan itself.
+	return Algo::AnyOf(PendingLatentCreatePlanSteps, [Cost](const FHTNPendingLatentCreatePlanSteps& Pending) 
+	{ 
+		return Pending.Plan->Cost < Cost; 
+	});
+}
+
 bool UAITask_MakeHTNPlan::EnterDecorators(const FHTNPlan& Plan, const FHTNPlanStepID& StepID, const FBlackboardWorldState& WorldState, UHTNStandaloneNode* Node, TSharedPtr<FBlackboardWorldState>& OutNewWorldState) const
 {	
-	OutNewWorldState = WorldState.MakeNext();
 	check(OwnerComponent);
+	HTN_PROFILER_SCOPE(*OwnerComponent, Node, EHTNProfilerPhase::EnterDecorators);
+
+	OutNewWorldState = WorldState.MakeNext();
 	OwnerComponent->SetPlanningWorldState(OutNewWorldState);
 
 	SET_NODE_FAILURE_REASON(TEXT(""));
@@ -500,6 +730,7 @@ bool UAITask_MakeHTNPlan::ExitDecoratorsAndPropagateWorldState(FHTNPlan& Plan, c
 	const TSharedPtr<FBlackboardWorldState> WorldState = Step.WorldState;
 	check(WorldState.IsValid());
 	FGuardWorldStateProxy GuardProxy(*OwnerComponent->GetPlanningWorldStateProxy(), WorldState);
+	HTN_PROFILER_SCOPE(*OwnerComponent, Step.Node.Get(), EHTNProfilerPhase::ExitDecorators);
 	
 	SET_NODE_FAILURE_REASON(TEXT(""));
 
@@ -595,13 +826,17 @@ void UAITask_MakeHTNPlan::SubmitCandidatePlan(const TSharedRef<FHTNPlan>& NewPla
 		return;
 	}
 
+	++Stats.NumCandidatePlans;
+	NewPlan->UpdateMinRemainingCost();
 	AddBlockingPriorityMarkersOf(*NewPlan);
 	if (!IsBlockedByPriorityMarkers(*NewPlan))
 	{
 		Frontier.HeapPush(NewPlan, FCompareHTNPlanCosts());
+		Stats.MaxFrontierSize = FMath::Max(Stats.MaxFrontierSize, Frontier.Num());
 	}
 	else
 	{
+		++Stats.NumBlockedPlans;
 		BlockedPlans.Add(NewPlan);
 	}
 
@@ -615,6 +850,7 @@ void UAITask_MakeHTNPlan::ClearIntermediateState()
 	NextNodesIndex = 0;
 	WorldStateAfterEnteredDecorators = nullptr;
 	CurrentTask = nullptr;
+	CurrentLatentCreatePlanStepsID = INDEX_NONE;
 }
 
 void UAITask_MakeHTNPlan::AddBlockingPriorityMarkersOf(const FHTNPlan& Plan)
@@ -669,6 +905,7 @@ void UAITask_MakeHTNPlan::AddUnblockedPlansToFrontier()
 			Frontier.HeapPush(BlockedPlans[I], FCompareHTNPlanCosts());
 		}
 		BlockedPlans.SetNum(Index);
+		Stats.MaxFrontierSize = FMath::Max(Stats.MaxFrontierSize, Frontier.Num());
 	}
 }
 
@@ -0,0 +1,299 @@
+// Copyright 2020-2021 Maksym Maisak. All Rights Reserved.
+
+#include "Benchmark/HTNBenchmarkHelpers.h"
+
+#if HTN_BENCHMARKS
+
+#include "AIController.h"
+#include "BehaviorTree/BlackboardComponent.h"
+#include "BehaviorTree/BlackboardData.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Int.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Vector.h"
+#include "Engine/World.h"
+#include "GameFramework/Pawn.h"
+#include "Misc/CommandLine.h"
+#include "Misc/DateTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Parse.h"
+#include "Misc/Paths.h"
+
+#include "Benchmark/HTNBenchmarkNodes.h"
+#include "HTNComponent.h"
+
+namespace
+{
+	// Forwards everything to the actual allocator, counting what's allocated on the game thread while enabled.
+	class FHTNCountingMallocProxy : public FMalloc
+	{
+	public:
+		FMalloc* InnerMalloc = nullptr;
+		TAtomic<bool> bIsCounting { false };
+		TAtomic<uint64> NumBytes { 0 };
+		TAtomic<uint64> NumAllocations { 0 };
+
+		FORCEINLINE void CountAllocation(SIZE_T Size)
+		{
+			if (bIsCounting && IsInGameThread())
+			{
+				NumBytes += Size;
+				++NumAllocations;
+			}
+		}
+
+		// Only the growth counts as newly allocated memory, so growing an array by one element doesn't count the whole array again.
+		FORCEINLINE void CountReallocation(void* Ptr, SIZE_T NewSize)
+		{
+			if (bIsCounting && IsInGameThread())
+			{
+				SIZE_T OldSize = 0;
+				if (Ptr && !InnerMalloc->GetAllocationSize(Ptr, OldSize))
+				{
+					// The allocator can't tell, so count the whole new size.
+					OldSize = 0;
+				}
+
+				if (NewSize > OldSize)
+				{
+					NumBytes += NewSize - OldSize;
+					++NumAllocations;
+				}
+			}
+		}
+
+		virtual void* Malloc(SIZE_T Size, uint32 Alignment) override
+		{
+			CountAllocation(Size);
+			return InnerMalloc->Malloc(Size, Alignment);
+		}
+
+		virtual void* TryMalloc(SIZE_T Size, uint32 Alignment) override
+		{
+			CountAllocation(Size);
+			return InnerMalloc->TryMalloc(Size, Alignment);
+		}
+
+		virtual void* Realloc(void* Ptr, SIZE_T NewSize, uint32 Alignment) override
+		{
+			CountReallocation(Ptr, NewSize);
+			return InnerMalloc->Realloc(Ptr, NewSize, Alignment);
+		}
+
+		virtual void* TryRealloc(void* Ptr, SIZE_T NewSize, uint32 Alignment) override
+		{
+			CountReallocation(Ptr, NewSize);
+			return InnerMalloc->TryRealloc(Ptr, NewSize, Alignment);
+		}
+
+		virtual void Free(void* Ptr) override { InnerMalloc->Free(Ptr); }
+		virtual SIZE_T QuickSize(SIZE_T Count, uint32 Alignment) override { return InnerMalloc->QuickSize(Count, Alignment); }
+		virtual bool GetAllocationSize(void* Original, SIZE_T& SizeOut) override { return InnerMalloc->GetAllocationSize(Original, SizeOut); }
+		virtual void Trim(bool bTrimThreadCaches) override { InnerMalloc->Trim(bTrimThreadCaches); }
+		virtual void SetupTLSCachesOnCurrentThread() override { InnerMalloc->SetupTLSCachesOnCurrentThread(); }
+		virtual void ClearAndDisableTLSCachesOnCurrentThread() override { InnerMalloc->ClearAndDisableTLSCachesOnCurrentThread(); }
+		virtual void InitializeStatsMetadata() override { InnerMalloc->InitializeStatsMetadata(); }
+		virtual void UpdateStats() override { InnerMalloc->UpdateStats(); }
+		virtual void GetAllocatorStats(FGenericMemoryStats& OutStats) override { InnerMalloc->GetAllocatorStats(OutStats); }
+		virtual void DumpAllocatorStats(FOutputDevice& Ar) override { InnerMalloc->DumpAllocatorStats(Ar); }
+		virtual bool IsInternallyThreadSafe() const override { return InnerMalloc->IsInternallyThreadSafe(); }
+		virtual bool ValidateHeap() override { return InnerMalloc->ValidateHeap(); }
+		virtual const TCHAR* GetDescriptiveName() override { return InnerMalloc->GetDescriptiveName(); }
+	};
+
+	// Only installed at startup with -htnbench and never uninstalled or destroyed, so GMalloc only changes once and never at runtime.
+	// Blocks allocated before it was installed are freed through it too, which is fine since Free is forwarded as is.
+	FHTNCountingMallocProxy* GHTNCountingMallocProxy = nullptr;
+}
+
+FHTNBenchmarkAssetBuilder::FHTNBenchmarkAssetBuilder(UObject* InOuter) :
+	Outer(InOuter ? InOuter : GetTransientPackage())
+{}
+
+UBlackboardData* FHTNBenchmarkAssetBuilder::MakeBlackboard(int32 NumIntKeys) const
+{
+	UBlackboardData* const Blackboard = NewObject<UBlackboardData>(Outer);
+	Blackboard->UpdatePersistentKey<UBlackboardKeyType_Vector>(FBlackboard::KeySelfLocation);
+	for (int32 I = 0; I < NumIntKeys; ++I)
+	{
+		FBlackboardEntry& Entry = Blackboard->Keys.AddDefaulted_GetRef();
+		Entry.EntryName = GetIntKeyName(I);
+		Entry.KeyType = NewObject<UBlackboardKeyType_Int>(Blackboard);
+	}
+	Blackboard->UpdateKeyIDs();
+
+	return Blackboard;
+}
+
+UHTN* FHTNBenchmarkAssetBuilder::MakeHTN(UBlackboardData* Blackboard) const
+{
+	UHTN* const HTN = NewObject<UHTN>(Outer);
+	HTN->BlackboardAsset = Blackboard;
+	return HTN;
+}
+
+UHTNTask_BenchmarkSetInt* FHTNBenchmarkAssetBuilder::MakeSetInt(UHTN& HTN, int32 KeyIndex, int32 Value, int32 Cost) const
+{
+	UHTNTask_BenchmarkSetInt* const Task = MakeNode<UHTNTask_BenchmarkSetInt>(HTN);
+	Task->KeyName = GetIntKeyName(KeyIndex);
+	Task->Value = Value;
+	Task->Cost = Cost;
+	return Task;
+}
+
+UHTNTask_BenchmarkMoveTo* FHTNBenchmarkAssetBuilder::MakeMoveTo(UHTN& HTN, const TArray<FVector>& Destinations) const
+{
+	UHTNTask_BenchmarkMoveTo* const Task = MakeNode<UHTNTask_BenchmarkMoveTo>(HTN);
+	Task->Destinations = Destinations;
+	return Task;
+}
+
+UHTNStandaloneNode* FHTNBenchmarkAssetBuilder::Chain(const TArray<UHTNStandaloneNode*>& Nodes)
+{
+	for (int32 I = 0; I + 1 < Nodes.Num(); ++I)
+	{
+		Nodes[I]->NextNodes.Add(Nodes[I + 1]);
+	}
+
+	return Nodes.Num() ? Nodes[0] : nullptr;
+}
+
+FName FHTNBenchmarkAssetBuilder::GetIntKeyName(int32 Index)
+{
+	return FName(TEXT("Int"), Index + 1);
+}
+
+FHTNBenchmarkAllocationCounter::FHTNBenchmarkAllocationCounter()
+{
+	check(IsInGameThread());
+	if (GHTNCountingMallocProxy)
+	{
+		checkf(!GHTNCountingMallocProxy->bIsCounting, TEXT("Only one FHTNBenchmarkAllocationCounter can be alive at a time"));
+
+		Reset();
+		GHTNCountingMallocProxy->bIsCounting = true;
+	}
+}
+
+FHTNBenchmarkAllocationCounter::~FHTNBenchmarkAllocationCounter()
+{
+	if (GHTNCountingMallocProxy)
+	{
+		GHTNCountingMallocProxy->bIsCounting = false;
+	}
+}
+
+bool FHTNBenchmarkAllocationCounter::IsAvailable()
+{
+	return GHTNCountingMallocProxy != nullptr;
+}
+
+void FHTNBenchmarkAllocationCounter::Reset()
+{
+	if (GHTNCountingMallocProxy)
+	{
+		GHTNCountingMallocProxy->NumBytes = 0;
+		GHTNCountingMallocProxy->NumAllocations = 0;
+	}
+}
+
+uint64 FHTNBenchmarkAllocationCounter::GetNumBytes() const
+{
+	return GHTNCountingMallocProxy ? GHTNCountingMallocProxy->NumBytes.Load() : 0;
+}
+
+uint64 FHTNBenchmarkAllocationCounter::GetNumAllocations() const
+{
+	return GHTNCountingMallocProxy ? GHTNCountingMallocProxy->NumAllocations.Load() : 0;
+}
+
+void HTNBenchmark::InstallAllocationCountingIfRequested()
+{
+	check(IsInGameThread());
+	if (!GHTNCountingMallocProxy && FParse::Param(FCommandLine::Get(), TEXT("htnbench")))
+	{
+		GHTNCountingMallocProxy = new FHTNCountingMallocProxy();
+		GHTNCountingMallocProxy->InnerMalloc = GMalloc;
+		FPlatformMisc::MemoryBarrier();
+		GMalloc = GHTNCountingMallocProxy;
+		UE_LOG(LogHTN, Display, TEXT("HTN benchmarks: counting game thread allocations through a GMalloc proxy (-htnbench)."));
+	}
+}
+
+FHTNBenchmarkAgent HTNBenchmark::SpawnAgent(UWorld& World, const FVector& Location, UBlackboardData* Blackboard)
+{
+	FActorSpawnParameters SpawnParameters;
+	SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	SpawnParameters.ObjectFlags |= RF_Transient;
+
+	APawn* const Pawn = World.SpawnActor<APawn>(Location, FRotator::ZeroRotator, SpawnParameters);
+	AAIController* const Controller = World.SpawnActor<AAIController>(Location, FRotator::ZeroRotator, SpawnParameters);
+	if (!Pawn || !Controller)
+	{
+		if (Pawn)
+		{
+			Pawn->Destroy();
+		}
+		if (Controller)
+		{
+			Controller->Destroy();
+		}
+		return {};
+	}
+
+	// Same setup as UHTNBlueprintLibrary::RunHTN.
+	UHTNComponent* const HTNComponent = NewObject<UHTNComponent>(Controller, TEXT("HTNComponent"));
+	HTNComponent->RegisterComponent();
+	Controller->BrainComponent = HTNComponent;
+	Controller->Possess(Pawn);
+
+	UBlackboardComponent* BlackboardComponent = nullptr;
+	if (!Controller->UseBlackboard(Blackboard, BlackboardComponent))
+	{
+		DestroyAgent({ Controller, HTNComponent });
+		return {};
+	}
+	BlackboardComponent->SetValueAsVector(FBlackboard::KeySelfLocation, Location);
+
+	return { Controller, HTNComponent };
+}
+
+void HTNBenchmark::DestroyAgent(const FHTNBenchmarkAgent& Agent)
+{
+	if (IsValid(Agent.Controller))
+	{
+		if (APawn* const Pawn = Agent.Controller->GetPawn())
+		{
+			Pawn->Destroy();
+		}
+		Agent.Controller->Destroy();
+	}
+}
+
+double HTNBenchmark::GetPercentile(TArray<double>& Values, double Percentile)
+{
+	if (!Values.Num())
+	{
+		return 0.0;
+	}
+
+	Values.Sort();
+	const int32 Index = FMath::Clamp(FMath::CeilToInt(Percentile * Values.Num()) - 1, 0, Values.Num() - 1);
+	return Values[Index];
+}
+
+FString HTNBenchmark::WriteCSV(const FString& BaseFileName, const FString& Header, const TArray<FString>& Rows)
+{
+	const FString FilePath = FPaths::ProfilingDir() / TEXT("HTN") / FString::Printf(TEXT("%s_%s.csv"), *BaseFileName, *FDateTime::Now().ToString());
+
+	TArray<FString> Lines;
+	Lines.Reserve(Rows.Num() + 1);
+	Lines.Add(Header);
+	Lines.Append(Rows);
+	if (!FFileHelper::SaveStringArrayToFile(Lines, *FilePath))
+	{
+		return FString();
+	}
+
+	return FPaths::ConvertRelativePathToFull(FilePath);
+}
+
+#endif
@@ -0,0 +1,94 @@
+// Copyright 2020-2021 Maksym Maisak. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HTNTypes.h"
+
+#if HTN_BENCHMARKS
+
+#include "HTN.h"
+#include "HTNStandaloneNode.h"
+
+class AAIController;
+class UBlackboardData;
+class UHTNComponent;
+class UHTNTask_BenchmarkMoveTo;
+class UHTNTask_BenchmarkSetInt;
+
+// Builds HTN and blackboard assets in code for the benchmarks, so they don't depend on any content.
+class FHTNBenchmarkAssetBuilder
+{
+public:
+	explicit FHTNBenchmarkAssetBuilder(UObject* InOuter);
+
+	// Makes a blackboard with SelfLocation and the given number of int keys (named by GetIntKeyName).
+	UBlackboardData* MakeBlackboard(int32 NumIntKeys) const;
+	UHTN* MakeHTN(UBlackboardData* Blackboard) const;
+
+	template<typename NodeType>
+	NodeType* MakeNode(UHTN& HTN) const;
+
+	UHTNTask_BenchmarkSetInt* MakeSetInt(UHTN& HTN, int32 KeyIndex, int32 Value, int32 Cost) const;
+	UHTNTask_BenchmarkMoveTo* MakeMoveTo(UHTN& HTN, const TArray<FVector>& Destinations) const;
+
+	// Makes the given nodes follow each other, returns the first one.
+	static UHTNStandaloneNode* Chain(const TArray<UHTNStandaloneNode*>& Nodes);
+
+	static FName GetIntKeyName(int32 Index);
+
+private:
+	UObject* Outer;
+};
+
+// While alive, counts the memory allocated on the game thread through a forwarding proxy of GMalloc.
+// The proxy is only installed at startup when running with -htnbench (see HTNBenchmark::InstallAllocationCountingIfRequested),
+// so sessions that aren't run for benchmarking never pay for it. Without it, nothing is counted.
+// Reallocations count only by how much they grow. Only one can be alive at a time. 
+class FHTNBenchmarkAllocationCounter : public FNoncopyable
+{
+public:
+	FHTNBenchmarkAllocationCounter();
+	~FHTNBenchmarkAllocationCounter();
+
+	// Returns false if the proxy isn't installed, so counters count nothing.
+	static bool IsAvailable();
+
+	void Reset();
+	uint64 GetNumBytes() const;
+	uint64 GetNumAllocations() const;
+};
+
+// An agent used by the benchmarks: a pawn possessed by an AI controller that has an HTN component and a blackboard.
+struct FHTNBenchmarkAgent
+{
+	AAIController* Controller = nullptr;
+	UHTNComponent* HTNComponent = nullptr;
+
+	bool IsValid() const { return Controller && HTNComponent; }
+};
+
+namespace HTNBenchmark
+{
+	// Installs the GMalloc proxy that FHTNBenchmarkAllocationCounter counts through if the -htnbench switch is on the command line. 
+	// Called once when the HTN module starts up, before any benchmark or gameplay runs.
+	void InstallAllocationCountingIfRequested();
+
+	FHTNBenchmarkAgent SpawnAgent(UWorld& World, const FVector& Location, UBlackboardData* Blackboard);
+	void DestroyAgent(const FHTNBenchmarkAgent& Agent);
+
+	// Returns the requested percentile (0-1) of the given values, sorting them in place.
+	double GetPercentile(TArray<double>& Values, double Percentile);
+
+	// Writes the rows under the Profiling/HTN directory, returns the full path or an empty string on failure.
+	FString WriteCSV(const FString& BaseFileName, const FString& Header, const TArray<FString>& Rows);
+}
+
+template<typename NodeType>
+NodeType* FHTNBenchmarkAssetBuilder::MakeNode(UHTN& HTN) const
+{
+	// Nodes are outered to the asset they're in, same as in assets made in the editor.
+	return NewObject<NodeType>(&HTN);
+}
+
+#endif
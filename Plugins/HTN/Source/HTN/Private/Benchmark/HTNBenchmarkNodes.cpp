@@ -0,0 +1,104 @@
+// Copyright 2020-2021 Maksym Maisak. All Rights Reserved.
+
+#include "Benchmark/HTNBenchmarkNodes.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Int.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Vector.h"
+#include "BehaviorTree/BlackboardComponent.h"
+#include "WorldStateProxy.h"
+
+UHTNTask_BenchmarkSetInt::UHTNTask_BenchmarkSetInt(const FObjectInitializer& Initializer) : Super(Initializer),
+	Value(0),
+	Cost(1),
+	bIncrement(false)
+{
+	bShowTaskNameOnCurrentPlanVisualization = false;
+}
+
+void UHTNTask_BenchmarkSetInt::CreatePlanSteps(UHTNComponent& OwnerComp, UAITask_MakeHTNPlan& PlanningTask, const TSharedRef<const FBlackboardWorldState>& WorldState) const
+{
+	const int32 NewValue = bIncrement ? WorldState->GetValue<UBlackboardKeyType_Int>(KeyName) + 1 : Value;
+
+	const TSharedRef<FBlackboardWorldState> NewWorldState = WorldState->MakeNext();
+	NewWorldState->SetValue<UBlackboardKeyType_Int>(KeyName, NewValue);
+	PlanningTask.SubmitPlanStep(this, NewWorldState, Cost);
+}
+
+bool UHTNTask_BenchmarkSetInt::GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const
+{
+	OutKeyNames.Add(KeyName);
+	return true;
+}
+
+void UHTNTask_BenchmarkSetInt::GetImplicitlyReadBlackboardKeys(TArray<FName>& OutKeyNames) const
+{
+	if (bIncrement)
+	{
+		OutKeyNames.Add(KeyName);
+	}
+}
+
+UHTNTask_BenchmarkMoveTo::UHTNTask_BenchmarkMoveTo(const FObjectInitializer& Initializer) : Super(Initializer),
+	CostPerUnitDistance(0.01f)
+{}
+
+void UHTNTask_BenchmarkMoveTo::CreatePlanSteps(UHTNComponent& OwnerComp, UAITask_MakeHTNPlan& PlanningTask, const TSharedRef<const FBlackboardWorldState>& WorldState) const
+{
+	const FVector StartLocation = WorldState->GetValue<UBlackboardKeyType_Vector>(FBlackboard::KeySelfLocation);
+	for (const FVector& Destination : Destinations)
+	{
+		const int32 Cost = 1 + FMath::CeilToInt(FVector::Dist(StartLocation, Destination) * CostPerUnitDistance);
+
+		const TSharedRef<FBlackboardWorldState> NewWorldState = WorldState->MakeNext();
+		NewWorldState->SetValue<UBlackboardKeyType_Vector>(FBlackboard::KeySelfLocation, Destination);
+		PlanningTask.SubmitPlanStep(this, NewWorldState, Cost);
+	}
+}
+
+bool UHTNTask_BenchmarkMoveTo::GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const
+{
+	OutKeyNames.Add(FBlackboard::KeySelfLocation);
+	return true;
+}
+
+void UHTNTask_BenchmarkMoveTo::GetImplicitlyReadBlackboardKeys(TArray<FName>& OutKeyNames) const
+{
+	OutKeyNames.Add(FBlackboard::KeySelfLocation);
+}
+
+UHTNDecorator_BenchmarkIntCheck::UHTNDecorator_BenchmarkIntCheck(const FObjectInitializer& Initializer) : Super(Initializer),
+	Period(8),
+	NumPassingValues(6)
+{
+	bCheckConditionOnPlanEnter = true;
+	bCheckConditionOnPlanRecheck = true;
+	bCheckConditionOnTick = true;
+}
+
+void UHTNDecorator_BenchmarkIntCheck::GetImplicitlyReadBlackboardKeys(TArray<FName>& OutKeyNames) const
+{
+	OutKeyNames.Add(KeyName);
+}
+
+bool UHTNDecorator_BenchmarkIntCheck::CalculateRawConditionValue(UHTNComponent& OwnerComp, uint8* NodeMemory, EHTNDecoratorConditionCheckType CheckType) const
+{
+	if (const UWorldStateProxy* const WorldStateProxy = GetWorldStateProxy(OwnerComp, CheckType))
+	{
+		const int32 Value = WorldStateProxy->GetValue<UBlackboardKeyType_Int>(KeyName);
+		return Period <= 0 || FMath::Abs(Value % Period) < NumPassingValues;
+	}
+
+	return false;
+}
+
+UHTNService_BenchmarkIncrement::UHTNService_BenchmarkIncrement(const FObjectInitializer& Initializer) : Super(Initializer)
+{
+	bNotifyTick = true;
+}
+
+void UHTNService_BenchmarkIncrement::TickNode(UHTNComponent& OwnerComp, uint8* NodeMemory, float DeltaTime)
+{
+	if (UBlackboardComponent* const BlackboardComponent = OwnerComp.GetBlackboardComponent())
+	{
+		BlackboardComponent->SetValueAsInt(KeyName, BlackboardComponent->GetValueAsInt(KeyName) + 1);
+	}
+}
@@ -0,0 +1,96 @@
+// Copyright 2020-2021 Maksym Maisak. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HTNDecorator.h"
+#include "HTNService.h"
+#include "HTNTask.h"
+#include "HTNBenchmarkNodes.generated.h"
+
+// Used by the HTN benchmarks. Sets an int key to a fixed value (or increments it) at a fixed cost.
+UCLASS(HideDropdown, NotBlueprintable)
+class UHTNTask_BenchmarkSetInt : public UHTNTask
+{
+	GENERATED_BODY()
+
+public:
+	UHTNTask_BenchmarkSetInt(const FObjectInitializer& Initializer);
+	virtual void CreatePlanSteps(UHTNComponent& OwnerComp, UAITask_MakeHTNPlan& PlanningTask, const TSharedRef<const FBlackboardWorldState>& WorldState) const override;
+	virtual bool GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const override;
+	virtual void GetImplicitlyReadBlackboardKeys(TArray<FName>& OutKeyNames) const override;
+
+	UPROPERTY()
+	FName KeyName;
+
+	UPROPERTY()
+	int32 Value;
+
+	UPROPERTY()
+	int32 Cost;
+
+	// If true, adds 1 to the current value of the key instead of setting it to Value.
+	UPROPERTY()
+	uint8 bIncrement : 1;
+};
+
+// Used by the HTN benchmarks as a stand-in for MoveTo that needs neither navigation nor EQS.
+// Offers a plan step for each destination, costed by its distance from SelfLocation. Succeeds instantly during execution.
+UCLASS(HideDropdown, NotBlueprintable)
+class UHTNTask_BenchmarkMoveTo : public UHTNTask
+{
+	GENERATED_BODY()
+
+public:
+	UHTNTask_BenchmarkMoveTo(const FObjectInitializer& Initializer);
+	virtual void CreatePlanSteps(UHTNComponent& OwnerComp, UAITask_MakeHTNPlan& PlanningTask, const TSharedRef<const FBlackboardWorldState>& WorldState) const override;
+	virtual bool GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const override;
+	virtual void GetImplicitlyReadBlackboardKeys(TArray<FName>& OutKeyNames) const override;
+
+	UPROPERTY()
+	TArray<FVector> Destinations;
+
+	UPROPERTY()
+	float CostPerUnitDistance;
+};
+
+// Used by the HTN benchmarks. Passes while (Value of the int key) % Period < NumPassingValues.
+// Checked on plan enter, on plan recheck and on tick, so a key that changes over time makes plans fail rechecks and replan.
+UCLASS(HideDropdown, NotBlueprintable)
+class UHTNDecorator_BenchmarkIntCheck : public UHTNDecorator
+{
+	GENERATED_BODY()
+
+public:
+	UHTNDecorator_BenchmarkIntCheck(const FObjectInitializer& Initializer);
+	virtual bool GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const override { return true; }
+	virtual void GetImplicitlyReadBlackboardKeys(TArray<FName>& OutKeyNames) const override;
+
+	UPROPERTY()
+	FName KeyName;
+
+	UPROPERTY()
+	int32 Period;
+
+	UPROPERTY()
+	int32 NumPassingValues;
+
+protected:
+	virtual bool CalculateRawConditionValue(UHTNComponent& OwnerComp, uint8* NodeMemory, EHTNDecoratorConditionCheckType CheckType) const override;
+};
+
+// Used by the HTN benchmarks. Increments an int key in the blackboard every tick of the service.
+UCLASS(HideDropdown, NotBlueprintable)
+class UHTNService_BenchmarkIncrement : public UHTNService
+{
+	GENERATED_BODY()
+
+public:
+	UHTNService_BenchmarkIncrement(const FObjectInitializer& Initializer);
+
+	UPROPERTY()
+	FName KeyName;
+
+protected:
+	virtual void TickNode(UHTNComponent& OwnerComp, uint8* NodeMemory, float DeltaTime) override;
+};
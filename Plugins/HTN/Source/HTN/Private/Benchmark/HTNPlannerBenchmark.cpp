@@ -0,0 +1,353 @@
+// Copyright 2020-2021 Maksym Maisak. All Rights Reserved.
+
+#include "Benchmark/HTNBenchmarkHelpers.h"
+
+#if HTN_BENCHMARKS
+
+#include "AIController.h"
+#include "Algo/Accumulate.h"
+#include "BehaviorTree/BlackboardData.h"
+#include "HAL/IConsoleManager.h"
+#include "UObject/UObjectGlobals.h"
+
+#include "AITask_MakeHTNPlan.h"
+#include "Benchmark/HTNBenchmarkNodes.h"
+#include "HTNComponent.h"
+#include "Nodes/HTNNode_AnyOrder.h"
+#include "Nodes/HTNNode_AnyOrderN.h"
+#include "Nodes/HTNNode_Prefer.h"
+#include "Nodes/HTNNode_SubNetwork.h"
+#include "Tasks/HTNTask_Fail.h"
+
+// Measures the planner on synthetic HTNs built in code, so it can run on any map, including on a -nullrhi server:
+// UnrealEditor-Cmd <Project> <Map> -game -nullrhi -ExecCmds="ai.htn.benchmark.Planning 500, quit"
+// Results are logged and written as CSV to the Profiling/HTN directory.
+namespace
+{
+	const int32 BlackboardSizes[] = { 8, 32, 128 };
+
+	struct FPlannerBenchmarkScenario
+	{
+		const TCHAR* Name;
+		TFunction<UHTN*(const FHTNBenchmarkAssetBuilder& /*Builder*/, UBlackboardData& /*Blackboard*/, int32 /*NumIntKeys*/)> MakeHTN;
+	};
+
+	struct FPlannerBenchmarkResult
+	{
+		int32 NumIterations = 0;
+		int32 NumFailedPlans = 0;
+		int32 PlanCost = 0;
+		int64 NumExpandedPlans = 0;
+		int64 NumWorldStateCopies = 0;
+		int64 NumPlanCopies = 0;
+		int32 MaxFrontierSize = 0;
+		uint64 NumBytes = 0;
+		uint64 NumAllocations = 0;
+		TArray<double> LatenciesSeconds;
+	};
+
+	FVector GetPointOnCircle(int32 Index, int32 NumPoints, float Radius)
+	{
+		const float Angle = 2.0f * PI * Index / NumPoints;
+		return FVector(FMath::Cos(Angle) * Radius, FMath::Sin(Angle) * Radius, 0.0f);
+	}
+
+	// A long chain of primitive tasks. Measures the per-step overhead of the planner.
+	UHTN* MakeDeepSequence(const FHTNBenchmarkAssetBuilder& Builder, UBlackboardData& Blackboard, int32 NumIntKeys)
+	{
+		UHTN* const HTN = Builder.MakeHTN(&Blackboard);
+
+		TArray<UHTNStandaloneNode*> Tasks;
+		for (int32 I = 0; I < 48; ++I)
+		{
+			Tasks.Add(Builder.MakeSetInt(*HTN, I % NumIntKeys, I, 1));
+		}
+		HTN->StartNodes.Add(FHTNBenchmarkAssetBuilder::Chain(Tasks));
+
+		return HTN;
+	}
+
+	// Nested Prefer nodes with several nodes in each branch, where most leaves fail.
+	// Makes the planner go through the blocked lower-priority plans.
+	UHTN* MakeWidePrefer(const FHTNBenchmarkAssetBuilder& Builder, UBlackboardData& Blackboard, int32 NumIntKeys)
+	{
+		struct Local
+		{
+			static UHTNStandaloneNode* MakeTree(const FHTNBenchmarkAssetBuilder& Builder, UHTN& HTN, int32 NumIntKeys, int32 Depth, int32& NextLeafIndex)
+			{
+				if (Depth == 0)
+				{
+					const int32 LeafIndex = NextLeafIndex++;
+					if (LeafIndex % 4 != 3)
+					{
+						return Builder.MakeNode<UHTNTask_Fail>(HTN);
+					}
+
+					return Builder.MakeSetInt(HTN, LeafIndex % NumIntKeys, LeafIndex, 1 + LeafIndex % 5);
+				}
+
+				const int32 BranchWidth = 3;
+				UHTNNode_Prefer* const Prefer = Builder.MakeNode<UHTNNode_Prefer>(HTN);
+				for (int32 I = 0; I < BranchWidth * 2; ++I)
+				{
+					Prefer->NextNodes.Add(MakeTree(Builder, HTN, NumIntKeys, Depth - 1, NextLeafIndex));
+				}
+				Prefer->NumPrimaryNodes = BranchWidth;
+
+				return Prefer;
+			}
+		};
+
+		UHTN* const HTN = Builder.MakeHTN(&Blackboard);
+		int32 NextLeafIndex = 0;
+		HTN->StartNodes.Add(Local::MakeTree(Builder, *HTN, NumIntKeys, 3, NextLeafIndex));
+		return HTN;
+	}
+
+	TArray<UHTNStandaloneNode*> MakeMoveToPerPointOnCircle(const FHTNBenchmarkAssetBuilder& Builder, UHTN& HTN, int32 NumPoints)
+	{
+		TArray<UHTNStandaloneNode*> MoveTos;
+		for (int32 I = 0; I < NumPoints; ++I)
+		{
+			// Scramble the points so that the cheapest order isn't the order of the branches.
+			MoveTos.Add(Builder.MakeMoveTo(HTN, { GetPointOnCircle(I * 7 % (NumPoints * 2), NumPoints * 2, 1000.0f) }));
+		}
+
+		return MoveTos;
+	}
+
+	// Binary AnyOrder nodes nested in each other's secondary branches, with a MoveTo in each primary branch.
+	UHTN* MakeNestedAnyOrder(const FHTNBenchmarkAssetBuilder& Builder, UBlackboardData& Blackboard, int32 NumIntKeys)
+	{
+		UHTN* const HTN = Builder.MakeHTN(&Blackboard);
+
+		const TArray<UHTNStandaloneNode*> MoveTos = MakeMoveToPerPointOnCircle(Builder, *HTN, 6);
+		UHTNStandaloneNode* Node = MoveTos.Last();
+		for (int32 I = MoveTos.Num() - 2; I >= 0; --I)
+		{
+			UHTNNode_AnyOrder* const AnyOrder = Builder.MakeNode<UHTNNode_AnyOrder>(*HTN);
+			AnyOrder->NextNodes = { MoveTos[I], Node };
+			AnyOrder->NumPrimaryNodes = 1;
+			Node = AnyOrder;
+		}
+		HTN->StartNodes.Add(Node);
+
+		return HTN;
+	}
+
+	// The same MoveTos as in MakeNestedAnyOrder, but as branches of a single N-ary AnyOrder.
+	UHTN* MakeAnyOrderN(const FHTNBenchmarkAssetBuilder& Builder, UBlackboardData& Blackboard, int32 NumIntKeys)
+	{
+		UHTN* const HTN = Builder.MakeHTN(&Blackboard);
+
+		UHTNNode_AnyOrderN* const AnyOrder = Builder.MakeNode<UHTNNode_AnyOrderN>(*HTN);
+		AnyOrder->NextNodes = MakeMoveToPerPointOnCircle(Builder, *HTN, 6);
+		HTN->StartNodes.Add(AnyOrder);
+
+		return HTN;
+	}
+
+	// An HTN that can either finish or increment a key and recurse into itself, up to the recursion limit.
+	// Finishing is expensive enough that the planner explores every depth of recursion.
+	UHTN* MakeRecursiveSubNetwork(const FHTNBenchmarkAssetBuilder& Builder, UBlackboardData& Blackboard, int32 NumIntKeys)
+	{
+		const int32 RecursionLimit = 12;
+
+		UHTN* const HTN = Builder.MakeHTN(&Blackboard);
+
+		UHTNTask_BenchmarkSetInt* const Increment = Builder.MakeSetInt(*HTN, 0, 0, 1);
+		Increment->bIncrement = true;
+		UHTNNode_SubNetwork* const SubNetwork = Builder.MakeNode<UHTNNode_SubNetwork>(*HTN);
+		SubNetwork->HTN = HTN;
+		SubNetwork->MaxRecursionLimit = RecursionLimit;
+		HTN->StartNodes.Add(FHTNBenchmarkAssetBuilder::Chain({ Increment, SubNetwork }));
+
+		HTN->StartNodes.Add(Builder.MakeSetInt(*HTN, 1 % NumIntKeys, 1, RecursionLimit * 2));
+
+		return HTN;
+	}
+
+	// A sequence of MoveTos that each offer several destinations, so the planner searches for the shortest path through them.
+	UHTN* MakeMoveToChain(const FHTNBenchmarkAssetBuilder& Builder, UBlackboardData& Blackboard, int32 NumIntKeys)
+	{
+		UHTN* const HTN = Builder.MakeHTN(&Blackboard);
+
+		TArray<UHTNStandaloneNode*> MoveTos;
+		for (int32 I = 0; I < 4; ++I)
+		{
+			TArray<FVector> Destinations;
+			for (int32 J = 0; J < 6; ++J)
+			{
+				Destinations.Add(GetPointOnCircle(J * 5 + I, 30, 500.0f * (I + 1)));
+			}
+			MoveTos.Add(Builder.MakeMoveTo(*HTN, Destinations));
+		}
+		HTN->StartNodes.Add(FHTNBenchmarkAssetBuilder::Chain(MoveTos));
+
+		return HTN;
+	}
+
+	FPlannerBenchmarkResult RunPlannerBenchmark(const FHTNBenchmarkAgent& Agent, UHTN& HTN, int32 NumIterations, FHTNBenchmarkAllocationCounter& AllocationCounter)
+	{
+		const int32 NumWarmupIterations = FMath::Min(10, NumIterations);
+
+		FPlannerBenchmarkResult Result;
+		Result.LatenciesSeconds.Reserve(NumIterations);
+		for (int32 I = 0; I < NumWarmupIterations + NumIterations; ++I)
+		{
+			AllocationCounter.Reset();
+			const uint64 StartCycles = FPlatformTime::Cycles64();
+
+			UAITask_MakeHTNPlan* const PlanningTask = UAITask::NewAITask<UAITask_MakeHTNPlan>(*Agent.Controller, *Agent.HTNComponent, TEXT("HTN Planner Benchmark"));
+			PlanningTask->SetUp(Agent.HTNComponent, &HTN);
+			PlanningTask->ReadyForActivation();
+
+			const uint64 EndCycles = FPlatformTime::Cycles64();
+			const uint64 NumBytes = AllocationCounter.GetNumBytes();
+			const uint64 NumAllocations = AllocationCounter.GetNumAllocations();
+
+			// None of the benchmark tasks are latent, so planning should be done by now.
+			if (!ensure(PlanningTask->IsFinished()))
+			{
+				PlanningTask->ExternalCancel();
+			}
+
+			if (I < NumWarmupIterations)
+			{
+				continue;
+			}
+
+			++Result.NumIterations;
+			Result.LatenciesSeconds.Add(FPlatformTime::ToSeconds64(EndCycles - StartCycles));
+			const FHTNPlanningStats& Stats = PlanningTask->GetPlanningStats();
+			Result.NumExpandedPlans += Stats.NumExpandedPlans;
+			Result.NumWorldStateCopies += Stats.NumWorldStateCopies;
+			Result.NumPlanCopies += Stats.NumPlanCopies;
+			Result.MaxFrontierSize = FMath::Max(Result.MaxFrontierSize, Stats.MaxFrontierSize);
+			Result.NumBytes += NumBytes;
+			Result.NumAllocations += NumAllocations;
+			if (PlanningTask->FoundPlan())
+			{
+				Result.PlanCost = PlanningTask->GetFinishedPlan()->Cost;
+			}
+			else
+			{
+				++Result.NumFailedPlans;
+			}
+		}
+
+		return Result;
+	}
+
+	void RunPlannerBenchmarks(UWorld* World, int32 NumIterations, const FString& ScenarioFilter)
+	{
+		if (!World)
+		{
+			UE_LOG(LogHTN, Error, TEXT("HTN planner benchmark: no world to spawn the benchmark agent in."));
+			return;
+		}
+
+		const FPlannerBenchmarkScenario Scenarios[] =
+		{
+			{ TEXT("DeepSequence"), &MakeDeepSequence },
+			{ TEXT("WidePrefer"), &MakeWidePrefer },
+			{ TEXT("NestedAnyOrder"), &MakeNestedAnyOrder },
+			{ TEXT("AnyOrderN"), &MakeAnyOrderN },
+			{ TEXT("RecursiveSubNetwork"), &MakeRecursiveSubNetwork },
+			{ TEXT("MoveToChain"), &MakeMoveToChain }
+		};
+
+		if (!FHTNBenchmarkAllocationCounter::IsAvailable())
+		{
+			UE_LOG(LogHTN, Warning, TEXT("HTN planner benchmark: allocations are only counted when running with -htnbench, BytesPerPlan and AllocationsPerPlan will be 0."));
+		}
+
+		const FHTNBenchmarkAssetBuilder Builder(GetTransientPackage());
+		TArray<FString> Rows;
+		for (const int32 NumIntKeys : BlackboardSizes)
+		{
+			UBlackboardData* const Blackboard = Builder.MakeBlackboard(NumIntKeys);
+			const FHTNBenchmarkAgent Agent = HTNBenchmark::SpawnAgent(*World, FVector::ZeroVector, Blackboard);
+			if (!Agent.IsValid())
+			{
+				UE_LOG(LogHTN, Error, TEXT("HTN planner benchmark: failed to spawn the benchmark agent."));
+				return;
+			}
+
+			for (const FPlannerBenchmarkScenario& Scenario : Scenarios)
+			{
+				if (!ScenarioFilter.IsEmpty() && !FString(Scenario.Name).Contains(ScenarioFilter))
+				{
+					continue;
+				}
+
+				UHTN* const HTN = Scenario.MakeHTN(Builder, *Blackboard, NumIntKeys);
+
+				FPlannerBenchmarkResult Result;
+				{
+					FHTNBenchmarkAllocationCounter AllocationCounter;
+					Result = RunPlannerBenchmark(Agent, *HTN, NumIterations, AllocationCounter);
+				}
+
+				const double TotalSeconds = FMath::Max(Algo::Accumulate(Result.LatenciesSeconds, 0.0), SMALL_NUMBER);
+				const double MeanLatencyMicroseconds = TotalSeconds * 1000000.0 / FMath::Max(Result.NumIterations, 1);
+				const double P50LatencyMicroseconds = HTNBenchmark::GetPercentile(Result.LatenciesSeconds, 0.5) * 1000000.0;
+				const double P99LatencyMicroseconds = HTNBenchmark::GetPercentile(Result.LatenciesSeconds, 0.99) * 1000000.0;
+				const int32 NumIterationsDivisor = FMath::Max(Result.NumIterations, 1);
+
+				const FString Row = FString::Printf(TEXT("%s,%i,%i,%i,%i,%.1f,%.1f,%.1f,%i,%.1f,%.1f,%llu,%llu,%.2f,%.2f,%.2f"),
+					Scenario.Name,
+					NumIntKeys,
+					Result.NumIterations,
+					Result.NumFailedPlans,
+					Result.PlanCost,
+					Result.NumIterations / TotalSeconds,
+					(double)Result.NumExpandedPlans / NumIterationsDivisor,
+					Result.NumExpandedPlans / TotalSeconds,
+					Result.MaxFrontierSize,
+					(double)Result.NumWorldStateCopies / NumIterationsDivisor,
+					(double)Result.NumPlanCopies / NumIterationsDivisor,
+					Result.NumBytes / NumIterationsDivisor,
+					Result.NumAllocations / NumIterationsDivisor,
+					MeanLatencyMicroseconds,
+					P50LatencyMicroseconds,
+					P99LatencyMicroseconds
+				);
+				UE_LOG(LogHTN, Display, TEXT("HTN planner benchmark: %s"), *Row);
+				Rows.Add(Row);
+			}
+
+			HTNBenchmark::DestroyAgent(Agent);
+		}
+
+		CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+
+		const FString FilePath = HTNBenchmark::WriteCSV(TEXT("HTNPlannerBenchmark"),
+			TEXT("Scenario,BlackboardKeys,Iterations,FailedPlans,PlanCost,PlansPerSecond,ExpansionsPerPlan,ExpansionsPerSecond,")
+			TEXT("MaxFrontierSize,WorldStateCopiesPerPlan,PlanCopiesPerPlan,BytesPerPlan,AllocationsPerPlan,MeanLatencyUs,P50LatencyUs,P99LatencyUs"),
+			Rows
+		);
+		if (FilePath.IsEmpty())
+		{
+			UE_LOG(LogHTN, Error, TEXT("HTN planner benchmark: failed to write results."));
+		}
+		else
+		{
+			UE_LOG(LogHTN, Display, TEXT("HTN planner benchmark: results written to %s"), *FilePath);
+		}
+	}
+
+	FAutoConsoleCommandWithWorldAndArgs CmdHTNBenchmarkPlanning(
+		TEXT("ai.htn.benchmark.Planning"),
+		TEXT("Runs the HTN planner on synthetic HTNs (deep sequences, wide Prefer trees, nested AnyOrders, recursive SubNetworks, MoveTo chains) ")
+		TEXT("with blackboards of 8, 32 and 128 keys, then logs and writes the results as CSV to the Profiling/HTN directory. ")
+		TEXT("Optionally takes the number of iterations per scenario (default 200) and a substring of the names of the scenarios to run."),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+		{
+			const int32 NumIterations = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 200;
+			RunPlannerBenchmarks(World, NumIterations, Args.Num() > 1 ? Args[1] : FString());
+		})
+	);
+}
+
+#endif
@@ -0,0 +1,169 @@
+// Copyright 2020-2021 Maksym Maisak. All Rights Reserved.
+
+#include "Benchmark/HTNPlanningRecording.h"
+
+#if HTN_BENCHMARKS
+
+#include "BehaviorTree/BlackboardData.h"
+#include "Containers/Ticker.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/DateTime.h"
+#include "Misc/Paths.h"
+
+#include "BlackboardWorldstate.h"
+#include "HTN.h"
+#include "HTNComponent.h"
+#include "HTNDelegates.h"
+#include "HTNPlan.h"
+#include "HTNPlanSerializer.h"
+#include "HTNPlanningStats.h"
+
+// Records the starting worldstate and HTN of every planning run to a file, so real planning problems from a session
+// can be replayed offline with UHTNReplayCommandlet. Start on a server with -ExecCmds="ai.htn.recorder.Start".
+namespace
+{
+	int32 GHTNRecorderMaxRecords = 100000;
+	FAutoConsoleVariableRef CVarHTNRecorderMaxRecords(
+		TEXT("ai.htn.recorder.MaxRecords"),
+		GHTNRecorderMaxRecords,
+		TEXT("The HTN planning recorder stops after recording this many planning runs."),
+		ECVF_Default
+	);
+
+	float GHTNRecorderFlushInterval = 5.0f;
+	FAutoConsoleVariableRef CVarHTNRecorderFlushInterval(
+		TEXT("ai.htn.recorder.FlushInterval"),
+		GHTNRecorderFlushInterval,
+		TEXT("How often (in seconds) the HTN planning recorder flushes the recorded planning runs to its file. Takes effect on the next ai.htn.recorder.Start."),
+		ECVF_Default
+	);
+
+	class FHTNPlanningRecorder
+	{
+	public:
+		static FHTNPlanningRecorder& Get()
+		{
+			static FHTNPlanningRecorder Instance;
+			return Instance;
+		}
+
+		void Start(const FString& InFilePath)
+		{
+			Stop();
+
+			FilePath = InFilePath.IsEmpty() ?
+				HTNPlanningRecording::GetDirectory() / FString::Printf(TEXT("HTNPlanning_%s%s"), *FDateTime::Now().ToString(), HTNPlanningRecording::FileExtension) :
+				InFilePath;
+			Writer.Reset(IFileManager::Get().CreateFileWriter(*FilePath, FILEWRITE_AllowRead));
+			if (!Writer.IsValid())
+			{
+				UE_LOG(LogHTN, Error, TEXT("HTN planning recorder: failed to open %s"), *FilePath);
+				return;
+			}
+
+			HTNPlanningRecording::WriteHeader(*Writer);
+			NumRecords = 0;
+			PlanningStartedHandle = FHTNDelegates::OnPlanningStarted.AddRaw(this, &FHTNPlanningRecorder::OnPlanningStarted);
+			PlanningFinishedHandle = FHTNDelegates::OnPlanningFinished.AddRaw(this, &FHTNPlanningRecorder::OnPlanningFinished);
+
+			// Flushing after every record would block the game thread on file writes, so records are only flushed periodically and on Stop.
+			FlushTickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &FHTNPlanningRecorder::OnFlushTick), FMath::Max(GHTNRecorderFlushInterval, 0.0f));
+			UE_LOG(LogHTN, Display, TEXT("HTN planning recorder: recording to %s"), *FPaths::ConvertRelativePathToFull(FilePath));
+		}
+
+		void Stop()
+		{
+			if (!Writer.IsValid())
+			{
+				return;
+			}
+
+			FHTNDelegates::OnPlanningStarted.Remove(PlanningStartedHandle);
+			FHTNDelegates::OnPlanningFinished.Remove(PlanningFinishedHandle);
+			FTSTicker::GetCoreTicker().RemoveTicker(FlushTickerHandle);
+			FlushTickerHandle.Reset();
+			PendingRecords.Reset();
+			Writer->Close();
+			Writer.Reset();
+			UE_LOG(LogHTN, Display, TEXT("HTN planning recorder: recorded %i planning runs to %s"), NumRecords, *FPaths::ConvertRelativePathToFull(FilePath));
+		}
+
+	private:
+		void OnPlanningStarted(const UHTNComponent& HTNComponent, const UHTN& HTN, const FBlackboardWorldState& WorldState)
+		{
+			// Assets that only exist at runtime couldn't be loaded by the replay.
+			if (!HTN.IsAsset() || !WorldState.GetBlackboardAsset() || !WorldState.GetBlackboardAsset()->IsAsset())
+			{
+				return;
+			}
+
+			FHTNPlanningRecord& Record = PendingRecords.Add(&HTNComponent);
+			Record.HTNPath = HTN.GetPathName();
+			Record.BlackboardPath = WorldState.GetBlackboardAsset()->GetPathName();
+			FHTNPlanSerializer::SaveWorldState(WorldState, Record.WorldState);
+		}
+
+		void OnPlanningFinished(const UHTNComponent& HTNComponent, const FHTNPlanningStats& Stats, const TSharedPtr<FHTNPlan>& Plan)
+		{
+			FHTNPlanningRecord Record;
+			if (!PendingRecords.RemoveAndCopyValue(&HTNComponent, Record))
+			{
+				return;
+			}
+
+			Record.bFoundPlan = Plan.IsValid();
+			Record.bWasCancelled = Stats.bWasCancelled;
+			Record.PlanIdentity = Plan.IsValid() ? FHTNPlanSerializer::GetPlanIdentity(*Plan) : 0;
+			Record.PlanCost = Plan.IsValid() ? Plan->Cost : 0;
+			Record.WallTimeSeconds = Stats.WallTimeSeconds;
+			Record.NumExpandedPlans = Stats.NumExpandedPlans;
+			Record.NumLatentWaits = Stats.NumLatentWaits;
+			*Writer << Record;
+
+			if (++NumRecords >= GHTNRecorderMaxRecords)
+			{
+				Stop();
+			}
+		}
+
+		bool OnFlushTick(float DeltaTime)
+		{
+			if (Writer.IsValid())
+			{
+				Writer->Flush();
+			}
+
+			return true;
+		}
+
+		TUniquePtr<FArchive> Writer;
+		FString FilePath;
+		int32 NumRecords = 0;
+		TMap<TWeakObjectPtr<const UHTNComponent>, FHTNPlanningRecord> PendingRecords;
+		FDelegateHandle PlanningStartedHandle;
+		FDelegateHandle PlanningFinishedHandle;
+		FTSTicker::FDelegateHandle FlushTickerHandle;
+	};
+
+	FAutoConsoleCommand CmdHTNRecorderStart(
+		TEXT("ai.htn.recorder.Start"),
+		TEXT("Starts recording the starting worldstate and HTN of every planning run, to be replayed with the HTNReplay commandlet. ")
+		TEXT("Optionally takes the file path, defaults to the Profiling/HTN/Recordings directory."),
+		FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+		{
+			FHTNPlanningRecorder::Get().Start(Args.Num() ? Args[0] : FString());
+		})
+	);
+
+	FAutoConsoleCommand CmdHTNRecorderStop(
+		TEXT("ai.htn.recorder.Stop"),
+		TEXT("Stops recording planning runs and closes the recording file."),
+		FConsoleCommandDelegate::CreateLambda([]()
+		{
+			FHTNPlanningRecorder::Get().Stop();
+		})
+	);
+}
+
+#endif
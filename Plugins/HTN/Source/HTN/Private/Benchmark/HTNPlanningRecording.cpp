@@ -0,0 +1,77 @@
+// Copyright 2020-2021 Maksym Maisak. All Rights Reserved.
+
+#include "Benchmark/HTNPlanningRecording.h"
+
+#if HTN_BENCHMARKS
+
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+
+namespace
+{
+	constexpr uint32 HTNRecordingMagic = 0x52505448; // "HTPR"
+	constexpr uint32 HTNRecordingVersion = 1;
+}
+
+FArchive& operator<<(FArchive& Ar, FHTNPlanningRecord& Record)
+{
+	Ar << Record.HTNPath;
+	Ar << Record.BlackboardPath;
+	Ar << Record.WorldState;
+	Ar << Record.PlanIdentity;
+	Ar << Record.PlanCost;
+	Ar << Record.WallTimeSeconds;
+	Ar << Record.NumExpandedPlans;
+	Ar << Record.NumLatentWaits;
+	Ar << Record.bFoundPlan;
+	Ar << Record.bWasCancelled;
+	return Ar;
+}
+
+FString HTNPlanningRecording::GetDirectory()
+{
+	return FPaths::ProfilingDir() / TEXT("HTN") / TEXT("Recordings");
+}
+
+void HTNPlanningRecording::WriteHeader(FArchive& Ar)
+{
+	uint32 Magic = HTNRecordingMagic;
+	uint32 Version = HTNRecordingVersion;
+	Ar << Magic;
+	Ar << Version;
+}
+
+bool HTNPlanningRecording::LoadRecords(const FString& FilePath, TArray<FHTNPlanningRecord>& OutRecords)
+{
+	TArray<uint8> Data;
+	if (!FFileHelper::LoadFileToArray(Data, *FilePath))
+	{
+		return false;
+	}
+
+	FMemoryReader Ar(Data, /*bIsPersistent=*/true);
+	uint32 Magic = 0;
+	uint32 Version = 0;
+	Ar << Magic;
+	Ar << Version;
+	if (Ar.IsError() || Magic != HTNRecordingMagic || Version != HTNRecordingVersion)
+	{
+		return false;
+	}
+
+	while (!Ar.AtEnd())
+	{
+		FHTNPlanningRecord Record;
+		Ar << Record;
+		if (Ar.IsError())
+		{
+			break;
+		}
+		OutRecords.Add(MoveTemp(Record));
+	}
+
+	return true;
+}
+
+#endif
@@ -0,0 +1,44 @@
+// Copyright 2020-2021 Maksym Maisak. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HTNTypes.h"
+
+#if HTN_BENCHMARKS
+
+// A planning run recorded by ai.htn.recorder.Start, to be replayed offline by UHTNReplayCommandlet.
+struct FHTNPlanningRecord
+{
+	FString HTNPath;
+	FString BlackboardPath;
+
+	// The worldstate at the start of planning, saved by FHTNPlanSerializer::SaveWorldState.
+	TArray<uint8> WorldState;
+
+	// The results of the recorded run. PlanIdentity is FHTNPlanSerializer::GetPlanIdentity of the produced plan, 0 if there was none.
+	uint32 PlanIdentity = 0;
+	int32 PlanCost = 0;
+	float WallTimeSeconds = 0.0f;
+	int32 NumExpandedPlans = 0;
+	int32 NumLatentWaits = 0;
+	bool bFoundPlan = false;
+	bool bWasCancelled = false;
+
+	friend FArchive& operator<<(FArchive& Ar, FHTNPlanningRecord& Record);
+};
+
+namespace HTNPlanningRecording
+{
+	// Recordings are written to (and by default replayed from) Profiling/HTN/Recordings.
+	FString GetDirectory();
+	const TCHAR* const FileExtension = TEXT(".htnrec");
+
+	// Writes the header of a recording. Records are then appended one by one with operator<<.
+	void WriteHeader(FArchive& Ar);
+
+	// Reads all records in the file. A truncated last record (e.g. from a crashed session) is ignored.
+	bool LoadRecords(const FString& FilePath, TArray<FHTNPlanningRecord>& OutRecords);
+}
+
+#endif
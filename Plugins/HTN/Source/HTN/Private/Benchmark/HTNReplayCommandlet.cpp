@@ -0,0 +1,229 @@
+// Copyright 2020-2021 Maksym Maisak. All Rights Reserved.
+
+#include "Benchmark/HTNReplayCommandlet.h"
+#include "HTNTypes.h"
+
+#if HTN_BENCHMARKS
+
+#include "AIController.h"
+#include "Algo/Accumulate.h"
+#include "BehaviorTree/BlackboardComponent.h"
+#include "BehaviorTree/BlackboardData.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "HAL/FileManager.h"
+#include "Misc/Paths.h"
+
+#include "AITask_MakeHTNPlan.h"
+#include "Benchmark/HTNBenchmarkHelpers.h"
+#include "Benchmark/HTNPlanningRecording.h"
+#include "BlackboardWorldstate.h"
+#include "HTN.h"
+#include "HTNComponent.h"
+#include "HTNPlanSerializer.h"
+
+namespace
+{
+	struct FHTNReplayResult
+	{
+		TArray<double> LatenciesSeconds;
+		uint32 PlanIdentity = 0;
+		int32 PlanCost = 0;
+		int32 NumExpandedPlans = 0;
+		int32 NumLatentWaits = 0;
+		bool bFoundPlan = false;
+		bool bIsDeterministic = true;
+	};
+
+	FHTNReplayResult ReplayRecord(const FHTNBenchmarkAgent& Agent, UHTN& HTN, int32 NumIterations)
+	{
+		FHTNReplayResult Result;
+		Result.LatenciesSeconds.Reserve(NumIterations);
+		for (int32 I = 0; I < NumIterations; ++I)
+		{
+			const uint64 StartCycles = FPlatformTime::Cycles64();
+
+			UAITask_MakeHTNPlan* const PlanningTask = UAITask::NewAITask<UAITask_MakeHTNPlan>(*Agent.Controller, *Agent.HTNComponent, TEXT("HTN Replay"));
+			PlanningTask->SetUp(Agent.HTNComponent, &HTN);
+			PlanningTask->SetStubLatentCreatePlanSteps(true);
+			PlanningTask->ReadyForActivation();
+
+			Result.LatenciesSeconds.Add(FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - StartCycles));
+
+			// With latent tasks stubbed out, planning should be done by now.
+			if (!ensure(PlanningTask->IsFinished()))
+			{
+				PlanningTask->ExternalCancel();
+			}
+
+			const uint32 PlanIdentity = PlanningTask->FoundPlan() ? FHTNPlanSerializer::GetPlanIdentity(*PlanningTask->GetFinishedPlan()) : 0;
+			if (I > 0 && PlanIdentity != Result.PlanIdentity)
+			{
+				Result.bIsDeterministic = false;
+			}
+
+			Result.PlanIdentity = PlanIdentity;
+			Result.bFoundPlan = PlanningTask->FoundPlan();
+			Result.PlanCost = Result.bFoundPlan ? PlanningTask->GetFinishedPlan()->Cost : 0;
+			Result.NumExpandedPlans = PlanningTask->GetPlanningStats().NumExpandedPlans;
+			Result.NumLatentWaits = PlanningTask->GetPlanningStats().NumLatentWaits;
+		}
+
+		return Result;
+	}
+
+	void FindRecordingFiles(const FString& Path, TArray<FString>& OutFilePaths)
+	{
+		if (!FPaths::DirectoryExists(Path))
+		{
+			OutFilePaths.Add(Path);
+			return;
+		}
+
+		TArray<FString> FileNames;
+		IFileManager::Get().FindFiles(FileNames, *(Path / FString(TEXT("*")) + HTNPlanningRecording::FileExtension), /*Files=*/true, /*Directories=*/false);
+		FileNames.Sort();
+		for (const FString& FileName : FileNames)
+		{
+			OutFilePaths.Add(Path / FileName);
+		}
+	}
+}
+
+#endif
+
+UHTNReplayCommandlet::UHTNReplayCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 UHTNReplayCommandlet::Main(const FString& Params)
+{
+#if HTN_BENCHMARKS
+	FString RecordingPath = HTNPlanningRecording::GetDirectory();
+	int32 NumIterations = 10;
+	FParse::Value(*Params, TEXT("Recording="), RecordingPath);
+	FParse::Value(*Params, TEXT("Iterations="), NumIterations);
+	NumIterations = FMath::Max(1, NumIterations);
+
+	TArray<FString> FilePaths;
+	FindRecordingFiles(RecordingPath, FilePaths);
+
+	UWorld* const World = UWorld::CreateWorld(EWorldType::Game, /*bInformEngineOfWorld=*/false);
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	WorldContext.SetCurrentWorld(World);
+	World->InitializeActorsForPlay(FURL());
+	World->BeginPlay();
+
+	// One agent per blackboard, reused by all records that use it.
+	TMap<UBlackboardData*, FHTNBenchmarkAgent> Agents;
+	TArray<FString> Rows;
+	int32 NumReplayed = 0;
+	int32 NumSamePlans = 0;
+	int32 NumDeterministic = 0;
+	for (const FString& FilePath : FilePaths)
+	{
+		TArray<FHTNPlanningRecord> Records;
+		if (!HTNPlanningRecording::LoadRecords(FilePath, Records))
+		{
+			UE_LOG(LogHTN, Error, TEXT("HTN replay: %s is not a valid recording."), *FilePath);
+			continue;
+		}
+
+		for (int32 RecordIndex = 0; RecordIndex < Records.Num(); ++RecordIndex)
+		{
+			const FHTNPlanningRecord& Record = Records[RecordIndex];
+			if (Record.bWasCancelled)
+			{
+				continue;
+			}
+
+			UHTN* const HTN = LoadObject<UHTN>(nullptr, *Record.HTNPath);
+			UBlackboardData* const Blackboard = LoadObject<UBlackboardData>(nullptr, *Record.BlackboardPath);
+			if (!HTN || !Blackboard)
+			{
+				UE_LOG(LogHTN, Warning, TEXT("HTN replay: skipping record %i of %s, could not load %s or %s."), RecordIndex, *FilePath, *Record.HTNPath, *Record.BlackboardPath);
+				continue;
+			}
+
+			FHTNBenchmarkAgent* Agent = Agents.Find(Blackboard);
+			if (!Agent)
+			{
+				Agent = &Agents.Add(Blackboard, HTNBenchmark::SpawnAgent(*World, FVector::ZeroVector, Blackboard));
+			}
+			if (!Agent->IsValid())
+			{
+				UE_LOG(LogHTN, Error, TEXT("HTN replay: failed to spawn an agent with blackboard %s."), *Record.BlackboardPath);
+				continue;
+			}
+
+			UBlackboardComponent& BlackboardComponent = *Agent->Controller->GetBlackboardComponent();
+			FBlackboardWorldState RecordedWorldState(BlackboardComponent);
+			FString Error;
+			if (!FHTNPlanSerializer::LoadWorldState(Record.WorldState, RecordedWorldState, &Error))
+			{
+				UE_LOG(LogHTN, Warning, TEXT("HTN replay: skipping record %i of %s: %s."), RecordIndex, *FilePath, *Error);
+				continue;
+			}
+			RecordedWorldState.ApplyChangedValues(BlackboardComponent);
+
+			FHTNReplayResult Result = ReplayRecord(*Agent, *HTN, NumIterations);
+			const bool bSamePlan = Result.bFoundPlan == Record.bFoundPlan && Result.PlanIdentity == Record.PlanIdentity;
+			++NumReplayed;
+			NumSamePlans += bSamePlan;
+			NumDeterministic += Result.bIsDeterministic;
+
+			const double TotalSeconds = Algo::Accumulate(Result.LatenciesSeconds, 0.0);
+			Rows.Add(FString::Printf(TEXT("%s,%i,%s,%i,%i,%i,%i,%i,%08x,%i,%i,%.3f,%i,%i,%i,%.2f,%.2f,%.2f"),
+				*FPaths::GetCleanFilename(FilePath),
+				RecordIndex,
+				*Record.HTNPath,
+				Result.LatenciesSeconds.Num(),
+				Record.bFoundPlan,
+				Result.bFoundPlan,
+				Record.PlanCost,
+				Result.PlanCost,
+				Result.PlanIdentity,
+				bSamePlan,
+				Result.bIsDeterministic,
+				Record.WallTimeSeconds * 1000.0f,
+				Record.NumLatentWaits,
+				Result.NumLatentWaits,
+				Result.NumExpandedPlans,
+				TotalSeconds * 1000000.0 / Result.LatenciesSeconds.Num(),
+				HTNBenchmark::GetPercentile(Result.LatenciesSeconds, 0.5) * 1000000.0,
+				HTNBenchmark::GetPercentile(Result.LatenciesSeconds, 0.99) * 1000000.0
+			));
+		}
+	}
+
+	for (const TPair<UBlackboardData*, FHTNBenchmarkAgent>& Pair : Agents)
+	{
+		HTNBenchmark::DestroyAgent(Pair.Value);
+	}
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(/*bInformEngineOfWorld=*/false);
+
+	if (!NumReplayed)
+	{
+		UE_LOG(LogHTN, Error, TEXT("HTN replay: no planning runs to replay in %s."), *RecordingPath);
+		return 1;
+	}
+
+	const FString CSVPath = HTNBenchmark::WriteCSV(TEXT("HTNReplay"),
+		TEXT("Recording,Record,HTN,Iterations,RecordedFoundPlan,FoundPlan,RecordedPlanCost,PlanCost,PlanIdentity,SamePlan,Deterministic,")
+		TEXT("RecordedMs,RecordedLatentWaits,StubbedLatentWaits,ExpandedPlans,MeanLatencyUs,P50LatencyUs,P99LatencyUs"),
+		Rows
+	);
+	UE_LOG(LogHTN, Display, TEXT("HTN replay: replayed %i planning runs, %i produced the recorded plan, %i were deterministic. Results written to %s"),
+		NumReplayed, NumSamePlans, NumDeterministic, CSVPath.IsEmpty() ? TEXT("(failed to write results)") : *CSVPath);
+
+	return 0;
+#else
+	UE_LOG(LogHTN, Error, TEXT("HTN replay is not available in this build configuration."));
+	return 1;
+#endif
+}
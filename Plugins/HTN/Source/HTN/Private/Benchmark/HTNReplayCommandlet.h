@@ -0,0 +1,22 @@
+// Copyright 2020-2021 Maksym Maisak. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "HTNReplayCommandlet.generated.h"
+
+// Replays planning runs recorded with ai.htn.recorder.Start through the planner, with latent tasks stubbed out,
+// and writes the timings and whether each replay produced the same plan as the recorded run as CSV to the Profiling/HTN directory.
+// UnrealEditor-Cmd <Project> -run=HTNReplay [-Recording=<file or directory>] [-Iterations=10]
+// By default, replays all recordings in Profiling/HTN/Recordings.
+// Object keys are restored only if their objects can be found, so plans depending on runtime actors may differ from the recorded ones.
+UCLASS()
+class UHTNReplayCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UHTNReplayCommandlet();
+	virtual int32 Main(const FString& Params) override;
+};
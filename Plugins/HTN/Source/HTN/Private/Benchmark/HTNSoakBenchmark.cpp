@@ -0,0 +1,445 @@
+// Copyright 2020-2021 Maksym Maisak. All Rights Reserved.
+
+#include "Benchmark/HTNBenchmarkHelpers.h"
+
+#if HTN_BENCHMARKS
+
+#include "AIController.h"
+#include "Algo/Accumulate.h"
+#include "Async/Async.h"
+#include "BehaviorTree/BlackboardData.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformMemory.h"
+#include "Math/RandomStream.h"
+#include "Misc/App.h"
+#include "UObject/GCObject.h"
+#include "UObject/UObjectGlobals.h"
+
+#include "Benchmark/HTNBenchmarkNodes.h"
+#include "HTNComponent.h"
+#include "Nodes/HTNNode_Prefer.h"
+#include "Tasks/HTNTask_Wait.h"
+
+// Measures the steady-state cost of executing HTNs with many agents at once.
+// Each agent runs a small looping HTN with waits, SetValue and MoveTo stand-ins, a decorator that fails rechecks periodically,
+// a service ticking every 0.5s, and a ForceReplan every few seconds. Needs no navmesh, so any map works, including on a -nullrhi server:
+// UnrealEditor-Cmd <Project> <Map> -game -nullrhi -ExecCmds="ai.htn.benchmark.Soak 30"
+// When running without rendering like that, the process exits once the results are written.
+// To measure HTN ticks in isolation, the benchmark ticks the HTN components of its agents itself instead of through their tick functions.
+// Results are logged and written as CSV to the Profiling/HTN directory.
+namespace
+{
+	const int32 SoakBenchmarkBlackboardSize = 32;
+	const float SoakBenchmarkWarmupSeconds = 5.0f;
+	const float SoakBenchmarkForceReplanInterval = 5.0f;
+	const float SoakBenchmarkAgentSpacing = 300.0f;
+
+	class FHTNSoakBenchmark : public FGCObject
+	{
+	public:
+		static TUniquePtr<FHTNSoakBenchmark> Instance;
+
+		FHTNSoakBenchmark(UWorld& InWorld, const TArray<int32>& InAgentCounts, float InMeasureSeconds);
+		virtual ~FHTNSoakBenchmark();
+		void RemoveDelegates();
+
+		virtual void AddReferencedObjects(FReferenceCollector& Collector) override;
+		virtual FString GetReferencerName() const override { return TEXT("FHTNSoakBenchmark"); }
+
+		bool IsFinished() const { return bIsFinished; }
+
+	private:
+		enum class EStage : uint8
+		{
+			WarmingUp,
+			Measuring
+		};
+
+		struct FAgentInfo
+		{
+			FHTNBenchmarkAgent Agent;
+			float TimeUntilForceReplan = 0.0f;
+		};
+
+		UHTN* MakeHTN();
+		void StartRun();
+		void FinishRun();
+		void Finish();
+
+		void OnWorldPostActorTick(UWorld* InWorld, ELevelTick TickType, float DeltaSeconds);
+		void OnPreGarbageCollect();
+		void OnPostGarbageCollect();
+
+		TWeakObjectPtr<UWorld> World;
+		TArray<int32> AgentCounts;
+		float MeasureSeconds;
+
+		FHTNBenchmarkAssetBuilder Builder;
+		UBlackboardData* Blackboard;
+		UHTN* HTN;
+
+		int32 RunIndex;
+		EStage Stage;
+		float StageElapsedSeconds;
+		TArray<FAgentInfo> Agents;
+		FRandomStream RandomStream;
+
+		uint64 BaselineUsedPhysicalMemory;
+		uint64 MemoryPerAgent;
+		TArray<double> FrameTickSeconds;
+		uint64 GCStartCycles;
+		TArray<double> GCSeconds;
+
+		TArray<FString> Rows;
+
+		FDelegateHandle PostActorTickHandle;
+		FDelegateHandle PreGarbageCollectHandle;
+		FDelegateHandle PostGarbageCollectHandle;
+		uint8 bIsFinished : 1;
+	};
+
+	TUniquePtr<FHTNSoakBenchmark> FHTNSoakBenchmark::Instance;
+
+	FHTNSoakBenchmark::FHTNSoakBenchmark(UWorld& InWorld, const TArray<int32>& InAgentCounts, float InMeasureSeconds) :
+		World(&InWorld),
+		AgentCounts(InAgentCounts),
+		MeasureSeconds(InMeasureSeconds),
+		Builder(GetTransientPackage()),
+		Blackboard(nullptr),
+		HTN(nullptr),
+		RunIndex(INDEX_NONE),
+		Stage(EStage::WarmingUp),
+		StageElapsedSeconds(0.0f),
+		RandomStream(12345),
+		BaselineUsedPhysicalMemory(0),
+		MemoryPerAgent(0),
+		GCStartCycles(0),
+		bIsFinished(false)
+	{
+		Blackboard = Builder.MakeBlackboard(SoakBenchmarkBlackboardSize);
+		HTN = MakeHTN();
+
+		PostActorTickHandle = FWorldDelegates::OnWorldPostActorTick.AddRaw(this, &FHTNSoakBenchmark::OnWorldPostActorTick);
+		PreGarbageCollectHandle = FCoreUObjectDelegates::GetPreGarbageCollectDelegate().AddRaw(this, &FHTNSoakBenchmark::OnPreGarbageCollect);
+		PostGarbageCollectHandle = FCoreUObjectDelegates::GetPostGarbageCollect().AddRaw(this, &FHTNSoakBenchmark::OnPostGarbageCollect);
+
+		StartRun();
+	}
+
+	FHTNSoakBenchmark::~FHTNSoakBenchmark()
+	{
+		RemoveDelegates();
+	}
+
+	void FHTNSoakBenchmark::RemoveDelegates()
+	{
+		if (PostActorTickHandle.IsValid())
+		{
+			FWorldDelegates::OnWorldPostActorTick.Remove(PostActorTickHandle);
+			PostActorTickHandle.Reset();
+		}
+		if (PreGarbageCollectHandle.IsValid())
+		{
+			FCoreUObjectDelegates::GetPreGarbageCollectDelegate().Remove(PreGarbageCollectHandle);
+			PreGarbageCollectHandle.Reset();
+		}
+		if (PostGarbageCollectHandle.IsValid())
+		{
+			FCoreUObjectDelegates::GetPostGarbageCollect().Remove(PostGarbageCollectHandle);
+			PostGarbageCollectHandle.Reset();
+		}
+	}
+
+	void FHTNSoakBenchmark::AddReferencedObjects(FReferenceCollector& Collector)
+	{
+		Collector.AddReferencedObject(Blackboard);
+		Collector.AddReferencedObject(HTN);
+	}
+
+	// Prefer
+	// |- [IntCheck on Int1] SetInt Int2 -> MoveTo -> Wait 1.5s
+	// |- SetInt Int3 -> Wait 1s
+	// with a service incrementing Int1 every 0.5s on the root.
+	// The check fails a quarter of the time, so plans get aborted by rechecks and the fallback branch gets used.
+	UHTN* FHTNSoakBenchmark::MakeHTN()
+	{
+		struct Local
+		{
+			static UHTNTask_Wait* MakeWait(const FHTNBenchmarkAssetBuilder& Builder, UHTN& HTN, float WaitTime)
+			{
+				UHTNTask_Wait* const Wait = Builder.MakeNode<UHTNTask_Wait>(HTN);
+				Wait->WaitTime = WaitTime;
+				Wait->RandomDeviation = WaitTime * 0.5f;
+				return Wait;
+			}
+		};
+
+		UHTN* const NewHTN = Builder.MakeHTN(Blackboard);
+
+		UHTNService_BenchmarkIncrement* const Service = NewObject<UHTNService_BenchmarkIncrement>(NewHTN);
+		Service->KeyName = FHTNBenchmarkAssetBuilder::GetIntKeyName(1);
+		NewHTN->RootServices.Add(Service);
+
+		UHTNStandaloneNode* const PrimaryBranch = FHTNBenchmarkAssetBuilder::Chain({
+			Builder.MakeSetInt(*NewHTN, 2, 1, 1),
+			Builder.MakeMoveTo(*NewHTN, { FVector(500.0f, 0.0f, 0.0f), FVector(0.0f, 500.0f, 0.0f) }),
+			Local::MakeWait(Builder, *NewHTN, 1.5f)
+		});
+		UHTNDecorator_BenchmarkIntCheck* const Decorator = NewObject<UHTNDecorator_BenchmarkIntCheck>(NewHTN);
+		Decorator->KeyName = FHTNBenchmarkAssetBuilder::GetIntKeyName(1);
+		PrimaryBranch->Decorators.Add(Decorator);
+
+		UHTNStandaloneNode* const SecondaryBranch = FHTNBenchmarkAssetBuilder::Chain({
+			Builder.MakeSetInt(*NewHTN, 3, 1, 1),
+			Local::MakeWait(Builder, *NewHTN, 1.0f)
+		});
+
+		UHTNNode_Prefer* const Prefer = Builder.MakeNode<UHTNNode_Prefer>(*NewHTN);
+		Prefer->NextNodes = { PrimaryBranch, SecondaryBranch };
+		Prefer->NumPrimaryNodes = 1;
+		NewHTN->StartNodes.Add(Prefer);
+
+		return NewHTN;
+	}
+
+	void FHTNSoakBenchmark::StartRun()
+	{
+		++RunIndex;
+		UWorld* const WorldPtr = World.Get();
+		if (!AgentCounts.IsValidIndex(RunIndex) || !WorldPtr)
+		{
+			Finish();
+			return;
+		}
+
+		CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+		BaselineUsedPhysicalMemory = FPlatformMemory::GetStats().UsedPhysical;
+
+		const int32 NumAgents = AgentCounts[RunIndex];
+		const int32 GridSize = FMath::CeilToInt(FMath::Sqrt((float)NumAgents));
+		Agents.Reset(NumAgents);
+		for (int32 I = 0; I < NumAgents; ++I)
+		{
+			const FVector Location((I % GridSize) * SoakBenchmarkAgentSpacing, (I / GridSize) * SoakBenchmarkAgentSpacing, 0.0f);
+			const FHTNBenchmarkAgent Agent = HTNBenchmark::SpawnAgent(*WorldPtr, Location, Blackboard);
+			if (!Agent.IsValid())
+			{
+				UE_LOG(LogHTN, Error, TEXT("HTN soak benchmark: failed to spawn agent %i."), I);
+				continue;
+			}
+
+			Agent.HTNComponent->SetComponentTickEnabled(false);
+			Agent.HTNComponent->StartHTN(HTN);
+			Agents.Add({ Agent, RandomStream.FRandRange(0.0f, SoakBenchmarkForceReplanInterval) });
+		}
+
+		Stage = EStage::WarmingUp;
+		StageElapsedSeconds = 0.0f;
+		MemoryPerAgent = 0;
+		FrameTickSeconds.Reset();
+		GCSeconds.Reset();
+		UE_LOG(LogHTN, Display, TEXT("HTN soak benchmark: spawned %i agents, warming up for %.1fs."), Agents.Num(), SoakBenchmarkWarmupSeconds);
+	}
+
+	void FHTNSoakBenchmark::FinishRun()
+	{
+		const int32 NumFrames = FrameTickSeconds.Num();
+		const double TotalTickSeconds = Algo::Accumulate(FrameTickSeconds, 0.0);
+		const double MeanTickMilliseconds = TotalTickSeconds * 1000.0 / FMath::Max(NumFrames, 1);
+		const double MicrosecondsPerAgentTick = TotalTickSeconds * 1000000.0 / FMath::Max(NumFrames * Agents.Num(), 1);
+		const double P50TickMilliseconds = HTNBenchmark::GetPercentile(FrameTickSeconds, 0.5) * 1000.0;
+		const double P99TickMilliseconds = HTNBenchmark::GetPercentile(FrameTickSeconds, 0.99) * 1000.0;
+		const double MaxTickMilliseconds = NumFrames ? FrameTickSeconds.Last() * 1000.0 : 0.0;
+		const double TotalGCMilliseconds = Algo::Accumulate(GCSeconds, 0.0) * 1000.0;
+		const double MaxGCMilliseconds = GCSeconds.Num() ? FMath::Max(GCSeconds) * 1000.0 : 0.0;
+
+		for (const FAgentInfo& AgentInfo : Agents)
+		{
+			HTNBenchmark::DestroyAgent(AgentInfo.Agent);
+		}
+
+		// How long it takes to collect the agents gives an idea of the cost of GC per agent.
+		const uint64 CleanupGCStartCycles = FPlatformTime::Cycles64();
+		CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+		const double CleanupGCMilliseconds = FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - CleanupGCStartCycles);
+
+		const FString Row = FString::Printf(TEXT("%i,%i,%.1f,%.3f,%.3f,%.3f,%.3f,%.3f,%llu,%i,%.3f,%.3f,%.3f"),
+			Agents.Num(),
+			NumFrames,
+			MeasureSeconds,
+			MeanTickMilliseconds,
+			P50TickMilliseconds,
+			P99TickMilliseconds,
+			MaxTickMilliseconds,
+			MicrosecondsPerAgentTick,
+			MemoryPerAgent,
+			GCSeconds.Num(),
+			TotalGCMilliseconds,
+			MaxGCMilliseconds,
+			CleanupGCMilliseconds
+		);
+		UE_LOG(LogHTN, Display, TEXT("HTN soak benchmark: %s"), *Row);
+		Rows.Add(Row);
+
+		Agents.Reset();
+	}
+
+	void FHTNSoakBenchmark::Finish()
+	{
+		bIsFinished = true;
+
+		const FString FilePath = HTNBenchmark::WriteCSV(TEXT("HTNSoakBenchmark"),
+			TEXT("Agents,Frames,MeasuredSeconds,MeanHTNTickMs,P50HTNTickMs,P99HTNTickMs,MaxHTNTickMs,HTNTickUsPerAgent,")
+			TEXT("MemoryPerAgentBytes,NumGCs,TotalGCMs,MaxGCMs,CleanupGCMs"),
+			Rows
+		);
+		if (FilePath.IsEmpty())
+		{
+			UE_LOG(LogHTN, Error, TEXT("HTN soak benchmark: failed to write results."));
+		}
+		else
+		{
+			UE_LOG(LogHTN, Display, TEXT("HTN soak benchmark: results written to %s"), *FilePath);
+		}
+
+		RemoveDelegates();
+
+		// This is called from the delegates or the constructor, so the instance is destroyed afterwards rather than right away.
+		AsyncTask(ENamedThreads::GameThread, []()
+		{
+			if (Instance.IsValid() && Instance->IsFinished())
+			{
+				Instance.Reset();
+			}
+		});
+
+		// Nobody is around to read the results of an unattended run without rendering, so don't keep the process running.
+		if (!FApp::CanEverRender())
+		{
+			UE_LOG(LogHTN, Display, TEXT("HTN soak benchmark: finished, requesting exit."));
+			FPlatformMisc::RequestExitWithStatus(false, FilePath.IsEmpty() ? 1 : 0);
+		}
+	}
+
+	void FHTNSoakBenchmark::OnWorldPostActorTick(UWorld* InWorld, ELevelTick TickType, float DeltaSeconds)
+	{
+		if (bIsFinished)
+		{
+			return;
+		}
+
+		// The world was torn down mid-benchmark, taking the agents with it.
+		if (!World.IsValid())
+		{
+			UE_LOG(LogHTN, Warning, TEXT("HTN soak benchmark: the world was destroyed, stopping."));
+			Agents.Reset();
+			Finish();
+			return;
+		}
+
+		if (InWorld != World.Get())
+		{
+			return;
+		}
+
+		const uint64 StartCycles = FPlatformTime::Cycles64();
+		for (FAgentInfo& AgentInfo : Agents)
+		{
+			UHTNComponent* const HTNComponent = AgentInfo.Agent.HTNComponent;
+			if (!IsValid(HTNComponent))
+			{
+				continue;
+			}
+
+			AgentInfo.TimeUntilForceReplan -= DeltaSeconds;
+			if (AgentInfo.TimeUntilForceReplan <= 0.0f)
+			{
+				AgentInfo.TimeUntilForceReplan += SoakBenchmarkForceReplanInterval;
+				HTNComponent->ForceReplan();
+			}
+
+			HTNComponent->TickComponent(DeltaSeconds, TickType, nullptr);
+		}
+		const double TickSeconds = FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - StartCycles);
+
+		StageElapsedSeconds += DeltaSeconds;
+		switch (Stage)
+		{
+		case EStage::WarmingUp:
+			if (StageElapsedSeconds >= SoakBenchmarkWarmupSeconds)
+			{
+				// All agents have been through a few plans by now, so their memory use is representative.
+				CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+				const uint64 UsedPhysicalMemory = FPlatformMemory::GetStats().UsedPhysical;
+				MemoryPerAgent = UsedPhysicalMemory > BaselineUsedPhysicalMemory ? (UsedPhysicalMemory - BaselineUsedPhysicalMemory) / FMath::Max(Agents.Num(), 1) : 0;
+
+				Stage = EStage::Measuring;
+				StageElapsedSeconds = 0.0f;
+				GCSeconds.Reset();
+			}
+			break;
+		case EStage::Measuring:
+			FrameTickSeconds.Add(TickSeconds);
+			if (StageElapsedSeconds >= MeasureSeconds)
+			{
+				FinishRun();
+				StartRun();
+			}
+			break;
+		}
+	}
+
+	void FHTNSoakBenchmark::OnPreGarbageCollect()
+	{
+		GCStartCycles = FPlatformTime::Cycles64();
+	}
+
+	void FHTNSoakBenchmark::OnPostGarbageCollect()
+	{
+		if (!bIsFinished && Stage == EStage::Measuring && GCStartCycles)
+		{
+			GCSeconds.Add(FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - GCStartCycles));
+		}
+		GCStartCycles = 0;
+	}
+
+	FAutoConsoleCommandWithWorldAndArgs CmdHTNBenchmarkSoak(
+		TEXT("ai.htn.benchmark.Soak"),
+		TEXT("Spawns 100, 500 and then 2000 agents running a representative HTN and measures the HTN tick time per frame, memory per agent and GC time. ")
+		TEXT("Optionally takes the number of seconds to measure each agent count for (default 20) and a comma-separated list of agent counts. ")
+		TEXT("Results are logged and written as CSV to the Profiling/HTN directory."),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+		{
+			if (FHTNSoakBenchmark::Instance.IsValid() && !FHTNSoakBenchmark::Instance->IsFinished())
+			{
+				UE_LOG(LogHTN, Warning, TEXT("HTN soak benchmark is already running."));
+				return;
+			}
+
+			if (!World)
+			{
+				UE_LOG(LogHTN, Error, TEXT("HTN soak benchmark: no world to spawn the benchmark agents in."));
+				return;
+			}
+
+			const float MeasureSeconds = Args.Num() > 0 ? FMath::Max(1.0f, FCString::Atof(*Args[0])) : 20.0f;
+
+			TArray<int32> AgentCounts = { 100, 500, 2000 };
+			if (Args.Num() > 1)
+			{
+				TArray<FString> AgentCountStrings;
+				Args[1].ParseIntoArray(AgentCountStrings, TEXT(","));
+				AgentCounts.Reset();
+				for (const FString& AgentCountString : AgentCountStrings)
+				{
+					AgentCounts.Add(FMath::Max(1, FCString::Atoi(*AgentCountString)));
+				}
+			}
+
+			FHTNSoakBenchmark::Instance = MakeUnique<FHTNSoakBenchmark>(*World, AgentCounts, MeasureSeconds);
+		})
+	);
+}
+
+#endif
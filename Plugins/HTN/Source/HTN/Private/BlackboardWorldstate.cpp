@@ -5,7 +5,9 @@
 #include "BehaviorTree/Blackboard/BlackboardKeyType_Vector.h"
 #include "BehaviorTree/Blackboard/BlackboardKeyType_Object.h"
 #include "AITypes.h"
+#include "Engine/World.h"
 
+#include "HTNPlanningStats.h"
 #include "HTNTypes.h"
 
 namespace
@@ -141,28 +143,32 @@ public:
 		check(WorldState.BlackboardAsset.IsValid());
 		check(!WorldState.bIsInitialized);
 		
-		const auto& SourceMemory = GetValueMemory(Source);
-		const TArray<UBlackboardKeyType*>& SourceKeyInstances = GetKeyInstances(Source);
 		UBlackboardComponent& BlackboardComponent = *WorldState.BlackboardComponent;
+		const FBlackboardWorldStateLayer* const Layer = WorldState.SharedLayer.Get();
 
-		WorldState.ValueMemory.AddZeroed(SourceMemory.Num());
-		WorldState.KeyInstances.AddZeroed(SourceKeyInstances.Num());
+		WorldState.ValueMemory.AddZeroed(Layer ? Layer->LocalValueMemorySize : UBlackboardComponentHelper::GetValueMemory(BlackboardComponent).Num());
+		WorldState.KeyInstances.AddZeroed(UBlackboardComponentHelper::GetKeyInstances(BlackboardComponent).Num());
 		for (UBlackboardData* It = WorldState.BlackboardAsset.Get(); It; It = It->Parent)
 		{
 			for (int32 KeyIndex = 0; KeyIndex < It->Keys.Num(); ++KeyIndex)
 			{
 				if (UBlackboardKeyType* const KeyType = It->Keys[KeyIndex].KeyType)
 				{
+					const FBlackboard::FKey KeyID = KeyIndex + It->GetFirstKeyID();
+					if (Layer && Layer->IsKeyShared(KeyID))
+					{
+						continue;
+					}
+
 					KeyType->PreInitialize(BlackboardComponent);
 					
 					const bool bKeyHasInstance = KeyType->HasInstance();
 					const uint16 MemoryOffset = bKeyHasInstance ? sizeof(FBlackboardInstancedKeyMemory) : 0;
-					const FBlackboard::FKey KeyID = KeyIndex + It->GetFirstKeyID();
 
-					const uint8* const SourceValueMemory = GetKeyRawDataConst(SourceMemory, BlackboardComponent, KeyID) + MemoryOffset;
-					UBlackboardKeyType* const SourceKey = bKeyHasInstance ? SourceKeyInstances[KeyID] : KeyType;
+					const uint8* const SourceValueMemory = GetValueRawData(Source, KeyID) + MemoryOffset;
+					UBlackboardKeyType* const SourceKey = bKeyHasInstance ? GetKeyInstance(Source, KeyID) : KeyType;
 					
-					uint8* const DestinationRawMemory = GetKeyRawData(WorldState.ValueMemory, BlackboardComponent, KeyID);
+					uint8* const DestinationRawMemory = WorldState.GetLocalKeyRawData(KeyID);
 					uint8* const DestinationValueMemory = DestinationRawMemory + MemoryOffset;
 					UBlackboardKeyType* DestinationKey = KeyType;
 					if (bKeyHasInstance)
@@ -186,10 +192,6 @@ public:
 	{
 		check(WorldState.BlackboardComponent.IsValid());
 		check(WorldState.BlackboardAsset.IsValid());
-
-		auto& DestinationMemory = GetValueMemory(Destination);
-		const TArray<UBlackboardKeyType*>& DestinationKeyInstances = GetKeyInstances(Destination);
-		UBlackboardComponent& BlackboardComponent = *WorldState.BlackboardComponent;
 		
 		for (FBlackboard::FKey KeyID = 0; KeyID < WorldState.ChangedFlags.Num(); ++KeyID)
 		{
@@ -197,21 +199,9 @@ public:
 			{
 				if (const FBlackboardEntry* const Entry = WorldState.BlackboardAsset->GetKey(KeyID))
 				{
-					if (UBlackboardKeyType* const KeyType = Entry->KeyType)
+					if (Entry->KeyType)
 					{
-						const bool bKeyHasInstance = KeyType->HasInstance();
-						const uint16 MemoryOffset = bKeyHasInstance ? sizeof(FBlackboardInstancedKeyMemory) : 0;
-
-						const uint8* const SourceValueMemory = GetKeyRawDataConst(WorldState.ValueMemory, BlackboardComponent, KeyID) + MemoryOffset;
-						uint8* const DestinationValueMemory = GetKeyRawData(DestinationMemory, BlackboardComponent, KeyID) + MemoryOffset;
-
-						UBlackboardKeyType* const SourceKey = bKeyHasInstance ? WorldState.KeyInstances[KeyID] : KeyType;
-						UBlackboardKeyType* const DestinationKey = bKeyHasInstance ? DestinationKeyInstances[KeyID] : KeyType;
-						if (DestinationKey->CompareValues(BlackboardComponent, SourceValueMemory, DestinationKey, DestinationValueMemory) != EBlackboardCompare::Equal)
-						{
-							UBlackboardKeyTypeHelper::CopyValuesHelper(DestinationKey, BlackboardComponent, DestinationValueMemory, SourceKey, SourceValueMemory);
-							NotifyValueChanged(Destination, KeyID, *Entry, DestinationKey, MemoryOffset, DestinationValueMemory);
-						}
+						CopyValueIfDifferent(WorldState, Destination, KeyID, *Entry);
 					}
 				}
 			}
@@ -224,34 +214,88 @@ public:
 		check(WorldState.BlackboardComponent.IsValid());
 		check(WorldState.BlackboardAsset.IsValid());
 
-		auto& DestinationMemory = GetValueMemory(Destination);
-		const TArray<UBlackboardKeyType*>& DestinationKeyInstances = GetKeyInstances(Destination);
-		UBlackboardComponent& BlackboardComponent = *WorldState.BlackboardComponent;
-
 		if (const FBlackboardEntry* const Entry = WorldState.BlackboardAsset->GetKey(KeyID))
 		{
-			if (UBlackboardKeyType* const KeyType = Entry->KeyType)
+			if (Entry->KeyType)
 			{
-				const bool bKeyHasInstance = KeyType->HasInstance();
-				const uint16 MemoryOffset = bKeyHasInstance ? sizeof(FBlackboardInstancedKeyMemory) : 0;
+				CopyValueIfDifferent(WorldState, Destination, KeyID, *Entry);
+				SetKeyChanged(Destination, KeyID);
+			}
+		}
+	}
 
-				const uint8* const SourceValueMemory = GetKeyRawDataConst(WorldState.ValueMemory, BlackboardComponent, KeyID) + MemoryOffset;
-				uint8* const DestinationValueMemory = GetKeyRawData(DestinationMemory, BlackboardComponent, KeyID) + MemoryOffset;
+	// Outputs the memory layout of the keys of the blackboard that aren't shared, packed the same way as in UBlackboardComponent::InitializeBlackboard.
+	static int32 MakeLocalValueOffsets(const UBlackboardData& BlackboardAsset, const TBitArray<>& SharedKeys, TArray<uint16>& OutOffsets)
+	{
+		struct FKeyMemory
+		{
+			FBlackboard::FKey KeyID;
+			uint16 DataSize;
+		};
 
-				UBlackboardKeyType* const SourceKey = bKeyHasInstance ? WorldState.KeyInstances[KeyID] : KeyType;
-				UBlackboardKeyType* const DestinationKey = bKeyHasInstance ? DestinationKeyInstances[KeyID] : KeyType;
-				if (DestinationKey->CompareValues(BlackboardComponent, SourceValueMemory, DestinationKey, DestinationValueMemory) != EBlackboardCompare::Equal)
+		TArray<FKeyMemory> LocalKeys;
+		OutOffsets.Init(0, BlackboardAsset.GetNumKeys());
+		for (const UBlackboardData* It = &BlackboardAsset; It; It = It->Parent)
+		{
+			for (int32 KeyIndex = 0; KeyIndex < It->Keys.Num(); ++KeyIndex)
+			{
+				const FBlackboard::FKey KeyID = KeyIndex + It->GetFirstKeyID();
+				const UBlackboardKeyType* const KeyType = It->Keys[KeyIndex].KeyType;
+				if (KeyType && !(SharedKeys.IsValidIndex(KeyID) && SharedKeys[KeyID]))
 				{
-					UBlackboardKeyTypeHelper::CopyValuesHelper(DestinationKey, BlackboardComponent, DestinationValueMemory, SourceKey, SourceValueMemory);
-					NotifyValueChanged(Destination, KeyID, *Entry, DestinationKey, MemoryOffset, DestinationValueMemory);
+					const uint16 DataSize = KeyType->GetValueSize() + (KeyType->HasInstance() ? sizeof(FBlackboardInstancedKeyMemory) : 0);
+					LocalKeys.Add({ KeyID, DataSize });
 				}
-				SetKeyChanged(Destination, KeyID);
 			}
 		}
+
+		// Largest values first to keep them aligned.
+		LocalKeys.StableSort([](const FKeyMemory& A, const FKeyMemory& B) { return A.DataSize > B.DataSize; });
+
+		int32 MemorySize = 0;
+		for (const FKeyMemory& Key : LocalKeys)
+		{
+			OutOffsets[Key.KeyID] = MemorySize;
+			MemorySize += Key.DataSize;
+		}
+
+		return MemorySize;
+	}
+
+	static bool HasSameValue(const FBlackboardWorldState& WorldState, const UBlackboardComponent& Blackboard, FBlackboard::FKey KeyID, const UBlackboardKeyType& KeyType)
+	{
+		const bool bKeyHasInstance = KeyType.HasInstance();
+		const uint16 MemoryOffset = bKeyHasInstance ? sizeof(FBlackboardInstancedKeyMemory) : 0;
+		const UBlackboardKeyType* const Key = bKeyHasInstance ? GetKeyInstance(WorldState, KeyID) : &KeyType;
+		const UBlackboardKeyType* const OtherKey = bKeyHasInstance ? GetKeyInstance(Blackboard, KeyID) : &KeyType;
+		return Key->CompareValues(Blackboard, GetValueRawData(WorldState, KeyID) + MemoryOffset, OtherKey, GetValueRawData(Blackboard, KeyID) + MemoryOffset) == EBlackboardCompare::Equal;
 	}
 	
 private:
 
+	template<typename DestinationType>
+	static void CopyValueIfDifferent(const FBlackboardWorldState& WorldState, DestinationType& Destination, FBlackboard::FKey KeyID, const FBlackboardEntry& Entry)
+	{
+		UBlackboardKeyType* const KeyType = Entry.KeyType;
+		UBlackboardComponent& BlackboardComponent = *WorldState.BlackboardComponent;
+		const bool bKeyHasInstance = KeyType->HasInstance();
+		const uint16 MemoryOffset = bKeyHasInstance ? sizeof(FBlackboardInstancedKeyMemory) : 0;
+
+		const uint8* const SourceValueMemory = GetValueRawData(WorldState, KeyID) + MemoryOffset;
+		UBlackboardKeyType* const SourceKey = bKeyHasInstance ? GetKeyInstance(WorldState, KeyID) : KeyType;
+
+		const uint8* const DestinationValueMemory = GetValueRawData(AsConst(Destination), KeyID) + MemoryOffset;
+		const UBlackboardKeyType* const DestinationKey = bKeyHasInstance ? GetKeyInstance(AsConst(Destination), KeyID) : KeyType;
+		if (DestinationKey->CompareValues(BlackboardComponent, SourceValueMemory, DestinationKey, DestinationValueMemory) != EBlackboardCompare::Equal)
+		{
+			// Writing to a shared key of a layered worldstate makes it copy the shared keys, so the memory and key instance need to be looked up again.
+			uint8* const MutableDestinationValueMemory = GetMutableValueRawData(Destination, KeyID) + MemoryOffset;
+			UBlackboardKeyType* const MutableDestinationKey = bKeyHasInstance ? GetKeyInstance(AsConst(Destination), KeyID) : KeyType;
+			UBlackboardKeyTypeHelper::CopyValuesHelper(MutableDestinationKey, BlackboardComponent, MutableDestinationValueMemory, SourceKey, SourceValueMemory);
+			NotifyValueChanged(Destination, KeyID, Entry, MutableDestinationKey, MemoryOffset, MutableDestinationValueMemory);
+		}
+	}
+
 	template<typename ValueMemoryArrayType>
 	static const uint8* GetKeyRawDataConst(const ValueMemoryArrayType& ValueMemory, const UBlackboardComponent& Blackboard, FBlackboard::FKey KeyID)
 	{
@@ -286,44 +330,36 @@ private:
 		return nullptr;
 	}
 
-	FORCEINLINE static const TArray<uint8>& GetValueMemory(const UBlackboardComponent& BlackboardComponent)
-	{
-		return UBlackboardComponentHelper::GetValueMemory(BlackboardComponent);
-	}
-
-	FORCEINLINE static TArray<uint8>& GetValueMemory(UBlackboardComponent& BlackboardComponent)
-	{
-		return UBlackboardComponentHelper::GetValueMemory(BlackboardComponent);
-	}
-
-	FORCEINLINE static const auto& GetValueMemory(const FBlackboardWorldState& WorldState)
+	FORCEINLINE static const uint8* GetValueRawData(const UBlackboardComponent& BlackboardComponent, FBlackboard::FKey KeyID)
 	{
-		return WorldState.ValueMemory;
+		return GetKeyRawDataConst(UBlackboardComponentHelper::GetValueMemory(BlackboardComponent), BlackboardComponent, KeyID);
 	}
 
-	FORCEINLINE static auto& GetValueMemory(FBlackboardWorldState& WorldState)
+	FORCEINLINE static uint8* GetMutableValueRawData(UBlackboardComponent& BlackboardComponent, FBlackboard::FKey KeyID)
 	{
-		return WorldState.ValueMemory;
+		return GetKeyRawData(UBlackboardComponentHelper::GetValueMemory(BlackboardComponent), BlackboardComponent, KeyID);
 	}
 
-	FORCEINLINE static const TArray<UBlackboardKeyType*>& GetKeyInstances(const UBlackboardComponent& BlackboardComponent)
+	// Reads from the shared layer if the key is in it.
+	FORCEINLINE static const uint8* GetValueRawData(const FBlackboardWorldState& WorldState, FBlackboard::FKey KeyID)
 	{
-		return UBlackboardComponentHelper::GetKeyInstances(BlackboardComponent);
+		return WorldState.GetKeyRawData(KeyID);
 	}
 
-	FORCEINLINE static TArray<UBlackboardKeyType*>& GetKeyInstances(UBlackboardComponent& BlackboardComponent)
+	// Copies the shared keys into the worldstate if the key is in its shared layer.
+	FORCEINLINE static uint8* GetMutableValueRawData(FBlackboardWorldState& WorldState, FBlackboard::FKey KeyID)
 	{
-		return UBlackboardComponentHelper::GetKeyInstances(BlackboardComponent);
+		return WorldState.GetKeyRawData(KeyID);
 	}
 
-	FORCEINLINE static const TArray<UBlackboardKeyType*>& GetKeyInstances(const FBlackboardWorldState& WorldState)
+	FORCEINLINE static UBlackboardKeyType* GetKeyInstance(const UBlackboardComponent& BlackboardComponent, FBlackboard::FKey KeyID)
 	{
-		return WorldState.KeyInstances;
+		return UBlackboardComponentHelper::GetKeyInstances(BlackboardComponent)[KeyID];
 	}
 
-	FORCEINLINE static TArray<UBlackboardKeyType*>& GetKeyInstances(FBlackboardWorldState& WorldState)
+	FORCEINLINE static UBlackboardKeyType* GetKeyInstance(const FBlackboardWorldState& WorldState, FBlackboard::FKey KeyID)
 	{
-		return WorldState.KeyInstances;
+		return WorldState.GetKeyInstance(KeyID);
 	}
 
 	FORCEINLINE static void NotifyValueChanged(UBlackboardComponent& BlackboardComponent, FBlackboard::FKey KeyID, const FBlackboardEntry& Entry, UBlackboardKeyType* DestinationKey, uint16 MemoryOffset, const uint8* SourceValueMemory)
@@ -360,6 +396,21 @@ FBlackboardWorldState::FBlackboardWorldState(UBlackboardComponent& Blackboard) :
 	check(BlackboardAsset.IsValid());
 	
 	FBlackboardWorldStateImpl::InitializeKeys(*this, Blackboard);
+	FHTNPlanningStats::CountWorldStateCopy();
+}
+
+FBlackboardWorldState::FBlackboardWorldState(UBlackboardComponent& Blackboard, const TSharedRef<const FBlackboardWorldStateLayer>& InSharedLayer) :
+	BlackboardComponent(&Blackboard),
+	BlackboardAsset(Blackboard.GetBlackboardAsset()),
+	SharedLayer(InSharedLayer),
+	bIsInitialized(false)
+{
+	check(BlackboardComponent.IsValid());
+	check(BlackboardAsset.IsValid());
+	check(InSharedLayer->GetBlackboardAsset() == BlackboardAsset.Get());
+	
+	FBlackboardWorldStateImpl::InitializeKeys(*this, Blackboard);
+	FHTNPlanningStats::CountWorldStateCopy();
 }
 
 FBlackboardWorldState::~FBlackboardWorldState()
@@ -391,7 +442,9 @@ TSharedRef<FBlackboardWorldState> FBlackboardWorldState::MakeNext() const
 	const TSharedRef<FBlackboardWorldState> NextWorldstate = MakeShared<FBlackboardWorldState>();
 	NextWorldstate->BlackboardComponent = BlackboardComponent;
 	NextWorldstate->BlackboardAsset = BlackboardAsset;
+	NextWorldstate->SharedLayer = SharedLayer;
 	FBlackboardWorldStateImpl::InitializeKeys(*NextWorldstate, *this);
+	FHTNPlanningStats::CountWorldStateCopy();
 	
 	return NextWorldstate;
 }
@@ -490,6 +543,60 @@ bool FBlackboardWorldState::HasAnyKeyChanged() const
 	return false;
 }
 
+void FBlackboardWorldState::GetChangedKeys(TArray<FBlackboard::FKey>& OutKeys) const
+{
+	for (TConstSetBitIterator<> It(ChangedFlags); It; ++It)
+	{
+		OutKeys.Add(It.GetIndex());
+	}
+}
+
+void FBlackboardWorldState::SetChangedKeys(const TArray<FBlackboard::FKey>& KeyIDs)
+{
+	ChangedFlags.Reset();
+	for (const FBlackboard::FKey KeyID : KeyIDs)
+	{
+		SetKeyChanged(KeyID);
+	}
+}
+
+void FBlackboardWorldState::GetKeysWithDifferentValues(const FBlackboardWorldState& Other, TArray<FBlackboard::FKey>& OutKeys) const
+{
+	if (!ensure(IsCompatible(Other)))
+	{
+		return;
+	}
+
+	for (UBlackboardData* It = BlackboardAsset.Get(); It; It = It->Parent)
+	{
+		const FBlackboard::FKey FirstKeyIndex = It->GetFirstKeyID();
+		for (int32 I = 0; I < It->Keys.Num(); ++I)
+		{
+			const FBlackboard::FKey KeyID = FirstKeyIndex + I;
+			UBlackboardKeyType* const KeyType = It->Keys[I].KeyType;
+			if (!KeyType)
+			{
+				continue;
+			}
+
+			// Both worldstates read shared keys from the same memory.
+			if (SharedLayer.IsValid() && SharedLayer == Other.SharedLayer && SharedLayer->IsKeyShared(KeyID))
+			{
+				continue;
+			}
+
+			const bool bKeyHasInstance = KeyType->HasInstance();
+			const uint16 DataOffset = bKeyHasInstance ? sizeof(FBlackboardInstancedKeyMemory) : 0;
+			const UBlackboardKeyType* const Key = bKeyHasInstance ? GetKeyInstance(KeyID) : KeyType;
+			const UBlackboardKeyType* const OtherKey = bKeyHasInstance ? Other.GetKeyInstance(KeyID) : KeyType;
+			if (Key->CompareValues(*BlackboardComponent, GetKeyRawData(KeyID) + DataOffset, OtherKey, Other.GetKeyRawData(KeyID) + DataOffset) != EBlackboardCompare::Equal)
+			{
+				OutKeys.Add(KeyID);
+			}
+		}
+	}
+}
+
 void FBlackboardWorldState::SetKeyChanged(FBlackboard::FKey KeyID, bool bWasChanged)
 {
 	if (!ChangedFlags.IsValidIndex(KeyID))
@@ -509,6 +616,11 @@ bool FBlackboardWorldState::IsCompatible(const FBlackboardWorldState& Other) con
 
 void FBlackboardWorldState::DestroyValues()
 {
+	if (!bIsInitialized)
+	{
+		return;
+	}
+
 	if (!ensure(BlackboardComponent.IsValid() && BlackboardComponent->HasBeenInitialized()) || !ensure(BlackboardAsset.IsValid()))
 	{
 		return;
@@ -518,10 +630,11 @@ void FBlackboardWorldState::DestroyValues()
 	{
 		for (int32 KeyIndex = 0; KeyIndex < It->Keys.Num(); KeyIndex++)
 		{
-			if (UBlackboardKeyType* const KeyType = It->Keys[KeyIndex].KeyType)
+			UBlackboardKeyType* const KeyType = It->Keys[KeyIndex].KeyType;
+			const FBlackboard::FKey KeyID = KeyIndex + It->GetFirstKeyID();
+			if (KeyType && !IsKeyShared(KeyID))
 			{
-				const FBlackboard::FKey KeyID = KeyIndex + It->GetFirstKeyID();
-				uint8* const KeyValueRawMemory = GetKeyRawData(KeyID);
+				uint8* const KeyValueRawMemory = GetLocalKeyRawData(KeyID);
 				if (ensure(KeyValueRawMemory))
 				{
 					uint8* const KeyValueMemory = KeyType->HasInstance() ? 
@@ -540,6 +653,7 @@ void FBlackboardWorldState::DestroyValues()
 
 	ValueMemory.Reset();
 	KeyInstances.Reset();
+	bIsInitialized = false;
 }
 
 void FBlackboardWorldState::ClearValue(FBlackboard::FKey KeyID)
@@ -551,13 +665,11 @@ void FBlackboardWorldState::ClearValue(FBlackboard::FKey KeyID)
 	{
 		if (const UBlackboardKeyType* const KeyType = EntryInfo->KeyType)
 		{
-			if (uint8* const RawData = GetKeyRawData(KeyID))
+			const uint8* const RawData = AsConst(*this).GetKeyRawData(KeyID);
+			if (RawData && !KeyType->WrappedIsEmpty(*BlackboardComponent, RawData))
 			{
-				if (!KeyType->WrappedIsEmpty(*BlackboardComponent, RawData))
-				{
-					KeyType->WrappedClear(*BlackboardComponent, RawData);
-					SetKeyChanged(KeyID);
-				}
+				KeyType->WrappedClear(*BlackboardComponent, GetKeyRawData(KeyID));
+				SetKeyChanged(KeyID);
 			}
 		}
 	}
@@ -572,7 +684,7 @@ bool FBlackboardWorldState::TestBasicOperation(const UBlackboardKeyType& Key, FB
 	{
 		if (Key.HasInstance())
 		{
-			const UBlackboardKeyType* const KeyInstance = KeyInstances.IsValidIndex(KeyID) ? KeyInstances[KeyID] : nullptr;
+			const UBlackboardKeyType* const KeyInstance = KeyInstances.IsValidIndex(KeyID) ? GetKeyInstance(KeyID) : nullptr;
 			if (ensure(KeyInstance))
 			{
 				const uint8* KeyValueMemory = RawMemory + sizeof(FBlackboardInstancedKeyMemory);
@@ -598,7 +710,7 @@ bool FBlackboardWorldState::TestArithmeticOperation(const UBlackboardKeyType& Ke
 	{
 		if (Key.HasInstance())
 		{
-			const UBlackboardKeyType* const KeyInstance = KeyInstances.IsValidIndex(KeyID) ? KeyInstances[KeyID] : nullptr;
+			const UBlackboardKeyType* const KeyInstance = KeyInstances.IsValidIndex(KeyID) ? GetKeyInstance(KeyID) : nullptr;
 			if (ensure(KeyInstance))
 			{
 				const uint8* KeyValueMemory = RawMemory + sizeof(FBlackboardInstancedKeyMemory);
@@ -624,7 +736,7 @@ bool FBlackboardWorldState::TestTextOperation(const UBlackboardKeyType& Key, FBl
 	{
 		if (Key.HasInstance())
 		{
-			const UBlackboardKeyType* const KeyInstance = KeyInstances.IsValidIndex(KeyID) ? KeyInstances[KeyID] : nullptr;
+			const UBlackboardKeyType* const KeyInstance = KeyInstances.IsValidIndex(KeyID) ? GetKeyInstance(KeyID) : nullptr;
 			if (ensure(KeyInstance))
 			{
 				const uint8* KeyValueMemory = RawMemory + sizeof(FBlackboardInstancedKeyMemory);
@@ -650,15 +762,10 @@ bool FBlackboardWorldState::GetLocationFromEntry(FBlackboard::FKey KeyID, FVecto
 {
 	if (BlackboardComponent.IsValid() && BlackboardAsset.IsValid())
 	{
-		const TArray<uint16>& MemoryOffsets = UBlackboardComponentHelper::GetValueMemoryOffsets(*BlackboardComponent);
-		if (MemoryOffsets.IsValidIndex(KeyID))
+		const FBlackboardEntry* const EntryInfo = BlackboardAsset->GetKey(KeyID);
+		if (EntryInfo && EntryInfo->KeyType)
 		{
-			const FBlackboardEntry* const EntryInfo = BlackboardAsset->GetKey(KeyID);
-			if (EntryInfo && EntryInfo->KeyType)
-			{
-				const uint8* const ValueData = ValueMemory.GetData() + MemoryOffsets[KeyID];
-				return EntryInfo->KeyType->WrappedGetLocation(*BlackboardComponent, ValueData, ResultLocation);
-			}
+			return EntryInfo->KeyType->WrappedGetLocation(*BlackboardComponent, GetKeyRawData(KeyID), ResultLocation);
 		}
 	}
 
@@ -669,15 +776,10 @@ bool FBlackboardWorldState::GetRotationFromEntry(FBlackboard::FKey KeyID, FRotat
 {
 	if (BlackboardComponent.IsValid() && BlackboardAsset.IsValid())
 	{
-		const TArray<uint16>& MemoryOffsets = UBlackboardComponentHelper::GetValueMemoryOffsets(*BlackboardComponent);
-		if (MemoryOffsets.IsValidIndex(KeyID))
+		const FBlackboardEntry* const EntryInfo = BlackboardAsset->GetKey(KeyID);
+		if (EntryInfo && EntryInfo->KeyType)
 		{
-			const FBlackboardEntry* const EntryInfo = BlackboardAsset->GetKey(KeyID);
-			if (EntryInfo && EntryInfo->KeyType)
-			{
-				const uint8* const ValueData = ValueMemory.GetData() + MemoryOffsets[KeyID];
-				return EntryInfo->KeyType->WrappedGetRotation(*BlackboardComponent, ValueData, ResultRotation);
-			}
+			return EntryInfo->KeyType->WrappedGetRotation(*BlackboardComponent, GetKeyRawData(KeyID), ResultRotation);
 		}
 	}
 
@@ -685,10 +787,33 @@ bool FBlackboardWorldState::GetRotationFromEntry(FBlackboard::FKey KeyID, FRotat
 }
 
 uint8* FBlackboardWorldState::GetKeyRawData(FBlackboard::FKey KeyID)
+{
+	// The shared layer is read-only, so this worldstate needs its own copy of the key to modify it.
+	if (IsKeyShared(KeyID))
+	{
+		Flatten();
+	}
+
+	return GetLocalKeyRawData(KeyID);
+}
+
+const uint8* FBlackboardWorldState::GetKeyRawData(FBlackboard::FKey KeyID) const
+{
+	if (IsKeyShared(KeyID))
+	{
+		return SharedLayer->Values->GetKeyRawData(KeyID);
+	}
+
+	return const_cast<FBlackboardWorldState*>(this)->GetLocalKeyRawData(KeyID);
+}
+
+uint8* FBlackboardWorldState::GetLocalKeyRawData(FBlackboard::FKey KeyID)
 {
 	if (ValueMemory.Num())
 	{
-		const TArray<uint16>& MemoryOffsets = UBlackboardComponentHelper::GetValueMemoryOffsets(*BlackboardComponent);
+		const TArray<uint16>& MemoryOffsets = SharedLayer.IsValid() ? 
+			SharedLayer->LocalValueOffsets : 
+			UBlackboardComponentHelper::GetValueMemoryOffsets(*BlackboardComponent);
 		if (ensure(MemoryOffsets.Num()) && MemoryOffsets.IsValidIndex(KeyID))
 		{
 			check(ValueMemory.IsValidIndex(MemoryOffsets[KeyID]));
@@ -700,9 +825,41 @@ uint8* FBlackboardWorldState::GetKeyRawData(FBlackboard::FKey KeyID)
 	return nullptr;
 }
 
-const uint8* FBlackboardWorldState::GetKeyRawData(FBlackboard::FKey KeyID) const
+bool FBlackboardWorldState::IsKeyShared(FBlackboard::FKey KeyID) const
+{
+	return SharedLayer.IsValid() && SharedLayer->IsKeyShared(KeyID);
+}
+
+UBlackboardKeyType* FBlackboardWorldState::GetKeyInstance(FBlackboard::FKey KeyID) const
 {
-	return const_cast<FBlackboardWorldState*>(this)->GetKeyRawData(KeyID);
+	return IsKeyShared(KeyID) ? SharedLayer->Values->KeyInstances[KeyID] : KeyInstances[KeyID];
+}
+
+void FBlackboardWorldState::Flatten()
+{
+	if (!SharedLayer.IsValid())
+	{
+		return;
+	}
+
+	DECLARE_SCOPE_CYCLE_COUNTER(TEXT("FBlackboardWorldState::Flatten"), STAT_AI_HTN_WorldStateFlatten, STATGROUP_AI_HTN);
+
+	FBlackboardWorldState FlatWorldState;
+	FlatWorldState.BlackboardComponent = BlackboardComponent;
+	FlatWorldState.BlackboardAsset = BlackboardAsset;
+	FBlackboardWorldStateImpl::InitializeKeys(FlatWorldState, *this);
+	FHTNPlanningStats::CountWorldStateCopy();
+
+	DestroyValues();
+	SharedLayer.Reset();
+	ValueMemory = MoveTemp(FlatWorldState.ValueMemory);
+	KeyInstances = MoveTemp(FlatWorldState.KeyInstances);
+	bIsInitialized = true;
+	
+	// The values now belong to this worldstate.
+	FlatWorldState.ValueMemory.Reset();
+	FlatWorldState.KeyInstances.Reset();
+	FlatWorldState.bIsInitialized = false;
 }
 
 FVector FBlackboardWorldState::GetLocation(const FBlackboardKeySelector& KeySelector, AActor** OutActor) const
@@ -732,3 +889,124 @@ FVector FBlackboardWorldState::GetLocation(const FBlackboardKeySelector& KeySele
 
 	return FAISystem::InvalidLocation;
 }
+
+namespace
+{
+	// Layers made for a SharedWorldStateGroup of blackboards with the same asset in the same world.
+	struct FSharedLayerGroup
+	{
+		// The layer given to new worldstates. Remade when the values of the shared keys change.
+		TSharedPtr<FBlackboardWorldStateLayer> CurrentLayer;
+
+		// All layers of this group that might still be used by worldstates, including the current one.
+		TArray<TWeakPtr<FBlackboardWorldStateLayer>> Layers;
+
+		// Blackboards that got layers of this group.
+		TArray<TWeakObjectPtr<UBlackboardComponent>> Members;
+	};
+
+	using FSharedLayerGroupKey = TTuple<FName, TWeakObjectPtr<UBlackboardData>, TWeakObjectPtr<UWorld>>;
+	TMap<FSharedLayerGroupKey, FSharedLayerGroup> SharedLayerGroups;
+}
+
+FBlackboardWorldStateLayer::FBlackboardWorldStateLayer(UBlackboardComponent& Blackboard, const TBitArray<>& InSharedKeys) :
+	Values(MakeShared<FBlackboardWorldState>(Blackboard)),
+	SharedKeys(InSharedKeys),
+	LocalValueMemorySize(0)
+{
+	check(Blackboard.GetBlackboardAsset());
+	LocalValueMemorySize = FBlackboardWorldStateImpl::MakeLocalValueOffsets(*Blackboard.GetBlackboardAsset(), SharedKeys, LocalValueOffsets);
+}
+
+TSharedPtr<const FBlackboardWorldStateLayer> FBlackboardWorldStateLayer::GetShared(FName Group, UBlackboardComponent& Blackboard)
+{
+	UBlackboardData* const BlackboardAsset = Blackboard.GetBlackboardAsset();
+	if (Group.IsNone() || !BlackboardAsset || !BlackboardAsset->HasSynchronizedKeys() || !Blackboard.HasBeenInitialized())
+	{
+		return nullptr;
+	}
+
+	FSharedLayerGroup& LayerGroup = SharedLayerGroups.FindOrAdd(FSharedLayerGroupKey(Group, BlackboardAsset, Blackboard.GetWorld()));
+	LayerGroup.Members.AddUnique(&Blackboard);
+
+	const bool bIsLayerUpToDate = LayerGroup.CurrentLayer.IsValid() && 
+		LayerGroup.CurrentLayer->Values->BlackboardComponent.IsValid() && 
+		LayerGroup.CurrentLayer->HasSameValues(Blackboard);
+	if (!bIsLayerUpToDate)
+	{
+		DECLARE_SCOPE_CYCLE_COUNTER(TEXT("FBlackboardWorldStateLayer::MakeShared"), STAT_AI_HTN_WorldStateMakeSharedLayer, STATGROUP_AI_HTN);
+
+		TBitArray<> SharedKeys(false, BlackboardAsset->GetNumKeys());
+		for (UBlackboardData* It = BlackboardAsset; It; It = It->Parent)
+		{
+			for (int32 KeyIndex = 0; KeyIndex < It->Keys.Num(); ++KeyIndex)
+			{
+				const FBlackboardEntry& Entry = It->Keys[KeyIndex];
+				if (Entry.KeyType && Entry.bInstanceSynced)
+				{
+					SharedKeys[KeyIndex + It->GetFirstKeyID()] = true;
+				}
+			}
+		}
+
+		LayerGroup.CurrentLayer = MakeShared<FBlackboardWorldStateLayer>(Blackboard, SharedKeys);
+		LayerGroup.Layers.RemoveAll([](const TWeakPtr<FBlackboardWorldStateLayer>& Layer) { return !Layer.IsValid(); });
+		LayerGroup.Layers.Add(LayerGroup.CurrentLayer);
+	}
+
+	return LayerGroup.CurrentLayer;
+}
+
+void FBlackboardWorldStateLayer::ReleaseShared(UBlackboardComponent& Blackboard)
+{
+	for (auto GroupIt = SharedLayerGroups.CreateIterator(); GroupIt; ++GroupIt)
+	{
+		const UBlackboardData* const GroupBlackboardAsset = GroupIt.Key().Get<1>().Get();
+		FSharedLayerGroup& LayerGroup = GroupIt.Value();
+		LayerGroup.Members.RemoveAll([&](const TWeakObjectPtr<UBlackboardComponent>& Member)
+		{
+			return !Member.IsValid() || Member.Get() == &Blackboard || !Member->HasBeenInitialized() || Member->GetBlackboardAsset() != GroupBlackboardAsset;
+		});
+
+		for (const TWeakPtr<FBlackboardWorldStateLayer>& WeakLayer : LayerGroup.Layers)
+		{
+			const TSharedPtr<FBlackboardWorldStateLayer> Layer = WeakLayer.Pin();
+			if (Layer.IsValid() && Layer->Values->BlackboardComponent == &Blackboard && LayerGroup.Members.Num())
+			{
+				Layer->SetBlackboardComponent(*LayerGroup.Members[0]);
+			}
+		}
+
+		if (!LayerGroup.Members.Num())
+		{
+			GroupIt.RemoveCurrent();
+		}
+	}
+}
+
+bool FBlackboardWorldStateLayer::HasSameValues(const UBlackboardComponent& Blackboard) const
+{
+	UBlackboardData* const BlackboardAsset = GetBlackboardAsset();
+	if (!BlackboardAsset || Blackboard.GetBlackboardAsset() != BlackboardAsset)
+	{
+		return false;
+	}
+
+	for (TConstSetBitIterator<> It(SharedKeys); It; ++It)
+	{
+		const FBlackboard::FKey KeyID = It.GetIndex();
+		const FBlackboardEntry* const Entry = BlackboardAsset->GetKey(KeyID);
+		if (Entry && Entry->KeyType && !FBlackboardWorldStateImpl::HasSameValue(*Values, Blackboard, KeyID, *Entry->KeyType))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void FBlackboardWorldStateLayer::SetBlackboardComponent(UBlackboardComponent& Blackboard)
+{
+	check(Blackboard.GetBlackboardAsset() == GetBlackboardAsset());
+	Values->BlackboardComponent = &Blackboard;
+}
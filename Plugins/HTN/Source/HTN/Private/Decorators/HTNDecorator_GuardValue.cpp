@@ -121,3 +121,13 @@ bool UHTNDecorator_GuardValue::RestoreWorldstateValue(UHTNComponent& OwnerComp,
 	);
 	return false;
 }
+
+bool UHTNDecorator_GuardValue::GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const
+{
+	if (bSetValueOnEnterPlan || bRestoreValueOnExitPlan)
+	{
+		OutKeyNames.Add(BlackboardKey.SelectedKeyName);
+	}
+
+	return true;
+}
@@ -3,9 +3,11 @@
 #include "Decorators/HTNDecorator_TraceTest.h"
 
 #include "AIController.h"
+#include "Algo/AnyOf.h"
 #include "Engine/World.h"
 #include "VisualLogger/VisualLogger.h"
 
+#include "AITask_MakeHTNPlan.h"
 #include "WorldStateProxy.h"
 
 UHTNDecorator_TraceTest::UHTNDecorator_TraceTest(const FObjectInitializer& Initializer) : Super(Initializer),
@@ -17,6 +19,9 @@ UHTNDecorator_TraceTest::UHTNDecorator_TraceTest(const FObjectInitializer& Initi
 	TraceExtentX(0.0f),
 	TraceExtentY(0.0f),
 	TraceExtentZ(0.0f),
+	bUseAsyncTraceDuringExecution(false),
+	RecheckInterval(0.0f),
+	bCacheResultsDuringPlanning(true),
 	DrawDebugType(EDrawDebugTrace::None),
 	DebugColor(FLinearColor::Red),
 	DebugHitColor(FLinearColor::Green),
@@ -48,13 +53,33 @@ FString UHTNDecorator_TraceTest::GetStaticDescription() const
 	static const UEnum* const TraceShapeEnum = StaticEnum<EEnvTraceShape::Type>();
 	static const UEnum* const CollisionChannelEnum = StaticEnum<ECollisionChannel>();
 	
-	return FString::Printf(TEXT("%s: %s trace\nfrom %s to %s\non %s\nMust %s"), 
+	FString Description = FString::Printf(TEXT("%s: %s trace\nfrom %s to %s\non %s\nMust %s"), 
 		*Super::GetStaticDescription(),
 		*TraceShapeEnum->GetDisplayNameTextByValue(TraceShape.GetValue()).ToString(),
 		*TraceFrom.SelectedKeyName.ToString(), *TraceTo.SelectedKeyName.ToString(),
 		*CollisionChannelEnum->GetDisplayNameTextByValue(CollisionChannel.GetValue()).ToString(),
 		IsInversed() ? TEXT("not hit") : TEXT("hit")
 	);
+
+	if (bUseAsyncTraceDuringExecution)
+	{
+		Description += TEXT("\n(async during execution)");
+	}
+
+	if (RecheckInterval > 0.0f)
+	{
+		Description += FString::Printf(TEXT("\n(retrace at most every %.2fs)"), RecheckInterval);
+	}
+
+	return Description;
+}
+
+uint16 UHTNDecorator_TraceTest::GetInstanceMemorySize() const { return sizeof(FNodeMemory); }
+
+void UHTNDecorator_TraceTest::InitializeMemory(UHTNComponent& OwnerComp, uint8* NodeMemory, const FHTNPlan& Plan, const FHTNPlanStepID& StepID) const
+{
+	FNodeMemory* const Memory = CastInstanceNodeMemory<FNodeMemory>(NodeMemory);
+	*Memory = {};
 }
 
 bool UHTNDecorator_TraceTest::CalculateRawConditionValue(UHTNComponent& OwnerComp, uint8* NodeMemory, EHTNDecoratorConditionCheckType CheckType) const
@@ -81,9 +106,90 @@ bool UHTNDecorator_TraceTest::CalculateRawConditionValue(UHTNComponent& OwnerCom
 
 	const FVector StartLocation = TraceFromRawPosition + FVector(0.0f, 0.0f, TraceFromZOffset);
 	const FVector EndLocation = TraceToRawPosition + FVector(0.0f, 0.0f, TraceToZOffset);
+	FillActorsToIgnoreBuffer(OwnerComp, TraceFromActor, TraceToActor);
+
+	// Node memory is only available once the plan is executing.
+	const bool bHit = NodeMemory ?
+		GetExecutionTimeTraceResult(OwnerComp, NodeMemory, CheckType, StartLocation, EndLocation) :
+		GetPlanTimeTraceResult(OwnerComp, StartLocation, EndLocation, TraceFromActor, TraceToActor);
+
+	UE_VLOG_ARROW(OwnerComp.GetOwner(), LogHTN, Verbose, 
+		StartLocation, EndLocation, 
+		bHit ? DebugHitColor.ToFColor(/*sRGB=*/true) : DebugColor.ToFColor(/*sRGB=*/true), TEXT("HTNDecorator_TraceTest")
+	);
+	return bHit;
+}
+
+bool UHTNDecorator_TraceTest::GetPlanTimeTraceResult(UHTNComponent& OwnerComp, const FVector& StartLocation, const FVector& EndLocation, AActor* TraceFromActor, AActor* TraceToActor) const
+{
+	UAITask_MakeHTNPlan* const PlanningTask = OwnerComp.GetCurrentPlanningTask();
+	if (!bCacheResultsDuringPlanning || !PlanningTask)
+	{
+		return Trace(OwnerComp, StartLocation, EndLocation);
+	}
+
+	FPlanTimeTraceCache& Cache = PlanningTask->GetNodePlanningCache<FPlanTimeTraceCache>(*this);
+	const FPlanTimeTraceKey Key { StartLocation, EndLocation, TraceFromActor, TraceToActor };
+	if (const bool* const CachedResult = Cache.Results.Find(Key))
+	{
+		return *CachedResult;
+	}
+
+	const bool bHit = Trace(OwnerComp, StartLocation, EndLocation);
+	Cache.Results.Add(Key, bHit);
+	return bHit;
+}
+
+bool UHTNDecorator_TraceTest::GetExecutionTimeTraceResult(UHTNComponent& OwnerComp, uint8* NodeMemory, EHTNDecoratorConditionCheckType CheckType, 
+	const FVector& StartLocation, const FVector& EndLocation) const
+{
+	FNodeMemory* const Memory = CastInstanceNodeMemory<FNodeMemory>(NodeMemory);
+	FTraceState& State = CheckType == EHTNDecoratorConditionCheckType::Execution ? Memory->ExecutionState : Memory->RecheckState;
+	
+	UWorld* const World = OwnerComp.GetWorld();
+	const float CurrentTime = World ? World->GetTimeSeconds() : 0.0f;
+
+	// Collect the result of the pending async trace, if it's done.
+	if (State.PendingTraceHandle.IsValid() && World)
+	{
+		FTraceDatum TraceDatum;
+		if (World->QueryTraceData(State.PendingTraceHandle, TraceDatum))
+		{
+			State.bLastResult = Algo::AnyOf(TraceDatum.OutHits, [](const FHitResult& Hit) { return Hit.bBlockingHit; });
+			State.bHasResult = true;
+			State.PendingTraceHandle = FTraceHandle();
+		}
+		else if (!World->IsTraceHandleValid(State.PendingTraceHandle, /*bOverlapTrace=*/false))
+		{
+			// The results of async traces are only kept for one frame. If we missed it, start a new one.
+			State.PendingTraceHandle = FTraceHandle();
+		}
+	}
+
+	const bool bCanStartNewTrace = !State.bHasResult || CurrentTime - State.LastTraceTime >= RecheckInterval;
+	if (!bCanStartNewTrace || State.PendingTraceHandle.IsValid())
+	{
+		return State.bLastResult;
+	}
+
+	// Without a previous result to fall back on, trace synchronously so that the condition is never based on a guess.
+	if (!bUseAsyncTraceDuringExecution || !State.bHasResult || !World)
+	{
+		State.bLastResult = Trace(OwnerComp, StartLocation, EndLocation);
+		State.bHasResult = true;
+		State.LastTraceTime = CurrentTime;
+		return State.bLastResult;
+	}
+
+	State.PendingTraceHandle = StartAsyncTrace(OwnerComp, StartLocation, EndLocation);
+	State.LastTraceTime = CurrentTime;
+	return State.bLastResult;
+}
+
+bool UHTNDecorator_TraceTest::Trace(UHTNComponent& OwnerComp, const FVector& StartLocation, const FVector& EndLocation) const
+{
 	const ETraceTypeQuery TraceTypeQuery = UEngineTypes::ConvertToTraceType(CollisionChannel);
 	const FVector Extent(TraceExtentX, TraceExtentY, TraceExtentZ);
-	FillActorsToIgnoreBuffer(OwnerComp, TraceFromActor, TraceToActor);
 
 	FHitResult Hit;
 	bool bHit = false;
@@ -128,13 +234,48 @@ bool UHTNDecorator_TraceTest::CalculateRawConditionValue(UHTNComponent& OwnerCom
 		break;
 	}
 
-	UE_VLOG_ARROW(OwnerComp.GetOwner(), LogHTN, Verbose, 
-		StartLocation, EndLocation, 
-		bHit ? DebugHitColor.ToFColor(/*sRGB=*/true) : DebugColor.ToFColor(/*sRGB=*/true), TEXT("HTNDecorator_TraceTest")
-	);
 	return bHit;
 }
 
+FTraceHandle UHTNDecorator_TraceTest::StartAsyncTrace(UHTNComponent& OwnerComp, const FVector& StartLocation, const FVector& EndLocation) const
+{
+	UWorld* const World = OwnerComp.GetWorld();
+	if (!ensure(World))
+	{
+		return FTraceHandle();
+	}
+
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(HTNDecoratorTraceTest), bUseComplexCollision);
+	QueryParams.AddIgnoredActors(ActorsToIgnoreBuffer);
+
+	if (TraceShape == EEnvTraceShape::Line)
+	{
+		return World->AsyncLineTraceByChannel(EAsyncTraceType::Single, StartLocation, EndLocation, CollisionChannel, QueryParams);
+	}
+
+	FCollisionShape CollisionShape;
+	switch (TraceShape)
+	{
+	case EEnvTraceShape::Box:
+		CollisionShape = FCollisionShape::MakeBox(FVector(TraceExtentX, TraceExtentY, TraceExtentZ));
+		break;
+
+	case EEnvTraceShape::Sphere:
+		CollisionShape = FCollisionShape::MakeSphere(TraceExtentX);
+		break;
+
+	case EEnvTraceShape::Capsule:
+		CollisionShape = FCollisionShape::MakeCapsule(TraceExtentX, TraceExtentZ);
+		break;
+
+	default:
+		return FTraceHandle();
+	}
+
+	const FQuat Rotation = (EndLocation - StartLocation).Rotation().Quaternion();
+	return World->AsyncSweepByChannel(EAsyncTraceType::Single, StartLocation, EndLocation, Rotation, CollisionChannel, CollisionShape, QueryParams);
+}
+
 void UHTNDecorator_TraceTest::FillActorsToIgnoreBuffer(UHTNComponent& OwnerComp, AActor* TraceFromActor, AActor* TraceToActor) const
 {
 	ActorsToIgnoreBuffer.Reset();
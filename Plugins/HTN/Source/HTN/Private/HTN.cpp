@@ -0,0 +1,30 @@
+// Copyright 2020-2021 Maksym Maisak. All Rights Reserved.
+
+#include "HTN.h"
+
+#if WITH_EDITOR
+uint32 UHTN::CurrentStaticAnalysisVersion = 1;
+
+void UHTN::InvalidateStaticAnalyses()
+{
+	++CurrentStaticAnalysisVersion;
+}
+#endif
+
+const FHTNStaticAnalysis& UHTN::GetStaticAnalysis() const
+{
+#if WITH_EDITOR
+	if (StaticAnalysisVersion != CurrentStaticAnalysisVersion)
+	{
+		StaticAnalysis.Reset();
+		StaticAnalysisVersion = CurrentStaticAnalysisVersion;
+	}
+#endif
+
+	if (!StaticAnalysis.IsValid())
+	{
+		StaticAnalysis = FHTNStaticAnalysis::Analyze(*this);
+	}
+
+	return *StaticAnalysis;
+}
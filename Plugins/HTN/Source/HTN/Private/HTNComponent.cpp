@@ -7,6 +7,7 @@
 #include "AIController.h"
 #include "BehaviorTree/Blackboard/BlackboardKeyType_Vector.h"
 #include "GameplayTasksComponent.h"
+#include "HAL/IConsoleManager.h"
 #include "Misc/ScopeExit.h"
 #include "Misc/RuntimeErrors.h"
 #include "ProfilingDebugging/CsvProfiler.h"
@@ -19,6 +20,7 @@
 #include "HTNDecorator.h"
 #include "HTNDelegates.h"
 #include "HTNService.h"
+#include "HTNSquad.h"
 #include "Nodes/HTNNode_SubNetwork.h"
 #include "Nodes/HTNNode_Parallel.h"
 #include "Nodes/HTNNode_SubNetworkDynamic.h"
@@ -33,38 +35,154 @@ DEFINE_STAT(STAT_AI_HTN_NodeInstantiation);
 DEFINE_STAT(STAT_AI_HTN_NumProducedPlans);
 DEFINE_STAT(STAT_AI_HTN_NumNodeInstances);
 
+CSV_DEFINE_CATEGORY(HTN, true);
+
 #if USE_HTN_DEBUGGER
 TArray<TWeakObjectPtr<UHTNComponent>> UHTNComponent::PlayingComponents;
+TWeakObjectPtr<const UHTNComponent> UHTNComponent::DebuggedComponent;
+
+namespace
+{
+	int32 GHTNDebuggerRecordOnlyDebuggedAgent = 0;
+	FAutoConsoleVariableRef CVarHTNDebuggerRecordOnlyDebuggedAgent(
+		TEXT("ai.htn.debugger.RecordOnlyDebuggedAgent"),
+		GHTNDebuggerRecordOnlyDebuggedAgent,
+		TEXT("If nonzero, only the agent selected in the HTN debugger records execution steps for it. Saves memory when there are many agents."),
+		ECVF_Default
+	);
+}
 #endif
 
-FHTNDebugExecutionStep& FHTNDebugSteps::Add_GetRef()
+namespace
+{
+	// The step ID pool of FHTNDebugSteps has room for this many IDs per step. Only a few steps are usually executing at the same time.
+	constexpr int32 DebugStepIDPoolSizePerStep = 4;
+}
+
+FHTNDebugSteps::FHTNDebugSteps() :
+	NextStepIDPoolIndex(0),
+	Capacity(100),
+	StartArrayIndex(0),
+	NumSteps(0),
+	NextDebugStepIndex(0)
+{}
+
+FHTNDebugExecutionStep& FHTNDebugSteps::Add_GetRef(TArrayView<const FHTNPlanStepID> ActivePlanStepIDs)
 {
-	if (Steps.Num() >= 100)
+	check(Capacity > 0);
+	if (NumSteps == Capacity)
+	{
+		RemoveOldest();
+	}
+
+	const int32 PoolSize = Capacity * DebugStepIDPoolSizePerStep;
+	if (StepIDPool.Num() != PoolSize)
+	{
+		StepIDPool.SetNumUninitialized(PoolSize);
+	}
+
+	// Keep the IDs of the step contiguous.
+	const int32 NumIDs = FMath::Min(ActivePlanStepIDs.Num(), PoolSize);
+	if (NextStepIDPoolIndex + NumIDs > PoolSize)
+	{
+		NextStepIDPoolIndex = 0;
+	}
+
+	// Remove the steps whose IDs are about to be overwritten. 
+	// Since the pool is written in order, they are always the oldest steps that have IDs.
+	if (NumIDs)
+	{
+		while (NumSteps)
+		{
+			int32 Offset = 0;
+			while (Offset < NumSteps && Steps[(StartArrayIndex + Offset) % Capacity].NumActivePlanStepIDs == 0)
+			{
+				++Offset;
+			}
+
+			if (Offset == NumSteps)
+			{
+				break;
+			}
+
+			const FHTNDebugExecutionStep& OldestStepWithIDs = Steps[(StartArrayIndex + Offset) % Capacity];
+			const bool bIsOverwritten = OldestStepWithIDs.ActivePlanStepIDsStart < NextStepIDPoolIndex + NumIDs &&
+				NextStepIDPoolIndex < OldestStepWithIDs.ActivePlanStepIDsStart + OldestStepWithIDs.NumActivePlanStepIDs;
+			if (!bIsOverwritten)
+			{
+				break;
+			}
+
+			for (int32 I = 0; I <= Offset; ++I)
+			{
+				RemoveOldest();
+			}
+		}
+	}
+
+	const int32 ArrayIndex = (StartArrayIndex + NumSteps) % Capacity;
+	if (ArrayIndex == Steps.Num())
 	{
-		Steps.RemoveAt(0, 1, false);
+		Steps.AddDefaulted();
 	}
+	++NumSteps;
 
-	const int32 Index = GetLastIndex() + 1;
-	FHTNDebugExecutionStep& DebugStep = Steps.AddDefaulted_GetRef();
-	DebugStep.DebugStepIndex = Index;
+	FHTNDebugExecutionStep& DebugStep = Steps[ArrayIndex];
+	DebugStep.DebugStepIndex = NextDebugStepIndex++;
+	DebugStep.ActivePlanStepIDsStart = NextStepIDPoolIndex;
+	DebugStep.NumActivePlanStepIDs = NumIDs;
+	FMemory::Memcpy(StepIDPool.GetData() + NextStepIDPoolIndex, ActivePlanStepIDs.GetData(), NumIDs * sizeof(FHTNPlanStepID));
+	NextStepIDPoolIndex += NumIDs;
+	
 	return DebugStep;
 }
 
+TArrayView<const FHTNPlanStepID> FHTNDebugSteps::GetActivePlanStepIDs(const FHTNDebugExecutionStep& Step) const
+{
+	return MakeArrayView(StepIDPool.GetData() + Step.ActivePlanStepIDsStart, Step.NumActivePlanStepIDs);
+}
+
 void FHTNDebugSteps::Reset()
 {
 	Steps.Reset();
+	StartArrayIndex = 0;
+	NumSteps = 0;
+	NextStepIDPoolIndex = 0;
+	NextDebugStepIndex = 0;
+}
+
+void FHTNDebugSteps::SetCapacity(int32 NewCapacity)
+{
+	NewCapacity = FMath::Max(NewCapacity, 1);
+	if (NewCapacity != Capacity)
+	{
+		Capacity = NewCapacity;
+		Reset();
+		Steps.Shrink();
+		StepIDPool.Empty();
+	}
+}
+
+void FHTNDebugSteps::RemoveOldest()
+{
+	check(NumSteps > 0);
+
+	// Release the plan and blackboard descriptions right away, the memory of the step is reused by a later one.
+	FHTNDebugExecutionStep& DebugStep = Steps[StartArrayIndex];
+	DebugStep.HTNPlan.Reset();
+	DebugStep.BlackboardValues.Reset();
+	DebugStep.NumActivePlanStepIDs = 0;
+
+	StartArrayIndex = (StartArrayIndex + 1) % Capacity;
+	--NumSteps;
 }
 
 const FHTNDebugExecutionStep* FHTNDebugSteps::GetByIndex(int32 Index) const
 {
-	if (Steps.Num())
+	const int32 Offset = Index - GetFirstIndex();
+	if (NumSteps && Offset >= 0 && Offset < NumSteps)
 	{
-		const int32 FirstIndex = Steps[0].DebugStepIndex;
-		const int32 ArrayIndex = Index - FirstIndex;
-		if (Steps.IsValidIndex(ArrayIndex))
-		{
-			return &Steps[ArrayIndex];
-		}
+		return &Steps[(StartArrayIndex + Offset) % Capacity];
 	}
 	
 	return nullptr;
@@ -72,22 +190,17 @@ const FHTNDebugExecutionStep* FHTNDebugSteps::GetByIndex(int32 Index) const
 
 FHTNDebugExecutionStep* FHTNDebugSteps::GetByIndex(int32 Index)
 {
-	if (Steps.Num())
-	{
-		const int32 FirstIndex = Steps[0].DebugStepIndex;
-		const int32 ArrayIndex = Index - FirstIndex;
-		if (Steps.IsValidIndex(ArrayIndex))
-		{
-			return &Steps[ArrayIndex];
-		}
-	}
+	return const_cast<FHTNDebugExecutionStep*>(static_cast<const FHTNDebugSteps*>(this)->GetByIndex(Index));
+}
 
-	return nullptr;
+int32 FHTNDebugSteps::GetFirstIndex() const
+{
+	return NumSteps ? Steps[StartArrayIndex].DebugStepIndex : INDEX_NONE;
 }
 
 int32 FHTNDebugSteps::GetLastIndex() const
 {
-	return Steps.Num() ? Steps.Last().DebugStepIndex : INDEX_NONE;
+	return NumSteps ? Steps[(StartArrayIndex + NumSteps - 1) % Capacity].DebugStepIndex : INDEX_NONE;
 }
 
 struct FHTNComponentScopedLock : FNoncopyable
@@ -123,7 +236,11 @@ UHTNComponent::UHTNComponent(const FObjectInitializer& ObjectInitializer) : Supe
 	bAbortingToStopHTN(false),
 	bDeferredStartPlanningTask(false),
 	CurrentHTNAsset(nullptr),
-	CurrentPlanningTask(nullptr)
+	CurrentPlanningTask(nullptr),
+	Squad(nullptr)
+#if WITH_EDITORONLY_DATA
+	, MaxDebuggerSteps(100)
+#endif
 {
 	bAutoActivate = true;
 	bWantsInitializeComponent = true;
@@ -211,6 +328,7 @@ void UHTNComponent::BeginPlay()
 
 #if USE_HTN_DEBUGGER
 	PlayingComponents.AddUnique(this);
+	DebuggerSteps.SetCapacity(MaxDebuggerSteps);
 #endif
 }
 
@@ -219,6 +337,11 @@ void UHTNComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
 	// Cleanup and remove worldstates before the blackboard component they reference gets uninitialized
 	Cleanup();
 
+	if (Squad)
+	{
+		Squad->RemoveMember(this);
+	}
+
 #if USE_HTN_DEBUGGER
 	PlayingComponents.Remove(this);
 #endif
@@ -256,6 +379,10 @@ void UHTNComponent::Cleanup()
 
 	CancelActivePlanning();
 	SetPlanningWorldState(nullptr);
+	if (BlackboardComp)
+	{
+		FBlackboardWorldStateLayer::ReleaseShared(*BlackboardComp);
+	}
 	
 	// End gameplay tasks
 	if (AIOwner)
@@ -479,6 +606,7 @@ void UHTNComponent::StopHTN(bool bDisregardLatentAbort)
 		SetPlanningWorldState(nullptr);
 		CurrentHTNAsset = nullptr;
 		CooldownOwnerToEndTimeMap.Reset();
+		PersistentNodeCaches.Reset();
 	}
 
 	if (IsWaitingForAbortingTasks())
@@ -538,6 +666,30 @@ void UHTNComponent::SetPlanningWorldState(TSharedPtr<FBlackboardWorldState> Worl
 	PlanningWorldStateProxy->bIsEditable = bIsEditable;
 }
 
+TSharedRef<FBlackboardWorldState> UHTNComponent::MakeBlackboardWorldState() const
+{
+	check(BlackboardComp);
+	
+	if (const TSharedPtr<const FBlackboardWorldStateLayer> SharedLayer = FBlackboardWorldStateLayer::GetShared(SharedWorldStateGroup, *BlackboardComp))
+	{
+		return MakeShared<FBlackboardWorldState>(*BlackboardComp, SharedLayer.ToSharedRef());
+	}
+
+	return MakeShared<FBlackboardWorldState>(*BlackboardComp);
+}
+
+void UHTNComponent::SetSharedWorldStateGroup(FName Group)
+{
+	if (Group != SharedWorldStateGroup)
+	{
+		if (BlackboardComp)
+		{
+			FBlackboardWorldStateLayer::ReleaseShared(*BlackboardComp);
+		}
+		SharedWorldStateGroup = Group;
+	}
+}
+
 float UHTNComponent::GetCooldownEndTime(const UObject* CooldownOwner) const
 {
 	const float* const CooldownEndTime = CooldownOwnerToEndTimeMap.Find(CooldownOwner);
@@ -698,6 +850,7 @@ void UHTNComponent::DescribeSelfToVisLog(FVisualLogEntry* Snapshot) const
 void UHTNComponent::StartPendingHTN()
 {
 	CooldownOwnerToEndTimeMap.Reset();
+	PersistentNodeCaches.Reset();
 	
 	CurrentHTNAsset = PendingHTNStartInfo.NewAsset.Get();
 	PendingHTNStartInfo = {};
@@ -707,6 +860,8 @@ void UHTNComponent::StartPendingHTN()
 		if (EnsureCompatibleBlackboardAsset(CurrentHTNAsset->BlackboardAsset))
 		{
 			check(!CurrentPlan.IsValid());
+			// Analyze the HTN and its subnetworks up front rather than during the first planning.
+			CurrentHTNAsset->GetStaticAnalysis();
 			StartPlanningTask();
 		}
 		else
@@ -754,6 +909,10 @@ void UHTNComponent::DeleteAllWorldStates()
 
 	CancelActivePlanning();
 	SetPlanningWorldState(nullptr);
+	if (BlackboardComp)
+	{
+		FBlackboardWorldStateLayer::ReleaseShared(*BlackboardComp);
+	}
 	
 #if USE_HTN_DEBUGGER
 	DebuggerSteps.Reset();
@@ -788,17 +947,20 @@ void UHTNComponent::OnPlanningTaskFinished()
 {
 	check(CurrentPlanningTask);
 
+	LastPlanningStats = CurrentPlanningTask->GetPlanningStats();
 	if (CurrentPlanningTask->WasCancelled())
 	{
 		UE_VLOG(GetOwner(), LogHTN, Log, TEXT("planning task was cancelled"));
 		CurrentPlanningTask->Clear();
 		CurrentPlanningTask = nullptr;
+		NotifyOnPlanningFinished(nullptr);
 		return;
 	}
 	
 	const TSharedPtr<FHTNPlan> ProducedPlan = CurrentPlanningTask->GetFinishedPlan();
 	CurrentPlanningTask->Clear();
 	CurrentPlanningTask = nullptr;
+	NotifyOnPlanningFinished(ProducedPlan);
 
 	if (CurrentPlan.IsValid())
 	{
@@ -1207,7 +1369,7 @@ void UHTNComponent::StartTasksPendingExecution()
 		// Store debug steps of entering the plan steps that contain this level
 		for (int32 StepIndex = EnteringStepIDs.Num() - 1; StepIndex >= 0; --StepIndex)
 		{
-			StoreDebugStep().ActivePlanStepIDs.Add(EnteringStepIDs[StepIndex]);
+			StoreDebugStep(/*bIsEmpty=*/false, EnteringStepIDs[StepIndex]);
 		}
 #endif
 
@@ -1286,7 +1448,7 @@ bool UHTNComponent::RecheckCurrentPlan()
 	TArray<FRecheckContext> RecheckStack;
 	Algo::Transform(CurrentlyExecutingStepIDs, RecheckStack, [&](const FHTNPlanStepID& StepID) -> FRecheckContext
 	{
-		return { MakeShared<FBlackboardWorldState>(*BlackboardComp), StepID };
+		return { MakeBlackboardWorldState(), StepID };
 	});
 	// Make sure that the step on the most primary branch is first, i.e. on the bottom of the stack.
 	Algo::SortBy(RecheckStack, [&](const FRecheckContext& RecheckContext)
@@ -1589,6 +1751,7 @@ void UHTNComponent::OnPlanAbortFinished()
 		SetPlanningWorldState(nullptr);
 		CurrentHTNAsset = nullptr;
 		CooldownOwnerToEndTimeMap.Reset();
+		PersistentNodeCaches.Reset();
 	}
 
 	NotifyOnPlanExecutionFinished(EHTNPlanExecutionFinishedResult::FailedOrAborted);
@@ -1780,6 +1943,24 @@ UHTNTask& UHTNComponent::GetTaskInCurrentPlan(const FHTNPlanStepID& ExecutingSte
 	return *ExecutingTask;
 }
 
+void UHTNComponent::NotifyOnPlanningFinished(const TSharedPtr<FHTNPlan>& ProducedPlan)
+{
+	CSV_CUSTOM_STAT(HTN, PlanningRuns, 1, ECsvCustomStatOp::Accumulate);
+	CSV_CUSTOM_STAT(HTN, PlanningMs, LastPlanningStats.WallTimeSeconds * 1000.0f, ECsvCustomStatOp::Accumulate);
+	CSV_CUSTOM_STAT(HTN, ExpandedPlans, LastPlanningStats.NumExpandedPlans, ECsvCustomStatOp::Accumulate);
+	CSV_CUSTOM_STAT(HTN, CandidatePlans, LastPlanningStats.NumCandidatePlans, ECsvCustomStatOp::Accumulate);
+	CSV_CUSTOM_STAT(HTN, PrunedCandidates, LastPlanningStats.NumPrunedCandidates, ECsvCustomStatOp::Accumulate);
+	CSV_CUSTOM_STAT(HTN, BlockedPlans, LastPlanningStats.NumBlockedPlans, ECsvCustomStatOp::Accumulate);
+	CSV_CUSTOM_STAT(HTN, MaxFrontierSize, LastPlanningStats.MaxFrontierSize, ECsvCustomStatOp::Max);
+	CSV_CUSTOM_STAT(HTN, WorldStateCopies, LastPlanningStats.NumWorldStateCopies, ECsvCustomStatOp::Accumulate);
+	CSV_CUSTOM_STAT(HTN, PlanCopies, LastPlanningStats.NumPlanCopies, ECsvCustomStatOp::Accumulate);
+	CSV_CUSTOM_STAT(HTN, LatentWaits, LastPlanningStats.NumLatentWaits, ECsvCustomStatOp::Accumulate);
+
+	UE_VLOG(GetOwner(), LogHTN, Verbose, TEXT("planning %s"), *LastPlanningStats.ToString());
+	PlanningFinishedEvent.Broadcast(this, LastPlanningStats);
+	FHTNDelegates::OnPlanningFinished.Broadcast(*this, LastPlanningStats, ProducedPlan);
+}
+
 void UHTNComponent::NotifyOnPlanExecutionStarted()
 {
 	PlanExecutionStartedEvent.Broadcast(this);
@@ -1856,28 +2037,65 @@ void UHTNComponent::NotifyNodesOnPlanExecutionHelper(TFunctionRef<void(UHTNNode*
 }
 
 #if USE_HTN_DEBUGGER
-FHTNDebugExecutionStep& UHTNComponent::StoreDebugStep(bool bIsEmpty) const
+FHTNDebugExecutionStep* UHTNComponent::StoreDebugStep(bool bIsEmpty, const FHTNPlanStepID& EnteringStepID) const
 {
-	FHTNDebugExecutionStep& Info = DebuggerSteps.Add_GetRef();
-
+	if (!ShouldRecordDebugSteps())
+	{
+		return nullptr;
+	}
+	
+	const FHTNDebugExecutionStep* const PreviousStep = DebuggerSteps.GetByIndex(DebuggerSteps.GetLastIndex());
+	TSharedPtr<const TMap<FName, FString>> PreviousBlackboardValues = PreviousStep ? PreviousStep->BlackboardValues : nullptr;
+	
+	TArray<FHTNPlanStepID, TInlineAllocator<8>> ActivePlanStepIDs;
+	if (!bIsEmpty)
+	{
+		ActivePlanStepIDs.Append(CurrentlyExecutingStepIDs);
+		if (EnteringStepID != FHTNPlanStepID::None)
+		{
+			ActivePlanStepIDs.Add(EnteringStepID);
+		}
+	}
+	
+	FHTNDebugExecutionStep& Info = DebuggerSteps.Add_GetRef(ActivePlanStepIDs);
 	if (!bIsEmpty)
 	{
 		Info.HTNPlan = CurrentPlan;
-		Info.ActivePlanStepIDs = CurrentlyExecutingStepIDs;
 
 		if (BlackboardComp && BlackboardComp->HasValidAsset())
 		{
 			const int32 NumKeys = BlackboardComp->GetNumKeys();
-			Info.BlackboardValues.Empty(NumKeys);
+			TMap<FName, FString> BlackboardValues;
+			BlackboardValues.Reserve(NumKeys);
 			for (FBlackboard::FKey KeyID = 0; KeyID < NumKeys; KeyID++)
 			{
 				const FString Value = BlackboardComp->DescribeKeyValue(KeyID, EBlackboardDescription::OnlyValue);
-				Info.BlackboardValues.Add(BlackboardComp->GetKeyName(KeyID), Value.Len() ? Value : TEXT("n/a"));
+				BlackboardValues.Add(BlackboardComp->GetKeyName(KeyID), Value.Len() ? Value : TEXT("n/a"));
+			}
+
+			// Share the descriptions with the previous step if nothing changed.
+			if (PreviousBlackboardValues.IsValid() && PreviousBlackboardValues->OrderIndependentCompareEqual(BlackboardValues))
+			{
+				Info.BlackboardValues = MoveTemp(PreviousBlackboardValues);
+			}
+			else
+			{
+				Info.BlackboardValues = MakeShared<const TMap<FName, FString>>(MoveTemp(BlackboardValues));
 			}
 		}
 	}
 
-	return Info;
+	return &Info;
+}
+
+bool UHTNComponent::ShouldRecordDebugSteps() const
+{
+	return !GHTNDebuggerRecordOnlyDebuggedAgent || DebuggedComponent == this;
+}
+
+void UHTNComponent::SetDebuggedComponent(const UHTNComponent* Component)
+{
+	DebuggedComponent = Component;
 }
 #endif
 
@@ -6,6 +6,7 @@
 #include "Misc/RuntimeErrors.h"
 #include "VisualLogger/VisualLogger.h"
 #include "WorldStateProxy.h"
+#include "Utility/HTNProfiler.h"
 
 UHTNDecorator::UHTNDecorator(const FObjectInitializer& Initializer) : Super(Initializer),
 	bNotifyOnEnterPlan(false),
@@ -162,6 +163,7 @@ EHTNDecoratorTestResult UHTNDecorator::WrappedTestCondition(UHTNComponent& Owner
 		return EHTNDecoratorTestResult::Failed;
 	}
 
+	HTN_PROFILER_SCOPE(OwnerComp, Decorator, EHTNProfilerPhase::DecoratorTest);
 	return Decorator->TestCondition(OwnerComp, NodeMemory, CheckType);
 }
 
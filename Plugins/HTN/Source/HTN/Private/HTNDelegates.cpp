@@ -3,3 +3,5 @@
 #include "HTNDelegates.h"
 
 FHTNDelegates::FOnPlanExecutionStarted FHTNDelegates::OnPlanExecutionStarted;
+FHTNDelegates::FOnPlanningStarted FHTNDelegates::OnPlanningStarted;
+FHTNDelegates::FOnPlanningFinished FHTNDelegates::OnPlanningFinished;
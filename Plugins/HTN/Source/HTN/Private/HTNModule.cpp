@@ -4,6 +4,7 @@
 #include "BehaviorTree/BlackboardData.h"
 #include "BehaviorTree/Blackboard/BlackboardKeyType_Vector.h"
 #include "HTNTypes.h"
+#include "Benchmark/HTNBenchmarkHelpers.h"
 
 #define LOCTEXT_NAMESPACE "HTNModule"
 
@@ -15,6 +16,10 @@ public:
 	{
 		// Ensure that there is a key for own location on every blackboard. 
 		OnUpdateBlackboardKeysDelegateHandle = UBlackboardData::OnUpdateKeys.AddStatic(&OnUpdateBlackboardKeys);
+
+#if HTN_BENCHMARKS
+		HTNBenchmark::InstallAllocationCountingIfRequested();
+#endif
 	}
 
 	virtual void ShutdownModule() override
@@ -128,6 +128,21 @@ void UHTNNode::WrappedOnPlanExecutionFinished(UHTNComponent& OwnerComp, uint8* N
 	}
 }
 
+#if WITH_EDITOR
+void UHTNNode::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+
+	// E.g. the cost of a task or the HTN of a SubNetwork node may have changed.
+	UHTN::InvalidateStaticAnalyses();
+}
+#endif
+
+bool UHTNNode::GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const
+{
+	return false;
+}
+
 FString UHTNNode::GetStaticDescription() const
 {
 	if (GetClass()->HasAnyClassFlags(CLASS_CompiledFromBlueprint))
@@ -5,18 +5,27 @@
 #include "Algo/Transform.h"
 
 #include "HTNDecorator.h"
+#include "HTNPlanningStats.h"
 #include "HTNService.h"
 #include "HTNTask.h"
 #include "Nodes/HTNNode_SubNetwork.h"
 #include "Nodes/HTNNode_Parallel.h"
 #include "Nodes/HTNNode_If.h"
+#include "Nodes/HTNNode_AnyOrderN.h"
 
 const FHTNPlanStepID FHTNPlanStepID::None = { INDEX_NONE, INDEX_NONE };
 
 FHTNPlan::FHTNPlan(UHTN* HTNAsset, TSharedRef<FBlackboardWorldState> WorldStateAtPlanStart) :
 	Levels { MakeShared<FHTNPlanLevel>(HTNAsset, WorldStateAtPlanStart) },
-	Cost(0)
-{}
+	Cost(0),
+	MinRemainingCost(0)
+{
+	if (HTNAsset)
+	{
+		Levels[0]->MinCost = HTNAsset->GetStaticAnalysis().MinCost;
+		MinRemainingCost = Levels[0]->MinCost;
+	}
+}
 
 TSharedRef<FHTNPlan> FHTNPlan::MakeCopy(int32 IndexOfLevelToCopy, bool bAlsoCopyParentLevel) const
 {
@@ -37,6 +46,7 @@ TSharedRef<FHTNPlan> FHTNPlan::MakeCopy(int32 IndexOfLevelToCopy, bool bAlsoCopy
 	};
 	
 	const TSharedRef<FHTNPlan> NewPlan = MakeShared<FHTNPlan>(*this);
+	FHTNPlanningStats::CountPlanCopy();
 	if (Local::CopyLevel(*NewPlan, IndexOfLevelToCopy))
 	{
 		if (bAlsoCopyParentLevel && IndexOfLevelToCopy > 0)
@@ -68,6 +78,22 @@ bool FHTNPlan::IsComplete() const
 }
 
 
+void FHTNPlan::UpdateMinRemainingCost()
+{
+	// Each unfinished level will add at least what its MinCost exceeds the cost spent since the level started by.
+	// The costs spent in parallel branches and nested levels are counted too, which only makes the bound lower, so the cheapest plan is still found first.
+	// The bounds of nested levels overlap, so only the largest one is used.
+	MinRemainingCost = 0;
+	for (int32 LevelIndex = 0; LevelIndex < Levels.Num(); ++LevelIndex)
+	{
+		if (HasLevel(LevelIndex) && Levels[LevelIndex]->MinCost > 0 && !IsLevelComplete(LevelIndex))
+		{
+			const FHTNPlanLevel& Level = *Levels[LevelIndex];
+			MinRemainingCost = FMath::Max(MinRemainingCost, Level.MinCost - (Cost - Level.PlanCostAtLevelStart));
+		}
+	}
+}
+
 bool FHTNPlan::IsLevelComplete(int32 LevelIndex) const
 {
 	if (!ensure(HasLevel(LevelIndex)))
@@ -156,6 +182,14 @@ void FHTNPlan::GetWorldStateAndNextNodes(const FHTNPlanStepID& StepID, TSharedPt
 				const bool bEffectivePrimaryBranch = ParentPlanStep.bAnyOrderInversed ? !bIsPrimaryBranch : bIsPrimaryBranch;
 				OutNextNodes = bEffectivePrimaryBranch ? TwoBranchesNode->GetPrimaryNextNodes() : TwoBranchesNode->GetSecondaryNextNodes();
 			}
+			else if (UHTNNode_AnyOrderN* const AnyOrderNode = Cast<UHTNNode_AnyOrderN>(ParentPlanStep.Node))
+			{
+				OutNextNodes = AnyOrderNode->GetNextNodesInSubLevel(ParentPlanStep, StepID.LevelIndex);
+			}
+			else if (UHTNNode_AnyOrderNContinuation* const ContinuationNode = Cast<UHTNNode_AnyOrderNContinuation>(ParentPlanStep.Node))
+			{
+				OutNextNodes = ContinuationNode->GetAnyOrderNode()->GetNextNodesInSubLevel(ParentPlanStep, StepID.LevelIndex);
+			}
 			else if (UHTNStandaloneNode* const StandaloneNode = Cast<UHTNStandaloneNode>(ParentPlanStep.Node))
 			{
 				OutNextNodes = StandaloneNode->NextNodes;
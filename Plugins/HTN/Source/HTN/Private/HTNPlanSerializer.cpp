@@ -0,0 +1,945 @@
+// Copyright 2020-2021 Maksym Maisak. All Rights Reserved.
+
+#include "HTNPlanSerializer.h"
+#include "Misc/Crc.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "UObject/SoftObjectPath.h"
+#include "UObject/UnrealType.h"
+#include "UObject/UObjectHash.h"
+
+#include "BlackboardWorldstate.h"
+#include "HTN.h"
+#include "HTNDecorator.h"
+#include "HTNPlan.h"
+#include "HTNService.h"
+#include "HTNStandaloneNode.h"
+
+namespace
+{
+	constexpr uint32 HTNPlanMagic = 0x504E5448; // "HTNP"
+	constexpr uint32 HTNPlanFormatVersion = 1;
+
+	enum class EHTNSavedStepFlags : uint8
+	{
+		None = 0,
+		AnyOrderInversed = 1 << 0,
+		IsIfNodeFalseBranch = 1 << 1,
+		CanConditionsInterruptTrueBranch = 1 << 2,
+		CanConditionsInterruptFalseBranch = 1 << 3
+	};
+	ENUM_CLASS_FLAGS(EHTNSavedStepFlags);
+
+	// Indices are offset by one so that INDEX_NONE takes a single byte when packed.
+	void SerializeIndex(FArchive& Ar, int32& Index)
+	{
+		uint32 Packed = Ar.IsLoading() ? 0 : static_cast<uint32>(Index + 1);
+		Ar.SerializeIntPacked(Packed);
+		if (Ar.IsLoading())
+		{
+			Index = Packed > static_cast<uint32>(MAX_int32) ? MAX_int32 : static_cast<int32>(Packed) - 1;
+		}
+	}
+
+	// Hashes the values of the saved properties of a node, so e.g. editing a cost or a parameter changes the asset version.
+	// The values are exported as text, which writes object references as paths that are the same between sessions.
+	// Editor-only properties are skipped, so the version is the same in the editor and in cooked builds.
+	uint32 HashNodeProperties(const UObject& Node, uint32 Hash)
+	{
+		FString ValueText;
+		for (TFieldIterator<FProperty> It(Node.GetClass()); It; ++It)
+		{
+			const FProperty* const Property = *It;
+			if (Property->HasAnyPropertyFlags(CPF_Transient | CPF_EditorOnly | CPF_Deprecated))
+			{
+				continue;
+			}
+
+			ValueText.Reset();
+			Property->ExportText_InContainer(0, ValueText, &Node, nullptr, nullptr, PPF_None);
+			Hash = FCrc::StrCrc32(*Property->GetName(), Hash);
+			Hash = FCrc::StrCrc32(*ValueText, Hash);
+		}
+
+		return Hash;
+	}
+
+	template<typename SubNodeType>
+	uint32 HashSubNodes(const TArray<SubNodeType*>& SubNodes, uint32 Hash)
+	{
+		Hash = HashCombine(Hash, static_cast<uint32>(SubNodes.Num()));
+		for (const SubNodeType* const SubNode : SubNodes)
+		{
+			if (SubNode)
+			{
+				Hash = FCrc::StrCrc32(*SubNode->GetClass()->GetPathName(), Hash);
+				Hash = HashNodeProperties(*SubNode, Hash);
+			}
+		}
+
+		return Hash;
+	}
+
+	template<typename KeyClass>
+	void SerializeValue(FArchive& Ar, FBlackboardWorldState& WorldState, FBlackboard::FKey KeyID)
+	{
+		typename KeyClass::FDataType Value = Ar.IsLoading() ? typename KeyClass::FDataType() : WorldState.GetValue<KeyClass>(KeyID);
+		Ar << Value;
+		if (Ar.IsLoading())
+		{
+			WorldState.SetValue<KeyClass>(KeyID, Value);
+		}
+	}
+
+	const UClass* GetKeyClass(const FBlackboardWorldState& WorldState, FBlackboard::FKey KeyID)
+	{
+		const UBlackboardData* const Blackboard = WorldState.GetBlackboardAsset();
+		const FBlackboardEntry* const Entry = Blackboard ? Blackboard->GetKey(KeyID) : nullptr;
+		return Entry && Entry->KeyType ? Entry->KeyType->GetClass() : nullptr;
+	}
+
+	bool CanSerializeKeyValue(const FBlackboardWorldState& WorldState, FBlackboard::FKey KeyID)
+	{
+		const UClass* const KeyClass = GetKeyClass(WorldState, KeyID);
+		return KeyClass == UBlackboardKeyType_Bool::StaticClass() ||
+			KeyClass == UBlackboardKeyType_Int::StaticClass() ||
+			KeyClass == UBlackboardKeyType_Float::StaticClass() ||
+			KeyClass == UBlackboardKeyType_Enum::StaticClass() ||
+			KeyClass == UBlackboardKeyType_NativeEnum::StaticClass() ||
+			KeyClass == UBlackboardKeyType_Name::StaticClass() ||
+			KeyClass == UBlackboardKeyType_String::StaticClass() ||
+			KeyClass == UBlackboardKeyType_Vector::StaticClass() ||
+			KeyClass == UBlackboardKeyType_Rotator::StaticClass() ||
+			KeyClass == UBlackboardKeyType_Object::StaticClass() ||
+			KeyClass == UBlackboardKeyType_Class::StaticClass();
+	}
+
+	// Returns false if the type of the key is not supported (see CanSerializeKeyValue).
+	bool SerializeKeyValue(FArchive& Ar, FBlackboardWorldState& WorldState, FBlackboard::FKey KeyID)
+	{
+		const UClass* const KeyClass = GetKeyClass(WorldState, KeyID);
+		if (KeyClass == UBlackboardKeyType_Bool::StaticClass())
+		{
+			SerializeValue<UBlackboardKeyType_Bool>(Ar, WorldState, KeyID);
+		}
+		else if (KeyClass == UBlackboardKeyType_Int::StaticClass())
+		{
+			SerializeValue<UBlackboardKeyType_Int>(Ar, WorldState, KeyID);
+		}
+		else if (KeyClass == UBlackboardKeyType_Float::StaticClass())
+		{
+			SerializeValue<UBlackboardKeyType_Float>(Ar, WorldState, KeyID);
+		}
+		else if (KeyClass == UBlackboardKeyType_Enum::StaticClass())
+		{
+			SerializeValue<UBlackboardKeyType_Enum>(Ar, WorldState, KeyID);
+		}
+		else if (KeyClass == UBlackboardKeyType_NativeEnum::StaticClass())
+		{
+			SerializeValue<UBlackboardKeyType_NativeEnum>(Ar, WorldState, KeyID);
+		}
+		else if (KeyClass == UBlackboardKeyType_Name::StaticClass())
+		{
+			SerializeValue<UBlackboardKeyType_Name>(Ar, WorldState, KeyID);
+		}
+		else if (KeyClass == UBlackboardKeyType_String::StaticClass())
+		{
+			SerializeValue<UBlackboardKeyType_String>(Ar, WorldState, KeyID);
+		}
+		else if (KeyClass == UBlackboardKeyType_Vector::StaticClass())
+		{
+			SerializeValue<UBlackboardKeyType_Vector>(Ar, WorldState, KeyID);
+		}
+		else if (KeyClass == UBlackboardKeyType_Rotator::StaticClass())
+		{
+			SerializeValue<UBlackboardKeyType_Rotator>(Ar, WorldState, KeyID);
+		}
+		else if (KeyClass == UBlackboardKeyType_Object::StaticClass())
+		{
+			FString Path = Ar.IsLoading() ? FString() : FSoftObjectPath(WorldState.GetValue<UBlackboardKeyType_Object>(KeyID)).ToString();
+			Ar << Path;
+			if (Ar.IsLoading())
+			{
+				// Not loading anything, since object keys usually point to actors that only exist at runtime.
+				WorldState.SetValue<UBlackboardKeyType_Object>(KeyID, FSoftObjectPath(Path).ResolveObject());
+			}
+		}
+		else if (KeyClass == UBlackboardKeyType_Class::StaticClass())
+		{
+			FString Path = Ar.IsLoading() ? FString() : FSoftClassPath(WorldState.GetValue<UBlackboardKeyType_Class>(KeyID)).ToString();
+			Ar << Path;
+			if (Ar.IsLoading())
+			{
+				WorldState.SetValue<UBlackboardKeyType_Class>(KeyID, FSoftClassPath(Path).TryLoadClass<UObject>());
+			}
+		}
+		else
+		{
+			return false;
+		}
+
+		return true;
+	}
+
+	class FHTNPlanWriter
+	{
+	public:
+		explicit FHTNPlanWriter(const FBlackboardWorldState& WorldStateAtPlanStart) :
+			WorldStateAtPlanStart(WorldStateAtPlanStart)
+		{}
+
+		bool Save(const FHTNPlan& Plan, TArray<uint8>& OutData)
+		{
+			// Levels are written first so the asset and worldstate tables can be filled in along the way.
+			TArray<uint8> LevelData;
+			FMemoryWriter LevelAr(LevelData);
+			int32 NumLevels = Plan.Levels.Num();
+			SerializeIndex(LevelAr, NumLevels);
+			for (const TSharedPtr<FHTNPlanLevel>& Level : Plan.Levels)
+			{
+				if (!Level.IsValid() || !WriteLevel(LevelAr, *Level))
+				{
+					return Fail(Error.IsEmpty() ? TEXT("The plan has an invalid level") : Error);
+				}
+			}
+
+			FMemoryWriter Ar(OutData);
+			uint32 Magic = HTNPlanMagic;
+			uint32 FormatVersion = HTNPlanFormatVersion;
+			uint32 BlackboardVersion = FHTNPlanSerializer::GetBlackboardVersion(*WorldStateAtPlanStart.GetBlackboardAsset());
+			int32 Cost = Plan.Cost;
+			Ar << Magic;
+			Ar.SerializeIntPacked(FormatVersion);
+			Ar << BlackboardVersion;
+			Ar << Cost;
+
+			int32 NumPriorityMarkers = Plan.PriorityMarkers.Num();
+			SerializeIndex(Ar, NumPriorityMarkers);
+			for (FHTNPriorityMarker PriorityMarker : Plan.PriorityMarkers)
+			{
+				Ar << PriorityMarker;
+			}
+
+			int32 NumAssets = Assets.Num();
+			SerializeIndex(Ar, NumAssets);
+			for (const UHTN* const Asset : Assets)
+			{
+				FString Path = FSoftObjectPath(Asset).ToString();
+				uint32 AssetVersion = FHTNPlanSerializer::GetAssetVersion(*Asset);
+				Ar << Path;
+				Ar << AssetVersion;
+			}
+
+			// The worldstate at plan start is not saved, since it's provided when loading.
+			int32 NumWorldStates = WorldStates.Num();
+			SerializeIndex(Ar, NumWorldStates);
+			for (const TSharedPtr<FBlackboardWorldState>& WorldState : WorldStates)
+			{
+				if (!WriteWorldState(Ar, *WorldState))
+				{
+					return false;
+				}
+			}
+
+			Ar.Serialize(LevelData.GetData(), LevelData.Num());
+			return true;
+		}
+
+		FString Error;
+
+	private:
+		bool WriteLevel(FArchive& Ar, const FHTNPlanLevel& Level)
+		{
+			const UHTN* const Asset = Level.HTNAsset.Get();
+			if (!Asset)
+			{
+				return Fail(TEXT("The HTN asset of a plan level is no longer valid"));
+			}
+
+			int32 AssetIndex = Assets.Find(Asset);
+			if (AssetIndex == INDEX_NONE)
+			{
+				AssetIndex = Assets.Add(Asset);
+				TArray<UHTNStandaloneNode*> Nodes;
+				FHTNPlanSerializer::GetNodeTable(*Asset, Nodes);
+				TMap<const UHTNStandaloneNode*, int32>& Indices = NodeIndices.AddDefaulted_GetRef();
+				for (int32 NodeIndex = 0; NodeIndex < Nodes.Num(); ++NodeIndex)
+				{
+					Indices.Add(Nodes[NodeIndex], NodeIndex);
+				}
+			}
+
+			int32 WorldStateIndex = GetWorldStateIndex(Level.WorldStateAtLevelStart);
+			int32 ParentLevelIndex = Level.ParentStepID.LevelIndex;
+			int32 ParentStepIndex = Level.ParentStepID.StepIndex;
+			int32 Cost = Level.Cost;
+			bool bIsInline = Level.bIsInline;
+			SerializeIndex(Ar, AssetIndex);
+			SerializeIndex(Ar, WorldStateIndex);
+			SerializeIndex(Ar, ParentLevelIndex);
+			SerializeIndex(Ar, ParentStepIndex);
+			Ar << Cost;
+			Ar << bIsInline;
+
+			int32 NumSteps = Level.Steps.Num();
+			SerializeIndex(Ar, NumSteps);
+			for (const FHTNPlanStep& Step : Level.Steps)
+			{
+				const int32* const FoundNodeIndex = NodeIndices[AssetIndex].Find(Step.Node.Get());
+				if (!FoundNodeIndex)
+				{
+					return Fail(FString::Printf(TEXT("Node %s is not part of %s, the HTN of its plan level"), *GetNameSafe(Step.Node.Get()), *Asset->GetName()));
+				}
+
+				int32 NodeIndex = *FoundNodeIndex;
+				int32 StepWorldStateIndex = GetWorldStateIndex(Step.WorldState);
+				int32 WorldStateAfterDecoratorsIndex = GetWorldStateIndex(Step.WorldStateAfterEnteringDecorators);
+				int32 StepCost = Step.Cost;
+				int32 SubLevelIndex = Step.SubLevelIndex;
+				int32 SecondarySubLevelIndex = Step.SecondarySubLevelIndex;
+				int32 AnyOrderBranchIndex = Step.AnyOrderBranchIndex;
+				EHTNSavedStepFlags Flags = EHTNSavedStepFlags::None;
+				Flags |= Step.bAnyOrderInversed ? EHTNSavedStepFlags::AnyOrderInversed : EHTNSavedStepFlags::None;
+				Flags |= Step.bIsIfNodeFalseBranch ? EHTNSavedStepFlags::IsIfNodeFalseBranch : EHTNSavedStepFlags::None;
+				Flags |= Step.bCanConditionsInterruptTrueBranch ? EHTNSavedStepFlags::CanConditionsInterruptTrueBranch : EHTNSavedStepFlags::None;
+				Flags |= Step.bCanConditionsInterruptFalseBranch ? EHTNSavedStepFlags::CanConditionsInterruptFalseBranch : EHTNSavedStepFlags::None;
+
+				SerializeIndex(Ar, NodeIndex);
+				SerializeIndex(Ar, StepWorldStateIndex);
+				SerializeIndex(Ar, WorldStateAfterDecoratorsIndex);
+				Ar << StepCost;
+				SerializeIndex(Ar, SubLevelIndex);
+				SerializeIndex(Ar, SecondarySubLevelIndex);
+				SerializeIndex(Ar, AnyOrderBranchIndex);
+				Ar << reinterpret_cast<uint8&>(Flags);
+			}
+
+			return true;
+		}
+
+		bool WriteWorldState(FArchive& Ar, FBlackboardWorldState& WorldState)
+		{
+			if (!WorldState.IsCompatible(WorldStateAtPlanStart))
+			{
+				return Fail(TEXT("The plan has worldstates of different blackboards"));
+			}
+
+			TArray<FBlackboard::FKey> Keys;
+			WorldState.GetKeysWithDifferentValues(WorldStateAtPlanStart, Keys);
+			int32 NumKeys = Keys.Num();
+			SerializeIndex(Ar, NumKeys);
+			for (FBlackboard::FKey KeyID : Keys)
+			{
+				Ar << KeyID;
+				if (!SerializeKeyValue(Ar, WorldState, KeyID))
+				{
+					return Fail(FString::Printf(TEXT("Key %s is of a type that can't be saved"), *WorldState.GetKeyName(KeyID).ToString()));
+				}
+			}
+
+			Keys.Reset();
+			WorldState.GetChangedKeys(Keys);
+			NumKeys = Keys.Num();
+			SerializeIndex(Ar, NumKeys);
+			for (FBlackboard::FKey KeyID : Keys)
+			{
+				Ar << KeyID;
+			}
+
+			return true;
+		}
+
+		// INDEX_NONE for null, 0 for the worldstate at plan start, the index in WorldStates plus one for others.
+		int32 GetWorldStateIndex(const TSharedPtr<FBlackboardWorldState>& WorldState)
+		{
+			if (!WorldState.IsValid())
+			{
+				return INDEX_NONE;
+			}
+
+			if (WorldState.Get() == &WorldStateAtPlanStart)
+			{
+				return 0;
+			}
+
+			if (const int32* const FoundIndex = WorldStateIndices.Find(WorldState.Get()))
+			{
+				return *FoundIndex;
+			}
+
+			const int32 Index = WorldStates.Add(WorldState) + 1;
+			WorldStateIndices.Add(WorldState.Get(), Index);
+			return Index;
+		}
+
+		bool Fail(const FString& Message)
+		{
+			Error = Message;
+			return false;
+		}
+
+		const FBlackboardWorldState& WorldStateAtPlanStart;
+		TArray<const UHTN*> Assets;
+		TArray<TMap<const UHTNStandaloneNode*, int32>> NodeIndices;
+		TArray<TSharedPtr<FBlackboardWorldState>> WorldStates;
+		TMap<const FBlackboardWorldState*, int32> WorldStateIndices;
+	};
+
+	class FHTNPlanReader
+	{
+	public:
+		explicit FHTNPlanReader(const TArray<uint8>& Data) :
+			Ar(Data, /*bIsPersistent=*/true)
+		{}
+
+		// Reads everything up to the worldstates: the format version, the blackboard version and the HTN assets.
+		bool ReadHeader(const FBlackboardWorldState& WorldStateAtPlanStart)
+		{
+			uint32 Magic = 0;
+			uint32 FormatVersion = 0;
+			uint32 BlackboardVersion = 0;
+			Ar << Magic;
+			if (Ar.IsError() || Magic != HTNPlanMagic)
+			{
+				return Fail(TEXT("Not a saved HTN plan"));
+			}
+
+			Ar.SerializeIntPacked(FormatVersion);
+			if (FormatVersion != HTNPlanFormatVersion)
+			{
+				return Fail(FString::Printf(TEXT("Unsupported format version %u"), FormatVersion));
+			}
+
+			Ar << BlackboardVersion;
+			const UBlackboardData* const Blackboard = WorldStateAtPlanStart.GetBlackboardAsset();
+			if (!Blackboard || BlackboardVersion != FHTNPlanSerializer::GetBlackboardVersion(*Blackboard))
+			{
+				return Fail(TEXT("The plan was saved with a different blackboard"));
+			}
+
+			Ar << Cost;
+
+			int32 NumPriorityMarkers = 0;
+			if (!ReadNum(NumPriorityMarkers))
+			{
+				return false;
+			}
+			PriorityMarkers.SetNumUninitialized(NumPriorityMarkers);
+			for (FHTNPriorityMarker& PriorityMarker : PriorityMarkers)
+			{
+				Ar << PriorityMarker;
+			}
+
+			int32 NumAssets = 0;
+			if (!ReadNum(NumAssets))
+			{
+				return false;
+			}
+			for (int32 AssetIndex = 0; AssetIndex < NumAssets; ++AssetIndex)
+			{
+				FString Path;
+				uint32 AssetVersion = 0;
+				Ar << Path;
+				Ar << AssetVersion;
+				if (Ar.IsError())
+				{
+					return Fail(TEXT("Unexpected end of data"));
+				}
+
+				UHTN* const Asset = Cast<UHTN>(FSoftObjectPath(Path).TryLoad());
+				if (!Asset)
+				{
+					return Fail(FString::Printf(TEXT("Could not load HTN %s"), *Path));
+				}
+
+				if (AssetVersion != FHTNPlanSerializer::GetAssetVersion(*Asset))
+				{
+					return Fail(FString::Printf(TEXT("HTN %s has changed since the plan was saved"), *Path));
+				}
+
+				Assets.Add(Asset);
+				FHTNPlanSerializer::GetNodeTable(*Asset, NodeTables.AddDefaulted_GetRef());
+			}
+
+			return !Ar.IsError() || Fail(TEXT("Unexpected end of data"));
+		}
+
+		TSharedPtr<FHTNPlan> ReadPlan(const TSharedRef<FBlackboardWorldState>& WorldStateAtPlanStart)
+		{
+			if (!ReadWorldStates(WorldStateAtPlanStart))
+			{
+				return nullptr;
+			}
+
+			int32 NumLevels = 0;
+			if (!ReadNum(NumLevels) || !NumLevels)
+			{
+				Fail(TEXT("The plan has no levels"));
+				return nullptr;
+			}
+
+			const TSharedRef<FHTNPlan> Plan = MakeShared<FHTNPlan>(nullptr, WorldStateAtPlanStart);
+			Plan->Levels.Reset(NumLevels);
+			Plan->Cost = Cost;
+			Plan->PriorityMarkers = PriorityMarkers;
+			for (int32 LevelIndex = 0; LevelIndex < NumLevels; ++LevelIndex)
+			{
+				if (!ReadLevel(*Plan, NumLevels))
+				{
+					return nullptr;
+				}
+			}
+
+			if (!ValidateStructure(*Plan))
+			{
+				return nullptr;
+			}
+
+			// Recursion counts are only needed to keep planning from this plan, so they're rebuilt instead of saved.
+			for (const TSharedPtr<FHTNPlanLevel>& Level : Plan->Levels)
+			{
+				for (const FHTNPlanStep& Step : Level->Steps)
+				{
+					if (Step.Node->MaxRecursionLimit > 0)
+					{
+						Plan->IncrementRecursionCount(Step.Node.Get());
+					}
+				}
+			}
+
+			return Plan;
+		}
+
+		FString Error;
+
+	private:
+		bool ReadWorldStates(const TSharedRef<FBlackboardWorldState>& WorldStateAtPlanStart)
+		{
+			const int32 NumKeysInBlackboard = WorldStateAtPlanStart->GetBlackboardAsset()->GetNumKeys();
+
+			int32 NumWorldStates = 0;
+			if (!ReadNum(NumWorldStates))
+			{
+				return false;
+			}
+
+			WorldStates.Reserve(NumWorldStates + 1);
+			WorldStates.Add(WorldStateAtPlanStart);
+			TArray<FBlackboard::FKey> ChangedKeys;
+			for (int32 I = 0; I < NumWorldStates; ++I)
+			{
+				const TSharedRef<FBlackboardWorldState> WorldState = WorldStateAtPlanStart->MakeNext();
+
+				int32 NumValues = 0;
+				if (!ReadNum(NumValues))
+				{
+					return false;
+				}
+				for (int32 ValueIndex = 0; ValueIndex < NumValues; ++ValueIndex)
+				{
+					FBlackboard::FKey KeyID = FBlackboard::InvalidKey;
+					Ar << KeyID;
+					if (Ar.IsError() || KeyID >= NumKeysInBlackboard || !SerializeKeyValue(Ar, *WorldState, KeyID))
+					{
+						return Fail(TEXT("Invalid worldstate value"));
+					}
+				}
+
+				int32 NumChangedKeys = 0;
+				if (!ReadNum(NumChangedKeys))
+				{
+					return false;
+				}
+				ChangedKeys.SetNumUninitialized(NumChangedKeys);
+				for (FBlackboard::FKey& KeyID : ChangedKeys)
+				{
+					Ar << KeyID;
+					if (KeyID >= NumKeysInBlackboard)
+					{
+						return Fail(TEXT("Invalid changed key"));
+					}
+				}
+				WorldState->SetChangedKeys(ChangedKeys);
+
+				WorldStates.Add(WorldState);
+			}
+
+			return !Ar.IsError() || Fail(TEXT("Unexpected end of data"));
+		}
+
+		bool ReadLevel(FHTNPlan& Plan, int32 NumLevels)
+		{
+			int32 AssetIndex = INDEX_NONE;
+			int32 WorldStateIndex = INDEX_NONE;
+			FHTNPlanStepID ParentStepID;
+			int32 LevelCost = 0;
+			bool bIsInline = false;
+			SerializeIndex(Ar, AssetIndex);
+			SerializeIndex(Ar, WorldStateIndex);
+			SerializeIndex(Ar, ParentStepID.LevelIndex);
+			SerializeIndex(Ar, ParentStepID.StepIndex);
+			Ar << LevelCost;
+			Ar << bIsInline;
+			if (Ar.IsError() || !Assets.IsValidIndex(AssetIndex) || !IsValidWorldStateIndex(WorldStateIndex))
+			{
+				return Fail(TEXT("Invalid plan level"));
+			}
+
+			FHTNPlanLevel& Level = *Plan.Levels.Add_GetRef(MakeShared<FHTNPlanLevel>(Assets[AssetIndex], GetWorldState(WorldStateIndex), ParentStepID, bIsInline));
+			Level.Cost = LevelCost;
+
+			int32 NumSteps = 0;
+			if (!ReadNum(NumSteps))
+			{
+				return false;
+			}
+
+			const TArray<UHTNStandaloneNode*>& Nodes = NodeTables[AssetIndex];
+			Level.Steps.Reserve(NumSteps);
+			for (int32 StepIndex = 0; StepIndex < NumSteps; ++StepIndex)
+			{
+				int32 NodeIndex = INDEX_NONE;
+				int32 StepWorldStateIndex = INDEX_NONE;
+				int32 WorldStateAfterDecoratorsIndex = INDEX_NONE;
+				int32 StepCost = 0;
+				int32 SubLevelIndex = INDEX_NONE;
+				int32 SecondarySubLevelIndex = INDEX_NONE;
+				int32 AnyOrderBranchIndex = INDEX_NONE;
+				EHTNSavedStepFlags Flags = EHTNSavedStepFlags::None;
+				SerializeIndex(Ar, NodeIndex);
+				SerializeIndex(Ar, StepWorldStateIndex);
+				SerializeIndex(Ar, WorldStateAfterDecoratorsIndex);
+				Ar << StepCost;
+				SerializeIndex(Ar, SubLevelIndex);
+				SerializeIndex(Ar, SecondarySubLevelIndex);
+				SerializeIndex(Ar, AnyOrderBranchIndex);
+				Ar << reinterpret_cast<uint8&>(Flags);
+
+				const auto IsValidSubLevelIndex = [&](int32 Index) { return Index == INDEX_NONE || (Index > 0 && Index < NumLevels); };
+				if (Ar.IsError() || !Nodes.IsValidIndex(NodeIndex) ||
+					!IsValidWorldStateIndex(StepWorldStateIndex) || !IsValidWorldStateIndex(WorldStateAfterDecoratorsIndex) ||
+					!IsValidSubLevelIndex(SubLevelIndex) || !IsValidSubLevelIndex(SecondarySubLevelIndex))
+				{
+					return Fail(TEXT("Invalid plan step"));
+				}
+
+				FHTNPlanStep& Step = Level.Steps.Emplace_GetRef(Nodes[NodeIndex], GetWorldState(StepWorldStateIndex), StepCost, SubLevelIndex, SecondarySubLevelIndex);
+				Step.WorldStateAfterEnteringDecorators = GetWorldState(WorldStateAfterDecoratorsIndex);
+				Step.AnyOrderBranchIndex = AnyOrderBranchIndex;
+				Step.bAnyOrderInversed = EnumHasAnyFlags(Flags, EHTNSavedStepFlags::AnyOrderInversed);
+				Step.bIsIfNodeFalseBranch = EnumHasAnyFlags(Flags, EHTNSavedStepFlags::IsIfNodeFalseBranch);
+				Step.bCanConditionsInterruptTrueBranch = EnumHasAnyFlags(Flags, EHTNSavedStepFlags::CanConditionsInterruptTrueBranch);
+				Step.bCanConditionsInterruptFalseBranch = EnumHasAnyFlags(Flags, EHTNSavedStepFlags::CanConditionsInterruptFalseBranch);
+			}
+
+			return true;
+		}
+
+		// Makes sure the plan can be used without failing the checks in FHTNPlan::CheckIntegrity.
+		bool ValidateStructure(const FHTNPlan& Plan)
+		{
+			if (Plan.Levels[0]->ParentStepID != FHTNPlanStepID::None || Plan.Levels[0]->IsInlineLevel() || Plan.Cost != Plan.Levels[0]->Cost)
+			{
+				return Fail(TEXT("Invalid top level"));
+			}
+
+			for (int32 LevelIndex = 1; LevelIndex < Plan.Levels.Num(); ++LevelIndex)
+			{
+				const FHTNPlanStepID& ParentStepID = Plan.Levels[LevelIndex]->ParentStepID;
+				// The planner always adds sublevels after the level of their parent, which also rules out cycles of parents.
+				const FHTNPlanStep* const ParentStep = ParentStepID.LevelIndex < LevelIndex ? Plan.FindStep(ParentStepID) : nullptr;
+				if (!ParentStep || (ParentStep->SubLevelIndex != LevelIndex && ParentStep->SecondarySubLevelIndex != LevelIndex))
+				{
+					return Fail(FString::Printf(TEXT("Invalid parent of plan level %i"), LevelIndex));
+				}
+			}
+
+			for (int32 LevelIndex = 0; LevelIndex < Plan.Levels.Num(); ++LevelIndex)
+			{
+				for (int32 StepIndex = 0; StepIndex < Plan.Levels[LevelIndex]->Steps.Num(); ++StepIndex)
+				{
+					const FHTNPlanStep& Step = Plan.Levels[LevelIndex]->Steps[StepIndex];
+					const FHTNPlanStepID StepID = { LevelIndex, StepIndex };
+					for (const int32 SubLevelIndex : { Step.SubLevelIndex, Step.SecondarySubLevelIndex })
+					{
+						if (SubLevelIndex != INDEX_NONE && Plan.Levels[SubLevelIndex]->ParentStepID != StepID)
+						{
+							return Fail(FString::Printf(TEXT("Invalid sublevel of plan step %i in level %i"), StepIndex, LevelIndex));
+						}
+					}
+				}
+			}
+
+			return true;
+		}
+
+		// Fails if the count is larger than the remaining data, since every element takes at least a byte.
+		bool ReadNum(int32& OutNum)
+		{
+			SerializeIndex(Ar, OutNum);
+			if (Ar.IsError() || OutNum < 0 || OutNum > Ar.TotalSize() - Ar.Tell())
+			{
+				OutNum = 0;
+				return Fail(TEXT("Unexpected end of data"));
+			}
+
+			return true;
+		}
+
+		FORCEINLINE bool IsValidWorldStateIndex(int32 Index) const { return Index == INDEX_NONE || WorldStates.IsValidIndex(Index); }
+		FORCEINLINE TSharedPtr<FBlackboardWorldState> GetWorldState(int32 Index) const { return Index == INDEX_NONE ? nullptr : WorldStates[Index]; }
+
+		bool Fail(const FString& Message)
+		{
+			Error = Message;
+			return false;
+		}
+
+		FMemoryReader Ar;
+		int32 Cost = 0;
+		TArray<FHTNPriorityMarker, TInlineAllocator<8>> PriorityMarkers;
+		TArray<UHTN*> Assets;
+		TArray<TArray<UHTNStandaloneNode*>> NodeTables;
+		TArray<TSharedPtr<FBlackboardWorldState>> WorldStates;
+	};
+}
+
+bool FHTNPlanSerializer::SavePlan(const FHTNPlan& Plan, TArray<uint8>& OutData, FString* OutError)
+{
+	const FBlackboardWorldState* const WorldStateAtPlanStart = Plan.HasLevel(0) ? Plan.Levels[0]->WorldStateAtLevelStart.Get() : nullptr;
+	if (!WorldStateAtPlanStart || !WorldStateAtPlanStart->GetBlackboardAsset())
+	{
+		if (OutError)
+		{
+			*OutError = TEXT("The plan has no valid worldstate at its start");
+		}
+		return false;
+	}
+
+	FHTNPlanWriter Writer(*WorldStateAtPlanStart);
+	OutData.Reset();
+	if (!Writer.Save(Plan, OutData))
+	{
+		OutData.Reset();
+		if (OutError)
+		{
+			*OutError = Writer.Error;
+		}
+		return false;
+	}
+
+	return true;
+}
+
+TSharedPtr<FHTNPlan> FHTNPlanSerializer::LoadPlan(const TArray<uint8>& Data, const TSharedRef<FBlackboardWorldState>& WorldStateAtPlanStart, FString* OutError)
+{
+	FHTNPlanReader Reader(Data);
+	TSharedPtr<FHTNPlan> Plan = Reader.ReadHeader(*WorldStateAtPlanStart) ? Reader.ReadPlan(WorldStateAtPlanStart) : nullptr;
+	if (!Plan.IsValid() && OutError)
+	{
+		*OutError = Reader.Error;
+	}
+
+	return Plan;
+}
+
+bool FHTNPlanSerializer::ValidatePlan(const TArray<uint8>& Data, const FBlackboardWorldState& WorldStateAtPlanStart, FString* OutError)
+{
+	FHTNPlanReader Reader(Data);
+	if (!Reader.ReadHeader(WorldStateAtPlanStart))
+	{
+		if (OutError)
+		{
+			*OutError = Reader.Error;
+		}
+		return false;
+	}
+
+	return true;
+}
+
+void FHTNPlanSerializer::GetNodeTable(const UHTN& Asset, TArray<UHTNStandaloneNode*>& OutNodes)
+{
+	TArray<UObject*> Objects;
+	GetObjectsWithOuter(&Asset, Objects, /*bIncludeNestedObjects=*/true);
+
+	TArray<TPair<FString, UHTNStandaloneNode*>> NamedNodes;
+	for (UObject* const Object : Objects)
+	{
+		if (UHTNStandaloneNode* const Node = Cast<UHTNStandaloneNode>(Object))
+		{
+			NamedNodes.Emplace(Node->GetPathName(&Asset), Node);
+		}
+	}
+	NamedNodes.Sort([](const TPair<FString, UHTNStandaloneNode*>& A, const TPair<FString, UHTNStandaloneNode*>& B) { return A.Key < B.Key; });
+
+	OutNodes.Reset(NamedNodes.Num());
+	for (const TPair<FString, UHTNStandaloneNode*>& NamedNode : NamedNodes)
+	{
+		OutNodes.Add(NamedNode.Value);
+	}
+}
+
+uint32 FHTNPlanSerializer::GetAssetVersion(const UHTN& Asset)
+{
+	TArray<UHTNStandaloneNode*> Nodes;
+	GetNodeTable(Asset, Nodes);
+
+	// Only hashing strings and indices, since hashes of names and pointers are different between sessions.
+	uint32 Hash = HTNPlanFormatVersion;
+	for (const UHTNStandaloneNode* const Node : Nodes)
+	{
+		Hash = FCrc::StrCrc32(*Node->GetPathName(&Asset), Hash);
+		Hash = FCrc::StrCrc32(*Node->GetClass()->GetPathName(), Hash);
+		for (const UHTNStandaloneNode* const NextNode : Node->NextNodes)
+		{
+			Hash = HashCombine(Hash, static_cast<uint32>(Nodes.IndexOfByKey(NextNode)));
+		}
+
+		Hash = HashNodeProperties(*Node, Hash);
+		Hash = HashSubNodes(Node->Decorators, Hash);
+		Hash = HashSubNodes(Node->Services, Hash);
+	}
+
+	for (const UHTNStandaloneNode* const StartNode : Asset.StartNodes)
+	{
+		Hash = HashCombine(Hash, static_cast<uint32>(Nodes.IndexOfByKey(StartNode)));
+	}
+
+	Hash = HashSubNodes(Asset.RootDecorators, Hash);
+	Hash = HashSubNodes(Asset.RootServices, Hash);
+
+	return Hash;
+}
+
+uint32 FHTNPlanSerializer::GetBlackboardVersion(const UBlackboardData& Blackboard)
+{
+	uint32 Hash = HTNPlanFormatVersion;
+	for (FBlackboard::FKey KeyID = 0; KeyID < Blackboard.GetNumKeys(); ++KeyID)
+	{
+		const TSubclassOf<UBlackboardKeyType> KeyType = Blackboard.GetKeyType(KeyID);
+		Hash = FCrc::StrCrc32(*Blackboard.GetKeyName(KeyID).ToString(), Hash);
+		Hash = FCrc::StrCrc32(*GetPathNameSafe(KeyType.Get()), Hash);
+	}
+
+	return Hash;
+}
+
+void FHTNPlanSerializer::SaveWorldState(const FBlackboardWorldState& WorldState, TArray<uint8>& OutData)
+{
+	OutData.Reset();
+	const UBlackboardData* const Blackboard = WorldState.GetBlackboardAsset();
+	if (!ensure(Blackboard))
+	{
+		return;
+	}
+
+	TArray<FBlackboard::FKey> Keys;
+	for (FBlackboard::FKey KeyID = 0; KeyID < Blackboard->GetNumKeys(); ++KeyID)
+	{
+		if (CanSerializeKeyValue(WorldState, KeyID))
+		{
+			Keys.Add(KeyID);
+		}
+	}
+
+	FMemoryWriter Ar(OutData);
+	uint32 Magic = HTNPlanMagic;
+	uint32 FormatVersion = HTNPlanFormatVersion;
+	uint32 BlackboardVersion = GetBlackboardVersion(*Blackboard);
+	int32 NumKeys = Keys.Num();
+	Ar << Magic;
+	Ar.SerializeIntPacked(FormatVersion);
+	Ar << BlackboardVersion;
+	SerializeIndex(Ar, NumKeys);
+	for (FBlackboard::FKey KeyID : Keys)
+	{
+		Ar << KeyID;
+		// Values are only read when saving.
+		SerializeKeyValue(Ar, const_cast<FBlackboardWorldState&>(WorldState), KeyID);
+	}
+}
+
+bool FHTNPlanSerializer::LoadWorldState(const TArray<uint8>& Data, FBlackboardWorldState& WorldState, FString* OutError)
+{
+	struct Local
+	{
+		static bool Fail(FString* OutError, const TCHAR* Message)
+		{
+			if (OutError)
+			{
+				*OutError = Message;
+			}
+			return false;
+		}
+	};
+
+	const UBlackboardData* const Blackboard = WorldState.GetBlackboardAsset();
+	if (!Blackboard)
+	{
+		return Local::Fail(OutError, TEXT("The worldstate has no blackboard"));
+	}
+
+	FMemoryReader Ar(Data, /*bIsPersistent=*/true);
+	uint32 Magic = 0;
+	uint32 FormatVersion = 0;
+	uint32 BlackboardVersion = 0;
+	Ar << Magic;
+	Ar.SerializeIntPacked(FormatVersion);
+	Ar << BlackboardVersion;
+	if (Ar.IsError() || Magic != HTNPlanMagic || FormatVersion != HTNPlanFormatVersion)
+	{
+		return Local::Fail(OutError, TEXT("Not a saved worldstate of a supported version"));
+	}
+
+	if (BlackboardVersion != GetBlackboardVersion(*Blackboard))
+	{
+		return Local::Fail(OutError, TEXT("The worldstate was saved with a different blackboard"));
+	}
+
+	int32 NumKeys = 0;
+	SerializeIndex(Ar, NumKeys);
+	if (Ar.IsError() || NumKeys < 0 || NumKeys > Blackboard->GetNumKeys())
+	{
+		return Local::Fail(OutError, TEXT("Invalid number of keys"));
+	}
+
+	for (int32 I = 0; I < NumKeys; ++I)
+	{
+		FBlackboard::FKey KeyID = FBlackboard::InvalidKey;
+		Ar << KeyID;
+		if (Ar.IsError() || KeyID >= Blackboard->GetNumKeys() || !SerializeKeyValue(Ar, WorldState, KeyID) || Ar.IsError())
+		{
+			return Local::Fail(OutError, TEXT("Invalid worldstate value"));
+		}
+	}
+
+	return true;
+}
+
+uint32 FHTNPlanSerializer::GetPlanIdentity(const FHTNPlan& Plan)
+{
+	uint32 Hash = HashCombine(HTNPlanFormatVersion, static_cast<uint32>(Plan.Cost));
+	for (const TSharedPtr<FHTNPlanLevel>& Level : Plan.Levels)
+	{
+		if (!Level.IsValid())
+		{
+			Hash = HashCombine(Hash, MAX_uint32);
+			continue;
+		}
+
+		const UHTN* const Asset = Level->HTNAsset.Get();
+		Hash = FCrc::StrCrc32(*GetPathNameSafe(Asset), Hash);
+		Hash = HashCombine(Hash, static_cast<uint32>(Level->ParentStepID.LevelIndex));
+		Hash = HashCombine(Hash, static_cast<uint32>(Level->ParentStepID.StepIndex));
+		for (const FHTNPlanStep& Step : Level->Steps)
+		{
+			Hash = FCrc::StrCrc32(Step.Node.IsValid() ? *Step.Node->GetPathName(Asset) : TEXT("None"), Hash);
+			Hash = HashCombine(Hash, static_cast<uint32>(Step.Cost));
+			Hash = HashCombine(Hash, static_cast<uint32>(Step.SubLevelIndex));
+			Hash = HashCombine(Hash, static_cast<uint32>(Step.SecondarySubLevelIndex));
+		}
+	}
+
+	return Hash;
+}
@@ -0,0 +1,21 @@
+// Copyright 2020-2021 Maksym Maisak. All Rights Reserved.
+
+#include "HTNPlanningStats.h"
+
+FHTNPlanningStats* FHTNPlanningStats::ActiveStats = nullptr;
+
+FString FHTNPlanningStats::ToString() const
+{
+	return FString::Printf(TEXT("%s in %.3fms: %i expanded, %i candidates, %i pruned, %i blocked, max frontier %i, %i worldstate copies, %i plan copies, %i latent waits"),
+		bWasCancelled ? TEXT("cancelled") : bFoundPlan ? TEXT("succeeded") : bExceededMaxPlanLength ? TEXT("failed (max plan length exceeded)") : TEXT("failed"),
+		WallTimeSeconds * 1000.0f,
+		NumExpandedPlans,
+		NumCandidatePlans,
+		NumPrunedCandidates,
+		NumBlockedPlans,
+		MaxFrontierSize,
+		NumWorldStateCopies,
+		NumPlanCopies,
+		NumLatentWaits
+	);
+}
@@ -1,6 +1,7 @@
 // Copyright 2020-2021 Maksym Maisak. All Rights Reserved.
 
 #include "HTNService.h"
+#include "Utility/HTNProfiler.h"
 
 UHTNService::UHTNService(const FObjectInitializer& Initializer) : Super(Initializer),
 	TickInterval(0.5f),
@@ -55,6 +56,7 @@ void UHTNService::WrappedTickNode(UHTNComponent& OwnerComp, uint8* NodeMemory, f
 		{
 			DeltaSeconds = TickCountdown.GetElapsedTimeWithFallback(DeltaSeconds);
 
+			HTN_PROFILER_SCOPE(OwnerComp, Service, EHTNProfilerPhase::ServiceTick);
 			Service->TickNode(OwnerComp, NodeMemory, DeltaSeconds);
 
 			TickCountdown.Interval = GetInterval();
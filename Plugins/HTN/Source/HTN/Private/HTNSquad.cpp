@@ -0,0 +1,199 @@
+// Copyright 2020-2021 Maksym Maisak. All Rights Reserved.
+
+#include "HTNSquad.h"
+#include "VisualLogger/VisualLogger.h"
+
+#include "HTNComponent.h"
+
+UHTNSquad::UHTNSquad() :
+	bAbortPlanOnRoleChange(false)
+{}
+
+void UHTNSquad::BeginDestroy()
+{
+	for (const FMember& Member : Members)
+	{
+		if (UHTNComponent* const Component = Member.Component.Get())
+		{
+			if (Component->Squad == this)
+			{
+				Component->Squad = nullptr;
+			}
+		}
+	}
+	Members.Reset();
+	Claims.Reset();
+	SharedNodeCaches.Reset();
+
+	Super::BeginDestroy();
+}
+
+void UHTNSquad::AddMember(UHTNComponent* Member)
+{
+	if (!Member || Members.ContainsByPredicate([&](const FMember& Existing) { return Existing.Component == Member; }))
+	{
+		return;
+	}
+
+	if (Member->Squad)
+	{
+		Member->Squad->RemoveMember(Member);
+	}
+
+	Member->Squad = this;
+	Members.Add({ Member });
+	UE_VLOG(Member->GetOwner(), LogHTN, Log, TEXT("Joined squad %s"), *GetName());
+	AssignRoles();
+}
+
+void UHTNSquad::RemoveMember(UHTNComponent* Member)
+{
+	const int32 MemberIndex = Member ? Members.IndexOfByPredicate([&](const FMember& Existing) { return Existing.Component == Member; }) : INDEX_NONE;
+	if (MemberIndex == INDEX_NONE)
+	{
+		return;
+	}
+
+	Members.RemoveAt(MemberIndex);
+	Claims.RemoveAll([&](const FClaim& Claim) { return Claim.Member == Member; });
+	if (Member->Squad == this)
+	{
+		Member->Squad = nullptr;
+	}
+
+	// E.g. stop planning tasks of the member from waiting for a query that another member runs for the squad.
+	for (const TPair<TPair<const UObject*, FHTNNodePlanningCacheTypeID>, TUniquePtr<FHTNNodePlanningCache>>& Pair : SharedNodeCaches)
+	{
+		Pair.Value->OnSquadMemberRemoved(*Member);
+	}
+
+	// Go back to the default HTN of the SubNetworkDynamic nodes.
+	if (RoleInjectTag.IsValid())
+	{
+		Member->SetDynamicHTN(RoleInjectTag, nullptr, bAbortPlanOnRoleChange);
+	}
+
+	UE_VLOG(Member->GetOwner(), LogHTN, Log, TEXT("Left squad %s"), *GetName());
+	AssignRoles();
+}
+
+TArray<UHTNComponent*> UHTNSquad::GetMembers() const
+{
+	TArray<UHTNComponent*> Result;
+	Result.Reserve(Members.Num());
+	for (const FMember& Member : Members)
+	{
+		if (UHTNComponent* const Component = Member.Component.Get())
+		{
+			Result.Add(Component);
+		}
+	}
+
+	return Result;
+}
+
+void UHTNSquad::SetRoles(const TArray<FHTNSquadRole>& NewRoles)
+{
+	Roles = NewRoles;
+	for (FMember& Member : Members)
+	{
+		Member.RoleIndex = INDEX_NONE;
+	}
+
+	AssignRoles();
+}
+
+int32 UHTNSquad::GetMemberRole(const UHTNComponent* Member) const
+{
+	const FMember* const FoundMember = Members.FindByPredicate([&](const FMember& Existing) { return Existing.Component == Member; });
+	return FoundMember ? FoundMember->RoleIndex : INDEX_NONE;
+}
+
+void UHTNSquad::ClaimLocation(const UHTNComponent& Member, const FVector& Location)
+{
+	Claims.Add({ &Member, Location });
+}
+
+void UHTNSquad::ReleaseLocation(const UHTNComponent& Member, const FVector& Location)
+{
+	const int32 ClaimIndex = Claims.IndexOfByPredicate([&](const FClaim& Claim) { return Claim.Member == &Member && Claim.Location.Equals(Location); });
+	if (ClaimIndex != INDEX_NONE)
+	{
+		Claims.RemoveAtSwap(ClaimIndex);
+	}
+}
+
+bool UHTNSquad::IsLocationClaimedByOthers(const UHTNComponent& Member, const FVector& Location, float Radius) const
+{
+	const float RadiusSquared = FMath::Square(Radius);
+	return Claims.ContainsByPredicate([&](const FClaim& Claim)
+	{
+		return Claim.Member != &Member && Claim.Member.IsValid() && FVector::DistSquared(Claim.Location, Location) <= RadiusSquared;
+	});
+}
+
+void UHTNSquad::AssignRoles()
+{
+	Members.RemoveAll([](const FMember& Member) { return !Member.Component.IsValid(); });
+	if (!RoleInjectTag.IsValid() || !Roles.Num())
+	{
+		return;
+	}
+
+	TArray<int32> NumMembersPerRole;
+	NumMembersPerRole.AddZeroed(Roles.Num());
+	for (FMember& Member : Members)
+	{
+		if (Roles.IsValidIndex(Member.RoleIndex))
+		{
+			const int32 MaxMembers = Roles[Member.RoleIndex].MaxMembers;
+			if (MaxMembers <= 0 || NumMembersPerRole[Member.RoleIndex] < MaxMembers)
+			{
+				++NumMembersPerRole[Member.RoleIndex];
+				continue;
+			}
+		}
+
+		Member.RoleIndex = INDEX_NONE;
+	}
+
+	for (FMember& Member : Members)
+	{
+		if (Member.RoleIndex != INDEX_NONE)
+		{
+			continue;
+		}
+
+		// Fill the roles with the fewest members first, in the order they're listed in on ties.
+		int32 BestRoleIndex = INDEX_NONE;
+		for (int32 RoleIndex = 0; RoleIndex < Roles.Num(); ++RoleIndex)
+		{
+			const int32 MaxMembers = Roles[RoleIndex].MaxMembers;
+			const bool bHasRoom = MaxMembers <= 0 || NumMembersPerRole[RoleIndex] < MaxMembers;
+			if (bHasRoom && (BestRoleIndex == INDEX_NONE || NumMembersPerRole[RoleIndex] < NumMembersPerRole[BestRoleIndex]))
+			{
+				BestRoleIndex = RoleIndex;
+			}
+		}
+
+		if (BestRoleIndex != INDEX_NONE)
+		{
+			++NumMembersPerRole[BestRoleIndex];
+		}
+		Member.RoleIndex = BestRoleIndex;
+	}
+
+	for (const FMember& Member : Members)
+	{
+		SetMemberRole(*Member.Component, Member.RoleIndex);
+	}
+}
+
+void UHTNSquad::SetMemberRole(UHTNComponent& Member, int32 RoleIndex)
+{
+	UHTN* const RoleHTN = Roles.IsValidIndex(RoleIndex) ? Roles[RoleIndex].HTN : nullptr;
+	if (Member.SetDynamicHTN(RoleInjectTag, RoleHTN, bAbortPlanOnRoleChange))
+	{
+		UE_VLOG(Member.GetOwner(), LogHTN, Log, TEXT("Squad %s assigned role %i (%s)"), *GetName(), RoleIndex, *GetNameSafe(RoleHTN));
+	}
+}
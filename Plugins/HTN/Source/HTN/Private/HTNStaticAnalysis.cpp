@@ -0,0 +1,262 @@
+// Copyright 2020-2021 Maksym Maisak. All Rights Reserved.
+
+#include "HTNStaticAnalysis.h"
+#include "BehaviorTree/BehaviorTreeTypes.h"
+#include "Misc/StringBuilder.h"
+#include "UObject/UnrealType.h"
+
+#include "HTN.h"
+#include "HTNDecorator.h"
+#include "HTNTask.h"
+#include "Nodes/HTNNode_SubNetwork.h"
+#include "Nodes/HTNNode_SubNetworkDynamic.h"
+#include "Nodes/HTNNode_TwoBranches.h"
+
+namespace
+{
+	// HTNs whose analysis is in progress. A subnetwork referring back to one of them is treated as free and feasible,
+	// which keeps the results conservative for recursive HTNs.
+	TArray<const UHTN*, TInlineAllocator<8>> HTNsBeingAnalyzed;
+
+	class FHTNStaticAnalyzer
+	{
+	public:
+		FHTNStaticAnalyzer(const UHTN& HTN, FHTNStaticAnalysis& Analysis) :
+			HTN(HTN),
+			Analysis(Analysis)
+		{}
+
+		void Run()
+		{
+			for (const UHTNDecorator* const Decorator : HTN.RootDecorators)
+			{
+				AddKeysOf(Decorator);
+			}
+
+			const FPathResult Result = AnalyzeAnyOf(HTN.StartNodes);
+			Analysis.bIsInfeasible = !Result.bIsFeasible;
+			Analysis.MinCost = Result.bIsFeasible ? Result.MinCost : 0;
+		}
+
+	private:
+		// The cheapest way to reach the end of the level from a node (inclusive).
+		struct FPathResult
+		{
+			int32 MinCost = 0;
+			bool bIsFeasible = true;
+		};
+
+		FPathResult AnalyzeAnyOf(const TArrayView<UHTNStandaloneNode* const>& Nodes)
+		{
+			if (!Nodes.Num())
+			{
+				return {};
+			}
+
+			FPathResult Result;
+			Result.bIsFeasible = false;
+			for (UHTNStandaloneNode* const Node : Nodes)
+			{
+				const FPathResult NodeResult = AnalyzeNode(Node);
+				if (NodeResult.bIsFeasible && (!Result.bIsFeasible || NodeResult.MinCost < Result.MinCost))
+				{
+					Result = NodeResult;
+				}
+			}
+
+			return Result;
+		}
+
+		FPathResult AnalyzeNode(UHTNStandaloneNode* Node)
+		{
+			if (!ensure(Node))
+			{
+				return {};
+			}
+
+			if (const FPathResult* const CachedResult = NodeResults.Find(Node))
+			{
+				return *CachedResult;
+			}
+
+			// Guard against cycles in malformed graphs.
+			NodeResults.Add(Node);
+
+			AddKeysOf(Node);
+			for (const UHTNDecorator* const Decorator : Node->Decorators)
+			{
+				AddKeysOf(Decorator);
+			}
+
+			FPathResult Result = AnalyzeOwnCost(*Node);
+			const FPathResult NextResult = AnalyzeAnyOf(Node->NextNodes);
+
+			// An empty branch of an If or Prefer node lets planning continue without going through any of the next nodes.
+			const UHTNNode_TwoBranches* const TwoBranchesNode = Cast<UHTNNode_TwoBranches>(Node);
+			const bool bHasEmptyBranch = TwoBranchesNode && Node->NextNodes.Num() &&
+				(!TwoBranchesNode->GetPrimaryNextNodes().Num() || !TwoBranchesNode->GetSecondaryNextNodes().Num());
+			if (Result.bIsFeasible && !bHasEmptyBranch)
+			{
+				Result.bIsFeasible = NextResult.bIsFeasible;
+				Result.MinCost = Result.bIsFeasible ? Result.MinCost + NextResult.MinCost : 0;
+			}
+
+			NodeResults.Add(Node, Result);
+			return Result;
+		}
+
+		FPathResult AnalyzeOwnCost(UHTNStandaloneNode& Node)
+		{
+			FPathResult Result;
+			if (const UHTNTask* const Task = Cast<UHTNTask>(&Node))
+			{
+				Result.bIsFeasible = Task->CanEverProducePlanSteps();
+
+				// Decorators can lower the cost of primitive tasks.
+				const bool bCostCanBeModified = Node.Decorators.ContainsByPredicate([](const UHTNDecorator* Decorator) { return Decorator && Decorator->ModifiesStepCost(); });
+				Result.MinCost = bCostCanBeModified ? 0 : FMath::Max(0, Task->GetMinPlanningCost());
+			}
+			else if (const UHTNNode_SubNetwork* const SubNetworkNode = Cast<UHTNNode_SubNetwork>(&Node))
+			{
+				if (SubNetworkNode->HTN && SubNetworkNode->HTN->StartNodes.Num() && !HTNsBeingAnalyzed.Contains(SubNetworkNode->HTN))
+				{
+					const FHTNStaticAnalysis& SubAnalysis = SubNetworkNode->HTN->GetStaticAnalysis();
+					AddKeysOf(SubAnalysis);
+					Result.bIsFeasible = !SubAnalysis.bIsInfeasible;
+					Result.MinCost = SubAnalysis.MinCost;
+				}
+			}
+			else if (const UHTNNode_SubNetworkDynamic* const SubNetworkDynamicNode = Cast<UHTNNode_SubNetworkDynamic>(&Node))
+			{
+				// The HTN can be replaced at runtime, so only the keys of the default one are known, and it's free and feasible as far as this HTN knows.
+				Analysis.bHasUnlistedKeys = true;
+				if (SubNetworkDynamicNode->DefaultHTN && !HTNsBeingAnalyzed.Contains(SubNetworkDynamicNode->DefaultHTN))
+				{
+					AddKeysOf(SubNetworkDynamicNode->DefaultHTN->GetStaticAnalysis());
+				}
+			}
+
+			return Result;
+		}
+
+		void AddKeysOf(const UHTNNode* Node)
+		{
+			if (!Node)
+			{
+				return;
+			}
+
+			// Any key selector of the node might be read during planning.
+			AddReadKeysIn(*Node->GetClass(), Node);
+
+			TArray<FName> ImplicitlyReadKeys;
+			Node->GetImplicitlyReadBlackboardKeys(ImplicitlyReadKeys);
+			Analysis.ReadKeys.Append(ImplicitlyReadKeys);
+
+			TArray<FName> WrittenKeys;
+			if (!Node->GetWrittenBlackboardKeys(WrittenKeys))
+			{
+				Analysis.bHasUnlistedKeys = true;
+			}
+			Analysis.WrittenKeys.Append(WrittenKeys);
+		}
+
+		void AddKeysOf(const FHTNStaticAnalysis& SubAnalysis)
+		{
+			Analysis.ReadKeys.Append(SubAnalysis.ReadKeys);
+			Analysis.WrittenKeys.Append(SubAnalysis.WrittenKeys);
+			Analysis.bHasUnlistedKeys |= SubAnalysis.bHasUnlistedKeys;
+		}
+
+		// Finds key selectors in the properties of the given struct or class, including ones nested in structs (e.g. EQS query params).
+		void AddReadKeysIn(const UStruct& Struct, const void* Container, int32 Depth = 0)
+		{
+			const auto AddReadKeysInValue = [&](const FStructProperty& StructProperty, const void* Value)
+			{
+				if (StructProperty.Struct == FBlackboardKeySelector::StaticStruct())
+				{
+					const FBlackboardKeySelector& KeySelector = *static_cast<const FBlackboardKeySelector*>(Value);
+					if (!KeySelector.SelectedKeyName.IsNone())
+					{
+						Analysis.ReadKeys.Add(KeySelector.SelectedKeyName);
+					}
+				}
+				else if (Depth < 4)
+				{
+					AddReadKeysIn(*StructProperty.Struct, Value, Depth + 1);
+				}
+			};
+
+			for (TFieldIterator<FProperty> It(&Struct); It; ++It)
+			{
+				if (const FStructProperty* const StructProperty = CastField<FStructProperty>(*It))
+				{
+					AddReadKeysInValue(*StructProperty, StructProperty->ContainerPtrToValuePtr<void>(Container));
+				}
+				else if (const FArrayProperty* const ArrayProperty = CastField<FArrayProperty>(*It))
+				{
+					if (const FStructProperty* const InnerProperty = CastField<FStructProperty>(ArrayProperty->Inner))
+					{
+						FScriptArrayHelper ArrayHelper(ArrayProperty, ArrayProperty->ContainerPtrToValuePtr<void>(Container));
+						for (int32 Index = 0; Index < ArrayHelper.Num(); ++Index)
+						{
+							AddReadKeysInValue(*InnerProperty, ArrayHelper.GetRawPtr(Index));
+						}
+					}
+				}
+			}
+		}
+
+		const UHTN& HTN;
+		FHTNStaticAnalysis& Analysis;
+		TMap<const UHTNStandaloneNode*, FPathResult> NodeResults;
+	};
+}
+
+TSharedRef<const FHTNStaticAnalysis> FHTNStaticAnalysis::Analyze(const UHTN& HTN)
+{
+	DECLARE_SCOPE_CYCLE_COUNTER(TEXT("FHTNStaticAnalysis::Analyze"), STAT_AI_HTN_StaticAnalysis, STATGROUP_AI_HTN);
+
+	const TSharedRef<FHTNStaticAnalysis> Analysis = MakeShared<FHTNStaticAnalysis>();
+	HTNsBeingAnalyzed.Push(&HTN);
+	FHTNStaticAnalyzer(HTN, *Analysis).Run();
+	HTNsBeingAnalyzed.Pop();
+
+	UE_LOG(LogHTN, Verbose, TEXT("Static analysis of %s: %s"), *HTN.GetName(), *Analysis->ToString());
+	return Analysis;
+}
+
+FString FHTNStaticAnalysis::ToString() const
+{
+	const auto AppendKeys = [](TStringBuilder<512>& StringBuilder, const TSet<FName>& Keys)
+	{
+		bool bIsFirst = true;
+		for (const FName& Key : Keys)
+		{
+			StringBuilder << (bIsFirst ? TEXT("") : TEXT(", ")) << Key.ToString();
+			bIsFirst = false;
+		}
+	};
+
+	TStringBuilder<512> StringBuilder;
+	if (bIsInfeasible)
+	{
+		StringBuilder << TEXT("infeasible");
+	}
+	else
+	{
+		StringBuilder << TEXT("min cost ") << FString::FromInt(MinCost);
+	}
+
+	StringBuilder << TEXT(", reads [");
+	AppendKeys(StringBuilder, ReadKeys);
+	StringBuilder << TEXT("], writes [");
+	AppendKeys(StringBuilder, WrittenKeys);
+	StringBuilder << TEXT("]");
+	if (bHasUnlistedKeys)
+	{
+		StringBuilder << TEXT(" and unlisted keys");
+	}
+
+	return StringBuilder.ToString();
+}
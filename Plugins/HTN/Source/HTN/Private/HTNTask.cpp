@@ -5,6 +5,7 @@
 #include "GameplayTasksComponent.h"
 #include "WorldStateProxy.h"
 #include "HTNPlan.h"
+#include "Utility/HTNProfiler.h"
 
 UHTNTask::UHTNTask(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer),
 	bShowTaskNameOnCurrentPlanVisualization(true),
@@ -42,6 +43,7 @@ EHTNNodeResult UHTNTask::WrappedExecuteTask(UHTNComponent& OwnerComp, uint8* Nod
 		return EHTNNodeResult::Failed;
 	}
 
+	HTN_PROFILER_SCOPE(OwnerComp, Task, EHTNProfilerPhase::ExecuteTask);
 	const EHTNNodeResult Result = Task->ExecuteTask(OwnerComp, NodeMemory, PlanStepID);
 	return Result;
 }
@@ -65,6 +67,7 @@ void UHTNTask::WrappedTickTask(UHTNComponent& OwnerComp, uint8* NodeMemory, floa
 	UHTNTask* const Task = StaticCast<UHTNTask*>(GetNodeFromMemory(OwnerComp, NodeMemory));
 	if (ensure(Task) && Task->bNotifyTick)
 	{
+		HTN_PROFILER_SCOPE(OwnerComp, Task, EHTNProfilerPhase::TickTask);
 		Task->TickTask(OwnerComp, NodeMemory, DeltaTime);
 	}
 }
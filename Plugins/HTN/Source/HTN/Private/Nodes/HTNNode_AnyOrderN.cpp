@@ -0,0 +1,246 @@
+// Copyright 2020-2021 Maksym Maisak. All Rights Reserved.
+
+#include "Nodes/HTNNode_AnyOrderN.h"
+#include "AITask_MakeHTNPlan.h"
+#include "Algo/Reverse.h"
+
+UHTNNode_AnyOrderN::UHTNNode_AnyOrderN(const FObjectInitializer& Initializer) : Super(Initializer),
+	bPruneCommutingBranches(false)
+{
+	ContinuationNode = CreateDefaultSubobject<UHTNNode_AnyOrderNContinuation>(TEXT("ContinuationNode"));
+}
+
+void UHTNNode_AnyOrderN::MakePlanExpansions(FHTNPlanningContext& Context)
+{
+	const FHTNPlan& Plan = *Context.PlanToExpand;
+
+	// Find the steps of this node that already chose a branch by walking up from the continuation being added.
+	TArray<FHTNPlanStepID, TInlineAllocator<8>> PlannedStepIDs;
+	if (Context.AddingNode == ContinuationNode)
+	{
+		ensure(Context.CurrentPlanStepID.StepIndex == INDEX_NONE);
+
+		FHTNPlanStepID StepID = Plan.Levels[Context.CurrentPlanStepID.LevelIndex]->ParentStepID;
+		while (ensure(StepID != FHTNPlanStepID::None))
+		{
+			PlannedStepIDs.Add(StepID);
+			if (Plan.GetStep(StepID).Node == this)
+			{
+				break;
+			}
+
+			StepID = Plan.Levels[StepID.LevelIndex]->ParentStepID;
+		}
+		Algo::Reverse(PlannedStepIDs);
+
+		if (bPruneCommutingBranches && !IsCanonicalBranchOrder(Plan, PlannedStepIDs))
+		{
+			return;
+		}
+	}
+
+	TArray<int32, TInlineAllocator<8>> RemainingBranches;
+	for (int32 BranchIndex = 0; BranchIndex < NextNodes.Num(); ++BranchIndex)
+	{
+		const bool bAlreadyPlanned = PlannedStepIDs.ContainsByPredicate([&](const FHTNPlanStepID& StepID)
+		{
+			return Plan.GetStep(StepID).AnyOrderBranchIndex == BranchIndex;
+		});
+		if (!bAlreadyPlanned)
+		{
+			RemainingBranches.Add(BranchIndex);
+		}
+	}
+
+	// Nothing left to plan. This only happens with no branches at all,
+	// or if the last branch was followed by a continuation to check the order of branches.
+	if (!RemainingBranches.Num())
+	{
+		FHTNPlanStep* AddedStep = nullptr;
+		FHTNPlanStepID AddedStepID;
+		const TSharedRef<FHTNPlan> NewPlan = Context.MakePlanCopyWithAddedStep(AddedStep, AddedStepID);
+		Context.SubmitCandidatePlan(NewPlan);
+		return;
+	}
+
+	// Only commit to the next branch here. The rest will be chosen by the continuation once this branch has been planned.
+	const bool bNeedsContinuation = RemainingBranches.Num() > 1 || bPruneCommutingBranches;
+	for (const int32 BranchIndex : RemainingBranches)
+	{
+		FHTNPlanStep* AddedStep = nullptr;
+		FHTNPlanStepID AddedStepID;
+		const TSharedRef<FHTNPlan> NewPlan = Context.MakePlanCopyWithAddedStep(AddedStep, AddedStepID);
+
+		AddedStep->AnyOrderBranchIndex = BranchIndex;
+		AddedStep->SubLevelIndex = Context.AddInlineLevel(*NewPlan, AddedStepID);
+		if (bNeedsContinuation)
+		{
+			AddedStep->SecondarySubLevelIndex = Context.AddInlineLevel(*NewPlan, AddedStepID);
+			NewPlan->Levels[AddedStep->SecondarySubLevelIndex]->WorldStateAtLevelStart.Reset();
+		}
+
+		Context.SubmitCandidatePlan(NewPlan, FString::Printf(TEXT("branch %i (%s)"), BranchIndex, *GetNameSafe(NextNodes[BranchIndex])));
+	}
+}
+
+bool UHTNNode_AnyOrderN::OnSubLevelFinishedPlanning(FHTNPlan& Plan, const FHTNPlanStepID& ThisStepID, int32 SubLevelIndex,
+	TSharedPtr<FBlackboardWorldState> WorldState)
+{
+	const FHTNPlanStep& Step = Plan.GetStep(ThisStepID);
+
+	// Chosen branch finished, set up the continuation.
+	if (SubLevelIndex == Step.SubLevelIndex && Step.SecondarySubLevelIndex != INDEX_NONE)
+	{
+		// Copy the continuation level before modifying it, as it might be shared with other candidate plans.
+		TSharedPtr<FHTNPlanLevel>& NextLevel = Plan.Levels[Step.SecondarySubLevelIndex];
+		NextLevel = MakeShared<FHTNPlanLevel>(*NextLevel);
+
+		NextLevel->WorldStateAtLevelStart = WorldState;
+		return false;
+	}
+
+	return true;
+}
+
+void UHTNNode_AnyOrderN::GetNextPrimitiveSteps(FHTNGetNextStepsContext& Context, const FHTNPlanStepID& ThisStepID)
+{
+	const FHTNPlanStep& Step = Context.Plan.GetStep(ThisStepID);
+
+	const int32 NumAddedFromBranch = Context.AddFirstPrimitiveStepsInLevel(Step.SubLevelIndex);
+	if (NumAddedFromBranch == 0)
+	{
+		Context.AddFirstPrimitiveStepsInLevel(Step.SecondarySubLevelIndex);
+	}
+}
+
+void UHTNNode_AnyOrderN::GetNextPrimitiveSteps(FHTNGetNextStepsContext& Context, const FHTNPlanStepID& ThisStepID, int32 FinishedSubLevelIndex)
+{
+	const FHTNPlanStep& Step = Context.Plan.GetStep(ThisStepID);
+
+	int32 NumAdded = 0;
+	if (FinishedSubLevelIndex == Step.SubLevelIndex)
+	{
+		NumAdded = Context.AddFirstPrimitiveStepsInLevel(Step.SecondarySubLevelIndex);
+	}
+
+	if (NumAdded == 0)
+	{
+		Super::GetNextPrimitiveSteps(Context, ThisStepID, FinishedSubLevelIndex);
+	}
+}
+
+bool UHTNNode_AnyOrderN::CanIncludeSubnodesInSubnodeQuery(const UHTNComponent& OwnerComp,
+	const FHTNPlanStepID& ThisStepID, int32 SubLevelIndex, bool bOnlyStarting, bool bOnlyEnding
+) const
+{
+	const FHTNPlanStep& Step = OwnerComp.GetCurrentPlan()->GetStep(ThisStepID);
+	// Only start subnodes if the starting sublevel is the first one.
+	if (bOnlyStarting)
+	{
+		return SubLevelIndex == Step.GetFirstSubLevelIndex();
+	}
+	// Only end subnodes if the ending sublevel is the last one.
+	else if (bOnlyEnding)
+	{
+		return SubLevelIndex == Step.GetLastSubLevelIndex();
+	}
+
+	return true;
+}
+
+FString UHTNNode_AnyOrderN::GetStaticDescription() const
+{
+	return FString::Printf(TEXT("%s%s"),
+		*Super::GetStaticDescription(),
+		bPruneCommutingBranches ? TEXT("\n(prunes orders of commuting branches)") : TEXT("")
+	);
+}
+
+TArrayView<UHTNStandaloneNode*> UHTNNode_AnyOrderN::GetNextNodesInSubLevel(const FHTNPlanStep& Step, int32 SubLevelIndex) const
+{
+	UHTNNode_AnyOrderN& MutableThis = const_cast<UHTNNode_AnyOrderN&>(*this);
+	if (SubLevelIndex == Step.SubLevelIndex)
+	{
+		return ensure(NextNodes.IsValidIndex(Step.AnyOrderBranchIndex)) ?
+			TArrayView<UHTNStandaloneNode*>(&MutableThis.NextNodes[Step.AnyOrderBranchIndex], 1) :
+			TArrayView<UHTNStandaloneNode*>();
+	}
+
+	return TArrayView<UHTNStandaloneNode*>(&MutableThis.ContinuationNode, 1);
+}
+
+bool UHTNNode_AnyOrderN::IsCanonicalBranchOrder(const FHTNPlan& Plan, const TArrayView<const FHTNPlanStepID>& StepIDs) const
+{
+	struct Local
+	{
+		static void GetChangedKeys(const FHTNPlan& Plan, const FHTNPlanStep& Step, TArray<FBlackboard::FKey>& OutKeys)
+		{
+			const TSharedPtr<FBlackboardWorldState>& WorldStateBefore = Plan.Levels[Step.SubLevelIndex]->WorldStateAtLevelStart;
+			const TSharedPtr<FBlackboardWorldState>& WorldStateAfter = Plan.Levels[Step.SecondarySubLevelIndex]->WorldStateAtLevelStart;
+			if (ensure(WorldStateBefore.IsValid() && WorldStateAfter.IsValid()))
+			{
+				WorldStateBefore->GetKeysWithDifferentValues(*WorldStateAfter, OutKeys);
+			}
+		}
+	};
+
+	if (StepIDs.Num() < 2)
+	{
+		return true;
+	}
+
+	// The most recently planned branch can be swapped with the branches before it for as long as they change different keys.
+	// If it could be moved in front of a branch with a higher index that way, the same order is planned with it in front instead.
+	const FHTNPlanStep& LastStep = Plan.GetStep(StepIDs.Last());
+	TArray<FBlackboard::FKey> LastBranchChangedKeys;
+	Local::GetChangedKeys(Plan, LastStep, LastBranchChangedKeys);
+
+	TArray<FBlackboard::FKey> ChangedKeys;
+	for (int32 I = StepIDs.Num() - 2; I >= 0; --I)
+	{
+		const FHTNPlanStep& Step = Plan.GetStep(StepIDs[I]);
+
+		ChangedKeys.Reset();
+		Local::GetChangedKeys(Plan, Step, ChangedKeys);
+		const bool bCommutes = !ChangedKeys.ContainsByPredicate([&](FBlackboard::FKey KeyID) { return LastBranchChangedKeys.Contains(KeyID); });
+		if (!bCommutes)
+		{
+			return true;
+		}
+
+		if (LastStep.AnyOrderBranchIndex < Step.AnyOrderBranchIndex)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void UHTNNode_AnyOrderNContinuation::MakePlanExpansions(FHTNPlanningContext& Context)
+{
+	GetAnyOrderNode()->MakePlanExpansions(Context);
+}
+
+bool UHTNNode_AnyOrderNContinuation::OnSubLevelFinishedPlanning(FHTNPlan& Plan, const FHTNPlanStepID& ThisStepID, int32 SubLevelIndex,
+	TSharedPtr<FBlackboardWorldState> WorldState)
+{
+	return GetAnyOrderNode()->OnSubLevelFinishedPlanning(Plan, ThisStepID, SubLevelIndex, WorldState);
+}
+
+void UHTNNode_AnyOrderNContinuation::GetNextPrimitiveSteps(FHTNGetNextStepsContext& Context, const FHTNPlanStepID& ThisStepID)
+{
+	GetAnyOrderNode()->GetNextPrimitiveSteps(Context, ThisStepID);
+}
+
+void UHTNNode_AnyOrderNContinuation::GetNextPrimitiveSteps(FHTNGetNextStepsContext& Context, const FHTNPlanStepID& ThisStepID, int32 FinishedSubLevelIndex)
+{
+	GetAnyOrderNode()->GetNextPrimitiveSteps(Context, ThisStepID, FinishedSubLevelIndex);
+}
+
+bool UHTNNode_AnyOrderNContinuation::CanIncludeSubnodesInSubnodeQuery(const UHTNComponent& OwnerComp,
+	const FHTNPlanStepID& ThisStepID, int32 SubLevelIndex, bool bOnlyStarting, bool bOnlyEnding
+) const
+{
+	return GetAnyOrderNode()->CanIncludeSubnodesInSubnodeQuery(OwnerComp, ThisStepID, SubLevelIndex, bOnlyStarting, bOnlyEnding);
+}
@@ -30,6 +30,12 @@ void UHTNNode_SubNetwork::MakePlanExpansions(FHTNPlanningContext& Context)
 	// Valid subnetwork, add a sublevel.
 	if (IsSubHTNValid())
 	{
+		if (HTN->GetStaticAnalysis().bIsInfeasible)
+		{
+			Context.PlanningTask->SetNodePlanningFailureReason(TEXT("subnetwork can never produce a plan"));
+			return;
+		}
+
 		AddedStep->SubLevelIndex = Context.AddLevel(*NewPlan, HTN, AddedStepID);
 	}
 	
@@ -31,3 +31,9 @@ FString UHTNTask_ClearValue::GetStaticDescription() const
 		*BlackboardKey.SelectedKeyName.ToString()
 	);
 }
+
+bool UHTNTask_ClearValue::GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const
+{
+	OutKeyNames.Add(BlackboardKey.SelectedKeyName);
+	return true;
+}
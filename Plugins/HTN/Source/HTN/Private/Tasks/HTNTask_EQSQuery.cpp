@@ -2,6 +2,8 @@
 
 #include "Tasks/HTNTask_EQSQuery.h"
 #include "GameFramework/Controller.h"
+#include "AISystem.h"
+#include "Async/Async.h"
 #include "BehaviorTree/Blackboard/BlackboardKeyType_Vector.h"
 #include "BehaviorTree/Blackboard/BlackboardKeyType_Object.h"
 #include "EnvironmentQuery/Items/EnvQueryItemType_VectorBase.h"
@@ -12,9 +14,20 @@
 #include "Runtime/Launch/Resources/Version.h"
 #include "VisualLogger/VisualLogger.h"
 
+#include "HTNPlan.h"
+#include "HTNSquad.h"
+
 UHTNTask_EQSQuery::UHTNTask_EQSQuery(const FObjectInitializer& Initializer) : Super(Initializer),
 	MaxNumCandidatePlans(1),
-	Cost(100)
+	Cost(100),
+	bContinuePlanningWhileQueryRuns(false),
+	bCacheQueryResults(false),
+	CacheDuration(1.0f),
+	CacheInvalidationDistance(100.0f),
+	StaleResultGracePeriod(0.0f),
+	bShareResultsWithSquad(false),
+	bAvoidSquadClaims(false),
+	SquadClaimRadius(100.0f)
 {
 	NodeName = TEXT("EQS Query");
 	bShowTaskNameOnCurrentPlanVisualization = false;
@@ -24,6 +37,14 @@ void UHTNTask_EQSQuery::InitializeFromAsset(UHTN& Asset)
 {
 	Super::InitializeFromAsset(Asset);
 	EQSRequest.InitForOwnerAndBlackboard(*this, GetBlackboardAsset());
+
+	if (const UBlackboardData* const BBAsset = GetBlackboardAsset())
+	{
+		for (FBlackboardKeySelector& CacheKey : AdditionalCacheKeys)
+		{
+			CacheKey.ResolveSelectedKey(*BBAsset);
+		}
+	}
 }
 
 void UHTNTask_EQSQuery::CreatePlanSteps(UHTNComponent& OwnerComp, UAITask_MakeHTNPlan& PlanningTask, const TSharedRef<const FBlackboardWorldState>& WorldState) const
@@ -52,80 +73,410 @@ void UHTNTask_EQSQuery::CreatePlanSteps(UHTNComponent& OwnerComp, UAITask_MakeHT
 		return;
 	}
 
-	const int32 RequestID = EQSRequest.Execute(*QueryOwner, *WorldState, FQueryFinishedSignature::CreateWeakLambda(const_cast<UHTNTask_EQSQuery*>(this), 
-	[
-		this, 
-		WorldStatePtr = TWeakPtr<const FBlackboardWorldState>(WorldState), 
-		PlanningTaskPtr = TWeakObjectPtr<UAITask_MakeHTNPlan>(&PlanningTask)
-	]
-	(TSharedPtr<FEnvQueryResult> Result)
+	// Submits the plan steps once the query finishes. Used both for queries this agent runs and those it waits for.
+	const auto MakeResultHandler = [&](int32 LatentCreatePlanStepsID)
 	{
-		ON_SCOPE_EXIT
+		return [
+			this,
+			WorldStatePtr = TWeakPtr<const FBlackboardWorldState>(WorldState),
+			PlanningTaskPtr = TWeakObjectPtr<UAITask_MakeHTNPlan>(&PlanningTask),
+			LatentCreatePlanStepsID,
+			OwnerCompPtr = TWeakObjectPtr<UHTNComponent>(&OwnerComp)
+		]
+		(TSharedPtr<FEnvQueryResult> Result)
 		{
-			if (PlanningTaskPtr.IsValid())
+			ON_SCOPE_EXIT
+			{
+				if (PlanningTaskPtr.IsValid())
+				{
+					PlanningTaskPtr->FinishLatentCreatePlanSteps(LatentCreatePlanStepsID);
+				}
+			};
+
+			if (!PlanningTaskPtr.IsValid() || !OwnerCompPtr.IsValid())
 			{
-				PlanningTaskPtr->FinishLatentCreatePlanSteps(this);
+				return;
 			}
+
+			const TSharedPtr<const FBlackboardWorldState> OldWorldState = WorldStatePtr.Pin();
+			if (!OldWorldState.IsValid())
+			{
+				return;
+			}
+
+			if (!Result.IsValid())
+			{
+				PlanningTaskPtr->SetNodePlanningFailureReason(TEXT("EQS query failed"));
+				return;
+			}
+
+			SubmitPlanStepsFromQueryResult(*OwnerCompPtr, *PlanningTaskPtr, *OldWorldState, *Result, LatentCreatePlanStepsID);
 		};
+	};
 
-		if (!PlanningTaskPtr.IsValid())
+	FString CacheKey;
+	FVector QuerierLocation = FAISystem::InvalidLocation;
+	FResultCacheRef CacheRef;
+	if (bCacheQueryResults)
+	{
+		CacheKey = MakeCacheKey(*WorldState);
+		CacheRef = MakeResultCacheRef(OwnerComp);
+		QuerierLocation = WorldState->GetValue<UBlackboardKeyType_Vector>(FBlackboard::KeySelfLocation);
+		if (!FAISystem::IsValidLocation(QuerierLocation))
 		{
-			return;
+			QuerierLocation = QueryOwner->GetActorLocation();
+		}
+
+		FResultCache& Cache = GetResultCache(OwnerComp);
+		if (FCachedResult* const CachedResult = Cache.Results.Find(CacheKey))
+		{
+			const float Age = OwnerComp.GetWorld()->GetTimeSeconds() - CachedResult->Timestamp;
+			const bool bQuerierMovedTooFar = FVector::DistSquared(QuerierLocation, CachedResult->QuerierLocation) > FMath::Square(CacheInvalidationDistance);
+			if (!bQuerierMovedTooFar && Age <= CacheDuration + StaleResultGracePeriod && CachedResult->Result.IsValid())
+			{
+				const TSharedRef<FEnvQueryResult> CachedQueryResult = CachedResult->Result.ToSharedRef();
+
+				// Refresh the stale result in the background without making the planner wait for it.
+				if (Age > CacheDuration && !CachedResult->bIsRefreshing)
+				{
+					CachedResult->bIsRefreshing = true;
+					CachedResult->RefreshQuerierLocation = QuerierLocation;
+					const int32 RefreshRequestID = EQSRequest.Execute(*QueryOwner, *WorldState, FQueryFinishedSignature::CreateWeakLambda(const_cast<UHTNTask_EQSQuery*>(this),
+						[this, CacheRef, CacheKey, QuerierLocation](TSharedPtr<FEnvQueryResult> Result)
+						{
+							StoreResultInCache(CacheRef, CacheKey, QuerierLocation, Result);
+						}));
+					if (RefreshRequestID == INDEX_NONE)
+					{
+						StoreResultInCache(CacheRef, CacheKey, QuerierLocation, nullptr);
+					}
+				}
+
+				UE_VLOG(&OwnerComp, LogHTN, VeryVerbose, TEXT("%s: reusing cached query result (age %.2fs)"), *GetNodeName(), Age);
+				SubmitPlanStepsFromQueryResult(OwnerComp, PlanningTask, *WorldState, *CachedQueryResult, INDEX_NONE);
+				return;
+			}
+
+			// The same query is already running from nearby (e.g. for another squad member), so wait for its result instead of running it again.
+			if (CachedResult->bIsRefreshing && FVector::DistSquared(QuerierLocation, CachedResult->RefreshQuerierLocation) <= FMath::Square(CacheInvalidationDistance))
+			{
+				UE_VLOG(&OwnerComp, LogHTN, VeryVerbose, TEXT("%s: waiting for a query that is already running"), *GetNodeName());
+				const int32 LatentCreatePlanStepsID = PlanningTask.WaitForLatentCreatePlanSteps(this, bContinuePlanningWhileQueryRuns);
+				CachedResult->Waiters.Add({ &OwnerComp, MakeResultHandler(LatentCreatePlanStepsID) });
+				return;
+			}
+		}
+
+		FCachedResult& PendingResult = Cache.Results.FindOrAdd(CacheKey);
+		PendingResult.bIsRefreshing = true;
+		PendingResult.RefreshQuerierLocation = QuerierLocation;
+	}
+
+	const int32 LatentCreatePlanStepsID = PlanningTask.WaitForLatentCreatePlanSteps(this, bContinuePlanningWhileQueryRuns);
+	const int32 RequestID = EQSRequest.Execute(*QueryOwner, *WorldState, FQueryFinishedSignature::CreateWeakLambda(const_cast<UHTNTask_EQSQuery*>(this), 
+	[
+		this, 
+		OnResult = MakeResultHandler(LatentCreatePlanStepsID),
+		CacheRef,
+		CacheKey,
+		QuerierLocation
+	]
+	(TSharedPtr<FEnvQueryResult> Result)
+	{
+		if (bCacheQueryResults)
+		{
+			StoreResultInCache(CacheRef, CacheKey, QuerierLocation, Result);
 		}
 		
-#if ENGINE_MAJOR_VERSION >= 5
-		const bool bSuccess = Result.IsValid() && Result->IsSuccessful() && Result->Items.Num() > 0;
-#else
-		const bool bSuccess = Result.IsValid() && Result->IsSuccsessful() && Result->Items.Num() > 0;
-#endif
-		if (!bSuccess)
+		OnResult(Result);
+	}));
+
+	if (RequestID == INDEX_NONE)
+	{
+		if (bCacheQueryResults)
 		{
-			PlanningTaskPtr->SetNodePlanningFailureReason(TEXT("EQS query failed"));
-			return;
+			StoreResultInCache(CacheRef, CacheKey, QuerierLocation, nullptr);
 		}
 
-		const TSharedPtr<const FBlackboardWorldState> OldWorldState = WorldStatePtr.Pin();
-		if (!OldWorldState.IsValid())
+		PlanningTask.SetNodePlanningFailureReason(TEXT("failed to start EQS query"));
+		PlanningTask.FinishLatentCreatePlanSteps(LatentCreatePlanStepsID);
+	}
+}
+
+int32 UHTNTask_EQSQuery::GetMinPlanningCost() const
+{
+	return FMath::Max(0, Cost);
+}
+
+bool UHTNTask_EQSQuery::GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const
+{
+	OutKeyNames.Add(BlackboardKey.SelectedKeyName);
+	return true;
+}
+
+void UHTNTask_EQSQuery::GetImplicitlyReadBlackboardKeys(TArray<FName>& OutKeyNames) const
+{
+	// The querier location cached query results are matched against.
+	if (bCacheQueryResults)
+	{
+		OutKeyNames.Add(FBlackboard::KeySelfLocation);
+	}
+}
+
+uint16 UHTNTask_EQSQuery::GetInstanceMemorySize() const { return sizeof(FNodeMemory); }
+
+void UHTNTask_EQSQuery::InitializeMemory(UHTNComponent& OwnerComp, uint8* NodeMemory, const FHTNPlan& Plan, const FHTNPlanStepID& StepID) const
+{
+	FNodeMemory* const Memory = CastInstanceNodeMemory<FNodeMemory>(NodeMemory);
+	*Memory = {};
+
+	// Claim the result this plan uses so that other squad members plan with different ones.
+	UHTNSquad* const Squad = bAvoidSquadClaims ? OwnerComp.GetSquad() : nullptr;
+	const FHTNPlanStep* const Step = Squad ? Plan.FindStep(StepID) : nullptr;
+	if (Step && Step->WorldState.IsValid())
+	{
+		const FVector Location = Step->WorldState->GetLocation(BlackboardKey);
+		if (FAISystem::IsValidLocation(Location))
 		{
-			return;
+			Squad->ClaimLocation(OwnerComp, Location);
+			Memory->Squad = Squad;
+			Memory->ClaimedLocation = Location;
 		}
+	}
+}
+
+void UHTNTask_EQSQuery::CleanupMemory(UHTNComponent& OwnerComp, uint8* NodeMemory) const
+{
+	FNodeMemory* const Memory = CastInstanceNodeMemory<FNodeMemory>(NodeMemory);
+	if (UHTNSquad* const Squad = Memory->Squad.Get())
+	{
+		Squad->ReleaseLocation(OwnerComp, Memory->ClaimedLocation);
+	}
+	Memory->Squad.Reset();
+}
+
+void UHTNTask_EQSQuery::SubmitPlanStepsFromQueryResult(const UHTNComponent& OwnerComp, UAITask_MakeHTNPlan& PlanningTask, const FBlackboardWorldState& WorldState, const FEnvQueryResult& Result, int32 LatentCreatePlanStepsID) const
+{
+#if ENGINE_MAJOR_VERSION >= 5
+	const bool bSuccess = Result.IsSuccessful() && Result.Items.Num() > 0;
+#else
+	const bool bSuccess = Result.IsSuccsessful() && Result.Items.Num() > 0;
+#endif
+	if (!bSuccess)
+	{
+		PlanningTask.SetNodePlanningFailureReason(TEXT("EQS query failed"));
+		return;
+	}
+
+	UEnvQueryItemType* const ItemTypeCDO = Result.ItemType->GetDefaultObject<UEnvQueryItemType>();
+	if (!ensure(ItemTypeCDO))
+	{
+		return;
+	}
+
+	const UHTNSquad* const Squad = bAvoidSquadClaims ? OwnerComp.GetSquad() : nullptr;
+	UEnvQueryItemType_VectorBase* const ItemTypeVectorBase = Cast<UEnvQueryItemType_VectorBase>(ItemTypeCDO);
 
-		UEnvQueryItemType* const ItemTypeCDO = Result->ItemType->GetDefaultObject<UEnvQueryItemType>();
-		if (!ensure(ItemTypeCDO))
+	const int32 MaxNumSteps = EQSRequest.RunMode == EEnvQueryRunMode::AllMatching ? FMath::Max(MaxNumCandidatePlans, 0) : 1;
+	int32 NumSteps = 0;
+	int32 NumClaimedItems = 0;
+	for (int32 ItemIndex = 0; ItemIndex < Result.Items.Num() && (MaxNumSteps <= 0 || NumSteps < MaxNumSteps); ++ItemIndex)
+	{
+		const uint8* const RawItemData = Result.RawData.GetData() + Result.Items[ItemIndex].DataOffset;
+		if (Squad && ItemTypeVectorBase && Squad->IsLocationClaimedByOthers(OwnerComp, ItemTypeVectorBase->GetItemLocation(RawItemData), SquadClaimRadius))
 		{
-			return;
+			++NumClaimedItems;
+			continue;
 		}
 
-		const int32 MaxNumSteps = EQSRequest.RunMode == EEnvQueryRunMode::AllMatching ? FMath::Max(MaxNumCandidatePlans, 0) : 1;
-		const int32 NumSteps = MaxNumSteps > 0 ? FMath::Min(Result->Items.Num(), MaxNumSteps) : Result->Items.Num();
-		for (int32 ItemIndex = 0; ItemIndex < NumSteps; ++ItemIndex)
+		++NumSteps;
+		const TSharedRef<FBlackboardWorldState> NewWorldState = WorldState.MakeNext();
+		if (StoreInWorldState(ItemTypeCDO, BlackboardKey, *NewWorldState, RawItemData))
 		{
-			const TSharedRef<FBlackboardWorldState> NewWorldState = OldWorldState->MakeNext();
-			const uint8* const RawItemData = Result->RawData.GetData() + Result->Items[ItemIndex].DataOffset;
-			if (StoreInWorldState(ItemTypeCDO, BlackboardKey, *NewWorldState, RawItemData))
-			{
 #if HTN_DEBUG_PLANNING && ENABLE_VISUAL_LOG
-				const FString Description = FVisualLogger::IsRecording() ? ItemTypeCDO->GetDescription(RawItemData) : TEXT("");
+			const FString Description = FVisualLogger::IsRecording() ? ItemTypeCDO->GetDescription(RawItemData) : TEXT("");
 #else
-				const FString Description = TEXT("");
+			const FString Description = TEXT("");
 #endif
-				PlanningTaskPtr->SubmitPlanStep(this, NewWorldState, FMath::Max(0, Cost), Description);
+			if (LatentCreatePlanStepsID != INDEX_NONE)
+			{
+				PlanningTask.SubmitLatentPlanStep(LatentCreatePlanStepsID, NewWorldState, FMath::Max(0, Cost), Description);
 			}
 			else
 			{
-				UE_LOG(LogHTN, Error, TEXT("%s: Failed to store result %i (%s) into world state at key %s"), 
-					*GetNodeName(), ItemIndex, *ItemTypeCDO->GetDescription(RawItemData), *BlackboardKey.SelectedKeyName.ToString()
-				);
+				PlanningTask.SubmitPlanStep(this, NewWorldState, FMath::Max(0, Cost), Description);
 			}
 		}
-	}));
+		else
+		{
+			UE_LOG(LogHTN, Error, TEXT("%s: Failed to store result %i (%s) into world state at key %s"), 
+				*GetNodeName(), ItemIndex, *ItemTypeCDO->GetDescription(RawItemData), *BlackboardKey.SelectedKeyName.ToString()
+			);
+		}
+	}
 
-	if (RequestID != INDEX_NONE)
+	if (!NumSteps && NumClaimedItems)
 	{
-		PlanningTask.WaitForLatentCreatePlanSteps(this);
+		PlanningTask.SetNodePlanningFailureReason(TEXT("all EQS results are claimed by other squad members"));
 	}
 }
 
+FString UHTNTask_EQSQuery::MakeCacheKey(const FBlackboardWorldState& WorldState) const
+{
+	TStringBuilder<256> StringBuilder;
+	const auto AppendKeyValue = [&](const FBlackboardKeySelector& KeySelector)
+	{
+		StringBuilder << WorldState.DescribeKeyValue(KeySelector.GetSelectedKeyID(), EBlackboardDescription::OnlyValue) << TEXT("|");
+	};
+	
+	if (EQSRequest.bUseBBKeyForQueryTemplate)
+	{
+		AppendKeyValue(EQSRequest.EQSQueryBlackboardKey);
+	}
+
+	for (const FAIDynamicParam& RuntimeParam : EQSRequest.QueryConfig)
+	{
+		if (RuntimeParam.BBKey.IsSet())
+		{
+			AppendKeyValue(RuntimeParam.BBKey);
+		}
+	}
+
+	for (const FBlackboardKeySelector& KeySelector : AdditionalCacheKeys)
+	{
+		AppendKeyValue(KeySelector);
+	}
+
+	return StringBuilder.ToString();
+}
+
+UHTNTask_EQSQuery::FResultCache& UHTNTask_EQSQuery::GetResultCache(UHTNComponent& OwnerComp) const
+{
+	if (bShareResultsWithSquad)
+	{
+		if (UHTNSquad* const Squad = OwnerComp.GetSquad())
+		{
+			return Squad->GetSharedNodeCache<FResultCache>(*this);
+		}
+	}
+
+	return OwnerComp.GetPersistentNodeCache<FResultCache>(*this);
+}
+
+UHTNTask_EQSQuery::FResultCacheRef UHTNTask_EQSQuery::MakeResultCacheRef(UHTNComponent& OwnerComp) const
+{
+	FResultCacheRef CacheRef;
+	CacheRef.World = OwnerComp.GetWorld();
+	UHTNSquad* const Squad = bShareResultsWithSquad ? OwnerComp.GetSquad() : nullptr;
+	if (Squad)
+	{
+		CacheRef.Squad = Squad;
+	}
+	else
+	{
+		CacheRef.Component = &OwnerComp;
+	}
+
+	return CacheRef;
+}
+
+UHTNTask_EQSQuery::FResultCache* UHTNTask_EQSQuery::FindResultCache(const FResultCacheRef& CacheRef) const
+{
+	// Don't fall back to the cache of the agent if the squad is gone, the query wasn't running for it.
+	if (!CacheRef.Squad.IsExplicitlyNull())
+	{
+		const UHTNSquad* const Squad = CacheRef.Squad.Get();
+		return Squad ? Squad->FindSharedNodeCache<FResultCache>(*this) : nullptr;
+	}
+
+	const UHTNComponent* const Component = CacheRef.Component.Get();
+	return Component ? Component->FindPersistentNodeCache<FResultCache>(*this) : nullptr;
+}
+
+void UHTNTask_EQSQuery::StoreResultInCache(const FResultCacheRef& CacheRef, const FString& CacheKey, const FVector& QuerierLocation, TSharedPtr<FEnvQueryResult> Result) const
+{
+	// If the cache was cleared since the query started, its waiters were already failed.
+	FResultCache* const Cache = FindResultCache(CacheRef);
+	if (!Cache || !Cache->Results.Contains(CacheKey))
+	{
+		return;
+	}
+
+	const UWorld* const World = CacheRef.World.Get();
+	const float CurrentTime = World ? World->GetTimeSeconds() : 0.0f;
+
+	// Drop results that can't be used anymore so the cache doesn't grow with every new combination of worldstate values.
+	const float MaxAge = CacheDuration + StaleResultGracePeriod;
+	for (auto It = Cache->Results.CreateIterator(); It; ++It)
+	{
+		if (CurrentTime - It->Value.Timestamp > MaxAge && !It->Value.bIsRefreshing)
+		{
+			It.RemoveCurrent();
+		}
+	}
+
+	FCachedResult& CachedResult = Cache->Results.FindChecked(CacheKey);
+	CachedResult.bIsRefreshing = false;
+	if (World && Result.IsValid() && !Result->IsAborted())
+	{
+		CachedResult.Result = Result;
+		CachedResult.QuerierLocation = QuerierLocation;
+		CachedResult.Timestamp = CurrentTime;
+	}
+
+	// Notify only once the cache is up to date, since the waiters may continue planning and run this task again.
+	const TArray<FWaiter> Waiters = MoveTemp(CachedResult.Waiters);
+	CachedResult.Waiters.Reset();
+	for (const FWaiter& Waiter : Waiters)
+	{
+		Waiter.OnResult(Result);
+	}
+}
+
+void UHTNTask_EQSQuery::FailWaitersLater(TArray<FWaiter>&& Waiters)
+{
+	if (Waiters.Num())
+	{
+		AsyncTask(ENamedThreads::GameThread, [Waiters = MoveTemp(Waiters)]()
+		{
+			for (const FWaiter& Waiter : Waiters)
+			{
+				Waiter.OnResult(nullptr);
+			}
+		});
+	}
+}
+
+UHTNTask_EQSQuery::FResultCache::~FResultCache()
+{
+	TArray<FWaiter> Waiters;
+	for (TPair<FString, FCachedResult>& Pair : Results)
+	{
+		Waiters.Append(MoveTemp(Pair.Value.Waiters));
+	}
+
+	FailWaitersLater(MoveTemp(Waiters));
+}
+
+void UHTNTask_EQSQuery::FResultCache::OnSquadMemberRemoved(const UHTNComponent& Member)
+{
+	TArray<FWaiter> RemovedWaiters;
+	for (TPair<FString, FCachedResult>& Pair : Results)
+	{
+		TArray<FWaiter>& Waiters = Pair.Value.Waiters;
+		for (int32 I = Waiters.Num() - 1; I >= 0; --I)
+		{
+			if (Waiters[I].Member == &Member)
+			{
+				RemovedWaiters.Add(MoveTemp(Waiters[I]));
+				Waiters.RemoveAt(I);
+			}
+		}
+	}
+
+	FailWaitersLater(MoveTemp(RemovedWaiters));
+}
+
 FString UHTNTask_EQSQuery::GetStaticDescription() const
 {
 	TStringBuilder<2048> StringBuilder;
@@ -159,6 +510,30 @@ FString UHTNTask_EQSQuery::GetStaticDescription() const
 		StringBuilder << FString::Printf(TEXT("\nCost: %i"), Cost);
 	}
 
+	if (bContinuePlanningWhileQueryRuns)
+	{
+		StringBuilder << TEXT("\nPlanning continues while the query runs");
+	}
+
+	if (bCacheQueryResults)
+	{
+		StringBuilder << FString::Printf(TEXT("\nReuses results for %.1fs within %.0fcm"), CacheDuration, CacheInvalidationDistance);
+		if (StaleResultGracePeriod > 0.0f)
+		{
+			StringBuilder << FString::Printf(TEXT(" (+%.1fs while refreshing)"), StaleResultGracePeriod);
+		}
+
+		if (bShareResultsWithSquad)
+		{
+			StringBuilder << TEXT("\nShares results with squad");
+		}
+	}
+
+	if (bAvoidSquadClaims)
+	{
+		StringBuilder << FString::Printf(TEXT("\nAvoids results within %.0fcm of squad claims"), SquadClaimRadius);
+	}
+
 	return StringBuilder.ToString();
 }
 
@@ -11,10 +11,58 @@
 #include "VisualLogger/VisualLogger.h"
 #include "HTNPlanStep.h"
 
+namespace
+{
+	// Plan-time pathfinding results shared by all MoveTo tasks during a single planning run.
+	struct FHTNMoveToPlanningCache : public FHTNNodePlanningCache
+	{
+		struct FPathKey
+		{
+			FVector StartLocation = FVector::ZeroVector;
+			FVector GoalLocation = FVector::ZeroVector;
+			const ANavigationData* NavData = nullptr;
+			const FNavigationQueryFilter* QueryFilter = nullptr;
+			int32 NavDataFlags = 0;
+			bool bAllowPartialPath = false;
+
+			FORCEINLINE bool operator==(const FPathKey& Other) const
+			{
+				return StartLocation == Other.StartLocation && GoalLocation == Other.GoalLocation &&
+					NavData == Other.NavData && QueryFilter == Other.QueryFilter &&
+					NavDataFlags == Other.NavDataFlags && bAllowPartialPath == Other.bAllowPartialPath;
+			}
+
+			FORCEINLINE friend uint32 GetTypeHash(const FPathKey& Key)
+			{
+				return HashCombine(HashCombine(GetTypeHash(Key.StartLocation), GetTypeHash(Key.GoalLocation)),
+					HashCombine(HashCombine(GetTypeHash(Key.NavData), GetTypeHash(Key.QueryFilter)), GetTypeHash(Key.NavDataFlags * 2 + Key.bAllowPartialPath)));
+			}
+		};
+
+		struct FPathResult
+		{
+			FVector PathEndLocation = FVector::ZeroVector;
+			float PathLength = 0.0f;
+			float PathCost = 0.0f;
+			bool bSuccess = false;
+		};
+
+		// Results of full pathfinding queries.
+		TMap<FPathKey, FPathResult> PathResults;
+
+		// Path length and cost from a start location to each navmesh polygon reached by a batched search.
+		// Keyed by FPathKey with a zero GoalLocation.
+		TMap<FPathKey, TMap<NavNodeRef, FPathResult>> BatchedSearchResults;
+	};
+}
+
 UHTNTask_MoveTo::UHTNTask_MoveTo(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer),
 	bTestPathDuringPlanning(true),
 	bUsePathCostInsteadOfLength(false),
 	bForcePlanTimeStringPulling(false),
+	bCachePlanTimePaths(true),
+	bUseBatchedPathCostEstimate(false),
+	BatchedPathSearchDistance(5000.0f),
 	CostPerUnitPathLength(1.0f)
 {
 	NodeName = TEXT("Move To");
@@ -55,7 +103,7 @@ void UHTNTask_MoveTo::CreatePlanSteps(UHTNComponent& OwnerComp, UAITask_MakeHTNP
 	
 	FVector LocationOnEnd;
 	float PathCostEstimate = -1.0f;
-	if (!PlanTimeTestPath(OwnerComp, RawLocationOnStart, RawTargetLocation, LocationOnEnd, PathCostEstimate))
+	if (!PlanTimeTestPath(OwnerComp, PlanningTask, RawLocationOnStart, RawTargetLocation, LocationOnEnd, PathCostEstimate))
 	{
 		PlanningTask.SetNodePlanningFailureReason(TEXT("plan-time test failed"));
 		return;
@@ -66,6 +114,17 @@ void UHTNTask_MoveTo::CreatePlanSteps(UHTNComponent& OwnerComp, UAITask_MakeHTNP
 	PlanningTask.SubmitPlanStep(this, NewWorldState, GetTaskCostFromPathLength(PathCostEstimate));
 }
 
+bool UHTNTask_MoveTo::GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const
+{
+	OutKeyNames.Add(FBlackboard::KeySelfLocation);
+	return true;
+}
+
+void UHTNTask_MoveTo::GetImplicitlyReadBlackboardKeys(TArray<FName>& OutKeyNames) const
+{
+	OutKeyNames.Add(FBlackboard::KeySelfLocation);
+}
+
 uint16 UHTNTask_MoveTo::GetInstanceMemorySize() const
 {
 	return sizeof(FHTNMoveToTaskMemory);
@@ -283,9 +342,12 @@ UAITask_HTNMoveTo* UHTNTask_MoveTo::PrepareMoveTask(UHTNComponent& OwnerComp, UA
 	return nullptr;
 }
 
-bool UHTNTask_MoveTo::PlanTimeTestPath(UHTNComponent& OwnerComp, const FVector& RawStartLocation, 
+bool UHTNTask_MoveTo::PlanTimeTestPath(UHTNComponent& OwnerComp, UAITask_MakeHTNPlan& PlanningTask, const FVector& RawStartLocation, 
 	const FVector& RawGoalLocation, FVector& OutEndLocation, float& OutPathCostEstimate) const
 {
+	using FPathKey = FHTNMoveToPlanningCache::FPathKey;
+	using FPathResult = FHTNMoveToPlanningCache::FPathResult;
+	
 	struct Local
 	{
 		static bool GetPawnAndNavData(UHTNComponent& InOwnerComp, const FVector& InRawStartLocation,
@@ -310,6 +372,54 @@ bool UHTNTask_MoveTo::PlanTimeTestPath(UHTNComponent& OwnerComp, const FVector&
 
 			return false;
 		}
+
+		// Answers the query using a single search outward from the start location, shared by all goals with the same start.
+		// Returns false if the estimate is not available, in which case regular pathfinding should be used.
+		static bool EstimatePathBatched(FHTNMoveToPlanningCache& Cache, const FPathKey& Key, const FPathFindingQuery& Query, float SearchDistance, FPathResult& OutResult)
+		{
+#if WITH_RECAST
+			const ARecastNavMesh* const NavMesh = Cast<const ARecastNavMesh>(Key.NavData);
+			if (!NavMesh)
+			{
+				return false;
+			}
+
+			FPathKey SearchKey = Key;
+			SearchKey.GoalLocation = FVector::ZeroVector;
+			TMap<NavNodeRef, FPathResult>* PolyResults = Cache.BatchedSearchResults.Find(SearchKey);
+			if (!PolyResults)
+			{
+				PolyResults = &Cache.BatchedSearchResults.Add(SearchKey);
+
+				FRecastDebugPathfindingData NodePoolData(ERecastDebugPathfindingFlags::PathLength);
+				TArray<NavNodeRef> FoundPolys;
+				NavMesh->GetPolysWithinPathingDistance(Key.StartLocation, SearchDistance, FoundPolys, Query.QueryFilter, Query.Owner.Get(), &NodePoolData);
+				PolyResults->Reserve(NodePoolData.Nodes.Num());
+				for (const FRecastDebugPathfindingNode& Node : NodePoolData.Nodes)
+				{
+					FPathResult& PolyResult = PolyResults->Add(Node.PolyRef);
+					PolyResult.PathLength = Node.Length;
+					PolyResult.PathCost = Node.Cost;
+					PolyResult.bSuccess = true;
+				}
+			}
+
+			FNavLocation ProjectedGoalLocation;
+			if (!NavMesh->ProjectPoint(Key.GoalLocation, ProjectedGoalLocation, NavMesh->GetConfig().DefaultQueryExtent, Query.QueryFilter, Query.Owner.Get()))
+			{
+				return false;
+			}
+
+			if (const FPathResult* const PolyResult = PolyResults->Find(ProjectedGoalLocation.NodeRef))
+			{
+				OutResult = *PolyResult;
+				OutResult.PathEndLocation = ProjectedGoalLocation.Location;
+				return true;
+			}
+#endif
+
+			return false;
+		}
 	};
 
 	APawn* Pawn = nullptr;
@@ -336,18 +446,52 @@ bool UHTNTask_MoveTo::PlanTimeTestPath(UHTNComponent& OwnerComp, const FVector&
 			PathfindingQuery.NavDataFlags &= ~ERecastPathFlags::SkipStringPulling;
 		}
 
-		// Test path
-		const FPathFindingResult PathfindingResult = NavData->FindPath(*NavAgentProps, PathfindingQuery);
-		if (PathfindingResult.IsSuccessful())
+		// The cache is shared between all MoveTo tasks, so it's owned by the class default object.
+		FHTNMoveToPlanningCache* const Cache = bCachePlanTimePaths || bUseBatchedPathCostEstimate ?
+			&PlanningTask.GetNodePlanningCache<FHTNMoveToPlanningCache>(*GetDefault<UHTNTask_MoveTo>()) : nullptr;
+		
+		FPathKey Key;
+		Key.StartLocation = RawStartLocation;
+		Key.GoalLocation = RawGoalLocation;
+		Key.NavData = NavData;
+		Key.QueryFilter = QueryFilter.Get();
+		Key.NavDataFlags = PathfindingQuery.NavDataFlags;
+		Key.bAllowPartialPath = bAllowPartialPath;
+
+		FPathResult Result;
+		const FPathResult* const CachedResult = bCachePlanTimePaths ? Cache->PathResults.Find(Key) : nullptr;
+		if (CachedResult)
+		{
+			Result = *CachedResult;
+		}
+		else if (!bUseBatchedPathCostEstimate || !Local::EstimatePathBatched(*Cache, Key, PathfindingQuery, BatchedPathSearchDistance, Result))
+		{
+			// Test path
+			const FPathFindingResult PathfindingResult = NavData->FindPath(*NavAgentProps, PathfindingQuery);
+			if (PathfindingResult.IsSuccessful())
+			{
+				const FNavigationPath& Path = *PathfindingResult.Path;
+				Result.PathEndLocation = Path.GetEndLocation();
+				Result.PathLength = Path.GetLength();
+				Result.PathCost = Path.GetCost();
+				Result.bSuccess = true;
+			}
+		}
+
+		if (bCachePlanTimePaths && !CachedResult)
+		{
+			Cache->PathResults.Add(Key, Result);
+		}
+		
+		if (Result.bSuccess)
 		{
-			const FNavigationPath& Path = *PathfindingResult.Path;
-			OutEndLocation = Path.GetEndLocation() + FVector(0.0f, 0.0f, Pawn->GetDefaultHalfHeight());
-			OutPathCostEstimate = bUsePathCostInsteadOfLength ? Path.GetCost() : Path.GetLength();
+			OutEndLocation = Result.PathEndLocation + FVector(0.0f, 0.0f, Pawn->GetDefaultHalfHeight());
+			OutPathCostEstimate = bUsePathCostInsteadOfLength ? Result.PathCost : Result.PathLength;
 			return true;
 		}
 		UE_VLOG_ARROW(&OwnerComp, LogHTN, Warning, RawStartLocation, RawGoalLocation, FColor::Red, 
-			TEXT("%s: failed plan-time test with AllowPartialPath=%s"), 
-			*GetNodeName(), bAllowPartialPath ? TEXT("true") : TEXT("false")
+			TEXT("%s: failed plan-time test with AllowPartialPath=%s%s"), 
+			*GetNodeName(), bAllowPartialPath ? TEXT("true") : TEXT("false"), CachedResult ? TEXT(" (cached)") : TEXT("")
 		);
 	}
 	else
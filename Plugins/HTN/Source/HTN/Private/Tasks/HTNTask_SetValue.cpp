@@ -42,3 +42,9 @@ FString UHTNTask_SetValue::GetStaticDescription() const
 		*Value.GetValueDescription(GetBlackboardAsset(), BlackboardKey.GetSelectedKeyID())
 	);
 }
+
+bool UHTNTask_SetValue::GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const
+{
+	OutKeyNames.Add(BlackboardKey.SelectedKeyName);
+	return true;
+}
@@ -13,6 +13,11 @@ void UHTNTask_Success::CreatePlanSteps(UHTNComponent& OwnerComp, UAITask_MakeHTN
 	PlanningTask.SubmitPlanStep(this, WorldState->MakeNext(), FMath::Max(0, Cost));
 }
 
+int32 UHTNTask_Success::GetMinPlanningCost() const
+{
+	return FMath::Max(0, Cost);
+}
+
 FString UHTNTask_Success::GetStaticDescription() const
 {
 	return FString::Printf(TEXT("%s: Cost: %i"), *Super::GetStaticDescription(), Cost);
@@ -16,6 +16,11 @@ void UHTNTask_Wait::CreatePlanSteps(UHTNComponent& OwnerComp, UAITask_MakeHTNPla
 	PlanningTask.SubmitPlanStep(this, WorldState->MakeNext(), FMath::Max(0, Cost));
 }
 
+int32 UHTNTask_Wait::GetMinPlanningCost() const
+{
+	return FMath::Max(0, Cost);
+}
+
 EHTNNodeResult UHTNTask_Wait::ExecuteTask(UHTNComponent& OwnerComp, uint8* NodeMemory, const FHTNPlanStepID& PlanStepID)
 {
 	FNodeMemory* const Memory = CastInstanceNodeMemory<FNodeMemory>(NodeMemory);
@@ -0,0 +1,315 @@
+// Copyright 2020-2021 Maksym Maisak. All Rights Reserved.
+
+#include "Utility/HTNProfiler.h"
+
+#if HTN_PROFILER
+
+#include "HAL/IConsoleManager.h"
+#include "Misc/DateTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+#include "HTN.h"
+#include "HTNComponent.h"
+#include "HTNNode.h"
+
+namespace
+{
+	int32 GHTNProfilerMaxEvents = 2000000;
+	FAutoConsoleVariableRef CVarHTNProfilerMaxEvents(
+		TEXT("ai.htn.profiler.MaxEvents"),
+		GHTNProfilerMaxEvents,
+		TEXT("The HTN profiler stops recording once this many events have been recorded."),
+		ECVF_Default
+	);
+
+	FAutoConsoleCommand CmdHTNProfilerStart(
+		TEXT("ai.htn.profiler.Start"),
+		TEXT("Starts recording the HTN profiler. Optionally takes a substring of the names of the agents to record."),
+		FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+		{
+			FHTNProfiler::Get().Start(Args.Num() ? Args[0] : FString());
+		})
+	);
+
+	FAutoConsoleCommand CmdHTNProfilerStop(
+		TEXT("ai.htn.profiler.Stop"),
+		TEXT("Stops recording the HTN profiler. Recorded events are kept until the next Start."),
+		FConsoleCommandDelegate::CreateLambda([]()
+		{
+			FHTNProfiler::Get().Stop();
+		})
+	);
+
+	FAutoConsoleCommand CmdHTNProfilerExport(
+		TEXT("ai.htn.profiler.Export"),
+		TEXT("Logs a summary of the HTN profiler events and writes them as Chrome trace JSON (viewable in speedscope). ")
+		TEXT("Optionally takes the file path, defaults to the Profiling/HTN directory."),
+		FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+		{
+			const FString FilePath = Args.Num() ? Args[0] :
+				FPaths::ProfilingDir() / TEXT("HTN") / FString::Printf(TEXT("HTNProfile_%s.json"), *FDateTime::Now().ToString());
+
+			FHTNProfiler& Profiler = FHTNProfiler::Get();
+			Profiler.LogSummary();
+			if (Profiler.ExportChromeTrace(FilePath))
+			{
+				UE_LOG(LogHTN, Display, TEXT("HTN profiler: exported to %s"), *FPaths::ConvertRelativePathToFull(FilePath));
+			}
+			else
+			{
+				UE_LOG(LogHTN, Error, TEXT("HTN profiler: failed to write %s"), *FilePath);
+			}
+		})
+	);
+
+	FString EscapeJsonString(const FString& String)
+	{
+		return String.Replace(TEXT("\\"), TEXT("\\\\")).Replace(TEXT("\""), TEXT("\\\""));
+	}
+}
+
+const TCHAR* LexToString(EHTNProfilerPhase Phase)
+{
+	switch (Phase)
+	{
+	case EHTNProfilerPhase::PlanExpansion: return TEXT("PlanExpansion");
+	case EHTNProfilerPhase::EnterDecorators: return TEXT("EnterDecorators");
+	case EHTNProfilerPhase::ExitDecorators: return TEXT("ExitDecorators");
+	case EHTNProfilerPhase::ExecuteTask: return TEXT("ExecuteTask");
+	case EHTNProfilerPhase::TickTask: return TEXT("TickTask");
+	case EHTNProfilerPhase::DecoratorTest: return TEXT("DecoratorTest");
+	case EHTNProfilerPhase::ServiceTick: return TEXT("ServiceTick");
+	default: return TEXT("Unknown");
+	}
+}
+
+bool FHTNProfiler::bIsRecording = false;
+
+FHTNProfiler& FHTNProfiler::Get()
+{
+	static FHTNProfiler Instance;
+	return Instance;
+}
+
+void FHTNProfiler::Start(const FString& InAgentNameFilter)
+{
+	Reset();
+	AgentNameFilter = InAgentNameFilter;
+	bIsRecording = true;
+	UE_LOG(LogHTN, Display, TEXT("HTN profiler: started recording%s"),
+		AgentNameFilter.IsEmpty() ? TEXT("") : *FString::Printf(TEXT(" agents matching '%s'"), *AgentNameFilter));
+}
+
+void FHTNProfiler::Stop()
+{
+	if (bIsRecording)
+	{
+		bIsRecording = false;
+		UE_LOG(LogHTN, Display, TEXT("HTN profiler: stopped recording, %i events recorded"), Events.Num());
+	}
+}
+
+void FHTNProfiler::Reset()
+{
+	Events.Empty();
+	Agents.Reset();
+	Nodes.Reset();
+	AgentIndices.Reset();
+	NodeIndices.Reset();
+}
+
+int32 FHTNProfiler::BeginEvent(const UHTNComponent& OwnerComp, const UHTNNode* Node, EHTNProfilerPhase Phase)
+{
+	if (!IsInGameThread() || !Node)
+	{
+		return INDEX_NONE;
+	}
+
+	if (Events.Num() >= GHTNProfilerMaxEvents)
+	{
+		UE_LOG(LogHTN, Warning, TEXT("HTN profiler: reached ai.htn.profiler.MaxEvents (%i)"), GHTNProfilerMaxEvents);
+		Stop();
+		return INDEX_NONE;
+	}
+
+	const int32 AgentIndex = FindOrAddAgent(OwnerComp);
+	if (!Agents[AgentIndex].bIsRecorded)
+	{
+		return INDEX_NONE;
+	}
+
+	FEvent& Event = Events.AddDefaulted_GetRef();
+	Event.AgentIndex = AgentIndex;
+	Event.NodeIndex = FindOrAddNode(Node->GetTemplateNode());
+	Event.Phase = Phase;
+	Event.StartCycles = FPlatformTime::Cycles64();
+	Event.EndCycles = Event.StartCycles;
+	return Events.Num() - 1;
+}
+
+void FHTNProfiler::EndEvent(int32 EventIndex)
+{
+	// The events might have been reset while the event was in progress.
+	if (Events.IsValidIndex(EventIndex))
+	{
+		Events[EventIndex].EndCycles = FPlatformTime::Cycles64();
+	}
+}
+
+int32 FHTNProfiler::FindOrAddAgent(const UHTNComponent& OwnerComp)
+{
+	if (const int32* const ExistingIndex = AgentIndices.Find(&OwnerComp))
+	{
+		return *ExistingIndex;
+	}
+
+	const FString Name = GetNameSafe(OwnerComp.GetOwner());
+	const int32 AgentIndex = Agents.Add({ Name, AgentNameFilter.IsEmpty() || Name.Contains(AgentNameFilter) });
+	AgentIndices.Add(&OwnerComp, AgentIndex);
+	return AgentIndex;
+}
+
+int32 FHTNProfiler::FindOrAddNode(const UHTNNode* Node)
+{
+	if (const int32* const ExistingIndex = NodeIndices.Find(Node))
+	{
+		return *ExistingIndex;
+	}
+
+	// The HTNAsset of a node is the top-level asset it was planned from, so use the asset that owns the node instead.
+	const int32 NodeIndex = Nodes.Add({ Node->GetNodeName(), GetNameSafe(Node->GetTypedOuter<UHTN>()) });
+	NodeIndices.Add(Node, NodeIndex);
+	return NodeIndex;
+}
+
+void FHTNProfiler::CalculateSelfCycles(TArray<uint64>& OutSelfCycles) const
+{
+	OutSelfCycles.SetNumUninitialized(Events.Num());
+
+	// Events are recorded in the order they started on a single thread, so nested events directly follow their parent.
+	TArray<int32, TInlineAllocator<32>> OpenEventIndices;
+	for (int32 I = 0; I < Events.Num(); ++I)
+	{
+		const FEvent& Event = Events[I];
+		OutSelfCycles[I] = Event.EndCycles - Event.StartCycles;
+
+		while (OpenEventIndices.Num() && Events[OpenEventIndices.Last()].EndCycles <= Event.StartCycles)
+		{
+			OpenEventIndices.Pop(/*bAllowShrinking=*/false);
+		}
+
+		if (OpenEventIndices.Num())
+		{
+			uint64& ParentSelfCycles = OutSelfCycles[OpenEventIndices.Last()];
+			ParentSelfCycles -= FMath::Min(ParentSelfCycles, Event.EndCycles - Event.StartCycles);
+		}
+
+		OpenEventIndices.Add(I);
+	}
+}
+
+bool FHTNProfiler::ExportChromeTrace(const FString& FilePath) const
+{
+	const uint64 FirstCycles = Events.Num() ? Events[0].StartCycles : 0;
+	const auto CyclesToMicroseconds = [](uint64 Cycles) { return FPlatformTime::ToMilliseconds64(Cycles) * 1000.0; };
+
+	FString Json;
+	Json.Reserve(Events.Num() * 160);
+	Json += TEXT("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+	bool bIsFirstEntry = true;
+	const auto AppendEntry = [&](const FString& Entry)
+	{
+		if (!bIsFirstEntry)
+		{
+			Json += TEXT(",\n");
+		}
+		bIsFirstEntry = false;
+		Json += Entry;
+	};
+
+	// Each agent is displayed as a separate thread.
+	for (int32 AgentIndex = 0; AgentIndex < Agents.Num(); ++AgentIndex)
+	{
+		if (Agents[AgentIndex].bIsRecorded)
+		{
+			AppendEntry(FString::Printf(TEXT("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%i,\"args\":{\"name\":\"%s\"}}"),
+				AgentIndex, *EscapeJsonString(Agents[AgentIndex].Name)));
+		}
+	}
+
+	for (const FEvent& Event : Events)
+	{
+		const FNodeInfo& NodeInfo = Nodes[Event.NodeIndex];
+		AppendEntry(FString::Printf(TEXT("{\"name\":\"%s (%s)\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%i,\"args\":{\"asset\":\"%s\",\"phase\":\"%s\"}}"),
+			*EscapeJsonString(NodeInfo.NodeName), LexToString(Event.Phase), LexToString(Event.Phase),
+			CyclesToMicroseconds(Event.StartCycles - FirstCycles), CyclesToMicroseconds(Event.EndCycles - Event.StartCycles),
+			Event.AgentIndex, *EscapeJsonString(NodeInfo.AssetName), LexToString(Event.Phase)
+		));
+	}
+
+	Json += TEXT("\n]}\n");
+
+	return FFileHelper::SaveStringToFile(Json, *FilePath, FFileHelper::EEncodingOptions::ForceUTF8WithoutBOM);
+}
+
+void FHTNProfiler::LogSummary(int32 MaxEntries) const
+{
+	struct FTotal
+	{
+		uint64 SelfCycles = 0;
+		int32 Count = 0;
+	};
+
+	TArray<uint64> SelfCycles;
+	CalculateSelfCycles(SelfCycles);
+
+	TMap<TPair<int32, EHTNProfilerPhase>, FTotal> NodeTotals;
+	TMap<FString, FTotal> AssetTotals;
+	for (int32 I = 0; I < Events.Num(); ++I)
+	{
+		const FEvent& Event = Events[I];
+
+		FTotal& NodeTotal = NodeTotals.FindOrAdd(TPair<int32, EHTNProfilerPhase>(Event.NodeIndex, Event.Phase));
+		NodeTotal.SelfCycles += SelfCycles[I];
+		++NodeTotal.Count;
+
+		FTotal& AssetTotal = AssetTotals.FindOrAdd(Nodes[Event.NodeIndex].AssetName);
+		AssetTotal.SelfCycles += SelfCycles[I];
+		++AssetTotal.Count;
+	}
+
+	const auto ByTime = [](const FTotal& A, const FTotal& B) { return A.SelfCycles > B.SelfCycles; };
+	NodeTotals.ValueSort(ByTime);
+	AssetTotals.ValueSort(ByTime);
+
+	UE_LOG(LogHTN, Display, TEXT("HTN profiler: %i events, %i agents. Self time per asset:"), Events.Num(), Agents.Num());
+	int32 NumLogged = 0;
+	for (const TPair<FString, FTotal>& Pair : AssetTotals)
+	{
+		if (NumLogged++ >= MaxEntries)
+		{
+			break;
+		}
+
+		UE_LOG(LogHTN, Display, TEXT("  %10.3f ms %8i events  %s"), FPlatformTime::ToMilliseconds64(Pair.Value.SelfCycles), Pair.Value.Count, *Pair.Key);
+	}
+
+	UE_LOG(LogHTN, Display, TEXT("HTN profiler: self time per node and phase:"));
+	NumLogged = 0;
+	for (const TPair<TPair<int32, EHTNProfilerPhase>, FTotal>& Pair : NodeTotals)
+	{
+		if (NumLogged++ >= MaxEntries)
+		{
+			break;
+		}
+
+		const FNodeInfo& NodeInfo = Nodes[Pair.Key.Key];
+		UE_LOG(LogHTN, Display, TEXT("  %10.3f ms %8i events  %s: %s (%s)"),
+			FPlatformTime::ToMilliseconds64(Pair.Value.SelfCycles), Pair.Value.Count,
+			*NodeInfo.AssetName, *NodeInfo.NodeName, LexToString(Pair.Key.Value));
+	}
+}
+
+#endif
@@ -8,6 +8,7 @@
 #include "HTN.h"
 #include "HTNPlan.h"
 #include "HTNPlanningDebugInfo.h"
+#include "HTNPlanningStats.h"
 #include "HTNStandaloneNode.h"
 #include "AITask_MakeHTNPlan.generated.h"
 
@@ -35,6 +36,25 @@ struct HTN_API FHTNPlanningContext
 	void SubmitCandidatePlan(const TSharedRef<FHTNPlan>& CandidatePlan, const FString& AddedStepDescription = TEXT("")) const;
 };
 
+// A task that is producing plan steps latently (see UAITask_MakeHTNPlan::WaitForLatentCreatePlanSteps),
+// together with the planner state needed to turn those steps into new plans once it finishes.
+struct FHTNPendingLatentCreatePlanSteps
+{
+	int32 ID = INDEX_NONE;
+	class UHTNTask* Task = nullptr;
+	TSharedPtr<FHTNPlan> Plan;
+	FHTNPlanStepID PlanStepID;
+	TSharedPtr<FBlackboardWorldState> WorldStateAfterEnteredDecorators;
+	TArray<TPair<FHTNPlanStep, FString>> PossibleSteps;
+#if HTN_DEBUG_PLANNING
+	FString FailureReason;
+#endif
+	uint8 bBlocksPlanning : 1;
+	uint8 bFinished : 1;
+
+	FHTNPendingLatentCreatePlanSteps() : bBlocksPlanning(true), bFinished(false) {}
+};
+
 // Can make a plan given a top level htn and a blackboard component.
 UCLASS()
 class HTN_API UAITask_MakeHTNPlan : public UAITask
@@ -57,13 +77,36 @@ public:
 	TSharedPtr<struct FHTNPlan> GetFinishedPlan() const;
 	void Clear();
 
+	// The stats of the current (or last) planning run.
+	const FHTNPlanningStats& GetPlanningStats() const;
+
+	// If set, tasks that want to produce plan steps latently are treated as if they finished right away,
+	// with only the steps they submitted before going latent. Makes planning synchronous and deterministic for offline replays.
+	void SetStubLatentCreatePlanSteps(bool bInStubLatentCreatePlanSteps);
+
 	// To be used by tasks when planning
 	void SubmitPlanStep(const class UHTNTask* Task, TSharedPtr<class FBlackboardWorldState> WorldState, int32 Cost, const FString& Description = TEXT(""));
-	void WaitForLatentCreatePlanSteps(const class UHTNTask* Task);
+	
+	// Call from CreatePlanSteps to produce plan steps later, then call FinishLatentCreatePlanSteps when done.
+	// Returns an ID that identifies this particular call for SubmitLatentPlanStep and FinishLatentCreatePlanSteps.
+	// If bAllowPlanningToContinue is false, the planner stops until this task finishes.
+	// If true, the plan being expanded is parked and the planner keeps expanding other plans in the meantime, 
+	// so several latent tasks can be in flight at once. Only use this if the task doesn't depend on 
+	// the planning worldstate proxy (UHTNComponent::GetPlanningWorldStateProxy) after CreatePlanSteps returns,
+	// since the planner will point it to other worldstates while expanding other plans.
+	int32 WaitForLatentCreatePlanSteps(const class UHTNTask* Task, bool bAllowPlanningToContinue = false);
+	void SubmitLatentPlanStep(int32 LatentCreatePlanStepsID, TSharedPtr<class FBlackboardWorldState> WorldState, int32 Cost, const FString& Description = TEXT(""));
+	void FinishLatentCreatePlanSteps(int32 LatentCreatePlanStepsID);
+	// Same as the above, but identifies the latent call by task. Only valid if the task has only one latent call in flight.
 	void FinishLatentCreatePlanSteps(const class UHTNTask* Task);
 	int32 MakePriorityMarker();
 	void SetNodePlanningFailureReason(const FString& FailureReason);
 
+	// Returns the cache of the given node for this planning run, creating it if needed. 
+	// The cache is discarded when planning finishes, so it's safe to store results that are only valid for the current worldstate of the world.
+	template<typename CacheType>
+	CacheType& GetNodePlanningCache(const UHTNNode& Node);
+
 protected:
 	virtual void Activate() override;
 	virtual void OnDestroy(bool bInOwnerFinished) override;
@@ -76,6 +119,11 @@ private:
 	void SubmitCandidatePlan(const TSharedRef<FHTNPlan>& NewPlan, UHTNStandaloneNode* AddedNode, const FString& AddedStepDescription = TEXT(""));
 
 	void OnTaskFinishedProducingCandidateSteps(class UHTNTask* Task);
+	FHTNPendingLatentCreatePlanSteps* FindPendingLatentCreatePlanSteps(int32 LatentCreatePlanStepsID);
+	FHTNPendingLatentCreatePlanSteps* FindPendingLatentCreatePlanSteps(const class UHTNTask* Task);
+	void ProcessFinishedLatentCreatePlanSteps();
+	bool IsBlockedByLatentCreatePlanSteps() const;
+	bool CanPendingLatentCreatePlanStepsProducePlanCheaperThan(int32 Cost) const;
 
 	bool EnterDecorators(const FHTNPlan& Plan, const FHTNPlanStepID& StepID, const FBlackboardWorldState& WorldState, UHTNStandaloneNode* Node, TSharedPtr<FBlackboardWorldState>& OutNewWorldState) const;
 	bool EnterDecorators(const TArrayView<UHTNDecorator*>& Decorators, const FHTNPlan& Plan, const FHTNPlanStepID& StepID) const;
@@ -120,13 +168,27 @@ private:
 	class UHTNTask* CurrentTask;
 	// The buffer for candidate plan steps (and their descriptions) that are provided by the currently planning task. 
 	TArray<TPair<FHTNPlanStep, FString>> PossibleStepsBuffer;
+	// The ID given by WaitForLatentCreatePlanSteps to the currently planning task, if it decided to produce plan steps latently.
+	int32 CurrentLatentCreatePlanStepsID;
+
+	// Tasks that are producing plan steps latently. Their plan steps are turned into new plans once they finish.
+	TArray<FHTNPendingLatentCreatePlanSteps> PendingLatentCreatePlanSteps;
+	int32 NextLatentCreatePlanStepsID;
 	
 	TSharedPtr<FHTNPlan> FinishedPlan;
 
+	FHTNPlanningStats Stats;
+	uint64 PlanningStartCycles;
+
+	// Maps template nodes and cache types to the data they cache for the duration of this planning run.
+	TMap<TPair<TWeakObjectPtr<const UHTNNode>, FHTNNodePlanningCacheTypeID>, TUniquePtr<FHTNNodePlanningCache>> NodePlanningCaches;
+
+	// True when the planner has nothing to do until a latent task finishes producing plan steps.
 	UPROPERTY(Transient)
 	uint8 bIsWaitingForTaskToProducePlanSteps : 1;
 
 	uint8 bWasCancelled : 1;
+	uint8 bStubLatentCreatePlanSteps : 1;
 
 #if HTN_DEBUG_PLANNING
 	FHTNPlanningDebugInfo DebugInfo;
@@ -145,9 +207,25 @@ FORCEINLINE FHTNPlanStepID UAITask_MakeHTNPlan::GetExpandingPlanStepID() const {
 
 FORCEINLINE bool UAITask_MakeHTNPlan::FoundPlan() const { return FinishedPlan.IsValid(); }
 FORCEINLINE TSharedPtr<struct FHTNPlan> UAITask_MakeHTNPlan::GetFinishedPlan() const { return FinishedPlan; }
+FORCEINLINE const FHTNPlanningStats& UAITask_MakeHTNPlan::GetPlanningStats() const { return Stats; }
+FORCEINLINE void UAITask_MakeHTNPlan::SetStubLatentCreatePlanSteps(bool bInStubLatentCreatePlanSteps) { bStubLatentCreatePlanSteps = bInStubLatentCreatePlanSteps; }
 
 FORCEINLINE int32 UAITask_MakeHTNPlan::MakePriorityMarker() { return NextPriorityMarker++; }
 
+template<typename CacheType>
+CacheType& UAITask_MakeHTNPlan::GetNodePlanningCache(const UHTNNode& Node)
+{
+	static_assert(TIsDerivedFrom<CacheType, FHTNNodePlanningCache>::IsDerived, "CacheType must derive from FHTNNodePlanningCache");
+	
+	TUniquePtr<FHTNNodePlanningCache>& Cache = NodePlanningCaches.FindOrAdd({ Node.GetTemplateNode(), GetHTNNodePlanningCacheTypeID<CacheType>() });
+	if (!Cache.IsValid())
+	{
+		Cache = MakeUnique<CacheType>();
+	}
+
+	return StaticCast<CacheType&>(*Cache);
+}
+
 #if HTN_DEBUG_PLANNING
 FORCEINLINE void UAITask_MakeHTNPlan::SetNodePlanningFailureReason(const FString& FailureReason) { NodePlanningFailureReason = FailureReason; }
 #else
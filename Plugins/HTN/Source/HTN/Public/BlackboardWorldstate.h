@@ -10,9 +10,12 @@
 #include "HTNTypes.h"
 
 class FBlackboardWorldStateImpl;
+class FBlackboardWorldStateLayer;
 
 // Stores Blackboard values the same way as a BlackboardComponent, but is cheap to copy since it's not a UObject.
 // Used to model future states during planning. Also keeps track of which keys were changed since the object's creation.
+// A worldstate can be layered on top of a read-only FBlackboardWorldStateLayer shared with other agents, 
+// in which case it only stores the keys that aren't in the layer. Setting a value of a shared key makes it copy all keys.
 // Note: to work, it requires the original BlackboardComponent to be alive, 
 // so make sure all worldstates are deallocated before their BlackboardCompoent is.
 class HTN_API FBlackboardWorldState final : public FGCObject
@@ -22,6 +25,8 @@ public:
 	FBlackboardWorldState();
 	
 	FBlackboardWorldState(class UBlackboardComponent& Blackboard);
+	// Reads the keys of the layer from it and only copies the remaining keys from the blackboard.
+	FBlackboardWorldState(class UBlackboardComponent& Blackboard, const TSharedRef<const FBlackboardWorldStateLayer>& SharedLayer);
 	virtual ~FBlackboardWorldState();
 
 	// FGCObject implementation
@@ -75,21 +80,37 @@ public:
 	FORCEINLINE bool IsValidKey(FBlackboard::FKey KeyID) const { check(BlackboardAsset.IsValid()); return KeyID != FBlackboard::InvalidKey && BlackboardAsset->Keys.IsValidIndex(KeyID); }
 	FORCEINLINE	FName GetKeyName(FBlackboard::FKey KeyID) const { return BlackboardAsset.IsValid() ? BlackboardAsset->GetKeyName(KeyID) : NAME_None; }
 	FORCEINLINE FBlackboard::FKey GetKeyID(const FName& KeyName) const { return BlackboardAsset.IsValid() ? BlackboardAsset->GetKeyID(KeyName) : FBlackboard::InvalidKey; }
+	FORCEINLINE UBlackboardData* GetBlackboardAsset() const { return BlackboardAsset.Get(); }
 
 	FString DescribeKeyValue(const FName& KeyName, EBlackboardDescription::Type Type) const;
 	FString DescribeKeyValue(FBlackboard::FKey KeyID, EBlackboardDescription::Type Mode) const;
 	
 	bool WasKeyChanged(FBlackboard::FKey KeyID) const;
 	bool HasAnyKeyChanged() const;
+	void GetChangedKeys(TArray<FBlackboard::FKey>& OutKeys) const;
+	// Marks exactly the given keys as changed. Used when recreating saved worldstates (see FHTNPlanSerializer).
+	void SetChangedKeys(const TArray<FBlackboard::FKey>& KeyIDs);
+	// Outputs the keys whose values are different in the Other worldstate.
+	void GetKeysWithDifferentValues(const FBlackboardWorldState& Other, TArray<FBlackboard::FKey>& OutKeys) const;
 	
 	bool IsCompatible(const FBlackboardWorldState& Other) const;
 
+	FORCEINLINE const TSharedPtr<const FBlackboardWorldStateLayer>& GetSharedLayer() const { return SharedLayer; }
+
 private:
 	friend FBlackboardWorldStateImpl;
+	friend FBlackboardWorldStateLayer;
 	
 	void SetKeyChanged(FBlackboard::FKey KeyID, bool bWasChanged = true);
 	void DestroyValues();
 
+	bool IsKeyShared(FBlackboard::FKey KeyID) const;
+	UBlackboardKeyType* GetKeyInstance(FBlackboard::FKey KeyID) const;
+	// Returns the memory of a key stored in this worldstate, as opposed to the shared layer.
+	uint8* GetLocalKeyRawData(FBlackboard::FKey KeyID);
+	// Copies the keys of the shared layer into this worldstate and stops using the layer.
+	void Flatten();
+
 	TWeakObjectPtr<class UBlackboardComponent> BlackboardComponent;
 	TWeakObjectPtr<class UBlackboardData> BlackboardAsset;
 
@@ -101,9 +122,52 @@ private:
 	// Whether or not a given key was changed on this worldstate.
 	TBitArray<> ChangedFlags;
 
+	// If set, the values of the keys in this layer are read from it instead of ValueMemory, 
+	// and ValueMemory is laid out according to the layer.
+	TSharedPtr<const FBlackboardWorldStateLayer> SharedLayer;
+
 	bool bIsInitialized : 1;
 };
 
+// The read-only part of layered worldstates, shared by the worldstates of several agents with the same blackboard asset.
+// Holds a copy of the values of the shared keys and the memory layout of the other keys, which the layered worldstates store themselves.
+// Used by HTNComponents in the same SharedWorldStateGroup (see GetShared) so that they don't copy their common knowledge at every plan.
+class HTN_API FBlackboardWorldStateLayer
+{
+public:
+	FBlackboardWorldStateLayer(class UBlackboardComponent& Blackboard, const TBitArray<>& InSharedKeys);
+
+	// Returns the layer of the instance-synced keys of the blackboard shared by all components in the same group and world with the same blackboard asset.
+	// The values of instance-synced keys are the same in all such blackboards. The layer is remade if they changed since it was last made.
+	// Returns null if the blackboard has no instance-synced keys.
+	static TSharedPtr<const FBlackboardWorldStateLayer> GetShared(FName Group, class UBlackboardComponent& Blackboard);
+
+	// Call before the blackboard component is uninitialized or changes its asset.
+	// Layers made from that blackboard are moved to another blackboard of their group, since worldstates of other agents can still use them.
+	static void ReleaseShared(class UBlackboardComponent& Blackboard);
+
+	FORCEINLINE bool IsKeyShared(FBlackboard::FKey KeyID) const { return SharedKeys.IsValidIndex(KeyID) && SharedKeys[KeyID]; }
+	FORCEINLINE const FBlackboardWorldState& GetValues() const { return *Values; }
+	FORCEINLINE UBlackboardData* GetBlackboardAsset() const { return Values->GetBlackboardAsset(); }
+
+	// Returns true if the shared keys have the same values in the given blackboard as in this layer.
+	bool HasSameValues(const class UBlackboardComponent& Blackboard) const;
+
+private:
+	friend FBlackboardWorldState;
+	friend FBlackboardWorldStateImpl;
+
+	// Makes the values of this layer use another blackboard component with the same asset.
+	void SetBlackboardComponent(class UBlackboardComponent& Blackboard);
+
+	TSharedRef<FBlackboardWorldState> Values;
+	TBitArray<> SharedKeys;
+
+	// Memory offsets of the keys that aren't shared in the ValueMemory of layered worldstates.
+	TArray<uint16> LocalValueOffsets;
+	int32 LocalValueMemorySize;
+};
+
 template <class TDataClass>
 typename TDataClass::FDataType FBlackboardWorldState::GetValue(const FName& KeyName) const
 {
@@ -120,7 +184,7 @@ typename TDataClass::FDataType FBlackboardWorldState::GetValue(FBlackboard::FKey
 		return TDataClass::InvalidValue;
 	}
 
-	UBlackboardKeyType* const KeyOb = EntryInfo->KeyType->HasInstance() ? KeyInstances[KeyID] : UNWRAP_TOBJECT_PTR(EntryInfo->KeyType);
+	UBlackboardKeyType* const KeyOb = EntryInfo->KeyType->HasInstance() ? GetKeyInstance(KeyID) : UNWRAP_TOBJECT_PTR(EntryInfo->KeyType);
 	const uint16 DataOffset = EntryInfo->KeyType->HasInstance() ? sizeof(FBlackboardInstancedKeyMemory) : 0;
 
 	const uint8* const RawData = GetKeyRawData(KeyID) + DataOffset;
@@ -146,7 +210,7 @@ bool FBlackboardWorldState::SetValue(FBlackboard::FKey KeyID, typename TDataClas
 	const uint16 DataOffset = EntryInfo->KeyType->HasInstance() ? sizeof(FBlackboardInstancedKeyMemory) : 0;
 	if (uint8* const RawData = GetKeyRawData(KeyID) + DataOffset)
 	{
-		UBlackboardKeyType* const KeyOb = EntryInfo->KeyType->HasInstance() ? KeyInstances[KeyID] : UNWRAP_TOBJECT_PTR(EntryInfo->KeyType);
+		UBlackboardKeyType* const KeyOb = EntryInfo->KeyType->HasInstance() ? GetKeyInstance(KeyID) : UNWRAP_TOBJECT_PTR(EntryInfo->KeyType);
 		TDataClass::SetValue(StaticCast<TDataClass*>(KeyOb), RawData, Value);
 		// Intentionally marking the key as changed even though it might have been set to the same value it had before.
 		SetKeyChanged(KeyID);
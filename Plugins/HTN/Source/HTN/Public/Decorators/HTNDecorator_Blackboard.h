@@ -20,6 +20,7 @@ public:
 	virtual bool CalculateRawConditionValue(UHTNComponent& OwnerComp, uint8* NodeMemory, EHTNDecoratorConditionCheckType CheckType) const override;
 	virtual FString GetNodeName() const override;
 	virtual FString GetStaticDescription() const override;
+	virtual bool GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const override { return true; }
 	
 protected:
 
@@ -22,6 +22,7 @@ public:
 	UHTNDecorator_Cooldown(const FObjectInitializer& Initializer);
 
 	virtual FString GetStaticDescription() const override;
+	virtual bool GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const override { return true; }
 	virtual uint16 GetInstanceMemorySize() const override;
 	virtual void InitializeMemory(UHTNComponent& OwnerComp, uint8* NodeMemory, const FHTNPlan& Plan, const FHTNPlanStepID& StepID) const override;
 	
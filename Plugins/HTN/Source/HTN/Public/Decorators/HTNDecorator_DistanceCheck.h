@@ -17,6 +17,7 @@ public:
 	UHTNDecorator_DistanceCheck(const FObjectInitializer& Initializer);
 	virtual void InitializeFromAsset(UHTN& Asset) override;
 	virtual FString GetStaticDescription() const override;
+	virtual bool GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const override { return true; }
 
 	UPROPERTY(EditAnywhere, Category = Node)
 	FBlackboardKeySelector A;
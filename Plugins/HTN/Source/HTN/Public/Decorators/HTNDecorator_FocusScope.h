@@ -20,6 +20,7 @@ public:
 	UHTNDecorator_FocusScope(const FObjectInitializer& Initializer);
 
 	virtual FString GetStaticDescription() const override;
+	virtual bool GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const override { return true; }
 	
 	virtual void InitializeFromAsset(UHTN& Asset) override;
 	virtual uint16 GetInstanceMemorySize() const override;
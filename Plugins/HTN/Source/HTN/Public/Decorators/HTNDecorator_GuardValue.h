@@ -25,6 +25,7 @@ protected:
 	virtual void OnExecutionFinish(UHTNComponent& OwnerComp, uint8* NodeMemory, EHTNNodeResult Result) override;
 	
 	virtual FString GetStaticDescription() const override;
+	virtual bool GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const override;
 
 	bool RestoreWorldstateValue(UHTNComponent& OwnerComp, UWorldStateProxy& WorldStateProxy, const FHTNPlan& CurrentPlan, const FHTNPlanStepID& CurrentStepID) const;
 	
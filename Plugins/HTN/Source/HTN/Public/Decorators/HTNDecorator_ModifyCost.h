@@ -23,6 +23,7 @@ public:
 	int32 Bias;
 
 	virtual FString GetStaticDescription() const override;
+	virtual bool GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const override { return true; }
 	
 protected:
 
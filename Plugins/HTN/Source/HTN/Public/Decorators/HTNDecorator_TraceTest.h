@@ -7,12 +7,15 @@
 #include "BehaviorTree/BehaviorTreeTypes.h"
 #include "EnvironmentQuery/EnvQueryTypes.h"
 #include "Kismet/KismetSystemLibrary.h"
+#include "WorldCollision.h"
 #include "HTNDecorator.h"
 #include "HTNDecorator_TraceTest.generated.h"
 
 // The condition of this decorator passes based on a trace between two points (or actors) being blocked.
 // (By default, must be blocked to pass).
 // When tracing from/to actors, they're automatically excluded from the trace test.
+// During planning, results are reused between candidate plans that trace between the same points.
+// During execution, traces can optionally be done asynchronously and at a limited rate (see bUseAsyncTraceDuringExecution).
 UCLASS()
 class HTN_API UHTNDecorator_TraceTest : public UHTNDecorator
 {
@@ -22,6 +25,9 @@ public:
 	UHTNDecorator_TraceTest(const FObjectInitializer& Initializer);
 	virtual void InitializeFromAsset(class UHTN& Asset) override;
 	virtual FString GetStaticDescription() const override;
+	virtual bool GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const override { return true; }
+	virtual uint16 GetInstanceMemorySize() const override;
+	virtual void InitializeMemory(UHTNComponent& OwnerComp, uint8* NodeMemory, const FHTNPlan& Plan, const FHTNPlanStepID& StepID) const override;
 	
 	UPROPERTY(EditAnywhere, Category = Trace)
 	FBlackboardKeySelector TraceFrom;
@@ -59,6 +65,21 @@ public:
 	UPROPERTY(EditAnywhere, Category = "Trace|Shape", meta = (UIMin = 0, ClampMin = 0, EditCondition = "TraceShape == EEnvTraceShape::Box || TraceShape == EEnvTraceShape::Capsule"))
 	float TraceExtentZ;
 
+	// If set, plan rechecks and execution-time checks will use asynchronous traces instead of blocking the game thread.
+	// The condition will then use the result of the last finished trace, which may be up to a frame old.
+	// Plan-time checks (on plan enter/exit) are always synchronous, since the planner needs the result immediately.
+	UPROPERTY(EditAnywhere, Category = "Trace|Performance")
+	uint8 bUseAsyncTraceDuringExecution : 1;
+
+	// The minimum time (in seconds) between two traces during plan recheck or execution. 
+	// In between, the result of the last trace is reused. 0 means trace on every check.
+	UPROPERTY(EditAnywhere, Category = "Trace|Performance", Meta = (UIMin = 0, ClampMin = 0))
+	float RecheckInterval;
+
+	// If set, during a single planning run, candidate plans that trace between the same points will reuse the same trace result.
+	UPROPERTY(EditAnywhere, Category = "Trace|Performance")
+	uint8 bCacheResultsDuringPlanning : 1;
+
 	UPROPERTY(EditAnywhere, Category = "Trace|Debug")
 	TEnumAsByte<EDrawDebugTrace::Type> DrawDebugType;
 
@@ -78,6 +99,52 @@ protected:
 	virtual bool CalculateRawConditionValue(UHTNComponent& OwnerComp, uint8* NodeMemory, EHTNDecoratorConditionCheckType CheckType) const override;
 	void FillActorsToIgnoreBuffer(UHTNComponent& OwnerComp, AActor* TraceFromActor, AActor* TraceToActor) const;
 
+	bool Trace(UHTNComponent& OwnerComp, const FVector& StartLocation, const FVector& EndLocation) const;
+	FTraceHandle StartAsyncTrace(UHTNComponent& OwnerComp, const FVector& StartLocation, const FVector& EndLocation) const;
+	bool GetPlanTimeTraceResult(UHTNComponent& OwnerComp, const FVector& StartLocation, const FVector& EndLocation, AActor* TraceFromActor, AActor* TraceToActor) const;
+	bool GetExecutionTimeTraceResult(UHTNComponent& OwnerComp, uint8* NodeMemory, EHTNDecoratorConditionCheckType CheckType, const FVector& StartLocation, const FVector& EndLocation) const;
+
 	UPROPERTY(Transient)
 	mutable TArray<AActor*> ActorsToIgnoreBuffer;
+
+	// The state of traces done during either plan recheck or execution.
+	// These are tracked separately since plan rechecks look at future worldstates while execution looks at the blackboard.
+	struct FTraceState
+	{
+		FTraceHandle PendingTraceHandle;
+		float LastTraceTime = -FLT_MAX;
+		bool bHasResult = false;
+		bool bLastResult = false;
+	};
+
+	struct FNodeMemory
+	{
+		FTraceState ExecutionState;
+		FTraceState RecheckState;
+	};
+
+	struct FPlanTimeTraceKey
+	{
+		FVector StartLocation;
+		FVector EndLocation;
+		TWeakObjectPtr<AActor> TraceFromActor;
+		TWeakObjectPtr<AActor> TraceToActor;
+
+		FORCEINLINE friend bool operator==(const FPlanTimeTraceKey& A, const FPlanTimeTraceKey& B)
+		{
+			return A.StartLocation == B.StartLocation && A.EndLocation == B.EndLocation && 
+				A.TraceFromActor == B.TraceFromActor && A.TraceToActor == B.TraceToActor;
+		}
+
+		FORCEINLINE friend uint32 GetTypeHash(const FPlanTimeTraceKey& Key)
+		{
+			return HashCombine(HashCombine(GetTypeHash(Key.StartLocation), GetTypeHash(Key.EndLocation)), 
+				HashCombine(GetTypeHash(Key.TraceFromActor), GetTypeHash(Key.TraceToActor)));
+		}
+	};
+
+	struct FPlanTimeTraceCache : public FHTNNodePlanningCache
+	{
+		TMap<FPlanTimeTraceKey, bool> Results;
+	};
 };
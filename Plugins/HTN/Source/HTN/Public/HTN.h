@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "UObject/NoExportTypes.h"
+#include "HTNStaticAnalysis.h"
 #include "HTN.generated.h"
 
 // A Hierarchical Task Network asset
@@ -13,6 +14,15 @@ class HTN_API UHTN : public UObject
 	GENERATED_BODY()
 
 public:
+	// Returns what is known about this HTN without planning, such as the lowest cost of its plans and the keys it uses.
+	// Computed on first use (usually when an HTNComponent starts running this HTN) and cached.
+	const FHTNStaticAnalysis& GetStaticAnalysis() const;
+
+#if WITH_EDITOR
+	// Discards the cached static analyses of all HTNs, since the analysis of an HTN includes that of its subnetworks.
+	static void InvalidateStaticAnalyses();
+#endif
+
 	// The nodes that begin from the root.
 	UPROPERTY()
 	TArray<class UHTNStandaloneNode*> StartNodes;
@@ -36,4 +46,12 @@ public:
 	// Blackboard asset for this HTH.
 	UPROPERTY()
 	class UBlackboardData* BlackboardAsset;
+
+private:
+	mutable TSharedPtr<const FHTNStaticAnalysis> StaticAnalysis;
+
+#if WITH_EDITOR
+	mutable uint32 StaticAnalysisVersion = 0;
+	static uint32 CurrentStaticAnalysisVersion;
+#endif
 };
\ No newline at end of file
@@ -7,6 +7,7 @@
 #include "GameplayTagContainer.h"
 #include "GameplayTaskOwnerInterface.h"
 #include "HTN.h"
+#include "HTNPlanningStats.h"
 #include "HTNTypes.h"
 #include "HTNComponent.generated.h"
 
@@ -28,25 +29,50 @@ struct FHTNDebugExecutionStep
 {
 	TSharedPtr<FHTNPlan> HTNPlan;
 	
-	TArray<FHTNPlanStepID> ActivePlanStepIDs;
+	// The range of IDs of the plan steps executing at this step in the step ID pool of FHTNDebugSteps.
+	// See FHTNDebugSteps::GetActivePlanStepIDs.
+	int32 ActivePlanStepIDsStart = 0;
+	int32 NumActivePlanStepIDs = 0;
 	
-	// Descriptions of blackboard values at this step
-	TMap<FName, FString> BlackboardValues;
+	// Descriptions of blackboard values at this step. Shared with the previous step if the values didn't change.
+	TSharedPtr<const TMap<FName, FString>> BlackboardValues;
 
 	int32 DebugStepIndex = 0;
 };
 
+// A fixed-capacity ring buffer of debug steps. Once full, adding a step overwrites the oldest one.
+// The active plan step IDs of all steps are kept in a shared fixed-capacity ring buffer too, so recording a step never allocates.
 class HTN_API FHTNDebugSteps
 {
 public:
-	FHTNDebugExecutionStep& Add_GetRef();
+	FHTNDebugSteps();
+	
+	FHTNDebugExecutionStep& Add_GetRef(TArrayView<const FHTNPlanStepID> ActivePlanStepIDs);
+	TArrayView<const FHTNPlanStepID> GetActivePlanStepIDs(const FHTNDebugExecutionStep& Step) const;
 	void Reset();
+	void SetCapacity(int32 NewCapacity);
 	const FHTNDebugExecutionStep* GetByIndex(int32 Index) const;
 	FHTNDebugExecutionStep* GetByIndex(int32 Index);
+	int32 GetFirstIndex() const;
 	int32 GetLastIndex() const;
+	FORCEINLINE int32 Num() const { return NumSteps; }
+	FORCEINLINE int32 GetCapacity() const { return Capacity; }
 	
 private:
+	void RemoveOldest();
+
 	TArray<FHTNDebugExecutionStep> Steps;
+
+	// The active plan step IDs of the steps. The IDs of each step are contiguous. 
+	// When the IDs of a step are about to be overwritten, that step and the ones before it are removed.
+	TArray<FHTNPlanStepID> StepIDPool;
+	int32 NextStepIDPoolIndex;
+
+	int32 Capacity;
+	// Index in the Steps array of the oldest step.
+	int32 StartArrayIndex;
+	int32 NumSteps;
+	int32 NextDebugStepIndex;
 };
 
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnHTNPlanExecutionStartedBP, UHTNComponent*, Sender);
@@ -141,6 +167,10 @@ public:
 	FORCEINLINE const TArray<FHTNPlanStepID>& GetPendingExecutingStepIDs() const { return PendingExecutionStepIDs; }
 	FORCEINLINE const TArray<FHTNPlanStepID>& GetCurrentlyExecutingStepIDs() const { return CurrentlyExecutingStepIDs; }
 	FORCEINLINE const TArray<FHTNPlanStepID>& GetCurrentlyAbortingStepIDs() const { return CurrentlyAbortingStepIDs; }
+
+	// Returns the stats of the last finished (or cancelled) planning run.
+	UFUNCTION(BlueprintPure, Category = "AI|HTN")
+	FORCEINLINE FHTNPlanningStats GetLastPlanningStats() const { return LastPlanningStats; }
 	
 	UFUNCTION(BlueprintPure, Category = "AI|HTN")
 	FORCEINLINE class UWorldStateProxy* GetPlanningWorldStateProxy() const { check(PlanningWorldStateProxy); return PlanningWorldStateProxy; }
@@ -151,6 +181,17 @@ public:
 	UFUNCTION(BlueprintPure, Category = "AI|HTN")
 	FORCEINLINE class UWorldStateProxy* GetWorldStateProxy(bool bForPlanning) const { return bForPlanning ? GetPlanningWorldStateProxy() : GetBlackboardProxy(); }
 
+	// Makes a worldstate with the current values of the blackboard. 
+	// If this component is in a SharedWorldStateGroup, the instance-synced keys are read from a layer shared with the rest of the group instead of copied.
+	TSharedRef<class FBlackboardWorldState> MakeBlackboardWorldState() const;
+
+	UFUNCTION(BlueprintPure, Category = "AI|HTN")
+	FORCEINLINE FName GetSharedWorldStateGroup() const { return SharedWorldStateGroup; }
+
+	// Takes effect from the next planning run.
+	UFUNCTION(BlueprintCallable, Category = "AI|HTN")
+	void SetSharedWorldStateGroup(FName Group);
+
 	// Sets the "current worldstate" in the planning WorldStateProxy. Call this before handing over control to external logic like eqs contexts during planning.
 	// When calling GetPlanningWorldStateProxy, they will get a proxy to the given worldstate. If null, the proxy will be pointing to the blackboard.
 	void SetPlanningWorldState(TSharedPtr<class FBlackboardWorldState> WorldState, bool bIsEditable = true);
@@ -161,6 +202,15 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "AI|Logic")
 	void AddCooldownDuration(const UObject* CooldownOwner, float CooldownDuration, bool bAddToExistingDuration);
 
+	// Returns the data the given owner (usually a template node) keeps on this component between planning runs, creating it if needed.
+	// Cleared together with cooldowns when the HTN is stopped or restarted.
+	template<typename CacheType>
+	CacheType& GetPersistentNodeCache(const UObject& CacheOwner);
+
+	// Returns the data the given owner keeps on this component between planning runs, or null if there is none.
+	template<typename CacheType>
+	CacheType* FindPersistentNodeCache(const UObject& CacheOwner) const;
+
 	// Assign an HTN asset to SubnetworkDynamic specified by tag.
 	// Returns true if the new HTN is different from the old one.
 	// If the HTN of any SubnetworkDynamic nodes in the current plan was changed, forces a replan.
@@ -174,12 +224,19 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "AI|Logic")
 	UHTN* GetDynamicHTN(FGameplayTag InjectTag) const;
 
+	// Returns the squad this component is a member of, if any. See UHTNSquad::AddMember.
+	UFUNCTION(BlueprintPure, Category = "AI|Logic")
+	FORCEINLINE class UHTNSquad* GetSquad() const { return Squad; }
+
 	DECLARE_EVENT_OneParam(UHTNComponent, FOnHTNPlanExecutionStarted, UHTNComponent* /*Sender*/);
 	FORCEINLINE FOnHTNPlanExecutionStarted& OnPlanExecutionStarted() { return PlanExecutionStartedEvent; }
 
 	DECLARE_EVENT_TwoParams(UHTNComponent, FOnHTNPlanExecutionFinished, UHTNComponent* /*Sender*/, EHTNPlanExecutionFinishedResult /*Result*/);
 	FORCEINLINE FOnHTNPlanExecutionFinished& OnPlanExecutionFinished() { return PlanExecutionFinishedEvent; }
 
+	DECLARE_EVENT_TwoParams(UHTNComponent, FOnHTNPlanningFinished, UHTNComponent* /*Sender*/, const FHTNPlanningStats& /*Stats*/);
+	FORCEINLINE FOnHTNPlanningFinished& OnPlanningFinished() { return PlanningFinishedEvent; }
+
 protected:
 	uint8 LockFlags;
 	uint8 bIsPaused : 1;
@@ -219,6 +276,7 @@ private:
 	UHTNTask& GetTaskInCurrentPlan(const FHTNPlanStepID& ExecutingStepID) const;
 	UHTNTask& GetTaskInCurrentPlan(const FHTNPlanStepID& ExecutingStepID, uint8*& OutTaskMemory) const;
 
+	void NotifyOnPlanningFinished(const TSharedPtr<struct FHTNPlan>& ProducedPlan);
 	void NotifyOnPlanExecutionStarted();
 	void NotifyOnPlanExecutionFinished(EHTNPlanExecutionFinishedResult Result);
 	void NotifyNodesOnPlanExecutionStarted();
@@ -226,7 +284,9 @@ private:
 	void NotifyNodesOnPlanExecutionHelper(TFunctionRef<void(UHTNNode* /*TemplateNode*/, uint16 /*NodeMemoryOffset*/)> Callable);
 
 #if USE_HTN_DEBUGGER
-	FHTNDebugExecutionStep& StoreDebugStep(bool bIsEmpty = false) const;
+	// Returns null if this component is currently not recording debug steps.
+	FHTNDebugExecutionStep* StoreDebugStep(bool bIsEmpty = false, const FHTNPlanStepID& EnteringStepID = FHTNPlanStepID::None) const;
+	bool ShouldRecordDebugSteps() const;
 #endif
 	
 #if ENABLE_VISUAL_LOG
@@ -241,12 +301,16 @@ private:
 	FOnHTNPlanExecutionFinishedBP PlanExecutionFinishedBPEvent;
 	FOnHTNPlanExecutionFinished PlanExecutionFinishedEvent;
 
+	FOnHTNPlanningFinished PlanningFinishedEvent;
+
 	UPROPERTY()
 	class UHTN* CurrentHTNAsset;
 
 	UPROPERTY()
 	class UAITask_MakeHTNPlan* CurrentPlanningTask;
 
+	FHTNPlanningStats LastPlanningStats;
+
 	TSharedPtr<struct FHTNPlan> CurrentPlan;
 	TArray<FHTNPlanStepID> CurrentlyExecutingStepIDs;
 	TArray<FHTNPlanStepID> PendingExecutionStepIDs;
@@ -276,24 +340,76 @@ private:
 	// Deliberately does not retain the objects, so they might become invalid.
 	UPROPERTY(Transient, VisibleAnywhere, Category = "AI|HTN")
 	TMap<const UObject*, float> CooldownOwnerToEndTimeMap;
+
+	// Data that nodes keep between planning runs. See GetPersistentNodeCache.
+	// Like the cooldowns, deliberately does not retain the owners.
+	TMap<TPair<const UObject*, FHTNNodePlanningCacheTypeID>, TUniquePtr<FHTNNodePlanningCache>> PersistentNodeCaches;
 	
 	// Maps from gameplay tags to HTN assets used by HTNNode_SubnetworkDynamic
 	UPROPERTY(Transient, VisibleAnywhere, Category = "AI|HTN")
 	TMap<FGameplayTag, UHTN*> GameplayTagToDynamicHTNMap;
+
+	// The squad this component is a member of. Set by UHTNSquad.
+	UPROPERTY(Transient, VisibleAnywhere, Category = "AI|HTN")
+	class UHTNSquad* Squad;
+
+	// HTNComponents with the same group and blackboard asset share a single read-only copy of the instance-synced blackboard keys 
+	// in their planning worldstates instead of each copying them, e.g. the targets, waypoints and alarm state of a squad.
+	// Only worthwhile when the blackboard has instance-synced keys and several agents plan with it. None to disable.
+	UPROPERTY(EditAnywhere, Category = "AI|HTN")
+	FName SharedWorldStateGroup;
+
+#if WITH_EDITORONLY_DATA
+	// How many execution steps this component keeps for the HTN debugger. Once reached, the oldest steps are overwritten.
+	UPROPERTY(EditAnywhere, Category = "AI|HTN|Debug", Meta = (ClampMin = "1"))
+	int32 MaxDebuggerSteps;
+#endif
 	
 	FHTNPendingHTNStartInfo PendingHTNStartInfo;
 	FHTNPendingPlanExecutionInfo PendingPlanExecutionInfo;
 
 	friend class UHTNNode;
 	friend class FHTNDebugger;
+	friend class UHTNSquad;
 	friend struct FHTNComponentScopedLock;
 
 #if USE_HTN_DEBUGGER
 	mutable FHTNDebugSteps DebuggerSteps;
 	static TArray<TWeakObjectPtr<UHTNComponent>> PlayingComponents;
+
+public:
+	// The component currently inspected in the HTN debugger. 
+	// If ai.htn.debugger.RecordOnlyDebuggedAgent is set, only this component records debug steps.
+	static void SetDebuggedComponent(const UHTNComponent* Component);
+
+private:
+	static TWeakObjectPtr<const UHTNComponent> DebuggedComponent;
 #endif
 };
 
+template<typename CacheType>
+CacheType& UHTNComponent::GetPersistentNodeCache(const UObject& CacheOwner)
+{
+	static_assert(TIsDerivedFrom<CacheType, FHTNNodePlanningCache>::IsDerived, "CacheType must derive from FHTNNodePlanningCache");
+
+	TUniquePtr<FHTNNodePlanningCache>& Cache = PersistentNodeCaches.FindOrAdd({ &CacheOwner, GetHTNNodePlanningCacheTypeID<CacheType>() });
+	if (!Cache.IsValid())
+	{
+		Cache = MakeUnique<CacheType>();
+	}
+
+	return StaticCast<CacheType&>(*Cache);
+}
+
+template<typename CacheType>
+CacheType* UHTNComponent::FindPersistentNodeCache(const UObject& CacheOwner) const
+{
+	static_assert(TIsDerivedFrom<CacheType, FHTNNodePlanningCache>::IsDerived, "CacheType must derive from FHTNNodePlanningCache");
+
+	const TUniquePtr<FHTNNodePlanningCache>* const Cache = PersistentNodeCaches.Find({ &CacheOwner, GetHTNNodePlanningCacheTypeID<CacheType>() });
+	return Cache ? StaticCast<CacheType*>(Cache->Get()) : nullptr;
+}
+
 FORCEINLINE uint8* UHTNComponent::GetNodeMemory(uint16 MemoryOffset) const
 {
 	// The range intentionally includes PlanMemory.Num() for when the (non-special) memory use of the last node is 0.
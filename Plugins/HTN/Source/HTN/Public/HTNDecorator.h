@@ -53,6 +53,7 @@ public:
 
 	UFUNCTION(BlueprintPure, Category = AI)
 	FORCEINLINE bool IsInversed() const { return bInverseCondition; }
+	FORCEINLINE bool ModifiesStepCost() const { return bModifyStepCost; }
 
 protected:
 	// Note that NodeMemory will be nullptr during plan-time checks, as memory blocks are only allocated once a plan is selected for execution.
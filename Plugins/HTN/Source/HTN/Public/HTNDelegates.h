@@ -7,6 +7,11 @@
 struct HTN_API FHTNDelegates
 {
 	DECLARE_MULTICAST_DELEGATE_TwoParams(FOnPlanExecutionStarted, const class UHTNComponent&, const TSharedPtr<struct FHTNPlan>&);
+	DECLARE_MULTICAST_DELEGATE_ThreeParams(FOnPlanningStarted, const class UHTNComponent&, const class UHTN& /*TopLevelHTN*/, const class FBlackboardWorldState& /*WorldStateAtPlanStart*/);
+	// The plan is null if planning failed or was cancelled.
+	DECLARE_MULTICAST_DELEGATE_ThreeParams(FOnPlanningFinished, const class UHTNComponent&, const struct FHTNPlanningStats&, const TSharedPtr<struct FHTNPlan>&);
 	
 	static FOnPlanExecutionStarted OnPlanExecutionStarted;
+	static FOnPlanningStarted OnPlanningStarted;
+	static FOnPlanningFinished OnPlanningFinished;
 };
\ No newline at end of file
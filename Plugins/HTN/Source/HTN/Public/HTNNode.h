@@ -81,7 +81,17 @@ public:
 #if WITH_EDITOR
 	// Get the name of the icon used to display this node in the editor
 	virtual FName GetNodeIconName() const { return FName(); }
+	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
 #endif
+
+	// Adds the names of the blackboard keys this node can change in the worldstate during planning. Used by FHTNStaticAnalysis.
+	// Returns false if the node may also change keys it can't list. That's the default, so only nodes that override this are trusted,
+	// including ones that write nothing and just return true.
+	virtual bool GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const;
+
+	// Adds the names of the blackboard keys this node reads during planning other than through its FBlackboardKeySelector properties,
+	// which are already counted as read (e.g. SelfLocation). Used by FHTNStaticAnalysis.
+	virtual void GetImplicitlyReadBlackboardKeys(TArray<FName>& OutKeyNames) const {}
 	
 	// Begin IGameplayTaskOwnerInterface
 	virtual UGameplayTasksComponent* GetGameplayTasksComponent(const UGameplayTask& Task) const override;
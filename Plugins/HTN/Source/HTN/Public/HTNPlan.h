@@ -42,6 +42,10 @@ struct HTN_API FHTNPlan
 	// The sum of the costs of the Levels.
 	int32 Cost;
 
+	// A lower bound on the cost the unfinished levels will add, from the static analysis of their HTNs (see FHTNStaticAnalysis).
+	// The planner expands plans in the order of Cost + MinRemainingCost. See UpdateMinRemainingCost.
+	int32 MinRemainingCost;
+
 	// For tasks with a recursion limit, stores how many times each task is present in this plan.
 	// Since most plan expansions don't change this, the map is shared between most plans and only copied when a task with a recursion limit is added.
 	TSharedPtr<TMap<TWeakObjectPtr<UHTNNode>, int32>> RecursionCounts;
@@ -58,6 +62,8 @@ struct HTN_API FHTNPlan
 	bool HasLevel(int32 LevelIndex) const;
 	bool IsComplete() const;
 	bool IsLevelComplete(int32 LevelIndex) const;
+	FORCEINLINE int32 GetMinTotalCost() const { return Cost + MinRemainingCost; }
+	void UpdateMinRemainingCost();
 	
 	bool FindStepToAddAfter(FHTNPlanStepID& OutPlanStepID) const;
 	void GetWorldStateAndNextNodes(const FHTNPlanStepID& StepID, TSharedPtr<class FBlackboardWorldState>& OutWorldState, TArrayView<UHTNStandaloneNode*>& OutNextNodes) const;
@@ -118,6 +124,11 @@ struct HTN_API FHTNPlanLevel
 	// The sum of the costs of the Steps.
 	int32 Cost;
 
+	// The lowest cost the HTN of this level can have, from its static analysis. 0 for inline levels.
+	int32 MinCost;
+	// The cost of the plan when this level was added. Everything the plan spent since then counts towards MinCost.
+	int32 PlanCostAtLevelStart;
+
 	bool bIsInline;
 	
 	TArray<THTNNodeInfo<class UHTNDecorator>> RootDecoratorInfos;
@@ -128,6 +139,8 @@ struct HTN_API FHTNPlanLevel
 		WorldStateAtLevelStart(WorldStateAtLevelStart),
 		ParentStepID(ParentStepID),
 		Cost(0),
+		MinCost(0),
+		PlanCostAtLevelStart(0),
 		bIsInline(bIsInline)
 	{}
 
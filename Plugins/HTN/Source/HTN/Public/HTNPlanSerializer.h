@@ -0,0 +1,54 @@
+// Copyright 2020-2021 Maksym Maisak. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class FBlackboardWorldState;
+class UBlackboardData;
+class UHTN;
+class UHTNStandaloneNode;
+struct FHTNPlan;
+
+// Saves plans in a compact binary form and loads them back, e.g. to keep plan caches between sessions or to record plans for replay.
+// Nodes are saved as indices into a per-asset node table, together with a version hash of every HTN asset the plan uses
+// and of the blackboard, so a saved plan is rejected once any of those change.
+// Worldstates are saved as the values that differ from the worldstate at the start of the plan plus the keys they changed,
+// and rebuilt on top of the starting worldstate given when loading.
+// Object and class values are saved as paths, so object values are only restored if the object exists when the plan is loaded.
+struct HTN_API FHTNPlanSerializer
+{
+	// Returns false if the plan can't be saved, e.g. if it has values of blackboard key types that aren't supported.
+	static bool SavePlan(const FHTNPlan& Plan, TArray<uint8>& OutData, FString* OutError = nullptr);
+
+	// Returns null if the data is malformed or was saved with different versions of the HTN assets or the blackboard.
+	static TSharedPtr<FHTNPlan> LoadPlan(const TArray<uint8>& Data, const TSharedRef<FBlackboardWorldState>& WorldStateAtPlanStart, FString* OutError = nullptr);
+
+	// Checks if the plan could be loaded on top of the given worldstate without recreating it.
+	// Only the header is checked, so LoadPlan can still fail if the rest of the data is malformed.
+	static bool ValidatePlan(const TArray<uint8>& Data, const FBlackboardWorldState& WorldStateAtPlanStart, FString* OutError = nullptr);
+
+	// Saves the values of all keys of the worldstate, e.g. to record the starting state of a planning run.
+	// Keys of unsupported types are skipped. Object and class values are saved as paths, same as in saved plans.
+	static void SaveWorldState(const FBlackboardWorldState& WorldState, TArray<uint8>& OutData);
+
+	// Sets the values saved with SaveWorldState on the given worldstate, marking them as changed.
+	// Fails if the worldstate has a different blackboard than the saved one.
+	static bool LoadWorldState(const TArray<uint8>& Data, FBlackboardWorldState& WorldState, FString* OutError = nullptr);
+
+	// A hash of the nodes, costs and structure of the plan, ignoring its worldstates. 
+	// Equal for plans made by separate planning runs if they chose the same steps.
+	static uint32 GetPlanIdentity(const FHTNPlan& Plan);
+
+	// Outputs the standalone nodes of the asset in the order used by saved plans.
+	// The order only depends on the names of the nodes, which are saved with the asset.
+	static void GetNodeTable(const UHTN& Asset, TArray<UHTNStandaloneNode*>& OutNodes);
+
+	// A hash of the node table of the asset (the names and classes of its nodes and the connections between them), 
+	// the saved properties of its nodes, and the classes and properties of their decorators and services and of the root ones.
+	// Editing anything that affects planning, like a cost or a parameter of a task, changes it.
+	static uint32 GetAssetVersion(const UHTN& Asset);
+
+	// A hash of the names and types of the keys of the blackboard, including the ones from its parents.
+	static uint32 GetBlackboardVersion(const UBlackboardData& Blackboard);
+};
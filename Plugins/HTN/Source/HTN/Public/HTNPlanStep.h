@@ -39,6 +39,9 @@ struct HTN_API FHTNPlanStep
 	// This stores the index of the secondary sublevel.
 	int32 SecondarySubLevelIndex;
 
+	// For steps of the AnyOrderN node, the index of the branch planned in the primary sublevel.
+	int32 AnyOrderBranchIndex;
+
 	// Extra flags used by specific structural nodes.
 	bool bAnyOrderInversed : 1;
 	bool bIsIfNodeFalseBranch : 1;
@@ -63,6 +66,7 @@ struct HTN_API FHTNPlanStep
 		Cost(Cost),
 		SubLevelIndex(SubLevelIndex),
 		SecondarySubLevelIndex(ParallelSubLevelIndex),
+		AnyOrderBranchIndex(INDEX_NONE),
 		bAnyOrderInversed(false),
 		bIsIfNodeFalseBranch(false),
 		bCanConditionsInterruptTrueBranch(true),
@@ -0,0 +1,92 @@
+// Copyright 2020-2021 Maksym Maisak. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HTNPlanningStats.generated.h"
+
+// Counters describing the search space of a single planning run. Always gathered, unlike FHTNPlanningDebugInfo,
+// so they can be used to monitor planning in production (see UHTNComponent::GetLastPlanningStats and FHTNDelegates::OnPlanningFinished).
+USTRUCT(BlueprintType)
+struct HTN_API FHTNPlanningStats
+{
+	GENERATED_BODY()
+
+	// The number of plans taken from the frontier to be expanded.
+	UPROPERTY(BlueprintReadOnly, Category = "AI|HTN")
+	int32 NumExpandedPlans = 0;
+
+	// The number of new plans made by expanding other plans.
+	UPROPERTY(BlueprintReadOnly, Category = "AI|HTN")
+	int32 NumCandidatePlans = 0;
+
+	// The number of expansions rejected by decorators or recursion limits.
+	UPROPERTY(BlueprintReadOnly, Category = "AI|HTN")
+	int32 NumPrunedCandidates = 0;
+
+	// The number of candidate plans that had to wait for higher-priority plans (e.g. in the lower branch of a Prefer node).
+	UPROPERTY(BlueprintReadOnly, Category = "AI|HTN")
+	int32 NumBlockedPlans = 0;
+
+	// The largest number of plans in the frontier at once.
+	UPROPERTY(BlueprintReadOnly, Category = "AI|HTN")
+	int32 MaxFrontierSize = 0;
+
+	// Copies of worldstates made on the game thread while the planner was running, including the ones made by tasks in CreatePlanSteps.
+	UPROPERTY(BlueprintReadOnly, Category = "AI|HTN")
+	int32 NumWorldStateCopies = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "AI|HTN")
+	int32 NumPlanCopies = 0;
+
+	// The number of times tasks decided to produce plan steps latently.
+	UPROPERTY(BlueprintReadOnly, Category = "AI|HTN")
+	int32 NumLatentWaits = 0;
+
+	// Time from the start of planning to its end, including the time spent waiting for latent tasks.
+	UPROPERTY(BlueprintReadOnly, Category = "AI|HTN")
+	float WallTimeSeconds = 0.0f;
+
+	UPROPERTY(BlueprintReadOnly, Category = "AI|HTN")
+	bool bFoundPlan = false;
+
+	UPROPERTY(BlueprintReadOnly, Category = "AI|HTN")
+	bool bWasCancelled = false;
+
+	// True if planning failed because a plan exceeded the maximum plan length.
+	UPROPERTY(BlueprintReadOnly, Category = "AI|HTN")
+	bool bExceededMaxPlanLength = false;
+
+	FORCEINLINE void Reset() { *this = FHTNPlanningStats(); }
+	FString ToString() const;
+
+	// Worldstate and plan copies are counted in the stats of the planner that is currently running (if any).
+	static void CountWorldStateCopy();
+	static void CountPlanCopy();
+
+private:
+	static FHTNPlanningStats* ActiveStats;
+	friend struct FHTNPlanningStatsScope;
+};
+
+// Makes the given stats active for the duration of the scope. Only used on the game thread.
+struct FHTNPlanningStatsScope : public TGuardValue<FHTNPlanningStats*>
+{
+	FORCEINLINE explicit FHTNPlanningStatsScope(FHTNPlanningStats& Stats) : TGuardValue(FHTNPlanningStats::ActiveStats, &Stats) {}
+};
+
+FORCEINLINE void FHTNPlanningStats::CountWorldStateCopy()
+{
+	if (ActiveStats && IsInGameThread())
+	{
+		++ActiveStats->NumWorldStateCopies;
+	}
+}
+
+FORCEINLINE void FHTNPlanningStats::CountPlanCopy()
+{
+	if (ActiveStats && IsInGameThread())
+	{
+		++ActiveStats->NumPlanCopies;
+	}
+}
@@ -0,0 +1,131 @@
+// Copyright 2020-2021 Maksym Maisak. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameplayTagContainer.h"
+#include "UObject/Object.h"
+#include "HTNTypes.h"
+#include "HTNSquad.generated.h"
+
+class UHTN;
+class UHTNComponent;
+
+USTRUCT(BlueprintType)
+struct HTN_API FHTNSquadRole
+{
+	GENERATED_BODY()
+
+	// The HTN that members with this role run in their SubNetworkDynamic nodes with the RoleInjectTag of the squad.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "AI|HTN")
+	UHTN* HTN = nullptr;
+
+	// How many members can have this role at the same time. 0 means no limit.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "AI|HTN", Meta = (ClampMin = "0"))
+	int32 MaxMembers = 0;
+};
+
+// Coordinates the planning of a group of HTNComponents so that they don't duplicate work or pick the same targets:
+// - Gives each member a role, which is an HTN injected into the SubNetworkDynamic nodes with RoleInjectTag (see UHTNComponent::SetDynamicHTN).
+//   Roles are kept when members join or leave, so that the rest of the squad doesn't need to replan.
+// - Keeps data nodes share between members, e.g. the results of EQS Query tasks with Share Results With Squad, so that a query runs once for the whole squad.
+// - Tracks locations claimed by the current plans of members, e.g. by EQS Query tasks with Avoid Squad Claims,
+//   so that other members plan with different ones instead of replanning after a conflict.
+UCLASS(BlueprintType)
+class HTN_API UHTNSquad : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	UHTNSquad();
+	virtual void BeginDestroy() override;
+
+	UFUNCTION(BlueprintCallable, Category = "AI|HTN")
+	void AddMember(UHTNComponent* Member);
+
+	UFUNCTION(BlueprintCallable, Category = "AI|HTN")
+	void RemoveMember(UHTNComponent* Member);
+
+	UFUNCTION(BlueprintPure, Category = "AI|HTN")
+	TArray<UHTNComponent*> GetMembers() const;
+
+	// Replaces the roles and reassigns them to all members.
+	UFUNCTION(BlueprintCallable, Category = "AI|HTN")
+	void SetRoles(const TArray<FHTNSquadRole>& NewRoles);
+
+	// Returns the index in Roles of the role of the member, or -1 if it has none.
+	UFUNCTION(BlueprintPure, Category = "AI|HTN")
+	int32 GetMemberRole(const UHTNComponent* Member) const;
+
+	// Claims a location for the member until it releases it or leaves the squad.
+	void ClaimLocation(const UHTNComponent& Member, const FVector& Location);
+	void ReleaseLocation(const UHTNComponent& Member, const FVector& Location);
+	// Returns true if another member claimed a location within Radius of the given one.
+	bool IsLocationClaimedByOthers(const UHTNComponent& Member, const FVector& Location, float Radius) const;
+
+	// Returns the data the given owner (usually a template node) shares between all members, creating it if needed.
+	// Like UHTNComponent::GetPersistentNodeCache, but for the whole squad.
+	template<typename CacheType>
+	CacheType& GetSharedNodeCache(const UObject& CacheOwner);
+
+	// Returns the data the given owner shares between all members, or null if there is none.
+	template<typename CacheType>
+	CacheType* FindSharedNodeCache(const UObject& CacheOwner) const;
+
+	// The gameplay tag of the SubNetworkDynamic nodes that run the HTNs of the roles.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "AI|HTN")
+	FGameplayTag RoleInjectTag;
+
+	// If set, members replan immediately when their role changes instead of finishing their current plan first.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "AI|HTN")
+	uint8 bAbortPlanOnRoleChange : 1;
+
+protected:
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "AI|HTN")
+	TArray<FHTNSquadRole> Roles;
+
+private:
+	// Gives roles to members that don't have one, and takes them from members of roles that have too many.
+	void AssignRoles();
+	void SetMemberRole(UHTNComponent& Member, int32 RoleIndex);
+
+	struct FMember
+	{
+		TWeakObjectPtr<UHTNComponent> Component;
+		int32 RoleIndex = INDEX_NONE;
+	};
+	TArray<FMember> Members;
+
+	struct FClaim
+	{
+		TWeakObjectPtr<const UHTNComponent> Member;
+		FVector Location = FVector::ZeroVector;
+	};
+	TArray<FClaim> Claims;
+
+	// Like the persistent node caches of UHTNComponent, deliberately does not retain the owners.
+	TMap<TPair<const UObject*, FHTNNodePlanningCacheTypeID>, TUniquePtr<FHTNNodePlanningCache>> SharedNodeCaches;
+};
+
+template<typename CacheType>
+CacheType& UHTNSquad::GetSharedNodeCache(const UObject& CacheOwner)
+{
+	static_assert(TIsDerivedFrom<CacheType, FHTNNodePlanningCache>::IsDerived, "CacheType must derive from FHTNNodePlanningCache");
+
+	TUniquePtr<FHTNNodePlanningCache>& Cache = SharedNodeCaches.FindOrAdd({ &CacheOwner, GetHTNNodePlanningCacheTypeID<CacheType>() });
+	if (!Cache.IsValid())
+	{
+		Cache = MakeUnique<CacheType>();
+	}
+
+	return StaticCast<CacheType&>(*Cache);
+}
+
+template<typename CacheType>
+CacheType* UHTNSquad::FindSharedNodeCache(const UObject& CacheOwner) const
+{
+	static_assert(TIsDerivedFrom<CacheType, FHTNNodePlanningCache>::IsDerived, "CacheType must derive from FHTNNodePlanningCache");
+
+	const TUniquePtr<FHTNNodePlanningCache>* const Cache = SharedNodeCaches.Find({ &CacheOwner, GetHTNNodePlanningCacheTypeID<CacheType>() });
+	return Cache ? StaticCast<CacheType*>(Cache->Get()) : nullptr;
+}
@@ -0,0 +1,39 @@
+// Copyright 2020-2021 Maksym Maisak. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UHTN;
+
+// What can be known about an HTN without planning. See UHTN::GetStaticAnalysis.
+// Conservative: an HTN is only considered infeasible if it certainly can't produce a plan,
+// and MinCost is a lower bound on the cost of any plan it produces, so it may be lower than any actual plan.
+struct HTN_API FHTNStaticAnalysis
+{
+	// The lowest cost a plan through this HTN can have.
+	// The planner uses it to prefer plans whose unfinished subnetworks are cheaper, without losing the guarantee of finding the cheapest plan.
+	int32 MinCost;
+
+	// Blackboard keys nodes of this HTN and its subnetworks read during planning.
+	TSet<FName> ReadKeys;
+
+	// Blackboard keys nodes of this HTN and its subnetworks can change in the worldstate during planning.
+	TSet<FName> WrittenKeys;
+
+	// If set, no plan can be made from this HTN, e.g. because every path through it ends in a Fail task.
+	// The planner skips SubNetwork nodes with such HTNs.
+	uint8 bIsInfeasible : 1;
+
+	// If set, some nodes may read or write keys not listed in ReadKeys and WrittenKeys (e.g. blueprint nodes or dynamic subnetworks).
+	uint8 bHasUnlistedKeys : 1;
+
+	FHTNStaticAnalysis() :
+		MinCost(0),
+		bIsInfeasible(false),
+		bHasUnlistedKeys(false)
+	{}
+
+	static TSharedRef<const FHTNStaticAnalysis> Analyze(const UHTN& HTN);
+	FString ToString() const;
+};
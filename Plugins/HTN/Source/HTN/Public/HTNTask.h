@@ -23,6 +23,11 @@ public:
 	// Check preconditions and output one (or more, for branching) plan steps with a link to self and a modified worldstate.
 	virtual void CreatePlanSteps(UHTNComponent& OwnerComp, UAITask_MakeHTNPlan& PlanningTask, const TSharedRef<const FBlackboardWorldState>& WorldState) const;
 
+	// The lowest cost this task can submit plan steps with. Used by FHTNStaticAnalysis, so it must never be higher than an actual cost.
+	virtual int32 GetMinPlanningCost() const { return 0; }
+	// Returns false if CreatePlanSteps never submits any plan steps, so paths through this task can be discarded without planning them.
+	virtual bool CanEverProducePlanSteps() const { return true; }
+
 	bool WrappedRecheckPlan(UHTNComponent& OwnerComp, uint8* NodeMemory, const FBlackboardWorldState& WorldState, const FHTNPlanStep& SubmittedPlanStep) const;
 	EHTNNodeResult WrappedExecuteTask(UHTNComponent& OwnerComp, uint8* NodeMemory, const FHTNPlanStepID& PlanStepID) const;
 	EHTNNodeResult WrappedAbortTask(UHTNComponent& OwnerComp, uint8* NodeMemory) const;
@@ -9,6 +9,8 @@
 
 #define USE_HTN_DEBUGGER (1 && WITH_EDITORONLY_DATA)
 #define HTN_DEBUG_PLANNING (1 && ENABLE_VISUAL_LOG)
+#define HTN_PROFILER (1 && !UE_BUILD_SHIPPING)
+#define HTN_BENCHMARKS (1 && !UE_BUILD_SHIPPING)
 
 // In 4.25, UProperty etc. were renamed to FProperty etc.
 // The code in the plugin uses the new naming, so these preprocessor definitions
@@ -103,6 +105,29 @@ struct HTN_API FHTNPlanStepID
 	}
 };
 
+// Base class for data that nodes cache to reuse expensive results (e.g. plan-time traces, pathfinding or EQS results).
+// See UAITask_MakeHTNPlan::GetNodePlanningCache for data kept for a single planning run 
+// and UHTNComponent::GetPersistentNodeCache for data kept between planning runs.
+struct HTN_API FHTNNodePlanningCache
+{
+	virtual ~FHTNNodePlanningCache() {}
+
+	// Called on the caches a squad shares between its members when one of them leaves it (see UHTNSquad::GetSharedNodeCache).
+	virtual void OnSquadMemberRemoved(const class UHTNComponent& Member) {}
+};
+
+// Identifies a type of FHTNNodePlanningCache. Caches are kept per owner and type, so two cache types used by the same node don't alias.
+using FHTNNodePlanningCacheTypeID = const void*;
+
+template<typename CacheType>
+FHTNNodePlanningCacheTypeID GetHTNNodePlanningCacheTypeID()
+{
+	static_assert(TIsDerivedFrom<CacheType, FHTNNodePlanningCache>::IsDerived, "CacheType must derive from FHTNNodePlanningCache");
+
+	static const uint8 TypeID = 0;
+	return &TypeID;
+}
+
 // Used in FHTNPlan::PriorityMarkers to deprioritize some plans relative to others. 
 // This is necessary for HTNNode_Prefer to work.
 // See FHTNPlan::PriorityMarkers for more info.
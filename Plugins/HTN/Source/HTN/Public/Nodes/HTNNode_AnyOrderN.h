@@ -0,0 +1,63 @@
+// Copyright 2020-2021 Maksym Maisak. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HTNStandaloneNode.h"
+#include "HTNNode_AnyOrderN.generated.h"
+
+// Plans to execute all of its branches in any order. Each node connected to the output starts a separate branch.
+// Unlike nested AnyOrder nodes, the order is chosen one branch at a time:
+// the next branch is only picked once the previous one has been planned, so the planner explores the cheapest prefixes first
+// instead of producing every permutation upfront.
+UCLASS()
+class HTN_API UHTNNode_AnyOrderN : public UHTNStandaloneNode
+{
+	GENERATED_BODY()
+
+public:
+	UHTNNode_AnyOrderN(const FObjectInitializer& Initializer);
+	virtual void MakePlanExpansions(FHTNPlanningContext& Context) override;
+	virtual bool GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const override { return true; }
+	virtual bool OnSubLevelFinishedPlanning(FHTNPlan& Plan, const FHTNPlanStepID& ThisStepID, int32 SubLevelIndex, TSharedPtr<FBlackboardWorldState> WorldState) override;
+	virtual void GetNextPrimitiveSteps(FHTNGetNextStepsContext& Context, const FHTNPlanStepID& ThisStepID) override;
+	virtual void GetNextPrimitiveSteps(FHTNGetNextStepsContext& Context, const FHTNPlanStepID& ThisStepID, int32 FinishedSubLevelIndex) override;
+	virtual bool CanIncludeSubnodesInSubnodeQuery(const UHTNComponent& OwnerComp, const FHTNPlanStepID& ThisStepID, int32 SubLevelIndex, bool bOnlyStarting, bool bOnlyEnding) const override;
+	virtual FString GetStaticDescription() const override;
+
+	// Returns the nodes a sublevel of a step of this node (or of its ContinuationNode) starts with.
+	// The primary sublevel is the branch chosen for that step, the secondary one plans the remaining branches.
+	TArrayView<UHTNStandaloneNode*> GetNextNodesInSubLevel(const FHTNPlanStep& Step, int32 SubLevelIndex) const;
+
+	// If true, two branches that changed disjoint sets of worldstate keys are assumed to commute,
+	// so only one of their relative orders is planned.
+	// Only enable this if no branch depends during planning on worldstate keys changed by other branches.
+	UPROPERTY(EditAnywhere, Category = Planning)
+	uint8 bPruneCommutingBranches : 1;
+
+	// Plans the branches remaining after the one chosen for a step. Has no decorators or services of its own.
+	UPROPERTY()
+	UHTNStandaloneNode* ContinuationNode;
+
+private:
+	// Returns false if the order in which the branches were planned in the steps with given IDs is a
+	// permutation of another order that is planned separately, with only commuting branches swapped.
+	bool IsCanonicalBranchOrder(const FHTNPlan& Plan, const TArrayView<const FHTNPlanStepID>& StepIDs) const;
+};
+
+// The node used by UHTNNode_AnyOrderN to plan its remaining branches. Not placeable in the graph.
+UCLASS(HideDropdown, NotBlueprintable)
+class HTN_API UHTNNode_AnyOrderNContinuation : public UHTNStandaloneNode
+{
+	GENERATED_BODY()
+
+public:
+	virtual void MakePlanExpansions(FHTNPlanningContext& Context) override;
+	virtual bool GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const override { return true; }
+	virtual bool OnSubLevelFinishedPlanning(FHTNPlan& Plan, const FHTNPlanStepID& ThisStepID, int32 SubLevelIndex, TSharedPtr<FBlackboardWorldState> WorldState) override;
+	virtual void GetNextPrimitiveSteps(FHTNGetNextStepsContext& Context, const FHTNPlanStepID& ThisStepID) override;
+	virtual void GetNextPrimitiveSteps(FHTNGetNextStepsContext& Context, const FHTNPlanStepID& ThisStepID, int32 FinishedSubLevelIndex) override;
+	virtual bool CanIncludeSubnodesInSubnodeQuery(const UHTNComponent& OwnerComp, const FHTNPlanStepID& ThisStepID, int32 SubLevelIndex, bool bOnlyStarting, bool bOnlyEnding) const override;
+
+	FORCEINLINE UHTNNode_AnyOrderN* GetAnyOrderNode() const { return CastChecked<UHTNNode_AnyOrderN>(GetOuter()); }
+};
@@ -15,6 +15,7 @@ class HTN_API UHTNNode_If : public UHTNNode_TwoBranches
 public:
 	UHTNNode_If(const FObjectInitializer& ObjectInitializer);
 	virtual void MakePlanExpansions(FHTNPlanningContext& Context) override;
+	virtual bool GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const override { return true; }
 	virtual void GetNextPrimitiveSteps(FHTNGetNextStepsContext& Context, const FHTNPlanStepID& ThisStepID) override;
 
 	virtual FString GetStaticDescription() const override;
@@ -19,6 +19,7 @@ class HTN_API UHTNNode_Parallel : public UHTNNode_TwoBranches
 public:
 	UHTNNode_Parallel(const FObjectInitializer& Initializer);
 	virtual void MakePlanExpansions(struct FHTNPlanningContext& Context) override;
+	virtual bool GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const override { return true; }
 	virtual bool OnSubLevelFinishedPlanning(FHTNPlan& Plan, const FHTNPlanStepID& ThisStepID, int32 SubLevelIndex, TSharedPtr<FBlackboardWorldState> WorldState) override;
 	virtual void GetNextPrimitiveSteps(FHTNGetNextStepsContext& Context, const FHTNPlanStepID& ThisStepID) override;
 	void OnSubLevelFinished(UHTNComponent& OwnerComp, const FHTNPlanStepID& ThisStepID, int32 FinishedSubLevelIndex);
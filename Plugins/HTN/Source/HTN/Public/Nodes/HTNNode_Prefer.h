@@ -14,5 +14,6 @@ class HTN_API UHTNNode_Prefer : public UHTNNode_TwoBranches
 	
 public:
 	virtual void MakePlanExpansions(FHTNPlanningContext& Context) override;
+	virtual bool GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const override { return true; }
 	virtual void GetNextPrimitiveSteps(FHTNGetNextStepsContext& Context, const FHTNPlanStepID& ThisStepID) override;
 };
\ No newline at end of file
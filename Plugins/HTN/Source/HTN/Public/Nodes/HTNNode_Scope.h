@@ -16,5 +16,6 @@ class HTN_API UHTNNode_Scope : public UHTNStandaloneNode
 public:
 	virtual FString GetStaticDescription() const override;
 	virtual void MakePlanExpansions(FHTNPlanningContext& Context) override;
+	virtual bool GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const override { return true; }
 	virtual void GetNextPrimitiveSteps(FHTNGetNextStepsContext& Context, const FHTNPlanStepID& ThisStepID) override;
 };
\ No newline at end of file
@@ -14,6 +14,7 @@ class HTN_API UHTNNode_SubNetwork : public UHTNStandaloneNode
 public:
 	virtual FString GetStaticDescription() const override;
 	virtual void MakePlanExpansions(FHTNPlanningContext& Context) override;
+	virtual bool GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const override { return true; }
 	virtual void GetNextPrimitiveSteps(FHTNGetNextStepsContext& Context, const FHTNPlanStepID& ThisStepID) override;
 
 	virtual FString GetNodeName() const override;
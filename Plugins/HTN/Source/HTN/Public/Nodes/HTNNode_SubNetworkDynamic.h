@@ -16,6 +16,7 @@ class HTN_API UHTNNode_SubNetworkDynamic : public UHTNStandaloneNode
 public:
 	virtual FString GetStaticDescription() const override;
 	virtual void MakePlanExpansions(FHTNPlanningContext& Context) override;
+	virtual bool GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const override { return true; }
 	virtual void GetNextPrimitiveSteps(FHTNGetNextStepsContext& Context, const FHTNPlanStepID& ThisStepID) override;
 
 #if WITH_EDITOR
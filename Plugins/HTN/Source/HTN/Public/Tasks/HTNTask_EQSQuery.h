@@ -9,6 +9,8 @@
 
 #include "HTNTask_EQSQuery.generated.h"
 
+class UHTNSquad;
+
 // Runs an EQS query during planning and puts the result in the worldstate.
 // Can be configured to output multiple results, which creates multiple branching plans.
 UCLASS()
@@ -19,6 +21,12 @@ class UHTNTask_EQSQuery : public UHTNTask_BlackboardBase
 	UHTNTask_EQSQuery(const FObjectInitializer& Initializer);
 	virtual void InitializeFromAsset(UHTN& Asset) override;
 	virtual void CreatePlanSteps(UHTNComponent& OwnerComp, UAITask_MakeHTNPlan& PlanningTask, const TSharedRef<const FBlackboardWorldState>& WorldState) const override;
+	virtual int32 GetMinPlanningCost() const override;
+	virtual bool GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const override;
+	virtual void GetImplicitlyReadBlackboardKeys(TArray<FName>& OutKeyNames) const override;
+	virtual uint16 GetInstanceMemorySize() const override;
+	virtual void InitializeMemory(UHTNComponent& OwnerComp, uint8* NodeMemory, const FHTNPlan& Plan, const FHTNPlanStepID& StepID) const override;
+	virtual void CleanupMemory(UHTNComponent& OwnerComp, uint8* NodeMemory) const override;
 
 	virtual FString GetStaticDescription() const override;
 #if WITH_EDITOR
@@ -28,6 +36,8 @@ class UHTNTask_EQSQuery : public UHTNTask_BlackboardBase
 #endif
 
 private:
+	void SubmitPlanStepsFromQueryResult(const UHTNComponent& OwnerComp, UAITask_MakeHTNPlan& PlanningTask, const FBlackboardWorldState& WorldState, const FEnvQueryResult& Result, int32 LatentCreatePlanStepsID) const;
+	FString MakeCacheKey(const FBlackboardWorldState& WorldState) const;
 	bool StoreInWorldState(class UEnvQueryItemType* ItemTypeCDO, const struct FBlackboardKeySelector& KeySelector, FBlackboardWorldState& WorldState, const uint8* RawData) const;
 	
 	UPROPERTY(Category = EQS, EditAnywhere)
@@ -43,4 +53,114 @@ private:
 	// The planning cost of this task.
 	UPROPERTY(EditAnywhere, Category = Planning, Meta = (ClampMin = "0"))
 	int32 Cost;
+
+	// If set, the planner keeps expanding other candidate plans while the query is running instead of waiting for it.
+	// This lets multiple EQS queries run at the same time, which reduces the time it takes to make a plan.
+	// Only enable this if the contexts of the query don't read the planning worldstate (e.g. via EnvQueryContext_HTNBlueprintBase),
+	// since the planner will be processing other worldstates while the query runs.
+	UPROPERTY(EditAnywhere, Category = Planning)
+	uint8 bContinuePlanningWhileQueryRuns : 1;
+
+	// If set, query results are reused by later planning runs of the same agent instead of running the query again,
+	// as long as they are not older than Cache Duration, the querier has not moved further than Cache Invalidation Distance,
+	// and the worldstate values the query depends on (query params, query template key and Additional Cache Keys) are the same.
+	UPROPERTY(EditAnywhere, Category = "Planning|Cache")
+	uint8 bCacheQueryResults : 1;
+
+	// How long (in seconds) cached query results remain valid.
+	UPROPERTY(EditAnywhere, Category = "Planning|Cache", Meta = (ClampMin = "0", Units = "s", EditCondition = "bCacheQueryResults"))
+	float CacheDuration;
+
+	// Cached query results are discarded if the querier location (SelfLocation in the worldstate) differs by more than this.
+	UPROPERTY(EditAnywhere, Category = "Planning|Cache", Meta = (ClampMin = "0", Units = "cm", EditCondition = "bCacheQueryResults"))
+	float CacheInvalidationDistance;
+
+	// If above 0, expired results that are no older than Cache Duration + this are still used (if the querier has not moved too far),
+	// while the query is rerun in the background to refresh the cache for subsequent planning runs. 
+	// This lets the planner continue without waiting for the query, at the cost of using slightly outdated results.
+	// Note that EQS contexts reading the planning worldstate will see whatever worldstate is current when the background query runs.
+	UPROPERTY(EditAnywhere, Category = "Planning|Cache", Meta = (ClampMin = "0", Units = "s", EditCondition = "bCacheQueryResults"))
+	float StaleResultGracePeriod;
+
+	// Worldstate keys that the query reads in addition to its params (e.g. via EnvQueryContext_HTNBlueprintBase).
+	// Results are only reused if the values of these keys are the same as when the query was run.
+	UPROPERTY(EditAnywhere, Category = "Planning|Cache", Meta = (EditCondition = "bCacheQueryResults"))
+	TArray<FBlackboardKeySelector> AdditionalCacheKeys;
+
+	// If set and the agent is in a squad (see UHTNSquad), cached results are shared by all members of the squad,
+	// so a query runs once for the whole squad instead of once per member. Members that need a result while the query
+	// is already running for another member within Cache Invalidation Distance wait for it instead of running their own.
+	UPROPERTY(EditAnywhere, Category = "Planning|Cache", Meta = (EditCondition = "bCacheQueryResults"))
+	uint8 bShareResultsWithSquad : 1;
+
+	// If set and the agent is in a squad, query results close to locations claimed by the plans of other members are skipped,
+	// and the result in the plan of this agent is claimed while the plan is active. 
+	// E.g. makes members of a squad pick different cover points instead of all going for the best one.
+	UPROPERTY(EditAnywhere, Category = "Planning|Squad")
+	uint8 bAvoidSquadClaims : 1;
+
+	// Results within this distance of a location claimed by another squad member are skipped.
+	UPROPERTY(EditAnywhere, Category = "Planning|Squad", Meta = (ClampMin = "0", Units = "cm", EditCondition = "bAvoidSquadClaims"))
+	float SquadClaimRadius;
+
+	struct FNodeMemory
+	{
+		TWeakObjectPtr<UHTNSquad> Squad;
+		FVector ClaimedLocation = FVector::ZeroVector;
+	};
+
+	struct FWaiter
+	{
+		// Used to drop the waiter when this member leaves the squad.
+		TWeakObjectPtr<const UHTNComponent> Member;
+		TFunction<void(TSharedPtr<FEnvQueryResult>)> OnResult;
+	};
+
+	struct FCachedResult
+	{
+		TSharedPtr<FEnvQueryResult> Result;
+		FVector QuerierLocation = FVector::ZeroVector;
+		float Timestamp = 0.0f;
+		uint8 bIsRefreshing : 1;
+
+		// Where the currently running query was started from.
+		FVector RefreshQuerierLocation = FVector::ZeroVector;
+		// Called with the result of the currently running query. Used by squad members waiting for a query another member started.
+		TArray<FWaiter> Waiters;
+
+		FCachedResult() : bIsRefreshing(false) {}
+	};
+
+	// Query results of one agent or squad, keyed by the relevant worldstate values (see MakeCacheKey).
+	struct FResultCache : public FHTNNodePlanningCache
+	{
+		TMap<FString, FCachedResult> Results;
+
+		// Fails the waiters of queries that are still running, since their results will have nowhere to go.
+		virtual ~FResultCache() override;
+		// Fails the waiters of the member, so it doesn't keep waiting for a query of the squad it left.
+		virtual void OnSquadMemberRemoved(const UHTNComponent& Member) override;
+	};
+
+	// The cache a query stores its result in. Resolved when the query starts, 
+	// so the result still gets stored and the waiters notified if the querier is destroyed or leaves its squad before the query finishes.
+	struct FResultCacheRef
+	{
+		TWeakObjectPtr<UHTNSquad> Squad;
+		TWeakObjectPtr<UHTNComponent> Component;
+		TWeakObjectPtr<UWorld> World;
+	};
+
+	// Returns the cache of the squad of the agent if results are shared with it, otherwise the cache of the agent.
+	FResultCache& GetResultCache(UHTNComponent& OwnerComp) const;
+	FResultCacheRef MakeResultCacheRef(UHTNComponent& OwnerComp) const;
+	// Returns null if the cache was cleared or its squad destroyed.
+	FResultCache* FindResultCache(const FResultCacheRef& CacheRef) const;
+
+	// Finishes the running query of the cache entry: stores the result if there is one, and notifies the waiters either way.
+	void StoreResultInCache(const FResultCacheRef& CacheRef, const FString& CacheKey, const FVector& QuerierLocation, TSharedPtr<FEnvQueryResult> Result) const;
+
+	// Calls the waiters with a null result on the next tick. 
+	// Deferred because it happens while a squad or component is changing, and the waiters may continue planning right away.
+	static void FailWaitersLater(TArray<FWaiter>&& Waiters);
 };
\ No newline at end of file
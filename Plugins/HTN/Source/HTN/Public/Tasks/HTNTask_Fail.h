@@ -15,5 +15,7 @@ class HTN_API UHTNTask_Fail : public UHTNTask
 public:
 	UHTNTask_Fail(const FObjectInitializer& ObjectInitializer);
 	virtual void CreatePlanSteps(UHTNComponent& OwnerComp, UAITask_MakeHTNPlan& PlanningTask, const TSharedRef<const FBlackboardWorldState>& WorldState) const override;
+	virtual bool CanEverProducePlanSteps() const override { return false; }
 	virtual FString GetStaticDescription() const override;
+	virtual bool GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const override { return true; }
 };
@@ -83,6 +83,25 @@ public:
 	// Ticking this avoids that issue.
 	UPROPERTY(EditAnywhere, Category = Planning, Meta = (EditCondition = "bTestPathDuringPlanning"))
 	uint32 bForcePlanTimeStringPulling : 1;
+
+	// Only relevant if Test Path During Planning is set.
+	// If set, results of plan-time pathfinding are reused for the rest of the planning run 
+	// by all MoveTo tasks that test a path between the same locations with the same navigation filter.
+	UPROPERTY(EditAnywhere, Category = Planning, Meta = (EditCondition = "bTestPathDuringPlanning"))
+	uint32 bCachePlanTimePaths : 1;
+
+	// Only relevant if Test Path During Planning is set.
+	// If set, instead of finding a full path for every candidate goal, a single search is done outward from the start location
+	// which estimates the path cost to all navmesh polygons within Batched Path Search Distance. 
+	// Candidates that start at the same location (e.g. all the results of an EQS query) are then answered by a lookup.
+	// The estimate follows polygon centers, so it is slightly less precise than a string-pulled path.
+	// Goals outside the search distance fall back to regular pathfinding. Only supported on Recast navmeshes.
+	UPROPERTY(EditAnywhere, Category = Planning, Meta = (EditCondition = "bTestPathDuringPlanning"))
+	uint32 bUseBatchedPathCostEstimate : 1;
+
+	// The maximum path distance covered by the search done when Use Batched Path Cost Estimate is set.
+	UPROPERTY(EditAnywhere, Category = Planning, Meta = (ClampMin = "0", EditCondition = "bTestPathDuringPlanning && bUseBatchedPathCostEstimate"))
+	float BatchedPathSearchDistance;
 	
 	// Cost multiplier for the planning cost of the task.
 	UPROPERTY(EditAnywhere, Category = Planning, Meta = (ClampMin = "0"))
@@ -91,6 +110,8 @@ public:
 	UHTNTask_MoveTo(const FObjectInitializer& ObjectInitializer);
 
 	virtual void CreatePlanSteps(UHTNComponent& OwnerComp, UAITask_MakeHTNPlan& PlanningTask, const TSharedRef<const FBlackboardWorldState>& WorldState) const override;
+	virtual bool GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const override;
+	virtual void GetImplicitlyReadBlackboardKeys(TArray<FName>& OutKeyNames) const override;
 
 	virtual uint16 GetInstanceMemorySize() const override;
 	virtual EHTNNodeResult ExecuteTask(UHTNComponent& OwnerComp, uint8* NodeMemory, const FHTNPlanStepID& PlanStepID) override;
@@ -109,7 +130,7 @@ protected:
 	virtual UAITask_HTNMoveTo* PrepareMoveTask(UHTNComponent& OwnerComp, UAITask_HTNMoveTo* ExistingTask, FAIMoveRequest& MoveRequest, const FHTNPlanStepID& PlanStepID);
 
 private:
-	bool PlanTimeTestPath(UHTNComponent& OwnerComp, const FVector& RawStartLocation, const FVector& RawGoalLocation, FVector& OutEndLocation, float& OutPathCostEstimate) const;
+	bool PlanTimeTestPath(UHTNComponent& OwnerComp, UAITask_MakeHTNPlan& PlanningTask, const FVector& RawStartLocation, const FVector& RawGoalLocation, FVector& OutEndLocation, float& OutPathCostEstimate) const;
 	int32 GetTaskCostFromPathLength(float PathLength) const;
 	
 	bool MakeMoveRequest(UHTNComponent& OwnerComp, FHTNMoveToTaskMemory& Memory, FAIMoveRequest& OutMoveRequest) const;
@@ -18,6 +18,7 @@ public:
 	UHTNTask_SetValue(const FObjectInitializer& ObjectInitializer);
 	virtual void CreatePlanSteps(UHTNComponent& OwnerComp, UAITask_MakeHTNPlan& PlanningTask, const TSharedRef<const FBlackboardWorldState>& WorldState) const override;
 	virtual FString GetStaticDescription() const override;
+	virtual bool GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const override;
 
 protected:
 	UPROPERTY(EditAnywhere, Category = Node)
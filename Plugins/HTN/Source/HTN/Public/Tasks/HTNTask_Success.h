@@ -15,7 +15,9 @@ class HTN_API UHTNTask_Success : public UHTNTask
 public:
 	UHTNTask_Success(const FObjectInitializer& ObjectInitializer);
 	virtual void CreatePlanSteps(UHTNComponent& OwnerComp, UAITask_MakeHTNPlan& PlanningTask, const TSharedRef<const FBlackboardWorldState>& WorldState) const override;
+	virtual int32 GetMinPlanningCost() const override;
 	virtual FString GetStaticDescription() const override;
+	virtual bool GetWrittenBlackboardKeys(TArray<FName>& OutKeyNames) const override { return true; }
 	
 private:
 
@@ -0,0 +1,111 @@
+// Copyright 2020-2021 Maksym Maisak. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HTNTypes.h"
+
+#if HTN_PROFILER
+
+// The phases of planning and execution timed by the FHTNProfiler.
+enum class EHTNProfilerPhase : uint8
+{
+	PlanExpansion,
+	EnterDecorators,
+	ExitDecorators,
+	ExecuteTask,
+	TickTask,
+	DecoratorTest,
+	ServiceTick,
+	Num
+};
+
+HTN_API const TCHAR* LexToString(EHTNProfilerPhase Phase);
+
+// An opt-in profiler that records time spent per agent, per HTN asset, per node and per phase of planning and execution.
+// Controlled with the ai.htn.profiler.Start/Stop/Export console commands, so it can be used on a dedicated server.
+// Exports Chrome trace event JSON (one thread per agent), which can be opened in speedscope or chrome://tracing.
+// Only records on the game thread.
+class HTN_API FHTNProfiler
+{
+public:
+	static FHTNProfiler& Get();
+	FORCEINLINE static bool IsRecording() { return bIsRecording; }
+
+	// Clears previously recorded events and starts recording.
+	// If AgentNameFilter is not empty, only agents whose owner's name contains it are recorded.
+	void Start(const FString& AgentNameFilter = FString());
+	void Stop();
+	void Reset();
+
+	// Writes the recorded events as Chrome trace event JSON. Returns false if the file couldn't be written.
+	bool ExportChromeTrace(const FString& FilePath) const;
+	// Logs the nodes and assets with the highest self time.
+	void LogSummary(int32 MaxEntries = 20) const;
+
+	int32 BeginEvent(const class UHTNComponent& OwnerComp, const class UHTNNode* Node, EHTNProfilerPhase Phase);
+	void EndEvent(int32 EventIndex);
+
+private:
+	struct FEvent
+	{
+		uint64 StartCycles;
+		uint64 EndCycles;
+		int32 AgentIndex;
+		int32 NodeIndex;
+		EHTNProfilerPhase Phase;
+	};
+
+	struct FAgentInfo
+	{
+		FString Name;
+		bool bIsRecorded;
+	};
+
+	struct FNodeInfo
+	{
+		FString NodeName;
+		FString AssetName;
+	};
+
+	int32 FindOrAddAgent(const class UHTNComponent& OwnerComp);
+	int32 FindOrAddNode(const class UHTNNode* Node);
+	// Outputs the duration of each event minus the durations of the events nested in it.
+	void CalculateSelfCycles(TArray<uint64>& OutSelfCycles) const;
+
+	static bool bIsRecording;
+
+	FString AgentNameFilter;
+	TArray<FEvent> Events;
+	TArray<FAgentInfo> Agents;
+	TArray<FNodeInfo> Nodes;
+	TMap<TWeakObjectPtr<const class UHTNComponent>, int32> AgentIndices;
+	TMap<TWeakObjectPtr<const class UHTNNode>, int32> NodeIndices;
+};
+
+// Records a profiler event for the duration of the scope if the profiler is recording.
+struct FHTNProfilerScope
+{
+	FORCEINLINE FHTNProfilerScope(const class UHTNComponent& OwnerComp, const class UHTNNode* Node, EHTNProfilerPhase Phase) :
+		EventIndex(FHTNProfiler::IsRecording() ? FHTNProfiler::Get().BeginEvent(OwnerComp, Node, Phase) : INDEX_NONE)
+	{}
+
+	FORCEINLINE ~FHTNProfilerScope()
+	{
+		if (EventIndex != INDEX_NONE)
+		{
+			FHTNProfiler::Get().EndEvent(EventIndex);
+		}
+	}
+
+private:
+	int32 EventIndex;
+};
+
+#define HTN_PROFILER_SCOPE(OwnerComp, Node, Phase) const FHTNProfilerScope ANONYMOUS_VARIABLE(HTNProfilerScope)(OwnerComp, Node, Phase)
+
+#else
+
+#define HTN_PROFILER_SCOPE(OwnerComp, Node, Phase)
+
+#endif
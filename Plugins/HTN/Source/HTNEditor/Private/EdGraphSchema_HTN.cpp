@@ -87,6 +87,11 @@ void UEdGraphSchema_HTN::GetGraphContextActions(FGraphContextMenuBuilder& Contex
 	for (FGraphNodeClassData& NodeClassData : NodeClasses)
 	{
 		const UClass& Class = *NodeClassData.GetClass();
+		if (Class.HasAnyClassFlags(CLASS_HideDropDown))
+		{
+			continue;
+		}
+		
 		if (Class.IsChildOf(UHTNTask::StaticClass()))
 		{
 			MakeCreateNodeAction(TasksBuilder, NodeClassData, UHTNGraphNode::StaticClass());
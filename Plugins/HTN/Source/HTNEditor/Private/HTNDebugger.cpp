@@ -136,14 +136,21 @@ void FHTNDebugger::Tick(float DeltaTime)
 	{
 		// Catch up and trigger breakpoints
 		const FHTNDebugSteps& DebugSteps = DebuggedHTNComponent->DebuggerSteps;
+		
+		// Skip steps that were overwritten before we got to them.
+		if (DebugSteps.Num() && ActiveDebugStepIndex + 1 < DebugSteps.GetFirstIndex())
+		{
+			ActiveDebugStepIndex = DebugSteps.GetFirstIndex() - 1;
+		}
+		
 		while (const FHTNDebugExecutionStep* const NextDebugStep = DebugSteps.GetByIndex(ActiveDebugStepIndex + 1))
 		{
 			const FHTNDebugExecutionStep* const ActiveDebugStep = DebugSteps.GetByIndex(ActiveDebugStepIndex);
 			const bool bPlanChanged = !ActiveDebugStep || ActiveDebugStep->HTNPlan != NextDebugStep->HTNPlan;
 			
-			for (const FHTNPlanStepID& NewStepID : NextDebugStep->ActivePlanStepIDs)
+			for (const FHTNPlanStepID& NewStepID : DebugSteps.GetActivePlanStepIDs(*NextDebugStep))
 			{
-				const bool bStepJustBeganExecuting = bPlanChanged || !ActiveDebugStep->ActivePlanStepIDs.Contains(NewStepID);
+				const bool bStepJustBeganExecuting = bPlanChanged || !DebugSteps.GetActivePlanStepIDs(*ActiveDebugStep).Contains(NewStepID);
 				if (bStepJustBeganExecuting)
 				{
 					UHTNGraphNode* const GraphNode = GetGraphNode(*NextDebugStep->HTNPlan, NewStepID);
@@ -585,6 +592,9 @@ void FHTNDebugger::SetDebuggedComponent(TWeakObjectPtr<UHTNComponent> NewDebugge
 
 	ClearDebuggerState();
 	DebuggedHTNComponent = NewDebuggedComponent;
+#if USE_HTN_DEBUGGER
+	UHTNComponent::SetDebuggedComponent(DebuggedHTNComponent.Get());
+#endif
 	if (DebuggedHTNComponent.IsValid())
 	{
 		ActiveDebugStepIndex = DebuggedHTNComponent->DebuggerSteps.GetLastIndex();
@@ -622,6 +632,7 @@ void FHTNDebugger::UpdateDebugFlags()
 	}
 	
 	const FHTNPlan& Plan = *DebugStep->HTNPlan;
+	const TArrayView<const FHTNPlanStepID> ActivePlanStepIDs = DebuggedHTNComponent->DebuggerSteps.GetActivePlanStepIDs(*DebugStep);
 	
 	// Mark nodes that are part of the current plan
 	{
@@ -640,9 +651,9 @@ void FHTNDebugger::UpdateDebugFlags()
 			const FHTNPlanStepID StepID = Current.StepID;
 			const int32 Depth = Current.Depth;
 			const bool bIsInFutureOfPlan = Current.bIsInFutureOfPlan || 
-				DebugStep->ActivePlanStepIDs.Num() == 0 || 
-				DebugStep->ActivePlanStepIDs.Contains(StepID);
-			const bool bIsStepExecuting = bIsInFutureOfPlan && DebugStep->ActivePlanStepIDs.Contains(StepID);
+				ActivePlanStepIDs.Num() == 0 || 
+				ActivePlanStepIDs.Contains(StepID);
+			const bool bIsStepExecuting = bIsInFutureOfPlan && ActivePlanStepIDs.Contains(StepID);
 			const auto PushToStack = [&](int32 LevelIndex, int32 StepIndex = 0)
 			{
 				Stack.Push({ {LevelIndex, StepIndex}, Depth + 1, bIsInFutureOfPlan});
@@ -688,7 +699,7 @@ void FHTNDebugger::UpdateDebugFlags()
 	}
 
 	// Mark currently executing nodes
-	for (const FHTNPlanStepID& StepID : DebugStep->ActivePlanStepIDs)
+	for (const FHTNPlanStepID& StepID : ActivePlanStepIDs)
 	{
 		check(Plan.HasStep(StepID));
 
@@ -217,6 +217,7 @@ void UHTNGraph::UpdateAsset(int32 UpdateFlags)
 	}
 
 	OnBlackboardChanged();
+	UHTN::InvalidateStaticAnalyses();
 }
 
 void UHTNGraph::OnSubNodeDropped()
@@ -16,13 +16,15 @@ public class GAS_Core : ModuleRules
 			"HeadMountedDisplay",
 			"GameplayAbilities",
 			"GameplayTags",
-			"GameplayTasks", });
+			"GameplayTasks",
+			"NetCore", });
 
 		PrivateDependencyModuleNames.AddRange(new string[] {
 			"Slate",
 			"SlateCore",
 			"InputCore",
 			"MoviePlayer",
+			"AssetRegistry",
 
 			"AIModule" });
 
@@ -179,8 +179,11 @@ void URPGAttributeSet::PostGameplayEffectExecute(const FGameplayEffectModCallbac
 				// This is proper damage
 				TargetCharacter->HandleDamage(LocalDamageDone, HitResult, SourceTags, SourceCharacter, SourceActor);
 
-				// Call for all health changes
-				TargetCharacter->HandleHealthChanged(-LocalDamageDone, SourceTags);
+				// Call for all health changes, aggregated damage reports its health change together with the damage
+				if (!TargetCharacter->bAggregateDamage)
+				{
+					TargetCharacter->HandleHealthChanged(-LocalDamageDone, SourceTags);
+				}
 			}
 		}
 	}
@@ -3,6 +3,9 @@
 #include "Abilities/RPGDamageExecution.h"
 #include "Abilities/RPGAttributeSet.h"
 #include "AbilitySystemComponent.h"
+#include "AbilitySystemGlobals.h"
+#include "Abilities/GameplayAbilityTargetTypes.h"
+#include "GameplayCueManager.h"
 
 struct RPGDamageStatics
 {
@@ -31,6 +34,8 @@ static const RPGDamageStatics& DamageStatics()
 	return DmgStatics;
 }
 
+const FName URPGDamageExecution::BaseDamageDataName = TEXT("BaseDamage");
+
 URPGDamageExecution::URPGDamageExecution()
 {
 	RelevantAttributesToCapture.Add(DamageStatics().DefensePowerDef);
@@ -73,10 +78,157 @@ void URPGDamageExecution::Execute_Implementation(const FGameplayEffectCustomExec
 
 	float Damage = 0.f;
 	ExecutionParams.AttemptCalculateCapturedAttributeMagnitude(DamageStatics().DamageDef, EvaluationParameters, Damage);
+	Damage += Spec.GetSetByCallerMagnitude(BaseDamageDataName, false, 0.f);
 
-	float DamageDone = Damage * AttackPower / DefensePower;
+	float DamageDone = CalculateDamageDone(Damage, AttackPower, DefensePower);
 	if (DamageDone > 0.f)
 	{
 		OutExecutionOutput.AddOutputModifier(FGameplayModifierEvaluatedData(DamageStatics().DamageProperty, EGameplayModOp::Additive, DamageDone));
 	}
-}
\ No newline at end of file
+}
+
+bool URPGDamageExecution::CanBatchDamage(const UGameplayEffect& Effect, float Level)
+{
+	// Anything else the effect does would be skipped by the batched path
+	if (Effect.DurationPolicy != EGameplayEffectDurationType::Instant || Effect.Modifiers.Num() > 0 || Effect.Executions.Num() != 1 || Effect.ConditionalGameplayEffects.Num() > 0 ||
+		!Effect.ApplicationTagRequirements.IsEmpty() || Effect.ApplicationRequirements.Num() > 0 || Effect.ChanceToApplyToTarget.GetValueAtLevel(Level) < 1.0f)
+	{
+		return false;
+	}
+
+	// Subclasses may calculate damage differently
+	const FGameplayEffectExecutionDefinition& ExecutionDefinition = Effect.Executions[0];
+	if (ExecutionDefinition.CalculationClass != URPGDamageExecution::StaticClass() || ExecutionDefinition.ConditionalGameplayEffects.Num() > 0)
+	{
+		return false;
+	}
+
+	// Scoped modifiers are only applied to the source attributes captured once for all targets, so they can't depend on the target
+	for (const FGameplayEffectExecutionScopedModifierInfo& ScopedModifier : ExecutionDefinition.CalculationModifiers)
+	{
+		if (ScopedModifier.CapturedAttribute.AttributeSource == EGameplayEffectAttributeCaptureSource::Target || !ScopedModifier.SourceTags.IsEmpty() || !ScopedModifier.TargetTags.IsEmpty())
+		{
+			return false;
+		}
+
+		TArray<FGameplayEffectAttributeCaptureDefinition> MagnitudeCaptures;
+		ScopedModifier.ModifierMagnitude.GetAttributeCaptureDefinitions(MagnitudeCaptures);
+		for (const FGameplayEffectAttributeCaptureDefinition& MagnitudeCapture : MagnitudeCaptures)
+		{
+			if (MagnitudeCapture.AttributeSource == EGameplayEffectAttributeCaptureSource::Target)
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+bool URPGDamageExecution::ApplyBatchedDamage(const FGameplayEffectSpec& Spec, const FGameplayAbilityTargetDataHandle& TargetData, TArray<FActiveGameplayEffectHandle>& OutEffects)
+{
+	UAbilitySystemComponent* SourceAbilitySystemComponent = Spec.GetContext().GetInstigatorAbilitySystemComponent();
+	if (!Spec.Def || !SourceAbilitySystemComponent || !SourceAbilitySystemComponent->IsOwnerActorAuthoritative() || !CanBatchDamage(*Spec.Def, Spec.GetLevel()))
+	{
+		return false;
+	}
+
+	// Gather the targets like applying the spec to the target data would, each target data adds its hit result to the context of its actors
+	TArray<UAbilitySystemComponent*> TargetAbilitySystemComponents;
+	TArray<FGameplayEffectContextHandle> TargetContexts;
+	for (const TSharedPtr<FGameplayAbilityTargetData>& Data : TargetData.Data)
+	{
+		if (!Data.IsValid())
+		{
+			continue;
+		}
+
+		FGameplayEffectContextHandle Context = Spec.GetContext().Duplicate();
+		Data->AddTargetDataToContext(Context, false);
+
+		for (const TWeakObjectPtr<AActor>& TargetActor : Data->GetActors())
+		{
+			UAbilitySystemComponent* TargetAbilitySystemComponent = UAbilitySystemGlobals::GetAbilitySystemComponentFromActor(TargetActor.Get());
+			if (TargetAbilitySystemComponent)
+			{
+				TargetAbilitySystemComponents.Add(TargetAbilitySystemComponent);
+				TargetContexts.Add(Context);
+			}
+		}
+	}
+
+	// The source attributes and the scoped modifiers of the execution are captured once
+	FGameplayEffectSpec SourceSpec(Spec);
+	const FGameplayEffectExecutionDefinition& ExecutionDefinition = Spec.Def->Executions[0];
+	const FGameplayEffectCustomExecutionParameters ExecutionParams(SourceSpec, ExecutionDefinition.CalculationModifiers, nullptr, ExecutionDefinition.PassedInTags, FPredictionKey());
+	const float BaseDamage = Spec.GetSetByCallerMagnitude(BaseDamageDataName, false, 0.f);
+
+	// One spec is reused for every target, applying an instant effect copies what it needs
+	FGameplayEffectSpec DamageSpec(GetDefault<URPGBatchedDamageEffect>(), Spec.GetContext(), Spec.GetLevel());
+	DamageSpec.CapturedSourceTags.GetSpecTags().AppendTags(Spec.CapturedSourceTags.GetSpecTags());
+
+	// The cues of the original effect still play on every target that is damaged
+	UGameplayCueManager* CueManager = Spec.Def->GameplayCues.Num() > 0 ? UAbilitySystemGlobals::Get().GetGameplayCueManager() : nullptr;
+
+	for (int32 TargetIndex = 0; TargetIndex < TargetAbilitySystemComponents.Num(); TargetIndex++)
+	{
+		UAbilitySystemComponent* TargetAbilitySystemComponent = TargetAbilitySystemComponents[TargetIndex];
+
+		// The target tags are captured when the spec is applied, modifiers of the captured attributes may depend on them
+		FTagContainerAggregator TargetTags(Spec.CapturedTargetTags);
+		TargetTags.GetActorTags().Reset();
+		TargetAbilitySystemComponent->GetOwnedGameplayTags(TargetTags.GetActorTags());
+
+		FAggregatorEvaluateParameters EvaluationParameters;
+		EvaluationParameters.SourceTags = Spec.CapturedSourceTags.GetAggregatedTags();
+		EvaluationParameters.TargetTags = TargetTags.GetAggregatedTags();
+
+		// The current value, like the execution which doesn't snapshot DefensePower
+		FGameplayEffectAttributeCaptureSpec DefensePowerCapture(DamageStatics().DefensePowerDef);
+		TargetAbilitySystemComponent->CaptureAttributeForGameplayEffect(DefensePowerCapture);
+
+		float DefensePower = 0.f;
+		DefensePowerCapture.AttemptCalculateAttributeMagnitude(EvaluationParameters, DefensePower);
+
+		float AttackPower = 0.f;
+		ExecutionParams.AttemptCalculateCapturedAttributeMagnitude(DamageStatics().AttackPowerDef, EvaluationParameters, AttackPower);
+
+		float Damage = 0.f;
+		ExecutionParams.AttemptCalculateCapturedAttributeMagnitude(DamageStatics().DamageDef, EvaluationParameters, Damage);
+
+		const float DamageDone = CalculateDamageDone(Damage + BaseDamage, AttackPower, DefensePower);
+		if (DamageDone <= 0.f)
+		{
+			continue;
+		}
+
+		DamageSpec.SetContext(TargetContexts[TargetIndex], true);
+		DamageSpec.SetSetByCallerMagnitude(URPGBatchedDamageEffect::DamageDataName, DamageDone);
+		const FActiveGameplayEffectHandle EffectHandle = SourceAbilitySystemComponent->ApplyGameplayEffectSpecToTarget(DamageSpec, TargetAbilitySystemComponent);
+		OutEffects.Add(EffectHandle);
+
+		if (CueManager && EffectHandle.WasSuccessfullyApplied())
+		{
+			SourceSpec.SetContext(TargetContexts[TargetIndex], true);
+			CueManager->InvokeGameplayCueExecuted_FromSpec(TargetAbilitySystemComponent, SourceSpec, FPredictionKey());
+		}
+	}
+
+	return true;
+}
+
+const FName URPGBatchedDamageEffect::DamageDataName = TEXT("Damage");
+
+URPGBatchedDamageEffect::URPGBatchedDamageEffect()
+{
+	DurationPolicy = EGameplayEffectDurationType::Instant;
+
+	FSetByCallerFloat DamageMagnitude;
+	DamageMagnitude.DataName = DamageDataName;
+
+	FGameplayModifierInfo DamageModifier;
+	DamageModifier.Attribute = URPGAttributeSet::GetDamageAttribute();
+	DamageModifier.ModifierOp = EGameplayModOp::Additive;
+	DamageModifier.ModifierMagnitude = FGameplayEffectModifierMagnitude(DamageMagnitude);
+	Modifiers.Add(DamageModifier);
+}
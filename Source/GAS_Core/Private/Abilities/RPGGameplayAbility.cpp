@@ -2,9 +2,19 @@
 
 #include "Abilities/RPGGameplayAbility.h"
 #include "Abilities/RPGAbilitySystemComponent.h"
+#include "Abilities/RPGDamageExecution.h"
 #include "Abilities/RPGTargetType.h"
+#include "RPGAssetManager.h"
 #include "RPGCharacterBase.h"
 
+namespace
+{
+	TAutoConsoleVariable<int32> CVarBatchedDamageMinTargets(
+		TEXT("RPG.BatchedDamageMinTargets"),
+		4,
+		TEXT("Damage effects applied to at least this many targets at once compute their damage in one batch. 0 disables batching."));
+}
+
 URPGGameplayAbility::URPGGameplayAbility() {}
 
 FRPGGameplayEffectContainerSpec URPGGameplayAbility::MakeEffectContainerSpecFromContainer(const FRPGGameplayEffectContainer& Container, const FGameplayEventData& EventData, int32 OverrideGameplayLevel)
@@ -34,10 +44,18 @@ FRPGGameplayEffectContainerSpec URPGGameplayAbility::MakeEffectContainerSpecFrom
 			OverrideGameplayLevel = OverrideGameplayLevel = this->GetAbilityLevel(); //OwningASC->GetDefaultAbilityLevel();
 		}
 
+		// Look the base damage up once, it's the same for every effect
+		const float BaseDamage = Container.BaseDamageRow.IsNone() ? 0.f : URPGAssetManager::Get().GetProgressionValue(Container.BaseDamageRow, OverrideGameplayLevel);
+
 		// Build GameplayEffectSpecs for each applied effect
 		for (const TSubclassOf<UGameplayEffect>& EffectClass : Container.TargetGameplayEffectClasses)
 		{
-			ReturnSpec.TargetGameplayEffectSpecs.Add(MakeOutgoingGameplayEffectSpec(EffectClass, OverrideGameplayLevel));
+			FGameplayEffectSpecHandle SpecHandle = MakeOutgoingGameplayEffectSpec(EffectClass, OverrideGameplayLevel);
+			if (SpecHandle.IsValid() && !Container.BaseDamageRow.IsNone())
+			{
+				SpecHandle.Data->SetSetByCallerMagnitude(URPGDamageExecution::BaseDamageDataName, BaseDamage);
+			}
+			ReturnSpec.TargetGameplayEffectSpecs.Add(SpecHandle);
 		}
 	}
 	return ReturnSpec;
@@ -58,9 +76,25 @@ TArray<FActiveGameplayEffectHandle> URPGGameplayAbility::ApplyEffectContainerSpe
 {
 	TArray<FActiveGameplayEffectHandle> AllEffects;
 
+	// Area of effect damage doesn't need to run the damage execution for every target
+	const int32 MinBatchedTargets = CVarBatchedDamageMinTargets.GetValueOnGameThread();
+	int32 NumTargets = 0;
+	if (MinBatchedTargets > 0)
+	{
+		for (const TSharedPtr<FGameplayAbilityTargetData>& Data : ContainerSpec.TargetData.Data)
+		{
+			NumTargets += Data.IsValid() ? Data->GetActors().Num() : 0;
+		}
+	}
+
 	// Iterate list of effect specs and apply them to their target data
 	for (const FGameplayEffectSpecHandle& SpecHandle : ContainerSpec.TargetGameplayEffectSpecs)
 	{
+		if (MinBatchedTargets > 0 && NumTargets >= MinBatchedTargets && SpecHandle.IsValid() && URPGDamageExecution::ApplyBatchedDamage(*SpecHandle.Data, ContainerSpec.TargetData, AllEffects))
+		{
+			continue;
+		}
+
 		AllEffects.Append(K2_ApplyGameplayEffectSpecToTarget(SpecHandle, ContainerSpec.TargetData));
 	}
 	return AllEffects;
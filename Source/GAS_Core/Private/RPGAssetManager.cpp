@@ -3,12 +3,20 @@
 #include "RPGAssetManager.h"
 #include "Items/RPGItem.h"
 #include "AbilitySystemGlobals.h"
+#include "AssetRegistry/IAssetRegistry.h"
+#include "Engine/CurveTable.h"
+#include "Engine/StreamableManager.h"
+#include "HAL/IConsoleManager.h"
+#include "UObject/UObjectHash.h"
 
 const FPrimaryAssetType	URPGAssetManager::PotionItemType = TEXT("Potion");
 const FPrimaryAssetType	URPGAssetManager::SkillItemType = TEXT("Skill");
 const FPrimaryAssetType	URPGAssetManager::TokenItemType = TEXT("Token");
 const FPrimaryAssetType	URPGAssetManager::WeaponItemType = TEXT("Weapon");
 
+const FName	URPGAssetManager::UIBundle = TEXT("UI");
+const FName	URPGAssetManager::GameplayBundle = TEXT("Gameplay");
+
 URPGAssetManager& URPGAssetManager::Get()
 {
 	URPGAssetManager* This = Cast<URPGAssetManager>(GEngine->AssetManager);
@@ -29,6 +37,61 @@ void URPGAssetManager::StartInitialLoading()
 	Super::StartInitialLoading();
 
 	UAbilitySystemGlobals::Get().InitGlobalData();
+
+	BakeProgressionTables();
+}
+
+void URPGAssetManager::BakeProgressionTables()
+{
+	BakedProgressionTables.Reset();
+	ProgressionRowTables.Reset();
+
+	for (const TSoftObjectPtr<UCurveTable>& TablePtr : ProgressionTables)
+	{
+		// These are small, and needed before any character sets its level
+		const UCurveTable* CurveTable = TablePtr.LoadSynchronous();
+		if (!CurveTable)
+		{
+			UE_LOG(LogActionRPG, Warning, TEXT("Failed to load progression table %s!"), *TablePtr.ToString());
+			continue;
+		}
+
+		FRPGProgressionTable BakedTable;
+		if (BakedTable.Bake(*CurveTable))
+		{
+			const int32 TableIndex = BakedProgressionTables.Add(MoveTemp(BakedTable));
+			for (const FName& RowName : BakedProgressionTables[TableIndex].GetRowNames())
+			{
+				if (const int32* ExistingTableIndex = ProgressionRowTables.Find(RowName))
+				{
+					UE_LOG(LogActionRPG, Warning, TEXT("Progression row %s is in both %s and %s, using %s"), *RowName.ToString(),
+						*BakedProgressionTables[*ExistingTableIndex].GetTableName().ToString(), *CurveTable->GetName(), *BakedProgressionTables[*ExistingTableIndex].GetTableName().ToString());
+					continue;
+				}
+				ProgressionRowTables.Add(RowName, TableIndex);
+			}
+		}
+	}
+}
+
+const FRPGProgressionTable* URPGAssetManager::FindProgressionRow(FName RowName, int32& OutRowIndex) const
+{
+	const int32* TableIndex = ProgressionRowTables.Find(RowName);
+	if (TableIndex)
+	{
+		OutRowIndex = BakedProgressionTables[*TableIndex].FindRowIndex(RowName);
+		return &BakedProgressionTables[*TableIndex];
+	}
+
+	OutRowIndex = INDEX_NONE;
+	return nullptr;
+}
+
+float URPGAssetManager::GetProgressionValue(FName RowName, float Level, float DefaultValue) const
+{
+	int32 RowIndex;
+	const FRPGProgressionTable* Table = FindProgressionRow(RowName, RowIndex);
+	return Table ? Table->GetValue(RowIndex, Level) : DefaultValue;
 }
 
 
@@ -45,4 +108,337 @@ URPGItem* URPGAssetManager::ForceLoadItem(const FPrimaryAssetId& PrimaryAssetId,
 	}
 
 	return LoadedItem;
-}
\ No newline at end of file
+}
+
+namespace
+{
+	TAutoConsoleVariable<int32> CVarPreloadBudgetMB(
+		TEXT("RPG.PreloadBudgetMB"),
+		256,
+		TEXT("Memory budget of the assets preloaded by RPGAssetManager, in MB. 0 means no limit."));
+
+	FAutoConsoleCommand CmdPreloadReport(
+		TEXT("RPG.PreloadReport"),
+		TEXT("Logs load times and resident memory of the assets preloaded by RPGAssetManager, per primary asset type."),
+		FConsoleCommandDelegate::CreateLambda([]()
+		{
+			URPGAssetManager::Get().LogPreloadReport();
+		})
+	);
+}
+
+const FName	URPGAssetManager::EnemyClassPreloadType = TEXT("EnemyClass");
+
+FName URPGAssetManager::FPreloadEntry::GetStatsType() const
+{
+	return PrimaryAssetId.IsValid() ? PrimaryAssetId.PrimaryAssetType.GetName() : EnemyClassPreloadType;
+}
+
+void URPGAssetManager::PreloadAssets(const TArray<FPrimaryAssetId>& SlottedItemIds, const TArray<FPrimaryAssetId>& InventoryItemIds, const TArray<FSoftObjectPath>& EnemyClassPaths)
+{
+	TArray<FPreloadEntry> NewEntries;
+
+	const auto AddEntry = [&NewEntries](const FPrimaryAssetId& PrimaryAssetId, const FSoftObjectPath& ClassPath, EPreloadPriority Priority)
+	{
+		FPreloadEntry NewEntry;
+		NewEntry.PrimaryAssetId = PrimaryAssetId;
+		NewEntry.ClassPath = ClassPath;
+		NewEntry.Priority = Priority;
+
+		if (!NewEntries.ContainsByPredicate([&NewEntry](const FPreloadEntry& Entry) { return Entry.IsSameAsset(NewEntry); }))
+		{
+			NewEntries.Add(MoveTemp(NewEntry));
+		}
+	};
+
+	for (const FPrimaryAssetId& ItemId : SlottedItemIds)
+	{
+		if (ItemId.IsValid())
+		{
+			AddEntry(ItemId, FSoftObjectPath(), EPreloadPriority::SlottedItem);
+		}
+	}
+
+	for (const FPrimaryAssetId& ItemId : InventoryItemIds)
+	{
+		if (ItemId.IsValid())
+		{
+			AddEntry(ItemId, FSoftObjectPath(), EPreloadPriority::InventoryItem);
+		}
+	}
+
+	for (const FSoftObjectPath& ClassPath : EnemyClassPaths)
+	{
+		if (ClassPath.IsValid())
+		{
+			AddEntry(FPrimaryAssetId(), ClassPath, EPreloadPriority::EnemyClass);
+		}
+	}
+
+	if (CurrentPreloadHandle.IsValid())
+	{
+		// Let the current load finish first, its entry may be in the new set too
+		PendingPreloadEntries = MoveTemp(NewEntries);
+		return;
+	}
+
+	SetPreloadEntries(MoveTemp(NewEntries));
+	StartNextPreload();
+}
+
+bool URPGAssetManager::IsPreloading() const
+{
+	return CurrentPreloadHandle.IsValid();
+}
+
+void URPGAssetManager::SetPreloadEntries(TArray<FPreloadEntry>&& NewEntries)
+{
+	// Entries that are still wanted keep their loaded state, at their new priority
+	const auto TakeLoadedEntry = [&NewEntries](FPreloadEntry& LoadedEntry)
+	{
+		FPreloadEntry* NewEntry = NewEntries.FindByPredicate([&LoadedEntry](const FPreloadEntry& Entry) { return Entry.IsSameAsset(LoadedEntry); });
+		if (NewEntry)
+		{
+			const EPreloadPriority Priority = NewEntry->Priority;
+			*NewEntry = MoveTemp(LoadedEntry);
+			NewEntry->Priority = Priority;
+			return true;
+		}
+		return false;
+	};
+
+	for (FPreloadEntry& OldEntry : PreloadEntries)
+	{
+		if (OldEntry.bLoaded && !TakeLoadedEntry(OldEntry))
+		{
+			UnreferencedPreloadEntries.Add(MoveTemp(OldEntry));
+		}
+	}
+
+	UnreferencedPreloadEntries.RemoveAll([&TakeLoadedEntry](FPreloadEntry& Entry) { return TakeLoadedEntry(Entry); });
+
+	const auto ByPriority = [](const FPreloadEntry& A, const FPreloadEntry& B) { return A.Priority < B.Priority; };
+	NewEntries.StableSort(ByPriority);
+	UnreferencedPreloadEntries.StableSort(ByPriority);
+
+	PreloadEntries = MoveTemp(NewEntries);
+	PreloadIndex = 0;
+}
+
+void URPGAssetManager::StartNextPreload()
+{
+	for (; PreloadIndex < PreloadEntries.Num(); PreloadIndex++)
+	{
+		FPreloadEntry& Entry = PreloadEntries[PreloadIndex];
+		if (Entry.bLoaded)
+		{
+			continue;
+		}
+
+		if (!EnforcePreloadBudget())
+		{
+			UE_LOG(LogActionRPG, Warning, TEXT("PreloadAssets: Over the memory budget, skipping %d lower priority assets"), PreloadEntries.Num() - PreloadIndex);
+			PreloadIndex = PreloadEntries.Num();
+			return;
+		}
+
+		Entry.LoadStartTime = FPlatformTime::Seconds();
+		TSharedPtr<FStreamableHandle> LoadHandle = Entry.PrimaryAssetId.IsValid()
+			? LoadPrimaryAsset(Entry.PrimaryAssetId, GetPreloadBundles())
+			: GetStreamableManager().RequestAsyncLoad(Entry.ClassPath);
+
+		// One at a time, so higher priority assets are never waiting behind lower priority ones
+		if (LoadHandle.IsValid() && LoadHandle->IsLoadingInProgress())
+		{
+			CurrentPreloadHandle = LoadHandle;
+			LoadHandle->BindCompleteDelegate(FStreamableDelegate::CreateUObject(this, &URPGAssetManager::HandlePreloadLoaded));
+			return;
+		}
+
+		FinishPreload(Entry, LoadHandle);
+	}
+
+	EnforcePreloadBudget();
+}
+
+void URPGAssetManager::HandlePreloadLoaded()
+{
+	TSharedPtr<FStreamableHandle> LoadHandle = CurrentPreloadHandle;
+	CurrentPreloadHandle.Reset();
+
+	if (PreloadEntries.IsValidIndex(PreloadIndex))
+	{
+		FinishPreload(PreloadEntries[PreloadIndex], LoadHandle);
+		PreloadIndex++;
+	}
+
+	if (PendingPreloadEntries.IsSet())
+	{
+		SetPreloadEntries(MoveTemp(PendingPreloadEntries.GetValue()));
+		PendingPreloadEntries.Reset();
+	}
+
+	StartNextPreload();
+}
+
+void URPGAssetManager::FinishPreload(FPreloadEntry& Entry, const TSharedPtr<FStreamableHandle>& LoadHandle)
+{
+	TArray<UObject*> LoadedAssets;
+	if (LoadHandle.IsValid())
+	{
+		LoadHandle->GetLoadedAssets(LoadedAssets);
+	}
+	else if (UObject* LoadedAsset = Entry.PrimaryAssetId.IsValid() ? GetPrimaryAssetObject(Entry.PrimaryAssetId) : Entry.ClassPath.ResolveObject())
+	{
+		// Nothing needed loading
+		LoadedAssets.Add(LoadedAsset);
+	}
+
+	if (LoadedAssets.Num() == 0)
+	{
+		UE_LOG(LogActionRPG, Warning, TEXT("PreloadAssets: Failed to load %s"), Entry.PrimaryAssetId.IsValid() ? *Entry.PrimaryAssetId.ToString() : *Entry.ClassPath.ToString());
+	}
+
+	Entry.bLoaded = true;
+	Entry.Handle = LoadHandle;
+
+	// Only packages no other entry has counted yet are measured, so this doesn't walk shared dependencies again
+	const FName StatsType = Entry.GetStatsType();
+	Entry.Packages.Reset();
+	for (const UObject* LoadedAsset : LoadedAssets)
+	{
+		const FName PackageName = LoadedAsset ? LoadedAsset->GetOutermost()->GetFName() : NAME_None;
+		if (!PackageName.IsNone() && !Entry.Packages.Contains(PackageName) && AddPreloadedPackageReference(PackageName, StatsType))
+		{
+			Entry.Packages.Add(PackageName);
+		}
+	}
+
+	FRPGPreloadTypeStats& TypeStats = PreloadStats.FindOrAdd(StatsType);
+	TypeStats.NumLoaded++;
+	TypeStats.LoadSeconds += FPlatformTime::Seconds() - Entry.LoadStartTime;
+}
+
+bool URPGAssetManager::AddPreloadedPackageReference(FName PackageName, FName StatsType)
+{
+	if (FPreloadedPackage* PreloadedPackage = PreloadedPackages.Find(PackageName))
+	{
+		PreloadedPackage->RefCount++;
+		return true;
+	}
+
+	const FString PackageString = PackageName.ToString();
+	if (PackageString.StartsWith(TEXT("/Script/")) || PackageString.StartsWith(TEXT("/Engine/")))
+	{
+		return false;
+	}
+
+	UPackage* Package = FindObjectFast<UPackage>(nullptr, PackageName);
+	if (!Package)
+	{
+		return false;
+	}
+
+	// Every object in the package counts, e.g. class default objects, components and subobjects
+	FResourceSizeEx ResourceSize(EResourceSizeMode::EstimatedTotal);
+	ForEachObjectWithPackage(Package, [&ResourceSize](UObject* Object)
+	{
+		Object->GetResourceSizeEx(ResourceSize);
+		return true;
+	});
+
+	FPreloadedPackage& NewPackage = PreloadedPackages.Add(PackageName);
+	NewPackage.RefCount = 1;
+	NewPackage.ResidentBytes = (int64)ResourceSize.GetTotalMemoryBytes();
+	NewPackage.StatsType = StatsType;
+	PreloadResidentBytes += NewPackage.ResidentBytes;
+	PreloadStats.FindOrAdd(StatsType).ResidentBytes += NewPackage.ResidentBytes;
+
+	// Packages in a dependency cycle keep each other referenced, so they stay counted. That errs on the side of releasing too early.
+	// Without dependency data in the asset registry only the packages of the assets themselves are counted
+	TArray<FName> Dependencies;
+	GetAssetRegistry().GetDependencies(PackageName, Dependencies, UE::AssetRegistry::EDependencyCategory::Package, UE::AssetRegistry::EDependencyQuery::Hard);
+	Dependencies.RemoveAll([this, StatsType](FName Dependency) { return !AddPreloadedPackageReference(Dependency, StatsType); });
+
+	// Adding the dependencies can reallocate the map
+	PreloadedPackages.FindChecked(PackageName).Dependencies = MoveTemp(Dependencies);
+	return true;
+}
+
+void URPGAssetManager::ReleasePreloadedPackageReference(FName PackageName)
+{
+	FPreloadedPackage* PreloadedPackage = PreloadedPackages.Find(PackageName);
+	if (!PreloadedPackage || --PreloadedPackage->RefCount > 0)
+	{
+		return;
+	}
+
+	PreloadResidentBytes -= PreloadedPackage->ResidentBytes;
+	PreloadStats.FindOrAdd(PreloadedPackage->StatsType).ResidentBytes -= PreloadedPackage->ResidentBytes;
+
+	const TArray<FName> Dependencies = MoveTemp(PreloadedPackage->Dependencies);
+	PreloadedPackages.Remove(PackageName);
+	for (const FName Dependency : Dependencies)
+	{
+		ReleasePreloadedPackageReference(Dependency);
+	}
+}
+
+bool URPGAssetManager::EnforcePreloadBudget()
+{
+	const int64 BudgetBytes = (int64)CVarPreloadBudgetMB.GetValueOnGameThread() * 1024 * 1024;
+
+	while (BudgetBytes > 0 && PreloadResidentBytes >= BudgetBytes)
+	{
+		if (UnreferencedPreloadEntries.Num() == 0)
+		{
+			return false;
+		}
+
+		FPreloadEntry Entry = UnreferencedPreloadEntries.Pop();
+		if (Entry.PrimaryAssetId.IsValid())
+		{
+			// Drops the bundles, the item is only unloaded if nothing else references it
+			UnloadPrimaryAsset(Entry.PrimaryAssetId);
+		}
+		else if (Entry.Handle.IsValid())
+		{
+			Entry.Handle->ReleaseHandle();
+		}
+
+		// Packages still used by other entries stay counted
+		for (const FName PackageName : Entry.Packages)
+		{
+			ReleasePreloadedPackageReference(PackageName);
+		}
+	}
+
+	return true;
+}
+
+TArray<FName> URPGAssetManager::GetPreloadBundles() const
+{
+	TArray<FName> Bundles = { GameplayBundle };
+	if (!IsRunningDedicatedServer())
+	{
+		Bundles.Add(UIBundle);
+	}
+	return Bundles;
+}
+
+void URPGAssetManager::LogPreloadReport() const
+{
+	UE_LOG(LogActionRPG, Display, TEXT("Preloaded assets: %.2f MB resident, budget %d MB%s"),
+		PreloadResidentBytes / (1024.0 * 1024.0), CVarPreloadBudgetMB.GetValueOnGameThread(), IsPreloading() ? TEXT(", still loading") : TEXT(""));
+
+	for (const TPair<FName, FRPGPreloadTypeStats>& Pair : PreloadStats)
+	{
+		const FRPGPreloadTypeStats& TypeStats = Pair.Value;
+		UE_LOG(LogActionRPG, Display, TEXT("  %s: %d loaded in %.1f ms (%.1f ms average), %.2f MB resident"),
+			*Pair.Key.ToString(),
+			TypeStats.NumLoaded,
+			TypeStats.LoadSeconds * 1000.0,
+			TypeStats.NumLoaded > 0 ? TypeStats.LoadSeconds * 1000.0 / TypeStats.NumLoaded : 0.0,
+			TypeStats.ResidentBytes / (1024.0 * 1024.0));
+	}
+}
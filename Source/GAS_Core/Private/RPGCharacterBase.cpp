@@ -4,6 +4,7 @@
 #include "Items/RPGItem.h"
 #include "AbilitySystemGlobals.h"
 #include "Abilities/RPGGameplayAbility.h"
+#include "TimerManager.h"
 
 ARPGCharacterBase::ARPGCharacterBase()
 {
@@ -16,6 +17,9 @@ ARPGCharacterBase::ARPGCharacterBase()
 
 	CharacterLevel = 1;
 	bAbilitiesInitialized = false;
+	bAggregateDamage = false;
+	bRecordAggregatedDamageHits = false;
+	ReportingDamage = nullptr;
 }
 void ARPGCharacterBase::BetterJump(float FallMultiplier, float JumpMultiplier)
 {
@@ -46,6 +50,9 @@ void ARPGCharacterBase::AddStartupGameplayAbilities()
 			AbilitySystemComponent->GiveAbility(FGameplayAbilitySpec(StartupAbility, GetCharacterLevel(), INDEX_NONE, this));
 		}
 
+		// Base stats for this level come from the baked tables, passives can modify them
+		ApplyProgressionAttributes();
+
 		// Now apply passives
 		for (TSubclassOf<UGameplayEffect>& GameplayEffect : PassiveGameplayEffects)
 		{
@@ -65,6 +72,29 @@ void ARPGCharacterBase::AddStartupGameplayAbilities()
 	}
 }
 
+void ARPGCharacterBase::ApplyProgressionAttributes()
+{
+	if (ProgressionAttributes.Num() == 0)
+	{
+		return;
+	}
+
+	const URPGAssetManager& AssetManager = URPGAssetManager::Get();
+	for (const FRPGProgressionAttribute& ProgressionAttribute : ProgressionAttributes)
+	{
+		int32 RowIndex;
+		const FRPGProgressionTable* Table = AssetManager.FindProgressionRow(ProgressionAttribute.RowName, RowIndex);
+		if (Table && ProgressionAttribute.Attribute.IsValid())
+		{
+			AbilitySystemComponent->SetNumericAttributeBase(ProgressionAttribute.Attribute, Table->GetLevelValues(GetCharacterLevel())[RowIndex]);
+		}
+		else
+		{
+			UE_LOG(LogActionRPG, Warning, TEXT("%s: No progression row %s for attribute %s!"), *GetName(), *ProgressionAttribute.RowName.ToString(), *ProgressionAttribute.Attribute.GetName());
+		}
+	}
+}
+
 void ARPGCharacterBase::RemoveStartupGameplayAbilities()
 {
 	check(AbilitySystemComponent);
@@ -100,7 +130,15 @@ void ARPGCharacterBase::RemoveStartupGameplayAbilities()
 
 void ARPGCharacterBase::OnItemSlotChanged(FRPGItemSlot ItemSlot, URPGItem* Item)
 {
-	RefreshSlottedGameplayAbilities();
+	if (bAbilitiesInitialized)
+	{
+		// Swapping items changes several slots at once, so wait for all of them to update abilities together
+		if (PendingSlotUpdates.Num() == 0)
+		{
+			GetWorldTimerManager().SetTimerForNextTick(this, &ARPGCharacterBase::FlushPendingSlotUpdates);
+		}
+		PendingSlotUpdates.AddUnique(ItemSlot);
+	}
 }
 
 void ARPGCharacterBase::RefreshSlottedGameplayAbilities()
@@ -108,103 +146,169 @@ void ARPGCharacterBase::RefreshSlottedGameplayAbilities()
 	if (bAbilitiesInitialized)
 	{
 		// Refresh any invalid abilities and adds new ones
-		RemoveSlottedGameplayAbilities(false);
-		AddSlottedGameplayAbilities();
+		PendingSlotUpdates.Reset();
+		UpdateSlottedGameplayAbilities(GetAllAbilitySlots());
 	}
 }
 
-void ARPGCharacterBase::FillSlottedAbilitySpecs(TMap<FRPGItemSlot, FGameplayAbilitySpec>& SlottedAbilitySpecs)
+void ARPGCharacterBase::FlushPendingSlotUpdates()
 {
-	// First add default ones
-	for (const TPair<FRPGItemSlot, TSubclassOf<URPGGameplayAbility>>& DefaultPair : DefaultSlottedAbilities)
+	if (PendingSlotUpdates.Num() > 0)
 	{
-		if (DefaultPair.Value.Get())
+		TArray<FRPGItemSlot> ItemSlots = MoveTemp(PendingSlotUpdates);
+		PendingSlotUpdates.Reset();
+
+		if (bAbilitiesInitialized)
 		{
-			SlottedAbilitySpecs.Add(DefaultPair.Key, FGameplayAbilitySpec(DefaultPair.Value, GetCharacterLevel(), INDEX_NONE, this));
+			UpdateSlottedGameplayAbilities(ItemSlots);
 		}
 	}
+}
 
-	// Now potentially override with inventory
-	if (InventorySource)
+TArray<FRPGItemSlot> ARPGCharacterBase::GetAllAbilitySlots() const
+{
+	TArray<FRPGItemSlot> ItemSlots;
+	SlottedAbilities.GetKeys(ItemSlots);
+
+	for (const TPair<FRPGItemSlot, TSubclassOf<URPGGameplayAbility>>& DefaultPair : DefaultSlottedAbilities)
 	{
-		const TMap<FRPGItemSlot, URPGItem*>& SlottedItemMap = InventorySource->GetSlottedItemMap();
+		ItemSlots.AddUnique(DefaultPair.Key);
+	}
 
-		for (const TPair<FRPGItemSlot, URPGItem*>& ItemPair : SlottedItemMap)
+	if (InventorySource)
+	{
+		for (const TPair<FRPGItemSlot, URPGItem*>& ItemPair : InventorySource->GetSlottedItemMap())
 		{
-			URPGItem* SlottedItem = ItemPair.Value;
+			ItemSlots.AddUnique(ItemPair.Key);
+		}
+	}
 
-			// Use the character level as default
-			int32 AbilityLevel = GetCharacterLevel();
+	return ItemSlots;
+}
 
-			if (SlottedItem && SlottedItem->ItemType.GetName() == FName(TEXT("Weapon")))
-			{
-				// Override the ability level to use the data from the slotted item
-				AbilityLevel = SlottedItem->AbilityLevel;
-			}
+bool ARPGCharacterBase::GetSlottedAbilitySpec(const FRPGItemSlot& ItemSlot, FGameplayAbilitySpec& OutSpec) const
+{
+	// Inventory overrides anything from default
+	URPGItem* const* SlottedItem = InventorySource ? InventorySource->GetSlottedItemMap().Find(ItemSlot) : nullptr;
 
-			if (SlottedItem && SlottedItem->GrantedAbility)
-			{
-				// This will override anything from default
-				SlottedAbilitySpecs.Add(ItemPair.Key, FGameplayAbilitySpec(SlottedItem->GrantedAbility, AbilityLevel, INDEX_NONE, SlottedItem));
-			}
-		}
+	if (SlottedItem && *SlottedItem && (*SlottedItem)->GrantedAbility)
+	{
+		// Weapons use the ability level from the item, everything else uses the character level
+		const bool bIsWeapon = (*SlottedItem)->ItemType == URPGAssetManager::WeaponItemType;
+		const int32 AbilityLevel = bIsWeapon ? (*SlottedItem)->AbilityLevel : GetCharacterLevel();
+
+		OutSpec = FGameplayAbilitySpec((*SlottedItem)->GrantedAbility, AbilityLevel, INDEX_NONE, *SlottedItem);
+		return true;
+	}
+
+	const TSubclassOf<URPGGameplayAbility>* DefaultAbility = DefaultSlottedAbilities.Find(ItemSlot);
+
+	if (DefaultAbility && DefaultAbility->Get())
+	{
+		OutSpec = FGameplayAbilitySpec(*DefaultAbility, GetCharacterLevel(), INDEX_NONE, const_cast<ARPGCharacterBase*>(this));
+		return true;
 	}
+
+	return false;
 }
 
 void ARPGCharacterBase::AddSlottedGameplayAbilities()
 {
-	TMap<FRPGItemSlot, FGameplayAbilitySpec> SlottedAbilitySpecs;
-	FillSlottedAbilitySpecs(SlottedAbilitySpecs);
-	
-	// Now add abilities if needed
-	for (const TPair<FRPGItemSlot, FGameplayAbilitySpec>& SpecPair : SlottedAbilitySpecs)
+	UpdateSlottedGameplayAbilities(GetAllAbilitySlots());
+}
+
+void ARPGCharacterBase::UpdateSlottedGameplayAbilities(const TArray<FRPGItemSlot>& ItemSlots)
+{
+	check(AbilitySystemComponent);
+
+	const auto IsSameAbility = [](const FGameplayAbilitySpec& A, const FGameplayAbilitySpec& B)
+	{
+		return A.Ability == B.Ability && A.SourceObject == B.SourceObject;
+	};
+
+	// Work out what every slot needs first, so an ability that moved to another slot can be handed over instead of being cleared and given again
+	TArray<FGameplayAbilitySpecHandle> ReleasedHandles;
+	TArray<TPair<FRPGItemSlot, FGameplayAbilitySpec>> SpecsToGive;
+
+	for (const FRPGItemSlot& ItemSlot : ItemSlots)
+	{
+		FGameplayAbilitySpec DesiredSpec;
+		const bool bHasDesiredSpec = GetSlottedAbilitySpec(ItemSlot, DesiredSpec);
+
+		FGameplayAbilitySpecHandle* ExistingHandle = SlottedAbilities.Find(ItemSlot);
+		FGameplayAbilitySpec* ExistingSpec = ExistingHandle ? AbilitySystemComponent->FindAbilitySpecFromHandle(*ExistingHandle) : nullptr;
+
+		if (ExistingSpec && bHasDesiredSpec && IsSameAbility(*ExistingSpec, DesiredSpec))
+		{
+			continue;
+		}
+
+		if (ExistingHandle)
+		{
+			if (ExistingSpec)
+			{
+				ReleasedHandles.Add(*ExistingHandle);
+			}
+
+			// Make sure handle is cleared even if ability wasn't found
+			*ExistingHandle = FGameplayAbilitySpecHandle();
+		}
+
+		if (bHasDesiredSpec)
+		{
+			SpecsToGive.Emplace(ItemSlot, DesiredSpec);
+		}
+	}
+
+	for (const TPair<FRPGItemSlot, FGameplayAbilitySpec>& SpecPair : SpecsToGive)
 	{
 		FGameplayAbilitySpecHandle& SpecHandle = SlottedAbilities.FindOrAdd(SpecPair.Key);
 
-		if (!SpecHandle.IsValid())
+		const int32 ReleasedIndex = ReleasedHandles.IndexOfByPredicate([this, &SpecPair, &IsSameAbility](const FGameplayAbilitySpecHandle& ReleasedHandle)
+		{
+			const FGameplayAbilitySpec* ReleasedSpec = AbilitySystemComponent->FindAbilitySpecFromHandle(ReleasedHandle);
+			return ReleasedSpec && IsSameAbility(*ReleasedSpec, SpecPair.Value);
+		});
+
+		if (ReleasedIndex != INDEX_NONE)
+		{
+			SpecHandle = ReleasedHandles[ReleasedIndex];
+			ReleasedHandles.RemoveAtSwap(ReleasedIndex);
+		}
+		else
 		{
 			SpecHandle = AbilitySystemComponent->GiveAbility(SpecPair.Value);
 		}
 	}
+
+	// Need to remove registered abilities that no slot took over
+	for (const FGameplayAbilitySpecHandle& ReleasedHandle : ReleasedHandles)
+	{
+		AbilitySystemComponent->ClearAbility(ReleasedHandle);
+	}
 }
 
 void ARPGCharacterBase::RemoveSlottedGameplayAbilities(bool bRemoveAll)
 {
-	TMap<FRPGItemSlot, FGameplayAbilitySpec> SlottedAbilitySpecs;
-
 	if (!bRemoveAll)
 	{
-		// Fill in map so we can compare
-		FillSlottedAbilitySpecs(SlottedAbilitySpecs);
+		// Only remove invalid ones, which is what an update of every slot does
+		UpdateSlottedGameplayAbilities(GetAllAbilitySlots());
+		return;
 	}
 
+	PendingSlotUpdates.Reset();
+
 	for (TPair<FRPGItemSlot, FGameplayAbilitySpecHandle>& ExistingPair : SlottedAbilities)
 	{
-		FGameplayAbilitySpec* FoundSpec = AbilitySystemComponent->FindAbilitySpecFromHandle(ExistingPair.Value);
-		bool bShouldRemove = bRemoveAll || !FoundSpec;
-
-		if (!bShouldRemove)
+		if (AbilitySystemComponent->FindAbilitySpecFromHandle(ExistingPair.Value))
 		{
-			// Need to check desired ability specs, if we got here FoundSpec is valid
-			FGameplayAbilitySpec* DesiredSpec = SlottedAbilitySpecs.Find(ExistingPair.Key);
-
-			if (!DesiredSpec || DesiredSpec->Ability != FoundSpec->Ability || DesiredSpec->SourceObject != FoundSpec->SourceObject)
-			{
-				bShouldRemove = true;
-			}
+			// Need to remove registered ability
+			AbilitySystemComponent->ClearAbility(ExistingPair.Value);
 		}
-		
-		if (bShouldRemove)
-		{	
-			if (FoundSpec)
-			{
-				// Need to remove registered ability
-				AbilitySystemComponent->ClearAbility(ExistingPair.Value);
-			}
 
-			// Make sure handle is cleared even if ability wasn't found
-			ExistingPair.Value = FGameplayAbilitySpecHandle();
-		}
+		// Make sure handle is cleared even if ability wasn't found
+		ExistingPair.Value = FGameplayAbilitySpecHandle();
 	}
 }
 
@@ -311,6 +415,9 @@ bool ARPGCharacterBase::SetCharacterLevel(int32 NewLevel)
 
 bool ARPGCharacterBase::ActivateAbilitiesWithItemSlot(FRPGItemSlot ItemSlot, bool bAllowRemoteActivation)
 {
+	// The slot may have changed this frame
+	FlushPendingSlotUpdates();
+
 	FGameplayAbilitySpecHandle* FoundHandle = SlottedAbilities.Find(ItemSlot);
 
 	if (FoundHandle && AbilitySystemComponent)
@@ -323,6 +430,8 @@ bool ARPGCharacterBase::ActivateAbilitiesWithItemSlot(FRPGItemSlot ItemSlot, boo
 
 void ARPGCharacterBase::GetActiveAbilitiesWithItemSlot(FRPGItemSlot ItemSlot, TArray<URPGGameplayAbility*>& ActiveAbilities)
 {
+	FlushPendingSlotUpdates();
+
 	FGameplayAbilitySpecHandle* FoundHandle = SlottedAbilities.Find(ItemSlot);
 
 	if (FoundHandle && AbilitySystemComponent)
@@ -393,7 +502,81 @@ bool ARPGCharacterBase::GetCooldownRemainingForTag(FGameplayTagContainer Cooldow
 
 void ARPGCharacterBase::HandleDamage(float DamageAmount, const FHitResult& HitInfo, const struct FGameplayTagContainer& DamageTags, ARPGCharacterBase* InstigatorPawn, AActor* DamageCauser)
 {
-	OnDamaged(DamageAmount, HitInfo, DamageTags, InstigatorPawn, DamageCauser);	
+	if (!bAggregateDamage)
+	{
+		OnDamaged(DamageAmount, HitInfo, DamageTags, InstigatorPawn, DamageCauser);
+		return;
+	}
+
+	FAggregatedDamage* Damage = PendingDamage.FindByPredicate([&](const FAggregatedDamage& Pending)
+	{
+		return Pending.InstigatorCharacter == InstigatorPawn && Pending.DamageTags == DamageTags;
+	});
+
+	if (!Damage)
+	{
+		if (PendingDamage.Num() == 0)
+		{
+			GetWorldTimerManager().SetTimerForNextTick(this, &ARPGCharacterBase::FlushAggregatedDamage);
+		}
+
+		Damage = &PendingDamage.AddDefaulted_GetRef();
+		Damage->InstigatorCharacter = InstigatorPawn;
+		Damage->DamageTags = DamageTags;
+	}
+
+	// The latest hit stands in for the others
+	Damage->DamageAmount += DamageAmount;
+	Damage->HitInfo = HitInfo;
+	Damage->DamageCauser = DamageCauser;
+
+	if (bRecordAggregatedDamageHits)
+	{
+		FRecordedDamageHit& Hit = Damage->Hits.AddDefaulted_GetRef();
+		Hit.DamageAmount = DamageAmount;
+		Hit.HitInfo = HitInfo;
+		Hit.InstigatorCharacter = InstigatorPawn;
+		Hit.DamageCauser = DamageCauser;
+	}
+}
+
+void ARPGCharacterBase::FlushAggregatedDamage()
+{
+	if (PendingDamage.Num() == 0)
+	{
+		return;
+	}
+
+	// Damage taken while reporting is reported on the next tick
+	TArray<FAggregatedDamage> Damages = MoveTemp(PendingDamage);
+	PendingDamage.Reset();
+
+	for (const FAggregatedDamage& Damage : Damages)
+	{
+		ReportingDamage = &Damage;
+		OnDamaged(Damage.DamageAmount, Damage.HitInfo, Damage.DamageTags, Damage.InstigatorCharacter.Get(), Damage.DamageCauser.Get());
+		ReportingDamage = nullptr;
+
+		// The attribute set leaves the health change of aggregated damage to this
+		HandleHealthChanged(-Damage.DamageAmount, Damage.DamageTags);
+	}
+}
+
+void ARPGCharacterBase::GetAggregatedDamageHits(TArray<FRPGDamageHit>& Hits) const
+{
+	if (ReportingDamage)
+	{
+		Hits.Reserve(Hits.Num() + ReportingDamage->Hits.Num());
+		for (const FRecordedDamageHit& RecordedHit : ReportingDamage->Hits)
+		{
+			FRPGDamageHit& Hit = Hits.AddDefaulted_GetRef();
+			Hit.DamageAmount = RecordedHit.DamageAmount;
+			Hit.HitInfo = RecordedHit.HitInfo;
+			Hit.DamageTags = ReportingDamage->DamageTags;
+			Hit.InstigatorCharacter = RecordedHit.InstigatorCharacter.Get();
+			Hit.DamageCauser = RecordedHit.DamageCauser.Get();
+		}
+	}
 }
 
 void ARPGCharacterBase::HandleHealthChanged(float DeltaValue, const struct FGameplayTagContainer& EventTags)
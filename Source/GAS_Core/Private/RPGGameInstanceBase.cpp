@@ -5,10 +5,26 @@
 #include "RPGSaveGame.h"
 #include "Items/RPGItem.h"
 #include "Kismet/GameplayStatics.h"
+#include "Async/Async.h"
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+namespace
+{
+	const TCHAR* SnapshotExtension = TEXT(".rpgsave");
+	const TCHAR* ChangeLogExtension = TEXT(".rpglog");
+	const TCHAR* CorruptExtension = TEXT(".corrupt");
+}
 
 URPGGameInstanceBase::URPGGameInstanceBase()
 	: SaveSlot(TEXT("SaveGame"))
 	, SaveUserIndex(0)
+	, SaveLogCompactionSize(64 * 1024)
+	, SaveLogSize(0)
+	, bSaveCompactionRequested(false)
+	, bSavingSnapshot(false)
+	, bLegacySaveConversionPending(false)
 {}
 
 void URPGGameInstanceBase::AddDefaultInventory(URPGSaveGame* SaveGame, bool bRemoveExtra)
@@ -56,15 +72,75 @@ void URPGGameInstanceBase::SetSavingEnabled(bool bEnabled)
 bool URPGGameInstanceBase::LoadOrCreateSaveGame()
 {
 	URPGSaveGame* LoadedSave = nullptr;
+	bLegacySaveConversionPending = false;
 
-	if (UGameplayStatics::DoesSaveGameExist(SaveSlot, SaveUserIndex) && bSavingEnabled)
+	if (bSavingEnabled)
 	{
-		LoadedSave = Cast<URPGSaveGame>(UGameplayStatics::LoadGameFromSlot(SaveSlot, SaveUserIndex));
+		if (IFileManager::Get().FileExists(*GetChunkedSaveFilePath(SnapshotExtension)))
+		{
+			// Even if the snapshot is corrupt, the old slot is older than it, so don't roll back to it
+			LoadedSave = LoadChunkedSaveGame();
+		}
+		else if (UGameplayStatics::DoesSaveGameExist(SaveSlot, SaveUserIndex))
+		{
+			// Saves from before the chunked format, the first write will convert it
+			LoadedSave = Cast<URPGSaveGame>(UGameplayStatics::LoadGameFromSlot(SaveSlot, SaveUserIndex));
+			bLegacySaveConversionPending = LoadedSave != nullptr;
+		}
 	}
 
 	return HandleSaveGameLoaded(LoadedSave);
 }
 
+URPGSaveGame* URPGGameInstanceBase::LoadChunkedSaveGame()
+{
+	const FString SnapshotPath = GetChunkedSaveFilePath(SnapshotExtension);
+	TArray<uint8> SnapshotBytes;
+	if (!FFileHelper::LoadFileToArray(SnapshotBytes, *SnapshotPath, FILEREAD_Silent))
+	{
+		return nullptr;
+	}
+
+	URPGSaveGame* LoadedSave = Cast<URPGSaveGame>(UGameplayStatics::CreateSaveGameObject(URPGSaveGame::StaticClass()));
+	FGuid LoadedSaveId;
+	if (!LoadedSave->ReadSnapshot(SnapshotBytes, LoadedSaveId))
+	{
+		// Keep the corrupt files around so they can be recovered, the next write starts a new snapshot
+		const FString ChangeLogPath = GetChunkedSaveFilePath(ChangeLogExtension);
+		IFileManager& FileManager = IFileManager::Get();
+		FileManager.Move(*(SnapshotPath + CorruptExtension), *SnapshotPath, /*bReplace=*/true);
+		if (FileManager.FileExists(*ChangeLogPath))
+		{
+			FileManager.Move(*(ChangeLogPath + CorruptExtension), *ChangeLogPath, /*bReplace=*/true);
+		}
+
+		UE_LOG(LogActionRPG, Error, TEXT("LoadChunkedSaveGame: Snapshot of %s is corrupt, moved it to %s"), *SaveSlot, *(SnapshotPath + CorruptExtension));
+		return nullptr;
+	}
+
+	// A missing change log just means nothing changed since the snapshot
+	TArray<uint8> ChangeLogBytes;
+	FFileHelper::LoadFileToArray(ChangeLogBytes, *GetChunkedSaveFilePath(ChangeLogExtension), FILEREAD_Silent);
+
+	SaveId = LoadedSaveId;
+	SaveLogSize = ChangeLogBytes.Num();
+	bSaveCompactionRequested = false;
+
+	if (!LoadedSave->ApplyChangeLog(ChangeLogBytes, SaveId))
+	{
+		// Anything appended after a bad entry couldn't be read back, so start over with a new snapshot
+		UE_LOG(LogActionRPG, Warning, TEXT("LoadChunkedSaveGame: Change log of %s is truncated or corrupt, only the valid part was loaded"), *SaveSlot);
+		bSaveCompactionRequested = true;
+	}
+
+	return LoadedSave;
+}
+
+FString URPGGameInstanceBase::GetChunkedSaveFilePath(const TCHAR* Extension) const
+{
+	return FPaths::ProjectSavedDir() / TEXT("SaveGames") / SaveSlot + Extension;
+}
+
 bool URPGGameInstanceBase::HandleSaveGameLoaded(USaveGame* SaveGameObject)
 {
 	bool bLoaded = false;
@@ -115,16 +191,74 @@ bool URPGGameInstanceBase::WriteSaveGame()
 			return true;
 		}
 
-		// Indicate that we're currently doing an async save
-		bCurrentlySaving = true;
+		URPGSaveGame* SaveGame = GetCurrentSaveGame();
+		if (!SaveGame)
+		{
+			return false;
+		}
+
+		const FString SnapshotPath = GetChunkedSaveFilePath(SnapshotExtension);
+		const FString ChangeLogPath = GetChunkedSaveFilePath(ChangeLogExtension);
+		TArray<uint8> Bytes;
+
+		if (bSaveCompactionRequested || !SaveGame->HasWrittenState() || SaveLogSize >= SaveLogCompactionSize)
+		{
+			// Compact everything into a new snapshot. The new id makes the old change log stale even if deleting it fails
+			SaveId = FGuid::NewGuid();
+			SaveGame->WriteSnapshot(SaveId, Bytes);
+			SaveLogSize = 0;
+			bSaveCompactionRequested = false;
+			bSavingSnapshot = true;
 
-		// This goes off in the background
-		UGameplayStatics::AsyncSaveGameToSlot(GetCurrentSaveGame(), SaveSlot, SaveUserIndex, FAsyncSaveGameToSlotDelegate::CreateUObject(this, &URPGGameInstanceBase::HandleAsyncSave));
+			// This goes off in the background, the snapshot replaces the old one only once it's fully written
+			StartAsyncSave([SnapshotPath, ChangeLogPath, Bytes = MoveTemp(Bytes)]()
+			{
+				const FString TempPath = SnapshotPath + TEXT(".tmp");
+				IFileManager& FileManager = IFileManager::Get();
+
+				return FFileHelper::SaveArrayToFile(Bytes, *TempPath)
+					&& FileManager.Move(*SnapshotPath, *TempPath, /*bReplace=*/true)
+					&& (!FileManager.FileExists(*ChangeLogPath) || FileManager.Delete(*ChangeLogPath));
+			});
+		}
+		else if (SaveGame->WriteChanges(SaveId, Bytes))
+		{
+			SaveLogSize += Bytes.Num();
+			bSavingSnapshot = false;
+
+			StartAsyncSave([ChangeLogPath, Bytes = MoveTemp(Bytes)]()
+			{
+				return FFileHelper::SaveArrayToFile(Bytes, *ChangeLogPath, &IFileManager::Get(), FILEWRITE_Append);
+			});
+		}
 		return true;
 	}
 	return false;
 }
 
+void URPGGameInstanceBase::StartAsyncSave(TUniqueFunction<bool()>&& WriteToDisk)
+{
+	// Indicate that we're currently doing an async save
+	bCurrentlySaving = true;
+
+	TWeakObjectPtr<URPGGameInstanceBase> WeakThis(this);
+	const FString SlotName = SaveSlot;
+	const int32 UserIndex = SaveUserIndex;
+
+	Async(EAsyncExecution::ThreadPool, [WeakThis, SlotName, UserIndex, WriteToDisk = MoveTemp(WriteToDisk)]()
+	{
+		const bool bSuccess = WriteToDisk();
+
+		AsyncTask(ENamedThreads::GameThread, [WeakThis, SlotName, UserIndex, bSuccess]()
+		{
+			if (URPGGameInstanceBase* GameInstance = WeakThis.Get())
+			{
+				GameInstance->HandleAsyncSave(SlotName, UserIndex, bSuccess);
+			}
+		});
+	});
+}
+
 void URPGGameInstanceBase::ResetSaveGame()
 {
 	// Call handle function with no loaded save, this will reset the data
@@ -136,6 +270,19 @@ void URPGGameInstanceBase::HandleAsyncSave(const FString& SlotName, const int32
 	ensure(bCurrentlySaving);
 	bCurrentlySaving = false;
 
+	if (!bSuccess)
+	{
+		// What's on disk doesn't match what the save game thinks was written, so write everything next time
+		UE_LOG(LogActionRPG, Warning, TEXT("HandleAsyncSave: Failed to write save game %s"), *SlotName);
+		bSaveCompactionRequested = true;
+	}
+	else if (bSavingSnapshot && bLegacySaveConversionPending)
+	{
+		// Everything is in the snapshot now, the old slot would only roll the player back if the snapshot went missing
+		UGameplayStatics::DeleteGameInSlot(SlotName, UserIndex);
+		bLegacySaveConversionPending = false;
+	}
+
 	if (bPendingSaveRequested)
 	{
 		// Start another save as we got a request while saving
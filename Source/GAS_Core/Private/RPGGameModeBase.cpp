@@ -3,6 +3,10 @@
 #include "RPGGameModeBase.h"
 #include "RPGGameStateBase.h"
 #include "RPGPlayerControllerBase.h"
+#include "RPGAssetManager.h"
+#include "RPGCharacterBase.h"
+#include "RPGGameInstanceBase.h"
+#include "RPGSaveGame.h"
 
 ARPGGameModeBase::ARPGGameModeBase()
 {
@@ -16,6 +20,30 @@ void ARPGGameModeBase::ResetLevel()
 	K2_DoRestart();
 }
 
+void ARPGGameModeBase::StartPlay()
+{
+	TArray<FPrimaryAssetId> SlottedItemIds;
+	TArray<FPrimaryAssetId> InventoryItemIds;
+	URPGGameInstanceBase* GameInstance = GetGameInstance<URPGGameInstanceBase>();
+	URPGSaveGame* SaveGame = GameInstance ? GameInstance->GetCurrentSaveGame() : nullptr;
+
+	if (SaveGame)
+	{
+		SaveGame->SlottedItems.GenerateValueArray(SlottedItemIds);
+		SaveGame->InventoryData.GetKeys(InventoryItemIds);
+	}
+
+	TArray<FSoftObjectPath> EnemyClassPaths;
+	for (const TSoftClassPtr<ARPGCharacterBase>& EnemyClass : PreloadEnemyClasses)
+	{
+		EnemyClassPaths.Add(EnemyClass.ToSoftObjectPath());
+	}
+
+	URPGAssetManager::Get().PreloadAssets(SlottedItemIds, InventoryItemIds, EnemyClassPaths);
+
+	Super::StartPlay();
+}
+
 bool ARPGGameModeBase::HasMatchEnded() const 
 {
 	return bGameOver;
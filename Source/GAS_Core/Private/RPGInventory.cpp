@@ -0,0 +1,332 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "RPGInventory.h"
+#include "Items/RPGItem.h"
+
+void FRPGInventory::Reset()
+{
+	Groups.Reset();
+	GroupIndices.Reset();
+	ItemHandles.Reset();
+	ItemSlots.Reset();
+
+	// Handle entries are kept so their serials keep counting up, otherwise handles from before the reset would be valid for the items added after it
+	FreeHandleIndices.Reset(HandleEntries.Num());
+	for (int32 HandleIndex = HandleEntries.Num() - 1; HandleIndex >= 0; HandleIndex--)
+	{
+		FHandleEntry& Entry = HandleEntries[HandleIndex];
+		if (Entry.GroupIndex != INDEX_NONE)
+		{
+			Entry.GroupIndex = INDEX_NONE;
+			Entry.ItemIndex = INDEX_NONE;
+			Entry.Serial++;
+		}
+		FreeHandleIndices.Add(HandleIndex);
+	}
+}
+
+void FRPGInventory::InitSlots(const TMap<FPrimaryAssetType, int32>& SlotsPerType)
+{
+	for (const TPair<FPrimaryAssetType, int32>& Pair : SlotsPerType)
+	{
+		FRPGInventoryTypeGroup& Group = FindOrAddGroup(Pair.Key);
+		for (URPGItem* SlottedItem : Group.Slots)
+		{
+			ItemSlots.Remove(SlottedItem);
+		}
+
+		Group.Slots.Reset(Pair.Value);
+		Group.Slots.AddZeroed(FMath::Max(Pair.Value, 0));
+	}
+}
+
+FRPGInventoryHandle FRPGInventory::SetItem(URPGItem* Item, const FRPGItemData& ItemData)
+{
+	if (!Item)
+	{
+		return FRPGInventoryHandle();
+	}
+
+	if (const FRPGInventoryHandle* FoundHandle = ItemHandles.Find(Item))
+	{
+		const FHandleEntry& Entry = HandleEntries[FoundHandle->Index];
+		Groups[Entry.GroupIndex].ItemData[Entry.ItemIndex] = ItemData;
+		return *FoundHandle;
+	}
+
+	const FPrimaryAssetType ItemType = Item->GetPrimaryAssetId().PrimaryAssetType;
+	FindOrAddGroup(ItemType);
+	const int32 GroupIndex = GroupIndices.FindChecked(ItemType);
+	FRPGInventoryTypeGroup& Group = Groups[GroupIndex];
+
+	// Reuse handle entries of removed items, the serial makes their old handles invalid
+	const int32 HandleIndex = FreeHandleIndices.Num() ? FreeHandleIndices.Pop(false) : HandleEntries.AddDefaulted();
+	FHandleEntry& Entry = HandleEntries[HandleIndex];
+	Entry.GroupIndex = GroupIndex;
+	Entry.ItemIndex = Group.Items.Add(Item);
+	Entry.Serial++;
+	Group.ItemData.Add(ItemData);
+	Group.HandleIndices.Add(HandleIndex);
+
+	const FRPGInventoryHandle Handle(HandleIndex, Entry.Serial);
+	ItemHandles.Add(Item, Handle);
+	return Handle;
+}
+
+bool FRPGInventory::RemoveItem(URPGItem* Item, FRPGItemSlot* OutClearedSlot)
+{
+	FRPGInventoryHandle Handle;
+	if (!ItemHandles.RemoveAndCopyValue(Item, Handle))
+	{
+		return false;
+	}
+
+	FHandleEntry& Entry = HandleEntries[Handle.Index];
+	FRPGInventoryTypeGroup& Group = Groups[Entry.GroupIndex];
+
+	// Swap the last item of the group into the hole to keep the arrays dense
+	const int32 LastItemIndex = Group.Items.Num() - 1;
+	if (Entry.ItemIndex != LastItemIndex)
+	{
+		HandleEntries[Group.HandleIndices[LastItemIndex]].ItemIndex = Entry.ItemIndex;
+	}
+	Group.Items.RemoveAtSwap(Entry.ItemIndex, 1, false);
+	Group.ItemData.RemoveAtSwap(Entry.ItemIndex, 1, false);
+	Group.HandleIndices.RemoveAtSwap(Entry.ItemIndex, 1, false);
+
+	Entry.GroupIndex = INDEX_NONE;
+	Entry.ItemIndex = INDEX_NONE;
+	Entry.Serial++;
+	FreeHandleIndices.Add(Handle.Index);
+
+	FRPGItemSlot ClearedSlot;
+	if (ItemSlots.RemoveAndCopyValue(Item, ClearedSlot))
+	{
+		Groups[GroupIndices.FindChecked(ClearedSlot.ItemType)].Slots[ClearedSlot.SlotNumber] = nullptr;
+	}
+
+	if (OutClearedSlot)
+	{
+		*OutClearedSlot = ClearedSlot;
+	}
+	return true;
+}
+
+FRPGInventoryHandle FRPGInventory::FindItem(const URPGItem* Item) const
+{
+	const FRPGInventoryHandle* FoundHandle = ItemHandles.Find(Item);
+	return FoundHandle ? *FoundHandle : FRPGInventoryHandle();
+}
+
+URPGItem* FRPGInventory::GetItem(const FRPGInventoryHandle& Handle) const
+{
+	const FHandleEntry* Entry = FindHandleEntry(Handle);
+	return Entry ? Groups[Entry->GroupIndex].Items[Entry->ItemIndex] : nullptr;
+}
+
+const FRPGItemData* FRPGInventory::GetItemData(const FRPGInventoryHandle& Handle) const
+{
+	const FHandleEntry* Entry = FindHandleEntry(Handle);
+	return Entry ? &Groups[Entry->GroupIndex].ItemData[Entry->ItemIndex] : nullptr;
+}
+
+TArrayView<URPGItem* const> FRPGInventory::GetItemsOfType(const FPrimaryAssetType& ItemType) const
+{
+	const FRPGInventoryTypeGroup* Group = FindGroup(ItemType);
+	return Group ? TArrayView<URPGItem* const>(Group->Items) : TArrayView<URPGItem* const>();
+}
+
+void FRPGInventory::GetAllItems(TArray<URPGItem*>& OutItems) const
+{
+	OutItems.Reserve(OutItems.Num() + Num());
+	for (const FRPGInventoryTypeGroup& Group : Groups)
+	{
+		OutItems.Append(Group.Items);
+	}
+}
+
+bool FRPGInventory::IsValidSlot(const FRPGItemSlot& ItemSlot) const
+{
+	const FRPGInventoryTypeGroup* Group = ItemSlot.IsValid() ? FindGroup(ItemSlot.ItemType) : nullptr;
+	return Group && Group->Slots.IsValidIndex(ItemSlot.SlotNumber);
+}
+
+URPGItem* FRPGInventory::GetSlottedItem(const FRPGItemSlot& ItemSlot) const
+{
+	return IsValidSlot(ItemSlot) ? FindGroup(ItemSlot.ItemType)->Slots[ItemSlot.SlotNumber] : nullptr;
+}
+
+TArrayView<URPGItem* const> FRPGInventory::GetSlotsOfType(const FPrimaryAssetType& ItemType) const
+{
+	const FRPGInventoryTypeGroup* Group = FindGroup(ItemType);
+	return Group ? TArrayView<URPGItem* const>(Group->Slots) : TArrayView<URPGItem* const>();
+}
+
+FRPGItemSlot FRPGInventory::GetItemSlot(const URPGItem* Item) const
+{
+	const FRPGItemSlot* FoundSlot = ItemSlots.Find(Item);
+	return FoundSlot ? *FoundSlot : FRPGItemSlot();
+}
+
+bool FRPGInventory::SetSlottedItem(const FRPGItemSlot& ItemSlot, URPGItem* Item, TArray<FRPGItemSlot>& OutChangedSlots)
+{
+	if (!IsValidSlot(ItemSlot))
+	{
+		return false;
+	}
+
+	URPGItem*& Slot = FindGroup(ItemSlot.ItemType)->Slots[ItemSlot.SlotNumber];
+	if (Slot)
+	{
+		ItemSlots.Remove(Slot);
+	}
+
+	if (Item)
+	{
+		// An item can only be in one slot, so take it out of the old one
+		FRPGItemSlot OldSlot;
+		if (ItemSlots.RemoveAndCopyValue(Item, OldSlot) && OldSlot != ItemSlot)
+		{
+			FindGroup(OldSlot.ItemType)->Slots[OldSlot.SlotNumber] = nullptr;
+			OutChangedSlots.Add(OldSlot);
+		}
+
+		ItemSlots.Add(Item, ItemSlot);
+	}
+
+	Slot = Item;
+	OutChangedSlots.Add(ItemSlot);
+	return true;
+}
+
+FRPGItemSlot FRPGInventory::FindEmptySlot(const FPrimaryAssetType& ItemType) const
+{
+	const int32 SlotNumber = GetSlotsOfType(ItemType).Find(nullptr);
+	return SlotNumber != INDEX_NONE ? FRPGItemSlot(ItemType, SlotNumber) : FRPGItemSlot();
+}
+
+FRPGInventoryTypeGroup* FRPGInventory::FindGroup(const FPrimaryAssetType& ItemType)
+{
+	const int32* GroupIndex = GroupIndices.Find(ItemType);
+	return GroupIndex ? &Groups[*GroupIndex] : nullptr;
+}
+
+const FRPGInventoryTypeGroup* FRPGInventory::FindGroup(const FPrimaryAssetType& ItemType) const
+{
+	const int32* GroupIndex = GroupIndices.Find(ItemType);
+	return GroupIndex ? &Groups[*GroupIndex] : nullptr;
+}
+
+FRPGInventoryTypeGroup& FRPGInventory::FindOrAddGroup(const FPrimaryAssetType& ItemType)
+{
+	if (const int32* GroupIndex = GroupIndices.Find(ItemType))
+	{
+		return Groups[*GroupIndex];
+	}
+
+	const int32 GroupIndex = Groups.AddDefaulted();
+	GroupIndices.Add(ItemType, GroupIndex);
+	return Groups[GroupIndex];
+}
+
+const FRPGInventory::FHandleEntry* FRPGInventory::FindHandleEntry(const FRPGInventoryHandle& Handle) const
+{
+	if (HandleEntries.IsValidIndex(Handle.Index))
+	{
+		const FHandleEntry& Entry = HandleEntries[Handle.Index];
+		if (Entry.Serial == Handle.Serial && Entry.GroupIndex != INDEX_NONE)
+		{
+			return &Entry;
+		}
+	}
+	return nullptr;
+}
+
+void FRPGReplicatedInventoryEntry::PreReplicatedRemove(const FRPGReplicatedInventory& InArray)
+{
+	InArray.OnEntryChanged.ExecuteIfBound(*this, true);
+}
+
+void FRPGReplicatedInventoryEntry::PostReplicatedAdd(const FRPGReplicatedInventory& InArray)
+{
+	InArray.OnEntryChanged.ExecuteIfBound(*this, false);
+}
+
+void FRPGReplicatedInventoryEntry::PostReplicatedChange(const FRPGReplicatedInventory& InArray)
+{
+	InArray.OnEntryChanged.ExecuteIfBound(*this, false);
+}
+
+void FRPGReplicatedInventory::SetEntry(URPGItem* Item, const FRPGItemData* ItemData, const FRPGItemSlot& ItemSlot)
+{
+	if (!Item)
+	{
+		return;
+	}
+
+	const int32 EntryIndex = Entries.IndexOfByPredicate([Item](const FRPGReplicatedInventoryEntry& Entry) { return Entry.Item == Item; });
+	if (!ItemData && !ItemSlot.IsValid())
+	{
+		if (EntryIndex != INDEX_NONE)
+		{
+			Entries.RemoveAtSwap(EntryIndex);
+			MarkArrayDirty();
+			NumPendingChanges++;
+		}
+		return;
+	}
+
+	FRPGReplicatedInventoryEntry& Entry = EntryIndex != INDEX_NONE ? Entries[EntryIndex] : Entries.AddDefaulted_GetRef();
+	const FRPGItemData NewItemData = ItemData ? *ItemData : FRPGItemData(0, 0);
+	if (EntryIndex == INDEX_NONE || Entry.ItemData != NewItemData || Entry.ItemSlot != ItemSlot)
+	{
+		Entry.Item = Item;
+		Entry.ItemData = NewItemData;
+		Entry.ItemSlot = ItemSlot;
+		MarkItemDirty(Entry);
+		NumPendingChanges++;
+	}
+}
+
+void FRPGReplicatedInventory::RemoveEntries(TFunctionRef<bool(const FRPGReplicatedInventoryEntry&)> Predicate)
+{
+	const int32 OldNum = Entries.Num();
+	Entries.RemoveAllSwap(Predicate);
+	const int32 NumRemoved = OldNum - Entries.Num();
+	if (NumRemoved > 0)
+	{
+		NumPendingChanges += NumRemoved;
+		MarkArrayDirty();
+	}
+}
+
+const FRPGReplicatedInventoryEntry* FRPGReplicatedInventory::FindEntry(const URPGItem* Item) const
+{
+	return Entries.FindByPredicate([Item](const FRPGReplicatedInventoryEntry& Entry) { return Entry.Item == Item; });
+}
+
+void FRPGReplicatedInventory::PostReplicatedReceive(const FFastArraySerializer::FPostReplicatedReceiveParameters& Parameters)
+{
+	OnReceived.ExecuteIfBound();
+}
+
+bool FRPGReplicatedInventory::NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms)
+{
+	const int64 StartBits = DeltaParms.Writer ? DeltaParms.Writer->GetNumBits() : 0;
+	const bool bResult = FFastArraySerializer::FastArrayDeltaSerialize<FRPGReplicatedInventoryEntry, FRPGReplicatedInventory>(Entries, DeltaParms, *this);
+
+	// Only what was actually written is counted, nothing is written when no entry changed
+	const int64 NumBits = DeltaParms.Writer ? DeltaParms.Writer->GetNumBits() - StartBits : 0;
+	if (NumBits > 0)
+	{
+		const int32 NumChanges = FMath::Max(NumPendingChanges, 1);
+		Stats.NumChanges += NumChanges;
+		Stats.NumBytes += FMath::DivideAndRoundUp<int64>(NumBits, 8);
+		Stats.NumSends++;
+		NumPendingChanges = 0;
+
+		UE_LOG(LogActionRPG, Verbose, TEXT("Replicated %d inventory changes in %lld bits, %.1f bytes per change overall"), NumChanges, NumBits, Stats.GetBytesPerChange());
+	}
+
+	return bResult;
+}
@@ -5,6 +5,17 @@
 #include "RPGGameInstanceBase.h"
 #include "RPGSaveGame.h"
 #include "Items/RPGItem.h"
+#include "Engine/StreamableManager.h"
+#include "TimerManager.h"
+
+ARPGPlayerControllerBase::ARPGPlayerControllerBase()
+	: InventorySaveDelay(1.0f)
+	, bAsyncLoadInventory(true)
+	, InventoryLoadBundles({ URPGAssetManager::UIBundle, URPGAssetManager::GameplayBundle })
+	, AcknowledgedSlotPrediction(0)
+	, LastSlotPrediction(0)
+	, bRebuildingInventory(false)
+{}
 
 bool ARPGPlayerControllerBase::AddInventoryItem(URPGItem* NewItem, int32 ItemCount, int32 ItemLevel, bool bAutoSlot)
 {
@@ -15,12 +26,24 @@ bool ARPGPlayerControllerBase::AddInventoryItem(URPGItem* NewItem, int32 ItemCou
 		return false;
 	}
 
+	if (GetLocalRole() != ROLE_Authority)
+	{
+		UE_LOG(LogActionRPG, Warning, TEXT("AddInventoryItem: Failed trying to add item %s on a client, the inventory is changed by the server!"), *NewItem->GetName());
+		return false;
+	}
+
 	if (ItemCount <= 0 || ItemLevel <= 0)
 	{
 		UE_LOG(LogActionRPG, Warning, TEXT("AddInventoryItem: Failed trying to add item %s with negative count or level!"), *NewItem->GetName());
 		return false;
 	}
 
+	if (IsLoadingInventory())
+	{
+		UE_LOG(LogActionRPG, Warning, TEXT("AddInventoryItem: Failed trying to add item %s while the inventory is loading!"), *NewItem->GetName());
+		return false;
+	}
+
 	// Find current item data, which may be empty
 	FRPGItemData OldData;
 	GetInventoryItemData(NewItem, OldData);
@@ -32,7 +55,7 @@ bool ARPGPlayerControllerBase::AddInventoryItem(URPGItem* NewItem, int32 ItemCou
 	if (OldData != NewData)
 	{
 		// If data changed, need to update storage and call callback
-		InventoryData.Add(NewItem, NewData);
+		SetInventoryItemData(NewItem, NewData);
 		NotifyInventoryItemChanged(true, NewItem);
 		bChanged = true;
 	}
@@ -46,7 +69,7 @@ bool ARPGPlayerControllerBase::AddInventoryItem(URPGItem* NewItem, int32 ItemCou
 	if (bChanged)
 	{
 		// If anything changed, write to save game
-		SaveInventory();
+		RequestSaveInventory();
 		return true;
 	}
 	return false;
@@ -60,6 +83,18 @@ bool ARPGPlayerControllerBase::RemoveInventoryItem(URPGItem* RemovedItem, int32
 		return false;
 	}
 
+	if (GetLocalRole() != ROLE_Authority)
+	{
+		UE_LOG(LogActionRPG, Warning, TEXT("RemoveInventoryItem: Failed trying to remove item %s on a client, the inventory is changed by the server!"), *RemovedItem->GetName());
+		return false;
+	}
+
+	if (IsLoadingInventory())
+	{
+		UE_LOG(LogActionRPG, Warning, TEXT("RemoveInventoryItem: Failed trying to remove item %s while the inventory is loading!"), *RemovedItem->GetName());
+		return false;
+	}
+
 	// Find current item data, which may be empty
 	FRPGItemData NewData;
 	GetInventoryItemData(RemovedItem, NewData);
@@ -83,71 +118,65 @@ bool ARPGPlayerControllerBase::RemoveInventoryItem(URPGItem* RemovedItem, int32
 	if (NewData.ItemCount > 0)
 	{
 		// Update data with new count
-		InventoryData.Add(RemovedItem, NewData);
+		SetInventoryItemData(RemovedItem, NewData);
 	}
 	else
 	{
 		// Remove item entirely, make sure it is unslotted
-		InventoryData.Remove(RemovedItem);
-
-		for (TPair<FRPGItemSlot, URPGItem*>& Pair : SlottedItems)
+		const FRPGItemSlot ClearedSlot = RemoveInventoryItemData(RemovedItem);
+		if (ClearedSlot.IsValid())
 		{
-			if (Pair.Value == RemovedItem)
-			{
-				Pair.Value = nullptr;
-				NotifySlottedItemChanged(Pair.Key, Pair.Value);
-			}
+			NotifySlottedItemChanged(ClearedSlot, nullptr);
 		}
 	}
 
 	// If we got this far, there is a change so notify and save
 	NotifyInventoryItemChanged(false, RemovedItem);
 
-	SaveInventory();
+	RequestSaveInventory();
 	return true;
 }
 
 void ARPGPlayerControllerBase::GetInventoryItems(TArray<URPGItem*>& Items, FPrimaryAssetType ItemType)
 {
-	for (const TPair<URPGItem*, FRPGItemData>& Pair : InventoryData)
+	// Items are stored by type, so filtering doesn't need to look at items of other types
+	if (ItemType.IsValid())
 	{
-		if (Pair.Key)
-		{
-			FPrimaryAssetId AssetId = Pair.Key->GetPrimaryAssetId();
-
-			// Filters based on item type
-			if (AssetId.PrimaryAssetType == ItemType || !ItemType.IsValid())
-			{
-				Items.Add(Pair.Key);
-			}
-		}	
+		Items.Append(Inventory.GetItemsOfType(ItemType));
+	}
+	else
+	{
+		Inventory.GetAllItems(Items);
 	}
 }
 
 bool ARPGPlayerControllerBase::SetSlottedItem(FRPGItemSlot ItemSlot, URPGItem* Item)
 {
-	// Iterate entire inventory because we need to remove from old slot
-	bool bFound = false;
-	for (TPair<FRPGItemSlot, URPGItem*>& Pair : SlottedItems)
+	if (GetLocalRole() != ROLE_Authority)
 	{
-		if (Pair.Key == ItemSlot)
-		{
-			// Add to new slot
-			bFound = true;
-			Pair.Value = Item;
-			NotifySlottedItemChanged(Pair.Key, Pair.Value);
-		}
-		else if (Item != nullptr && Pair.Value == Item)
+		if (!Inventory.IsValidSlot(ItemSlot))
 		{
-			// If this item was found in another slot, remove it
-			Pair.Value = nullptr;
-			NotifySlottedItemChanged(Pair.Key, Pair.Value);
+			return false;
 		}
+
+		// Show the change right away, the server acknowledges it once it's been handled and the replicated slots take over again
+		const int32 PredictionKey = ++LastSlotPrediction;
+		PendingSlotPredictions.Add({ PredictionKey, ItemSlot, Item });
+		SetSlottedItemData(ItemSlot, Item);
+		ServerSetSlottedItem(ItemSlot, Item, PredictionKey);
+		return true;
 	}
 
-	if (bFound)
+	if (IsLoadingInventory())
 	{
-		SaveInventory();
+		UE_LOG(LogActionRPG, Warning, TEXT("SetSlottedItem: Failed trying to change slot %s %d while the inventory is loading!"), *ItemSlot.ItemType.ToString(), ItemSlot.SlotNumber);
+		return false;
+	}
+
+	// The old slot of the item is tracked, so it is removed from it without searching
+	if (SetSlottedItemData(ItemSlot, Item))
+	{
+		RequestSaveInventory();
 		return true;
 	}
 
@@ -180,37 +209,50 @@ bool ARPGPlayerControllerBase::GetInventoryItemData(URPGItem* Item, FRPGItemData
 
 URPGItem* ARPGPlayerControllerBase::GetSlottedItem(FRPGItemSlot ItemSlot) const
 {
-	URPGItem* const* FoundItem = SlottedItems.Find(ItemSlot);
-
-	if (FoundItem)
-	{
-		return *FoundItem;
-	}
-	return nullptr;
+	return Inventory.GetSlottedItem(ItemSlot);
 }
 
 void ARPGPlayerControllerBase::GetSlottedItems(TArray<URPGItem*>& Items, FPrimaryAssetType ItemType, bool bOutputEmptyIndexes)
 {
-	for (TPair<FRPGItemSlot, URPGItem*>& Pair : SlottedItems)
+	// Slots of each type are stored in SlotNumber order
+	if (ItemType.IsValid())
 	{
-		if (Pair.Key.ItemType == ItemType || !ItemType.IsValid())
+		Items.Append(Inventory.GetSlotsOfType(ItemType));
+	}
+	else
+	{
+		Inventory.ForEachSlot([&Items](const FRPGItemSlot& ItemSlot, URPGItem* SlottedItem)
 		{
-			Items.Add(Pair.Value);
-		}
+			Items.Add(SlottedItem);
+		});
 	}
 }
 
 void ARPGPlayerControllerBase::FillEmptySlots()
 {
+	if (GetLocalRole() != ROLE_Authority)
+	{
+		return;
+	}
+
+	// The loaded inventory fills the slots itself if none were saved
+	if (IsLoadingInventory())
+	{
+		return;
+	}
+
+	TArray<URPGItem*> Items;
+	Inventory.GetAllItems(Items);
+
 	bool bShouldSave = false;
-	for (const TPair<URPGItem*, FRPGItemData>& Pair : InventoryData)
+	for (URPGItem* Item : Items)
 	{
-		bShouldSave |= FillEmptySlotWithItem(Pair.Key);
+		bShouldSave |= FillEmptySlotWithItem(Item);
 	}
 
 	if (bShouldSave)
 	{
-		SaveInventory();
+		RequestSaveInventory();
 	}
 }
 
@@ -224,9 +266,15 @@ bool ARPGPlayerControllerBase::SaveInventory()
 		return false;
 	}
 
-	URPGSaveGame* CurrentSaveGame = GameInstance->GetCurrentSaveGame();
+	// Clients only have the replicated copy of the inventory, the server saves it
+	URPGSaveGame* CurrentSaveGame = GetLocalRole() == ROLE_Authority ? GameInstance->GetCurrentSaveGame() : nullptr;
 	if (CurrentSaveGame)
 	{
+		// Everything is written, so nothing is left pending
+		GetWorldTimerManager().ClearTimer(InventorySaveTimerHandle);
+		DirtyItems.Reset();
+		DirtySlots.Reset();
+
 		// Reset cached data in save game before writing to it
 		CurrentSaveGame->InventoryData.Reset();
 		CurrentSaveGame->SlottedItems.Reset();
@@ -260,10 +308,98 @@ bool ARPGPlayerControllerBase::SaveInventory()
 	return false;
 }
 
+bool ARPGPlayerControllerBase::FlushInventorySave()
+{
+	GetWorldTimerManager().ClearTimer(InventorySaveTimerHandle);
+
+	if (GetLocalRole() != ROLE_Authority)
+	{
+		// Clients only have the replicated copy of the inventory, the server saves it
+		DirtyItems.Reset();
+		DirtySlots.Reset();
+		return false;
+	}
+
+	if (DirtyItems.Num() == 0 && DirtySlots.Num() == 0)
+	{
+		return true;
+	}
+
+	UWorld* World = GetWorld();
+	URPGGameInstanceBase* GameInstance = World ? World->GetGameInstance<URPGGameInstanceBase>() : nullptr;
+	URPGSaveGame* CurrentSaveGame = GameInstance ? GameInstance->GetCurrentSaveGame() : nullptr;
+
+	if (!CurrentSaveGame)
+	{
+		return false;
+	}
+
+	// Only update the entries that changed, the rest of the save game is already up to date
+	for (URPGItem* Item : DirtyItems)
+	{
+		if (Item)
+		{
+			const FPrimaryAssetId AssetId = Item->GetPrimaryAssetId();
+			const FRPGItemData* FoundItem = InventoryData.Find(Item);
+
+			if (FoundItem)
+			{
+				CurrentSaveGame->InventoryData.Add(AssetId, *FoundItem);
+			}
+			else
+			{
+				CurrentSaveGame->InventoryData.Remove(AssetId);
+			}
+		}
+	}
+
+	for (const FRPGItemSlot& ItemSlot : DirtySlots)
+	{
+		FPrimaryAssetId AssetId;
+		URPGItem* SlottedItem = GetSlottedItem(ItemSlot);
+
+		if (SlottedItem)
+		{
+			AssetId = SlottedItem->GetPrimaryAssetId();
+		}
+		CurrentSaveGame->SlottedItems.Add(ItemSlot, AssetId);
+	}
+
+	DirtyItems.Reset();
+	DirtySlots.Reset();
+
+	// The game instance makes sure only one async save is running, and queues at most one more
+	return GameInstance->WriteSaveGame();
+}
+
+void ARPGPlayerControllerBase::RequestSaveInventory()
+{
+	if (InventorySaveDelay <= 0.0f)
+	{
+		FlushInventorySave();
+	}
+	else if (!GetWorldTimerManager().IsTimerActive(InventorySaveTimerHandle))
+	{
+		// Don't restart a running timer, so a steady stream of changes still gets saved every InventorySaveDelay
+		GetWorldTimerManager().SetTimer(InventorySaveTimerHandle, FTimerDelegate::CreateWeakLambda(this, [this]() { FlushInventorySave(); }), InventorySaveDelay, false);
+	}
+}
+
 bool ARPGPlayerControllerBase::LoadInventory()
 {
-	InventoryData.Reset();
-	SlottedItems.Reset();
+	ResetInventory(TMap<FPrimaryAssetType, int32>());
+
+	// A load that is still in progress would replace this one when it finishes
+	if (InventoryLoadHandle.IsValid())
+	{
+		InventoryLoadHandle->CancelHandle();
+		InventoryLoadHandle.Reset();
+	}
+
+	// Pending changes were made to the inventory that is being replaced
+	GetWorldTimerManager().ClearTimer(InventorySaveTimerHandle);
+	DirtyItems.Reset();
+	DirtySlots.Reset();
 
 	// Fill in slots from game instance
 	UWorld* World = GetWorld();
@@ -271,6 +407,7 @@ bool ARPGPlayerControllerBase::LoadInventory()
 
 	if (!GameInstance)
 	{
+		SyncReplicatedInventory();
 		return false;
 	}
 
@@ -280,94 +417,400 @@ bool ARPGPlayerControllerBase::LoadInventory()
 		GameInstance->OnSaveGameLoadedNative.AddUObject(this, &ARPGPlayerControllerBase::HandleSaveGameLoaded);
 	}
 
-	for (const TPair<FPrimaryAssetType, int32>& Pair : GameInstance->ItemSlotsPerType)
+	ResetInventory(GameInstance->ItemSlotsPerType);
+
+	if (GetLocalRole() != ROLE_Authority)
 	{
-		for (int32 SlotNumber = 0; SlotNumber < Pair.Value; SlotNumber++)
+		// The server loads the save game, clients rebuild from whatever it has replicated so far and get the rest as it arrives
+		for (const FRPGReplicatedInventoryEntry& Entry : ReplicatedInventory.GetEntries())
 		{
-			SlottedItems.Add(FRPGItemSlot(Pair.Key, SlotNumber), nullptr);
+			if (Entry.Item && Entry.ItemData.IsValid())
+			{
+				SetInventoryItemData(Entry.Item, Entry.ItemData);
+			}
 		}
+		ApplyReplicatedSlots();
+
+		NotifyInventoryLoaded();
+		return true;
 	}
 
 	URPGSaveGame* CurrentSaveGame = GameInstance->GetCurrentSaveGame();
 	URPGAssetManager& AssetManager = URPGAssetManager::Get();
-	if (CurrentSaveGame)
+	if (CurrentSaveGame && bAsyncLoadInventory)
 	{
-		// Copy from save game into controller data
-		bool bFoundAnySlots = false;
-		for (const TPair<FPrimaryAssetId, FRPGItemData>& ItemPair : CurrentSaveGame->InventoryData)
+		// Load every saved item in a single batch, the inventory is filled in once they're all loaded
+		TArray<FPrimaryAssetId> ItemIds;
+		CurrentSaveGame->InventoryData.GetKeys(ItemIds);
+		for (const TPair<FRPGItemSlot, FPrimaryAssetId>& SlotPair : CurrentSaveGame->SlottedItems)
 		{
-			URPGItem* LoadedItem = AssetManager.ForceLoadItem(ItemPair.Key);
-
-			if (LoadedItem != nullptr)
+			if (SlotPair.Value.IsValid())
 			{
-				InventoryData.Add(LoadedItem, ItemPair.Value);
+				ItemIds.AddUnique(SlotPair.Value);
 			}
 		}
 
-		for (const TPair<FRPGItemSlot, FPrimaryAssetId>& SlotPair : CurrentSaveGame->SlottedItems)
+		TArray<FName> LoadBundles = InventoryLoadBundles;
+		if (IsRunningDedicatedServer())
 		{
-			if (SlotPair.Value.IsValid())
-			{
-				URPGItem* LoadedItem = AssetManager.ForceLoadItem(SlotPair.Value);
-				if (GameInstance->IsValidItemSlot(SlotPair.Key) && LoadedItem)
-				{
-					SlottedItems.Add(SlotPair.Key, LoadedItem);
-					bFoundAnySlots = true;
-				}
-			}
+			LoadBundles.Remove(URPGAssetManager::UIBundle);
 		}
 
+		// This can call back right away if everything is already loaded
+		TSharedPtr<FStreamableHandle> LoadHandle = AssetManager.LoadPrimaryAssets(ItemIds, LoadBundles, FStreamableDelegate::CreateUObject(this, &ARPGPlayerControllerBase::HandleInventoryAssetsLoaded));
+		if (LoadHandle.IsValid() && LoadHandle->IsLoadingInProgress())
+		{
+			InventoryLoadHandle = LoadHandle;
+		}
+
+		return true;
+	}
+	else if (CurrentSaveGame)
+	{
+		// Copy from save game into controller data
+		const bool bFoundAnySlots = CopyInventoryFromSaveGame(*CurrentSaveGame, [&AssetManager](const FPrimaryAssetId& ItemId)
+		{
+			return AssetManager.ForceLoadItem(ItemId);
+		});
+
 		if (!bFoundAnySlots)
 		{
 			// Auto slot items as no slots were saved
 			FillEmptySlots();
 		}
 
+		SyncReplicatedInventory();
 		NotifyInventoryLoaded();
 
 		return true;
 	}
 
 	// Load failed but we reset inventory, so need to notify UI
+	SyncReplicatedInventory();
 	NotifyInventoryLoaded();
 
 	return false;
 }
 
-bool ARPGPlayerControllerBase::FillEmptySlotWithItem(URPGItem* NewItem)
+bool ARPGPlayerControllerBase::IsLoadingInventory() const
 {
-	// Look for an empty item slot to fill with this item
-	FPrimaryAssetType NewItemType = NewItem->GetPrimaryAssetId().PrimaryAssetType;
-	FRPGItemSlot EmptySlot;
-	for (TPair<FRPGItemSlot, URPGItem*>& Pair : SlottedItems)
+	return InventoryLoadHandle.IsValid() && InventoryLoadHandle->IsLoadingInProgress();
+}
+
+float ARPGPlayerControllerBase::GetInventoryBytesPerChange() const
+{
+	return ReplicatedInventory.GetStats().GetBytesPerChange();
+}
+
+void ARPGPlayerControllerBase::HandleInventoryAssetsLoaded()
+{
+	InventoryLoadHandle.Reset();
+
+	UWorld* World = GetWorld();
+	URPGGameInstanceBase* GameInstance = World ? World->GetGameInstance<URPGGameInstanceBase>() : nullptr;
+	URPGSaveGame* CurrentSaveGame = GameInstance ? GameInstance->GetCurrentSaveGame() : nullptr;
+
+	if (CurrentSaveGame)
 	{
-		if (Pair.Key.ItemType == NewItemType)
+		ResetInventory(GameInstance->ItemSlotsPerType);
+
+		URPGAssetManager& AssetManager = URPGAssetManager::Get();
+		const bool bFoundAnySlots = CopyInventoryFromSaveGame(*CurrentSaveGame, [&AssetManager](const FPrimaryAssetId& ItemId)
 		{
-			if (Pair.Value == NewItem)
+			URPGItem* LoadedItem = AssetManager.GetPrimaryAssetObject<URPGItem>(ItemId);
+			if (LoadedItem == nullptr)
 			{
-				// Item is already slotted
-				return false;
+				UE_LOG(LogActionRPG, Warning, TEXT("Failed to load item for identifier %s!"), *ItemId.ToString());
 			}
-			else if (Pair.Value == nullptr && (!EmptySlot.IsValid() || EmptySlot.SlotNumber > Pair.Key.SlotNumber))
+			return LoadedItem;
+		});
+
+		if (!bFoundAnySlots)
+		{
+			// Auto slot items as no slots were saved
+			FillEmptySlots();
+		}
+	}
+
+	SyncReplicatedInventory();
+	NotifyInventoryLoaded();
+}
+
+bool ARPGPlayerControllerBase::CopyInventoryFromSaveGame(URPGSaveGame& SaveGame, TFunctionRef<URPGItem*(const FPrimaryAssetId&)> GetItem)
+{
+	UWorld* World = GetWorld();
+	URPGGameInstanceBase* GameInstance = World ? World->GetGameInstance<URPGGameInstanceBase>() : nullptr;
+
+	if (!GameInstance)
+	{
+		return false;
+	}
+
+	bool bFoundAnySlots = false;
+	for (const TPair<FPrimaryAssetId, FRPGItemData>& ItemPair : SaveGame.InventoryData)
+	{
+		URPGItem* LoadedItem = GetItem(ItemPair.Key);
+
+		if (LoadedItem != nullptr)
+		{
+			SetInventoryItemData(LoadedItem, ItemPair.Value);
+		}
+	}
+
+	for (const TPair<FRPGItemSlot, FPrimaryAssetId>& SlotPair : SaveGame.SlottedItems)
+	{
+		if (SlotPair.Value.IsValid())
+		{
+			URPGItem* LoadedItem = GetItem(SlotPair.Value);
+			if (GameInstance->IsValidItemSlot(SlotPair.Key) && LoadedItem)
 			{
-				// We found an empty slot worth filling
-				EmptySlot = Pair.Key;
+				bFoundAnySlots |= SetSlottedItemData(SlotPair.Key, LoadedItem, false);
 			}
 		}
 	}
 
+	return bFoundAnySlots;
+}
+
+bool ARPGPlayerControllerBase::FillEmptySlotWithItem(URPGItem* NewItem)
+{
+	// Look for an empty item slot to fill with this item
+	FPrimaryAssetType NewItemType = NewItem->GetPrimaryAssetId().PrimaryAssetType;
+	if (Inventory.GetItemSlot(NewItem).ItemType == NewItemType)
+	{
+		// Item is already slotted
+		return false;
+	}
+
+	const FRPGItemSlot EmptySlot = Inventory.FindEmptySlot(NewItemType);
 	if (EmptySlot.IsValid())
 	{
-		SlottedItems[EmptySlot] = NewItem;
-		NotifySlottedItemChanged(EmptySlot, NewItem);
-		return true;
+		return SetSlottedItemData(EmptySlot, NewItem);
 	}
 
 	return false;
 }
 
+void ARPGPlayerControllerBase::SetInventoryItemData(URPGItem* Item, const FRPGItemData& ItemData)
+{
+	InventoryData.Add(Item, ItemData);
+	Inventory.SetItem(Item, ItemData);
+	UpdateReplicatedItem(Item);
+}
+
+FRPGItemSlot ARPGPlayerControllerBase::RemoveInventoryItemData(URPGItem* Item)
+{
+	InventoryData.Remove(Item);
+
+	FRPGItemSlot ClearedSlot;
+	Inventory.RemoveItem(Item, &ClearedSlot);
+	if (ClearedSlot.IsValid())
+	{
+		SlottedItems.Add(ClearedSlot, nullptr);
+	}
+	UpdateReplicatedItem(Item);
+	return ClearedSlot;
+}
+
+bool ARPGPlayerControllerBase::SetSlottedItemData(const FRPGItemSlot& ItemSlot, URPGItem* Item, bool bNotify)
+{
+	URPGItem* ReplacedItem = Inventory.GetSlottedItem(ItemSlot);
+	TArray<FRPGItemSlot> ChangedSlots;
+	if (!Inventory.SetSlottedItem(ItemSlot, Item, ChangedSlots))
+	{
+		return false;
+	}
+
+	UpdateReplicatedItem(ReplacedItem);
+	UpdateReplicatedItem(Item);
+
+	for (const FRPGItemSlot& ChangedSlot : ChangedSlots)
+	{
+		URPGItem* SlottedItem = Inventory.GetSlottedItem(ChangedSlot);
+		SlottedItems.Add(ChangedSlot, SlottedItem);
+		if (bNotify)
+		{
+			NotifySlottedItemChanged(ChangedSlot, SlottedItem);
+		}
+	}
+	return true;
+}
+
+void ARPGPlayerControllerBase::ResetInventory(const TMap<FPrimaryAssetType, int32>& SlotsPerType)
+{
+	InventoryData.Reset();
+	SlottedItems.Reset();
+	Inventory.Reset();
+	Inventory.InitSlots(SlotsPerType);
+
+	// The replicated entries are kept until the inventory is rebuilt, so the owning client only gets the entries that differ
+	if (GetLocalRole() == ROLE_Authority)
+	{
+		bRebuildingInventory = true;
+	}
+
+	for (const TPair<FPrimaryAssetType, int32>& Pair : SlotsPerType)
+	{
+		for (int32 SlotNumber = 0; SlotNumber < Pair.Value; SlotNumber++)
+		{
+			SlottedItems.Add(FRPGItemSlot(Pair.Key, SlotNumber), nullptr);
+		}
+	}
+}
+
+void ARPGPlayerControllerBase::ServerSetSlottedItem_Implementation(FRPGItemSlot ItemSlot, URPGItem* Item, int32 PredictionKey)
+{
+	// Clients can only slot items they own
+	if (!Item || InventoryData.Contains(Item))
+	{
+		SetSlottedItem(ItemSlot, Item);
+	}
+	else
+	{
+		UE_LOG(LogActionRPG, Warning, TEXT("ServerSetSlottedItem: Rejected slotting %s, it isn't in the inventory!"), *Item->GetName());
+	}
+
+	AcknowledgedSlotPrediction = PredictionKey;
+}
+
+void ARPGPlayerControllerBase::OnRep_AcknowledgedSlotPrediction()
+{
+	// Arrives with the replicated changes the server made for these predictions, so switching back to the replicated slots doesn't flicker
+	PendingSlotPredictions.RemoveAll([this](const FSlotPrediction& Prediction) { return Prediction.Key <= AcknowledgedSlotPrediction; });
+	ApplyReplicatedSlots();
+}
+
+void ARPGPlayerControllerBase::UpdateReplicatedItem(URPGItem* Item)
+{
+	if (Item && GetLocalRole() == ROLE_Authority && !bRebuildingInventory)
+	{
+		ReplicatedInventory.SetEntry(Item, InventoryData.Find(Item), Inventory.GetItemSlot(Item));
+	}
+}
+
+void ARPGPlayerControllerBase::SyncReplicatedInventory()
+{
+	if (GetLocalRole() != ROLE_Authority)
+	{
+		return;
+	}
+
+	bRebuildingInventory = false;
+
+	TSet<URPGItem*> Items;
+	for (const TPair<URPGItem*, FRPGItemData>& ItemPair : InventoryData)
+	{
+		Items.Add(ItemPair.Key);
+	}
+	Inventory.ForEachSlot([&Items](const FRPGItemSlot& ItemSlot, URPGItem* SlottedItem)
+	{
+		if (SlottedItem)
+		{
+			Items.Add(SlottedItem);
+		}
+	});
+
+	ReplicatedInventory.RemoveEntries([&Items](const FRPGReplicatedInventoryEntry& Entry) { return !Items.Contains(Entry.Item); });
+	for (URPGItem* Item : Items)
+	{
+		UpdateReplicatedItem(Item);
+	}
+}
+
+void ARPGPlayerControllerBase::HandleReplicatedInventoryEntryChanged(const FRPGReplicatedInventoryEntry& Entry, bool bRemoved)
+{
+	if (!Entry.Item || GetLocalRole() == ROLE_Authority)
+	{
+		return;
+	}
+
+	const bool bOwned = !bRemoved && Entry.ItemData.IsValid();
+	const FRPGItemData* OldData = InventoryData.Find(Entry.Item);
+	if (bOwned && (!OldData || *OldData != Entry.ItemData))
+	{
+		SetInventoryItemData(Entry.Item, Entry.ItemData);
+		NotifyInventoryItemChanged(true, Entry.Item);
+	}
+	else if (!bOwned && OldData)
+	{
+		const FRPGItemSlot ClearedSlot = RemoveInventoryItemData(Entry.Item);
+		if (ClearedSlot.IsValid())
+		{
+			NotifySlottedItemChanged(ClearedSlot, nullptr);
+		}
+		NotifyInventoryItemChanged(false, Entry.Item);
+	}
+}
+
+void ARPGPlayerControllerBase::HandleReplicatedInventoryReceived()
+{
+	// Slots are applied once per update rather than per entry, the removed entries are gone by now
+	if (GetLocalRole() != ROLE_Authority)
+	{
+		ApplyReplicatedSlots();
+	}
+}
+
+void ARPGPlayerControllerBase::ApplyReplicatedSlots()
+{
+	TMap<FRPGItemSlot, URPGItem*> TargetSlots;
+	for (const FRPGReplicatedInventoryEntry& Entry : ReplicatedInventory.GetEntries())
+	{
+		if (Entry.Item && Entry.ItemSlot.IsValid())
+		{
+			TargetSlots.Add(Entry.ItemSlot, Entry.Item);
+		}
+	}
+
+	// Replay the predictions in order, each one takes its item out of any other slot like SetSlottedItem does
+	for (const FSlotPrediction& Prediction : PendingSlotPredictions)
+	{
+		if (Prediction.Item)
+		{
+			for (TPair<FRPGItemSlot, URPGItem*>& Pair : TargetSlots)
+			{
+				if (Pair.Value == Prediction.Item)
+				{
+					Pair.Value = nullptr;
+				}
+			}
+		}
+		TargetSlots.Add(Prediction.ItemSlot, Prediction.Item);
+	}
+
+	// Empty the slots that are wrong first, so moving an item doesn't take it out of a slot that was already fixed
+	TArray<TPair<FRPGItemSlot, URPGItem*>> SlotsToFill;
+	Inventory.ForEachSlot([&](const FRPGItemSlot& ItemSlot, URPGItem* SlottedItem)
+	{
+		URPGItem* TargetItem = TargetSlots.FindRef(ItemSlot);
+		if (SlottedItem != TargetItem)
+		{
+			SlotsToFill.Emplace(ItemSlot, TargetItem);
+		}
+	});
+
+	for (const TPair<FRPGItemSlot, URPGItem*>& Pair : SlotsToFill)
+	{
+		if (Inventory.GetSlottedItem(Pair.Key))
+		{
+			SetSlottedItemData(Pair.Key, nullptr);
+		}
+	}
+
+	for (const TPair<FRPGItemSlot, URPGItem*>& Pair : SlotsToFill)
+	{
+		if (Pair.Value)
+		{
+			SetSlottedItemData(Pair.Key, Pair.Value);
+		}
+	}
+}
+
 void ARPGPlayerControllerBase::NotifyInventoryItemChanged(bool bAdded, URPGItem* Item)
 {
+	// All inventory changes are notified, so remember what to write on the next save
+	DirtyItems.Add(Item);
+
 	// Notify native before blueprint
 	OnInventoryItemChangedNative.Broadcast(bAdded, Item);
 	OnInventoryItemChanged.Broadcast(bAdded, Item);
@@ -378,6 +821,8 @@ void ARPGPlayerControllerBase::NotifyInventoryItemChanged(bool bAdded, URPGItem*
 
 void ARPGPlayerControllerBase::NotifySlottedItemChanged(FRPGItemSlot ItemSlot, URPGItem* Item)
 {
+	DirtySlots.Add(ItemSlot);
+
 	// Notify native before blueprint
 	OnSlottedItemChangedNative.Broadcast(ItemSlot, Item);
 	OnSlottedItemChanged.Broadcast(ItemSlot, Item);
@@ -398,10 +843,41 @@ void ARPGPlayerControllerBase::HandleSaveGameLoaded(URPGSaveGame* NewSaveGame)
 	LoadInventory();
 }
 
+void ARPGPlayerControllerBase::PostInitializeComponents()
+{
+	Super::PostInitializeComponents();
+
+	// Bound here rather than in the constructor, so it isn't copied from the class default object. Replicated entries can arrive before BeginPlay
+	ReplicatedInventory.OnEntryChanged.BindUObject(this, &ARPGPlayerControllerBase::HandleReplicatedInventoryEntryChanged);
+	ReplicatedInventory.OnReceived.BindUObject(this, &ARPGPlayerControllerBase::HandleReplicatedInventoryReceived);
+}
+
+void ARPGPlayerControllerBase::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME_CONDITION(ARPGPlayerControllerBase, ReplicatedInventory, COND_OwnerOnly);
+	DOREPLIFETIME_CONDITION(ARPGPlayerControllerBase, AcknowledgedSlotPrediction, COND_OwnerOnly);
+}
+
 void ARPGPlayerControllerBase::BeginPlay()
 {
 	// Load inventory off save game before starting play
 	LoadInventory();
 
 	Super::BeginPlay();
+}
+
+void ARPGPlayerControllerBase::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (InventoryLoadHandle.IsValid())
+	{
+		InventoryLoadHandle->CancelHandle();
+		InventoryLoadHandle.Reset();
+	}
+
+	// Don't lose changes that are still waiting for the save timer
+	FlushInventorySave();
+
+	Super::EndPlay(EndPlayReason);
 }
\ No newline at end of file
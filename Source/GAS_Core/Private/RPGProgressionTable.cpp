@@ -0,0 +1,119 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "RPGProgressionTable.h"
+#include "Engine/CurveTable.h"
+
+bool FRPGProgressionTable::Bake(const UCurveTable& CurveTable)
+{
+	TableName = CurveTable.GetFName();
+	RowNames.Reset();
+	RowIndices.Reset();
+	Values.Reset();
+	MaxLevel = 0;
+
+	// Keys are only imported for cells that have a value, so gather them first
+	TArray<TArray<TPair<float, float>>> RowKeys;
+	for (const TPair<FName, FRealCurve*>& Row : CurveTable.GetRowMap())
+	{
+		TArray<TPair<float, float>> Keys;
+		if (Row.Value)
+		{
+			for (auto KeyIt = Row.Value->GetKeyHandleIterator(); KeyIt; ++KeyIt)
+			{
+				Keys.Add(Row.Value->GetKeyTimeValuePair(*KeyIt));
+			}
+		}
+
+		if (Keys.Num() == 0)
+		{
+			UE_LOG(LogActionRPG, Warning, TEXT("Progression table %s: row %s has no values, skipping it"), *TableName.ToString(), *Row.Key.ToString());
+			continue;
+		}
+
+		Keys.Sort([](const TPair<float, float>& A, const TPair<float, float>& B) { return A.Key < B.Key; });
+		MaxLevel = FMath::Max(MaxLevel, FMath::RoundToInt(Keys.Last().Key));
+
+		RowIndices.Add(Row.Key, RowNames.Add(Row.Key));
+		RowKeys.Add(MoveTemp(Keys));
+	}
+
+	if (RowNames.Num() == 0 || MaxLevel < 1)
+	{
+		UE_LOG(LogActionRPG, Warning, TEXT("Progression table %s has no values"), *TableName.ToString());
+		RowNames.Reset();
+		RowIndices.Reset();
+		MaxLevel = 0;
+		return false;
+	}
+
+	const int32 NumRows = RowNames.Num();
+	Values.SetNumZeroed(NumRows * MaxLevel);
+
+	for (int32 RowIndex = 0; RowIndex < NumRows; RowIndex++)
+	{
+		const TArray<TPair<float, float>>& Keys = RowKeys[RowIndex];
+		TArray<int32> MissingLevels;
+
+		int32 NextKeyIndex = 0;
+		for (int32 Level = 1; Level <= MaxLevel; Level++)
+		{
+			while (NextKeyIndex < Keys.Num() && Keys[NextKeyIndex].Key < Level - KINDA_SMALL_NUMBER)
+			{
+				NextKeyIndex++;
+			}
+
+			float Value;
+			if (NextKeyIndex < Keys.Num() && FMath::IsNearlyEqual(Keys[NextKeyIndex].Key, (float)Level))
+			{
+				Value = Keys[NextKeyIndex].Value;
+			}
+			else
+			{
+				MissingLevels.Add(Level);
+
+				if (NextKeyIndex == 0)
+				{
+					Value = Keys[0].Value;
+				}
+				else if (NextKeyIndex == Keys.Num())
+				{
+					Value = Keys.Last().Value;
+				}
+				else
+				{
+					const TPair<float, float>& PrevKey = Keys[NextKeyIndex - 1];
+					const TPair<float, float>& NextKey = Keys[NextKeyIndex];
+					Value = FMath::Lerp(PrevKey.Value, NextKey.Value, (Level - PrevKey.Key) / (NextKey.Key - PrevKey.Key));
+				}
+			}
+
+			Values[(Level - 1) * NumRows + RowIndex] = Value;
+		}
+
+		if (MissingLevels.Num() > 0)
+		{
+			const FString MissingLevelsString = FString::JoinBy(MissingLevels, TEXT(", "), [](int32 Level) { return FString::FromInt(Level); });
+			UE_LOG(LogActionRPG, Warning, TEXT("Progression table %s: row %s has no value for levels %s, using the nearest values"), *TableName.ToString(), *RowNames[RowIndex].ToString(), *MissingLevelsString);
+		}
+	}
+
+	UE_LOG(LogActionRPG, Log, TEXT("Baked progression table %s: %d rows, levels 1-%d"), *TableName.ToString(), NumRows, MaxLevel);
+	return true;
+}
+
+float FRPGProgressionTable::GetValue(int32 RowIndex, float Level) const
+{
+	if (!RowNames.IsValidIndex(RowIndex))
+	{
+		return 0.0f;
+	}
+
+	const float ClampedLevel = FMath::Clamp(Level, 1.0f, (float)MaxLevel);
+	const int32 LowerLevel = FMath::FloorToInt(ClampedLevel);
+	const int32 UpperLevel = FMath::Min(LowerLevel + 1, MaxLevel);
+
+	const int32 NumRows = RowNames.Num();
+	const float LowerValue = Values[(LowerLevel - 1) * NumRows + RowIndex];
+	const float UpperValue = Values[(UpperLevel - 1) * NumRows + RowIndex];
+	return FMath::Lerp(LowerValue, UpperValue, ClampedLevel - LowerLevel);
+}
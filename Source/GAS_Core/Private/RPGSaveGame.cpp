@@ -2,12 +2,128 @@
 
 #include "RPGSaveGame.h"
 #include "RPGGameInstanceBase.h"
+#include "Misc/Crc.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+namespace RPGSaveGameFormat
+{
+	/** "RPGS" and "RPGL" */
+	const uint32 SnapshotMagic = 0x53475052;
+	const uint32 LogMagic = 0x4C475052;
+
+	/** Version of the chunked format itself, the data inside is versioned by SavedDataVersion */
+	const uint32 FormatVersion = 1;
+
+	enum class ESection : uint32
+	{
+		InventoryData = 1,
+		SlottedItems = 2,
+		UserId = 3,
+	};
+
+	enum class EChange : uint8
+	{
+		SetItem,
+		RemoveItem,
+		SetSlot,
+		RemoveSlot,
+		SetUserId,
+	};
+
+	void SerializeAssetId(FArchive& Ar, FPrimaryAssetId& AssetId)
+	{
+		FName TypeName = AssetId.PrimaryAssetType.GetName();
+		Ar << TypeName << AssetId.PrimaryAssetName;
+		if (Ar.IsLoading())
+		{
+			AssetId.PrimaryAssetType = TypeName;
+		}
+	}
+
+	void SerializeItemSlot(FArchive& Ar, FRPGItemSlot& ItemSlot)
+	{
+		FName TypeName = ItemSlot.ItemType.GetName();
+		Ar << TypeName << ItemSlot.SlotNumber;
+		if (Ar.IsLoading())
+		{
+			ItemSlot.ItemType = TypeName;
+		}
+	}
+
+	void SerializeItemData(FArchive& Ar, FRPGItemData& ItemData)
+	{
+		Ar << ItemData.ItemCount << ItemData.ItemLevel;
+	}
+
+	template<typename KeyType, typename ValueType>
+	void SerializeMap(FArchive& Ar, TMap<KeyType, ValueType>& Map, void (*SerializeKey)(FArchive&, KeyType&), void (*SerializeValue)(FArchive&, ValueType&))
+	{
+		int32 Num = Map.Num();
+		Ar << Num;
+
+		if (Ar.IsLoading())
+		{
+			Map.Reset();
+			for (int32 Index = 0; Index < Num && !Ar.IsError(); Index++)
+			{
+				KeyType Key;
+				ValueType Value;
+				SerializeKey(Ar, Key);
+				SerializeValue(Ar, Value);
+				Map.Add(Key, Value);
+			}
+		}
+		else
+		{
+			for (TPair<KeyType, ValueType>& Pair : Map)
+			{
+				SerializeKey(Ar, Pair.Key);
+				SerializeValue(Ar, Pair.Value);
+			}
+		}
+	}
+
+	/** Writes a block of tag, size, checksum and data */
+	void WriteChecksummedBlock(FArchive& Ar, uint32 Tag, TArray<uint8>& Data)
+	{
+		int32 Size = Data.Num();
+		uint32 Checksum = FCrc::MemCrc32(Data.GetData(), Data.Num());
+		Ar << Tag << Size << Checksum;
+		Ar.Serialize(Data.GetData(), Data.Num());
+	}
+
+	/** Reads a block written by WriteChecksummedBlock, returns false if it is truncated or the checksum doesn't match */
+	bool ReadChecksummedBlock(FMemoryReader& Ar, uint32& OutTag, TArray<uint8>& OutData)
+	{
+		int32 Size = 0;
+		uint32 Checksum = 0;
+		Ar << OutTag << Size << Checksum;
+
+		if (Ar.IsError() || Size < 0 || Ar.Tell() + Size > Ar.TotalSize())
+		{
+			return false;
+		}
+
+		OutData.SetNumUninitialized(Size);
+		Ar.Serialize(OutData.GetData(), Size);
+		return !Ar.IsError() && FCrc::MemCrc32(OutData.GetData(), OutData.Num()) == Checksum;
+	}
+}
 
 void URPGSaveGame::Serialize(FArchive& Ar)
 {
 	Super::Serialize(Ar);
 
-	if (Ar.IsLoading() && SavedDataVersion != ERPGSaveGameVersion::LatestVersion)
+	if (Ar.IsLoading())
+	{
+		ApplyVersionFixups();
+	}
+}
+
+void URPGSaveGame::ApplyVersionFixups()
+{
+	if (SavedDataVersion != ERPGSaveGameVersion::LatestVersion)
 	{
 		if (SavedDataVersion < ERPGSaveGameVersion::AddedItemData)
 		{
@@ -19,7 +135,272 @@ void URPGSaveGame::Serialize(FArchive& Ar)
 
 			InventoryItems_DEPRECATED.Empty();
 		}
-		
+
 		SavedDataVersion = ERPGSaveGameVersion::LatestVersion;
 	}
-}
\ No newline at end of file
+}
+
+void URPGSaveGame::SetWrittenState()
+{
+	WrittenInventoryData = InventoryData;
+	WrittenSlottedItems = SlottedItems;
+	WrittenUserId = UserId;
+	bHasWrittenState = true;
+}
+
+void URPGSaveGame::WriteSnapshot(const FGuid& SaveId, TArray<uint8>& OutBytes)
+{
+	using namespace RPGSaveGameFormat;
+
+	OutBytes.Reset();
+	FMemoryWriter Writer(OutBytes);
+
+	uint32 Magic = SnapshotMagic;
+	uint32 Version = FormatVersion;
+	int32 DataVersion = SavedDataVersion;
+	FGuid Id = SaveId;
+	int32 NumSections = 3;
+	Writer << Magic << Version << DataVersion << Id << NumSections;
+
+	TArray<uint8> SectionBytes;
+	{
+		FMemoryWriter SectionWriter(SectionBytes);
+		SerializeMap(SectionWriter, InventoryData, &SerializeAssetId, &SerializeItemData);
+		WriteChecksummedBlock(Writer, (uint32)ESection::InventoryData, SectionBytes);
+	}
+	SectionBytes.Reset();
+	{
+		FMemoryWriter SectionWriter(SectionBytes);
+		SerializeMap(SectionWriter, SlottedItems, &SerializeItemSlot, &SerializeAssetId);
+		WriteChecksummedBlock(Writer, (uint32)ESection::SlottedItems, SectionBytes);
+	}
+	SectionBytes.Reset();
+	{
+		FMemoryWriter SectionWriter(SectionBytes);
+		SectionWriter << UserId;
+		WriteChecksummedBlock(Writer, (uint32)ESection::UserId, SectionBytes);
+	}
+
+	SetWrittenState();
+}
+
+bool URPGSaveGame::WriteChanges(const FGuid& SaveId, TArray<uint8>& OutBytes)
+{
+	using namespace RPGSaveGameFormat;
+
+	if (!ensure(bHasWrittenState))
+	{
+		return false;
+	}
+
+	TArray<uint8> ChangeBytes;
+	FMemoryWriter ChangeWriter(ChangeBytes);
+	int32 NumChanges = 0;
+
+	const auto WriteChangeType = [&](EChange Type)
+	{
+		uint8 TypeValue = (uint8)Type;
+		ChangeWriter << TypeValue;
+		NumChanges++;
+	};
+
+	for (TPair<FPrimaryAssetId, FRPGItemData>& Pair : InventoryData)
+	{
+		const FRPGItemData* WrittenData = WrittenInventoryData.Find(Pair.Key);
+		if (!WrittenData || *WrittenData != Pair.Value)
+		{
+			FPrimaryAssetId AssetId = Pair.Key;
+			WriteChangeType(EChange::SetItem);
+			SerializeAssetId(ChangeWriter, AssetId);
+			SerializeItemData(ChangeWriter, Pair.Value);
+		}
+	}
+
+	for (const TPair<FPrimaryAssetId, FRPGItemData>& Pair : WrittenInventoryData)
+	{
+		if (!InventoryData.Contains(Pair.Key))
+		{
+			FPrimaryAssetId AssetId = Pair.Key;
+			WriteChangeType(EChange::RemoveItem);
+			SerializeAssetId(ChangeWriter, AssetId);
+		}
+	}
+
+	for (TPair<FRPGItemSlot, FPrimaryAssetId>& Pair : SlottedItems)
+	{
+		const FPrimaryAssetId* WrittenAssetId = WrittenSlottedItems.Find(Pair.Key);
+		if (!WrittenAssetId || *WrittenAssetId != Pair.Value)
+		{
+			FRPGItemSlot ItemSlot = Pair.Key;
+			WriteChangeType(EChange::SetSlot);
+			SerializeItemSlot(ChangeWriter, ItemSlot);
+			SerializeAssetId(ChangeWriter, Pair.Value);
+		}
+	}
+
+	for (const TPair<FRPGItemSlot, FPrimaryAssetId>& Pair : WrittenSlottedItems)
+	{
+		if (!SlottedItems.Contains(Pair.Key))
+		{
+			FRPGItemSlot ItemSlot = Pair.Key;
+			WriteChangeType(EChange::RemoveSlot);
+			SerializeItemSlot(ChangeWriter, ItemSlot);
+		}
+	}
+
+	if (UserId != WrittenUserId)
+	{
+		WriteChangeType(EChange::SetUserId);
+		ChangeWriter << UserId;
+	}
+
+	if (NumChanges == 0)
+	{
+		return false;
+	}
+
+	// The save id comes first so blocks left over from before a compaction are skipped
+	OutBytes.Reset();
+	FMemoryWriter Writer(OutBytes);
+	uint32 Magic = LogMagic;
+	FGuid Id = SaveId;
+	Writer << Magic << Id << NumChanges;
+	WriteChecksummedBlock(Writer, 0, ChangeBytes);
+
+	SetWrittenState();
+	return true;
+}
+
+bool URPGSaveGame::ReadSnapshot(const TArray<uint8>& Bytes, FGuid& OutSaveId)
+{
+	using namespace RPGSaveGameFormat;
+
+	FMemoryReader Reader(Bytes);
+	uint32 Magic = 0;
+	uint32 Version = 0;
+	int32 DataVersion = 0;
+	int32 NumSections = 0;
+	Reader << Magic << Version << DataVersion << OutSaveId << NumSections;
+
+	if (Reader.IsError() || Magic != SnapshotMagic || Version > FormatVersion)
+	{
+		UE_LOG(LogActionRPG, Warning, TEXT("ReadSnapshot: Unknown save game format"));
+		return false;
+	}
+
+	for (int32 SectionIndex = 0; SectionIndex < NumSections; SectionIndex++)
+	{
+		uint32 Tag = 0;
+		TArray<uint8> SectionBytes;
+		if (!ReadChecksummedBlock(Reader, Tag, SectionBytes))
+		{
+			UE_LOG(LogActionRPG, Warning, TEXT("ReadSnapshot: Section %d is corrupt"), SectionIndex);
+			return false;
+		}
+
+		// Unknown sections are from a newer build and are skipped
+		FMemoryReader SectionReader(SectionBytes);
+		switch ((ESection)Tag)
+		{
+		case ESection::InventoryData:
+			SerializeMap(SectionReader, InventoryData, &SerializeAssetId, &SerializeItemData);
+			break;
+		case ESection::SlottedItems:
+			SerializeMap(SectionReader, SlottedItems, &SerializeItemSlot, &SerializeAssetId);
+			break;
+		case ESection::UserId:
+			SectionReader << UserId;
+			break;
+		}
+
+		if (SectionReader.IsError())
+		{
+			UE_LOG(LogActionRPG, Warning, TEXT("ReadSnapshot: Section %d could not be read"), SectionIndex);
+			return false;
+		}
+	}
+
+	// Same fixups as when loading through Serialize
+	SavedDataVersion = DataVersion;
+	ApplyVersionFixups();
+
+	SetWrittenState();
+	return true;
+}
+
+bool URPGSaveGame::ApplyChangeLog(const TArray<uint8>& Bytes, const FGuid& SaveId)
+{
+	using namespace RPGSaveGameFormat;
+
+	FMemoryReader Reader(Bytes);
+	bool bValid = true;
+
+	while (Reader.Tell() < Reader.TotalSize())
+	{
+		uint32 Magic = 0;
+		FGuid BlockSaveId;
+		int32 NumChanges = 0;
+		uint32 Tag = 0;
+		TArray<uint8> ChangeBytes;
+		Reader << Magic << BlockSaveId << NumChanges;
+
+		if (Reader.IsError() || Magic != LogMagic || !ReadChecksummedBlock(Reader, Tag, ChangeBytes))
+		{
+			// Usually the end of a write that was interrupted, everything before it is still good
+			bValid = false;
+			break;
+		}
+
+		if (BlockSaveId != SaveId)
+		{
+			continue;
+		}
+
+		FMemoryReader ChangeReader(ChangeBytes);
+		for (int32 ChangeIndex = 0; ChangeIndex < NumChanges && !ChangeReader.IsError(); ChangeIndex++)
+		{
+			uint8 TypeValue = 0;
+			FPrimaryAssetId AssetId;
+			FRPGItemSlot ItemSlot;
+			FRPGItemData ItemData;
+			ChangeReader << TypeValue;
+
+			switch ((EChange)TypeValue)
+			{
+			case EChange::SetItem:
+				SerializeAssetId(ChangeReader, AssetId);
+				SerializeItemData(ChangeReader, ItemData);
+				InventoryData.Add(AssetId, ItemData);
+				break;
+			case EChange::RemoveItem:
+				SerializeAssetId(ChangeReader, AssetId);
+				InventoryData.Remove(AssetId);
+				break;
+			case EChange::SetSlot:
+				SerializeItemSlot(ChangeReader, ItemSlot);
+				SerializeAssetId(ChangeReader, AssetId);
+				SlottedItems.Add(ItemSlot, AssetId);
+				break;
+			case EChange::RemoveSlot:
+				SerializeItemSlot(ChangeReader, ItemSlot);
+				SlottedItems.Remove(ItemSlot);
+				break;
+			case EChange::SetUserId:
+				ChangeReader << UserId;
+				break;
+			default:
+				ChangeReader.SetError();
+				break;
+			}
+		}
+
+		if (ChangeReader.IsError())
+		{
+			bValid = false;
+			break;
+		}
+	}
+
+	SetWrittenState();
+	return bValid;
+}
@@ -37,6 +37,10 @@ public:
 	/** List of gameplay effects to apply to the targets */
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = GameplayEffectContainer)
 	TArray<TSubclassOf<UGameplayEffect>> TargetGameplayEffectClasses;
+
+	/** Optional row of the progression tables, e.g. DefaultAttack. Its value at the effect level is added to the Damage of damage executions */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = GameplayEffectContainer)
+	FName BaseDamageRow;
 };
 
 /** A "processed" version of RPGGameplayEffectContainer that can be passed around and eventually applied */
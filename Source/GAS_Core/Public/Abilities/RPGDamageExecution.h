@@ -3,9 +3,12 @@
 #pragma once
 
 #include "GAS_Core.h"
+#include "GameplayEffect.h"
 #include "GameplayEffectExecutionCalculation.h"
 #include "RPGDamageExecution.generated.h"
 
+struct FGameplayAbilityTargetDataHandle;
+
 /**
  * A damage execution, which allows doing damage by combining a raw Damage number with AttackPower and DefensePower
  * Most games will want to implement multiple game-specific executions
@@ -20,4 +23,39 @@ public:
 	URPGDamageExecution();
 	virtual void Execute_Implementation(const FGameplayEffectCustomExecutionParameters& ExecutionParams, OUT FGameplayEffectCustomExecutionOutput& OutExecutionOutput) const override;
 
+	/** Set by caller name of base damage added to the captured Damage, usually looked up in the baked progression tables by FRPGGameplayEffectContainer::BaseDamageRow */
+	static const FName BaseDamageDataName;
+
+	/** Damage Done = Damage * AttackPower / DefensePower. If DefensePower is 0, it is treated as 1.0 */
+	static float CalculateDamageDone(float Damage, float AttackPower, float DefensePower)
+	{
+		return Damage * AttackPower / (DefensePower == 0.0f ? 1.0f : DefensePower);
+	}
+
+	/**
+	 * Returns true if all the effect does is run this execution, so ApplyBatchedDamage gives the same result as applying it normally.
+	 * Scoped modifiers of the execution can't be on target attributes or require tags, as they are captured once for all targets.
+	 */
+	static bool CanBatchDamage(const UGameplayEffect& Effect, float Level);
+
+	/**
+	 * Applies a damage effect to every target at once, for area of effect abilities.
+	 * Source attributes are captured once, then evaluated with the tags of each target together with its DefensePower,
+	 * and each damaged target gets one URPGBatchedDamageEffect with its damage and the cues of the effect instead of running this execution.
+	 * Only runs on the server. Returns false without applying anything if the effect can't be batched.
+	 */
+	static bool ApplyBatchedDamage(const FGameplayEffectSpec& Spec, const FGameplayAbilityTargetDataHandle& TargetData, TArray<FActiveGameplayEffectHandle>& OutEffects);
+};
+
+/** Instant effect that adds already computed damage, passed as set by caller magnitude DamageDataName. Used by URPGDamageExecution::ApplyBatchedDamage */
+UCLASS()
+class GAS_CORE_API URPGBatchedDamageEffect : public UGameplayEffect
+{
+	GENERATED_BODY()
+
+public:
+	URPGBatchedDamageEffect();
+
+	/** Set by caller name of the damage to apply */
+	static const FName DamageDataName;
 };
\ No newline at end of file
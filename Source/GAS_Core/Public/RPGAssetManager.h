@@ -4,16 +4,32 @@
 
 #include "GAS_Core.h"
 #include "Engine/AssetManager.h"
+#include "RPGProgressionTable.h"
 #include "RPGAssetManager.generated.h"
 
 class URPGItem;
+class UCurveTable;
+struct FStreamableHandle;
+
+/** Load time and resident memory of the preloaded assets of one primary asset type */
+struct FRPGPreloadTypeStats
+{
+	/** Number of assets of this type loaded by preloading so far */
+	int32 NumLoaded = 0;
+
+	/** Total time from requesting to finishing their loads */
+	double LoadSeconds = 0.0;
+
+	/** Estimated memory of the packages they brought in that are still held by preloading, including the loaded packages they depend on. Packages shared with assets of other types are counted for the type that loaded them first */
+	int64 ResidentBytes = 0;
+};
 
 /**
  * Game implementation of asset manager, overrides functionality and stores game-specific types
  * It is expected that most games will want to override AssetManager as it provides a good place for game-specific loading logic
  * This is used by setting AssetManagerClassName in DefaultEngine.ini
  */
-UCLASS()
+UCLASS(Config = Game)
 class GAS_CORE_API URPGAssetManager : public UAssetManager
 {
 	GENERATED_BODY()
@@ -29,6 +45,10 @@ public:
 	static const FPrimaryAssetType	TokenItemType;
 	static const FPrimaryAssetType	WeaponItemType;
 
+	/** Asset bundles of items, tag soft references with meta = (AssetBundles = "UI") or "Gameplay" so they load with the item */
+	static const FName	UIBundle;
+	static const FName	GameplayBundle;
+
 	/** Returns the current AssetManager object */
 	static URPGAssetManager& Get();
 
@@ -40,5 +60,141 @@ public:
 	 * @param bDisplayWarning If true, this will log a warning if the item failed to load
 	 */
 	URPGItem* ForceLoadItem(const FPrimaryAssetId& PrimaryAssetId, bool bLogWarning = true);
+
+	/** Curve tables with per-level values, like the ones imported from DataFiles. They are baked during initial loading */
+	UPROPERTY(Config)
+	TArray<TSoftObjectPtr<UCurveTable>> ProgressionTables;
+
+	/** Returns the value of a row of the baked progression tables at the level, or DefaultValue if no table has the row */
+	float GetProgressionValue(FName RowName, float Level, float DefaultValue = 0.0f) const;
+
+	/** Returns the baked progression table that has the row and the index of the row in it, or null */
+	const FRPGProgressionTable* FindProgressionRow(FName RowName, int32& OutRowIndex) const;
+
+	/** Type name that enemy classes are reported under in the preload stats */
+	static const FName	EnemyClassPreloadType;
+
+	/**
+	 * Streams in items and enemy classes one at a time, slotted items first, then the rest of the inventory, then enemies.
+	 * Abilities and gameplay effects come with them as they are referenced by the items and classes.
+	 * This replaces the previous preload set. Assets that aren't in the new set stay loaded until the memory budget (RPG.PreloadBudgetMB) is exceeded,
+	 * then they are released, lowest priority first. Once nothing is left to release, the remaining assets are not preloaded.
+	 */
+	void PreloadAssets(const TArray<FPrimaryAssetId>& SlottedItemIds, const TArray<FPrimaryAssetId>& InventoryItemIds, const TArray<FSoftObjectPath>& EnemyClassPaths);
+
+	/** Returns true if preloading is still streaming assets in */
+	bool IsPreloading() const;
+
+	/** Returns load time and resident memory of preloaded assets, per primary asset type */
+	const TMap<FName, FRPGPreloadTypeStats>& GetPreloadStats() const
+	{
+		return PreloadStats;
+	}
+
+	/** Logs the preload stats */
+	void LogPreloadReport() const;
+
+protected:
+	/** Loads and bakes ProgressionTables */
+	void BakeProgressionTables();
+
+	TArray<FRPGProgressionTable> BakedProgressionTables;
+
+	/** Row name to index of the baked table that has it */
+	TMap<FName, int32> ProgressionRowTables;
+
+	/** Priority of a preloaded asset, lower loads first */
+	enum class EPreloadPriority : uint8
+	{
+		SlottedItem,
+		InventoryItem,
+		EnemyClass,
+	};
+
+	struct FPreloadEntry
+	{
+		/** Set for items */
+		FPrimaryAssetId PrimaryAssetId;
+
+		/** Set for enemy classes */
+		FSoftObjectPath ClassPath;
+
+		EPreloadPriority Priority = EPreloadPriority::EnemyClass;
+
+		/** The finished load. Enemy classes stay loaded while it's held, items are kept loaded by their primary asset bundle state */
+		TSharedPtr<FStreamableHandle> Handle;
+
+		double LoadStartTime = 0.0;
+
+		/** Packages of the loaded assets, each holding a reference in PreloadedPackages */
+		TArray<FName> Packages;
+		bool bLoaded = false;
+
+		FName GetStatsType() const;
+		bool IsSameAsset(const FPreloadEntry& Other) const
+		{
+			return PrimaryAssetId == Other.PrimaryAssetId && ClassPath == Other.ClassPath;
+		}
+	};
+
+	/** Starts loading the next entry that isn't loaded yet, releasing unreferenced entries if over budget */
+	void StartNextPreload();
+
+	/** Called when the entry at PreloadIndex finished loading */
+	void HandlePreloadLoaded();
+	void FinishPreload(FPreloadEntry& Entry, const TSharedPtr<FStreamableHandle>& LoadHandle);
+
+	/** Releases unreferenced entries, lowest priority first, until under the memory budget. Returns false if still over budget */
+	bool EnforcePreloadBudget();
+
+	/** Returns the bundles to load items with */
+	TArray<FName> GetPreloadBundles() const;
+
+	/** The current preload set, sorted by priority */
+	TArray<FPreloadEntry> PreloadEntries;
+
+	/** Entries loaded for a previous preload set, sorted by priority */
+	TArray<FPreloadEntry> UnreferencedPreloadEntries;
+
+	/** Index in PreloadEntries of the entry being loaded, or the next one to load */
+	int32 PreloadIndex = 0;
+
+	/** Handle of the entry being loaded */
+	TSharedPtr<FStreamableHandle> CurrentPreloadHandle;
+
+	/** A preload set requested while another entry was still loading, applied once it finishes */
+	TOptional<TArray<FPreloadEntry>> PendingPreloadEntries;
+
+	/** A loaded package counted in the resident memory of preloading */
+	struct FPreloadedPackage
+	{
+		/** Number of entries and other preloaded packages depending on it */
+		int32 RefCount = 0;
+		int64 ResidentBytes = 0;
+
+		/** Type of the entry that first loaded it, its memory is counted in the stats of that type */
+		FName StatsType;
+
+		/** Hard dependencies this package holds a reference to */
+		TArray<FName> Dependencies;
+	};
+
+	/** Every package counted in PreloadResidentBytes, so packages shared by several entries are only counted once */
+	TMap<FName, FPreloadedPackage> PreloadedPackages;
+
+	/**
+	 * Adds a reference to a package, counting it and its loaded hard dependencies the first time it is referenced.
+	 * Returns false if the package isn't counted: script and engine packages are always resident, and packages that aren't loaded aren't using memory
+	 */
+	bool AddPreloadedPackageReference(FName PackageName, FName StatsType);
+
+	/** Removes a reference to a package, releasing its dependencies once nothing references it anymore */
+	void ReleasePreloadedPackageReference(FName PackageName);
+
+	int64 PreloadResidentBytes = 0;
+	TMap<FName, FRPGPreloadTypeStats> PreloadStats;
+
+	/** Replaces the preload set, keeping what's already loaded */
+	void SetPreloadEntries(TArray<FPreloadEntry>&& NewEntries);
 };
 
@@ -14,6 +14,55 @@
 
 class URPGGameplayAbility;
 class UGameplayEffect;
+class ARPGCharacterBase;
+
+/** An attribute whose base value comes from a row of the baked progression tables, by character level */
+USTRUCT(BlueprintType)
+struct GAS_CORE_API FRPGProgressionAttribute
+{
+	GENERATED_BODY()
+
+	/** Attribute to set */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Abilities)
+	FGameplayAttribute Attribute;
+
+	/** Row in the progression tables of URPGAssetManager, e.g. PlayerMaxHealth */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Abilities)
+	FName RowName;
+};
+
+/** A single hit of damage taken by a character, kept when damage is aggregated */
+USTRUCT(BlueprintType)
+struct GAS_CORE_API FRPGDamageHit
+{
+	GENERATED_BODY()
+
+	FRPGDamageHit()
+		: DamageAmount(0.0f)
+		, InstigatorCharacter(nullptr)
+		, DamageCauser(nullptr)
+	{}
+
+	/** Amount of damage done by this hit */
+	UPROPERTY(BlueprintReadOnly, Category = Damage)
+	float DamageAmount;
+
+	/** Hit result of this hit */
+	UPROPERTY(BlueprintReadOnly, Category = Damage)
+	FHitResult HitInfo;
+
+	/** Tags of the effect that did the damage */
+	UPROPERTY(BlueprintReadOnly, Category = Damage)
+	FGameplayTagContainer DamageTags;
+
+	/** Character that initiated this damage */
+	UPROPERTY(BlueprintReadOnly, Category = Damage)
+	ARPGCharacterBase* InstigatorCharacter;
+
+	/** The actual actor that did the damage, might be a weapon or projectile */
+	UPROPERTY(BlueprintReadOnly, Category = Damage)
+	AActor* DamageCauser;
+};
 
 /** Base class for Character, Designed to be blueprinted */
 UCLASS()
@@ -92,6 +141,14 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Abilities")
 	bool GetCooldownRemainingForTag(FGameplayTagContainer CooldownTags, float& TimeRemaining, float& CooldownDuration);
 
+	/** While OnDamaged is called for aggregated damage, returns the hits it was made of. Only filled if bRecordAggregatedDamageHits is set. Instigators and causers destroyed since the hit are null */
+	UFUNCTION(BlueprintCallable, Category = "Damage")
+	void GetAggregatedDamageHits(TArray<FRPGDamageHit>& Hits) const;
+
+	/** Reports the damage aggregated so far right away, instead of on the next tick */
+	UFUNCTION(BlueprintCallable, Category = "Damage")
+	void FlushAggregatedDamage();
+
 protected:
 	/** The level of this character, should not be modified directly once it has already spawned */
 	UPROPERTY(EditAnywhere, Replicated, Category = Abilities)
@@ -109,6 +166,10 @@ protected:
 	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = Abilities)
 	TArray<TSubclassOf<UGameplayEffect>> PassiveGameplayEffects;
 
+	/** Attributes whose base values are set from the baked progression tables whenever the level changes, before passives are applied */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = Abilities)
+	TArray<FRPGProgressionAttribute> ProgressionAttributes;
+
 	/** The component used to handle ability system interactions */
 	UPROPERTY()
 	URPGAbilitySystemComponent* AbilitySystemComponent;
@@ -129,6 +190,46 @@ protected:
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Inventory)
 	TMap<FRPGItemSlot, FGameplayAbilitySpecHandle> SlottedAbilities;
 
+	/** Slots that changed since the slotted abilities were last updated, they are updated together on the next tick */
+	TArray<FRPGItemSlot> PendingSlotUpdates;
+
+	/**
+	 * If true, damage taken during a frame is added up per instigator and damage tags, and OnDamaged/OnHealthChanged are called once for each on the next tick.
+	 * Saves calling Blueprint events for every hit of damage over time and multi-hit abilities
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Damage)
+	bool bAggregateDamage;
+
+	/** If true, the individual hits of aggregated damage are kept so GetAggregatedDamageHits can return them */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Damage)
+	bool bRecordAggregatedDamageHits;
+
+	/** A hit of aggregated damage, the instigator and causer may be destroyed before it's reported */
+	struct FRecordedDamageHit
+	{
+		TWeakObjectPtr<ARPGCharacterBase> InstigatorCharacter;
+		TWeakObjectPtr<AActor> DamageCauser;
+		float DamageAmount = 0.0f;
+		FHitResult HitInfo;
+	};
+
+	/** Damage taken this frame from one instigator with the same damage tags */
+	struct FAggregatedDamage
+	{
+		TWeakObjectPtr<ARPGCharacterBase> InstigatorCharacter;
+		TWeakObjectPtr<AActor> DamageCauser;
+		FGameplayTagContainer DamageTags;
+		float DamageAmount = 0.0f;
+		FHitResult HitInfo;
+		TArray<FRecordedDamageHit> Hits;
+	};
+
+	/** Damage waiting to be reported on the next tick */
+	TArray<FAggregatedDamage> PendingDamage;
+
+	/** The aggregated damage OnDamaged is being called for */
+	const FAggregatedDamage* ReportingDamage;
+
 	/** Delegate handles */
 	FDelegateHandle InventoryUpdateHandle;
 	FDelegateHandle InventoryLoadedHandle;
@@ -177,17 +278,29 @@ protected:
 	void OnItemSlotChanged(FRPGItemSlot ItemSlot, URPGItem* Item);
 	void RefreshSlottedGameplayAbilities();
 
+	/** Updates the abilities of the slots that changed since the last update */
+	void FlushPendingSlotUpdates();
+
+	/** Gives and clears abilities so the given slots match defaults and inventory. Abilities that only moved to another slot keep their spec */
+	void UpdateSlottedGameplayAbilities(const TArray<FRPGItemSlot>& ItemSlots);
+
+	/** Returns every slot that has or could have an ability */
+	TArray<FRPGItemSlot> GetAllAbilitySlots() const;
+
 	/** Apply the startup gameplay abilities and effects */
 	void AddStartupGameplayAbilities();
 
+	/** Sets the base values of ProgressionAttributes for the current level */
+	void ApplyProgressionAttributes();
+
 	/** Attempts to remove any startup gameplay abilities */
 	void RemoveStartupGameplayAbilities();
 
 	/** Adds slotted item abilities if needed */
 	void AddSlottedGameplayAbilities();
 
-	/** Fills in with ability specs, based on defaults and inventory */
-	void FillSlottedAbilitySpecs(TMap<FRPGItemSlot, FGameplayAbilitySpec>& SlottedAbilitySpecs);
+	/** Fills in the ability spec of a slot, based on defaults and inventory. Returns false if the slot has no ability */
+	bool GetSlottedAbilitySpec(const FRPGItemSlot& ItemSlot, FGameplayAbilitySpec& OutSpec) const;
 
 	/** Remove slotted gameplay abilities, if force is false it only removes invalid ones */
 	void RemoveSlottedGameplayAbilities(bool bRemoveAll);
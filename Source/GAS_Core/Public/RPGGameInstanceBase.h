@@ -39,6 +39,10 @@ public:
 	UPROPERTY(BlueprintReadWrite, Category = Save)
 	int32 SaveUserIndex;
 
+	/** Once the change log of the save game is this many bytes, the next save writes a new snapshot instead of appending to it */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Save)
+	int32 SaveLogCompactionSize;
+
 	/** Delegate called when the save game has been loaded/reset */
 	UPROPERTY(BlueprintAssignable, Category = Inventory)
 	FOnSaveGameLoaded OnSaveGameLoaded;
@@ -78,7 +82,7 @@ public:
 	UFUNCTION(BlueprintCallable, Category = Save)
 	void GetSaveSlotInfo(FString& SlotName, int32& UserIndex) const;
 
-	/** Writes the current save game object to disk. The save to disk happens in a background thread*/
+	/** Writes the current save game object to disk. Only the changes since the last write are appended, unless the change log needs compacting. The save to disk happens in a background thread*/
 	UFUNCTION(BlueprintCallable, Category = Save)
 	bool WriteSaveGame();
 
@@ -103,6 +107,30 @@ protected:
 	UPROPERTY()
 	bool bPendingSaveRequested;
 
+	/** Identifies the snapshot on disk, change log entries written for other snapshots are ignored */
+	FGuid SaveId;
+
+	/** Size of the change log on disk */
+	int64 SaveLogSize;
+
+	/** True if the next save must write a new snapshot, e.g. because the change log on disk is corrupt */
+	bool bSaveCompactionRequested;
+
+	/** True if the save in progress writes a new snapshot */
+	bool bSavingSnapshot;
+
+	/** True if the save game was loaded from the slot of the format before chunked saves, which is deleted once the first snapshot is written */
+	bool bLegacySaveConversionPending;
+
+	/** Loads the chunked snapshot and change log of the save slot. Returns null if they are corrupt, after moving them aside so they aren't overwritten */
+	URPGSaveGame* LoadChunkedSaveGame();
+
+	/** Returns the path of a chunked save file of the save slot */
+	FString GetChunkedSaveFilePath(const TCHAR* Extension) const;
+
+	/** Runs a disk write in a background thread and calls HandleAsyncSave when it's done */
+	void StartAsyncSave(TUniqueFunction<bool()>&& WriteToDisk);
+
 	/** Called when the async save happens */
 	virtual void HandleAsyncSave(const FString& SlotName, const int32 UserIndex, bool bSuccess);
 };
\ No newline at end of file
@@ -6,6 +6,8 @@
 #include "GameFramework/GameModeBase.h"
 #include "RPGGameModeBase.generated.h"
 
+class ARPGCharacterBase;
+
 /** Base class for GameMode, should be blueprinted */
 UCLASS()
 class GAS_CORE_API ARPGGameModeBase : public AGameModeBase
@@ -24,6 +26,9 @@ public:
 	 */
 	virtual void ResetLevel() override;
 
+	/** Starts preloading the assets used by the saved inventory and PreloadEnemyClasses */
+	virtual void StartPlay() override;
+
 	/** Returns true if GameOver() has been called, false otherwise */
 	virtual bool HasMatchEnded() const override;
 
@@ -32,6 +37,10 @@ public:
 	UFUNCTION(BlueprintCallable, Category=Game)
 	virtual void GameOver();
 
+	/** Enemy classes spawned in this level. They are streamed in with their abilities and effects when play starts, after the player's items */
+	UPROPERTY(EditDefaultsOnly, Category=Game)
+	TArray<TSoftClassPtr<ARPGCharacterBase>> PreloadEnemyClasses;
+
 protected:
 	UFUNCTION(BlueprintImplementableEvent, Category=Game, meta=(DisplayName="DoRestart", ScriptName="DoRestart"))
 	void K2_DoRestart();
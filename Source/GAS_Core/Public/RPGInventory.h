@@ -0,0 +1,281 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "GAS_Core.h"
+#include "Net/Serialization/FastArraySerializer.h"
+#include "RPGInventory.generated.h"
+
+class URPGItem;
+struct FRPGReplicatedInventory;
+
+/** Stable reference to an item in an FRPGInventory, stays valid until that item is removed or the inventory is reset */
+USTRUCT(BlueprintType)
+struct GAS_CORE_API FRPGInventoryHandle
+{
+	GENERATED_BODY()
+
+	FRPGInventoryHandle()
+		: Index(INDEX_NONE)
+		, Serial(0)
+	{}
+
+	FRPGInventoryHandle(int32 InIndex, int32 InSerial)
+		: Index(InIndex)
+		, Serial(InSerial)
+	{}
+
+	/** Equality operators */
+	bool operator==(const FRPGInventoryHandle& Other) const
+	{
+		return Index == Other.Index && Serial == Other.Serial;
+	}
+	bool operator!=(const FRPGInventoryHandle& Other) const
+	{
+		return !(*this == Other);
+	}
+
+	/** Implemented so it can be used in Maps/Sets */
+	friend inline uint32 GetTypeHash(const FRPGInventoryHandle& Key)
+	{
+		return HashCombine((uint32)Key.Index, (uint32)Key.Serial);
+	}
+
+	/** Returns true if this was set, the item may have been removed since */
+	bool IsValid() const
+	{
+		return Index != INDEX_NONE;
+	}
+
+private:
+	friend struct FRPGInventory;
+
+	int32 Index;
+	int32 Serial;
+};
+
+/** Items and slots of one item type, stored in dense arrays */
+USTRUCT()
+struct GAS_CORE_API FRPGInventoryTypeGroup
+{
+	GENERATED_BODY()
+
+	/** Items of this type, in no particular order */
+	UPROPERTY()
+	TArray<URPGItem*> Items;
+
+	/** Data of the item at the same index in Items */
+	UPROPERTY()
+	TArray<FRPGItemData> ItemData;
+
+	/** Handle index of the item at the same index in Items */
+	TArray<int32> HandleIndices;
+
+	/** Items in the slots of this type, indexed by SlotNumber. Null for empty slots */
+	UPROPERTY()
+	TArray<URPGItem*> Slots;
+};
+
+/**
+ * Inventory storage with the items of each type stored together, and the slots of each type in an array indexed by SlotNumber
+ * Type-filtered queries are O(items of that type), slot and item lookups are O(1)
+ */
+USTRUCT()
+struct GAS_CORE_API FRPGInventory
+{
+	GENERATED_BODY()
+
+	/** Removes all items and slots */
+	void Reset();
+
+	/** Creates empty slots, usually from ItemSlotsPerType on RPGGameInstanceBase */
+	void InitSlots(const TMap<FPrimaryAssetType, int32>& SlotsPerType);
+
+	/** Adds the item, or updates its data if it's already in the inventory */
+	FRPGInventoryHandle SetItem(URPGItem* Item, const FRPGItemData& ItemData);
+
+	/** Removes the item and empties its slot. Returns false if it wasn't in the inventory */
+	bool RemoveItem(URPGItem* Item, FRPGItemSlot* OutClearedSlot = nullptr);
+
+	/** Returns the handle of the item, or an invalid handle if it isn't in the inventory */
+	FRPGInventoryHandle FindItem(const URPGItem* Item) const;
+
+	/** Returns the item or its data, or null if the handle is no longer valid */
+	URPGItem* GetItem(const FRPGInventoryHandle& Handle) const;
+	const FRPGItemData* GetItemData(const FRPGInventoryHandle& Handle) const;
+
+	/** Returns all items of a type */
+	TArrayView<URPGItem* const> GetItemsOfType(const FPrimaryAssetType& ItemType) const;
+
+	/** Adds all items of all types */
+	void GetAllItems(TArray<URPGItem*>& OutItems) const;
+
+	/** Returns the number of items */
+	int32 Num() const
+	{
+		return ItemHandles.Num();
+	}
+
+	/** Returns true if the slot was created by InitSlots */
+	bool IsValidSlot(const FRPGItemSlot& ItemSlot) const;
+
+	/** Returns the item in the slot, or null if it's empty or invalid */
+	URPGItem* GetSlottedItem(const FRPGItemSlot& ItemSlot) const;
+
+	/** Returns the items in the slots of a type, indexed by SlotNumber */
+	TArrayView<URPGItem* const> GetSlotsOfType(const FPrimaryAssetType& ItemType) const;
+
+	/** Returns the slot the item is in, or an invalid slot */
+	FRPGItemSlot GetItemSlot(const URPGItem* Item) const;
+
+	/** Puts the item in the slot, taking it out of the slot it was in before. Null empties the slot. Adds the slots that changed, returns false if the slot is invalid */
+	bool SetSlottedItem(const FRPGItemSlot& ItemSlot, URPGItem* Item, TArray<FRPGItemSlot>& OutChangedSlots);
+
+	/** Returns the empty slot of the type with the lowest SlotNumber, or an invalid slot */
+	FRPGItemSlot FindEmptySlot(const FPrimaryAssetType& ItemType) const;
+
+	/** Calls Func(const FRPGItemSlot&, URPGItem*) for every slot */
+	template<typename FuncType>
+	void ForEachSlot(FuncType Func) const
+	{
+		for (const TPair<FPrimaryAssetType, int32>& GroupPair : GroupIndices)
+		{
+			const TArray<URPGItem*>& Slots = Groups[GroupPair.Value].Slots;
+			for (int32 SlotNumber = 0; SlotNumber < Slots.Num(); SlotNumber++)
+			{
+				Func(FRPGItemSlot(GroupPair.Key, SlotNumber), Slots[SlotNumber]);
+			}
+		}
+	}
+
+private:
+	FRPGInventoryTypeGroup* FindGroup(const FPrimaryAssetType& ItemType);
+	const FRPGInventoryTypeGroup* FindGroup(const FPrimaryAssetType& ItemType) const;
+	FRPGInventoryTypeGroup& FindOrAddGroup(const FPrimaryAssetType& ItemType);
+
+	/** Where the item of a handle is stored */
+	struct FHandleEntry
+	{
+		int32 GroupIndex = INDEX_NONE;
+		int32 ItemIndex = INDEX_NONE;
+		int32 Serial = 0;
+	};
+
+	/** Returns the entry of the handle if it is still valid */
+	const FHandleEntry* FindHandleEntry(const FRPGInventoryHandle& Handle) const;
+
+	UPROPERTY()
+	TArray<FRPGInventoryTypeGroup> Groups;
+
+	TMap<FPrimaryAssetType, int32> GroupIndices;
+
+	TArray<FHandleEntry> HandleEntries;
+	TArray<int32> FreeHandleIndices;
+
+	TMap<const URPGItem*, FRPGInventoryHandle> ItemHandles;
+
+	/** Slot of every slotted item, including items slotted without being in the inventory */
+	TMap<const URPGItem*, FRPGItemSlot> ItemSlots;
+};
+
+/** An item or slotted item of an inventory, as replicated by FRPGReplicatedInventory */
+USTRUCT()
+struct GAS_CORE_API FRPGReplicatedInventoryEntry : public FFastArraySerializerItem
+{
+	GENERATED_BODY()
+
+	FRPGReplicatedInventoryEntry()
+		: Item(nullptr)
+		, ItemData(0, 0)
+	{}
+
+	UPROPERTY()
+	URPGItem* Item;
+
+	/** Count 0 if the item is slotted but isn't in the inventory */
+	UPROPERTY()
+	FRPGItemData ItemData;
+
+	/** Invalid if the item isn't slotted */
+	UPROPERTY()
+	FRPGItemSlot ItemSlot;
+
+	void PreReplicatedRemove(const FRPGReplicatedInventory& InArray);
+	void PostReplicatedAdd(const FRPGReplicatedInventory& InArray);
+	void PostReplicatedChange(const FRPGReplicatedInventory& InArray);
+};
+
+/** How much replicating an FRPGReplicatedInventory has cost, measured on the server */
+struct GAS_CORE_API FRPGInventoryReplicationStats
+{
+	/** Entry changes that were sent, an entry changed twice between sends counts twice */
+	int64 NumChanges = 0;
+
+	/** Bytes written for those changes, including the fast array header */
+	int64 NumBytes = 0;
+
+	/** Number of non-empty deltas that were written */
+	int64 NumSends = 0;
+
+	float GetBytesPerChange() const
+	{
+		return NumChanges > 0 ? (float)NumBytes / NumChanges : 0.0f;
+	}
+};
+
+/** Called on clients for each entry that replication added, changed or removed */
+DECLARE_DELEGATE_TwoParams(FOnReplicatedInventoryEntryChanged, const FRPGReplicatedInventoryEntry& /*Entry*/, bool /*bRemoved*/);
+
+/** Called on clients once all entry changes of a replication update have been handled */
+DECLARE_DELEGATE(FOnReplicatedInventoryReceived);
+
+/** Replicated variant of an inventory, one entry per item so only the entries that changed are sent */
+USTRUCT()
+struct GAS_CORE_API FRPGReplicatedInventory : public FFastArraySerializer
+{
+	GENERATED_BODY()
+
+	/** Makes the entry of the item match, adding or removing it as needed. Pass null ItemData if the item isn't in the inventory */
+	void SetEntry(URPGItem* Item, const FRPGItemData* ItemData, const FRPGItemSlot& ItemSlot);
+
+	/** Removes the entries the predicate returns true for */
+	void RemoveEntries(TFunctionRef<bool(const FRPGReplicatedInventoryEntry&)> Predicate);
+
+	const TArray<FRPGReplicatedInventoryEntry>& GetEntries() const
+	{
+		return Entries;
+	}
+
+	/** Returns the entry of the item, or null */
+	const FRPGReplicatedInventoryEntry* FindEntry(const URPGItem* Item) const;
+
+	const FRPGInventoryReplicationStats& GetStats() const
+	{
+		return Stats;
+	}
+
+	bool NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms);
+	void PostReplicatedReceive(const FFastArraySerializer::FPostReplicatedReceiveParameters& Parameters);
+
+	/** Bound by the owner to apply replicated changes */
+	FOnReplicatedInventoryEntryChanged OnEntryChanged;
+	FOnReplicatedInventoryReceived OnReceived;
+
+private:
+	UPROPERTY()
+	TArray<FRPGReplicatedInventoryEntry> Entries;
+
+	/** Entries changed since the last delta was written */
+	int32 NumPendingChanges = 0;
+
+	FRPGInventoryReplicationStats Stats;
+};
+
+template<>
+struct TStructOpsTypeTraits<FRPGReplicatedInventory> : public TStructOpsTypeTraitsBase2<FRPGReplicatedInventory>
+{
+	enum
+	{
+		WithNetDeltaSerializer = true,
+	};
+};
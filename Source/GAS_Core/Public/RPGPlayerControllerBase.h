@@ -4,9 +4,12 @@
 
 #include "GAS_Core.h"
 #include "GameFramework/PlayerController.h"
+#include "RPGInventory.h"
 #include "RPGInventoryInterface.h"
 #include "RPGPlayerControllerBase.generated.h"
 
+struct FStreamableHandle;
+
 /** Base class for PlayerController, should be blueprinted */
 UCLASS()
 class GAS_CORE_API ARPGPlayerControllerBase : public APlayerController, public IRPGInventoryInterface
@@ -15,8 +18,11 @@ class GAS_CORE_API ARPGPlayerControllerBase : public APlayerController, public I
 
 public:
 	// Constructor and overrides
-	ARPGPlayerControllerBase() {}
+	ARPGPlayerControllerBase();
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	virtual void PostInitializeComponents() override;
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
 
 	/** Map of all items owned by this player, from definition to data */
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Inventory)
@@ -26,6 +32,18 @@ public:
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Inventory)
 	TMap<FRPGItemSlot, URPGItem*> SlottedItems;
 
+	/** How long to wait after an inventory change before writing it to the save game, so bursts of changes are saved together. If <= 0 changes are saved immediately */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = Inventory)
+	float InventorySaveDelay;
+
+	/** If true, LoadInventory streams all saved items in as one async batch instead of loading them one by one on the game thread */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = Inventory)
+	bool bAsyncLoadInventory;
+
+	/** Asset bundles to load with the saved items, the UI bundle is skipped on dedicated servers */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = Inventory)
+	TArray<FName> InventoryLoadBundles;
+
 	/** Delegate called when an inventory item has been added or removed */
 	UPROPERTY(BlueprintAssignable, Category = Inventory)
 	FOnInventoryItemChanged OnInventoryItemChanged;
@@ -55,11 +73,11 @@ public:
 	/** Native version above, called before BP delegate */
 	FOnInventoryLoadedNative OnInventoryLoadedNative;
 
-	/** Adds a new inventory item, will add it to an empty slot if possible. If the item supports count you can add more than one count. It will also update the level when adding if required */
+	/** Adds a new inventory item, will add it to an empty slot if possible. If the item supports count you can add more than one count. It will also update the level when adding if required. Fails while the inventory is loading, wait for OnInventoryLoaded */
 	UFUNCTION(BlueprintCallable, Category = Inventory)
 	bool AddInventoryItem(URPGItem* NewItem, int32 ItemCount = 1, int32 ItemLevel = 1, bool bAutoSlot = true);
 
-	/** Remove an inventory item, will also remove from slots. A remove count of <= 0 means to remove all copies */
+	/** Remove an inventory item, will also remove from slots. A remove count of <= 0 means to remove all copies. Fails while the inventory is loading, wait for OnInventoryLoaded */
 	UFUNCTION(BlueprintCallable, Category = Inventory)
 	bool RemoveInventoryItem(URPGItem* RemovedItem, int32 RemoveCount = 1);
 
@@ -75,7 +93,7 @@ public:
 	UFUNCTION(BlueprintPure, Category = Inventory)
 	bool GetInventoryItemData(URPGItem* Item, FRPGItemData& ItemData) const;
 
-	/** Sets slot to item, will remove from other slots if necessary. If passing null this will empty the slot */
+	/** Sets slot to item, will remove from other slots if necessary. If passing null this will empty the slot. On clients the change is predicted and sent to the server, which rolls it back if it's rejected. Fails on the server while the inventory is loading, wait for OnInventoryLoaded */
 	UFUNCTION(BlueprintCallable, Category = Inventory)
 	bool SetSlottedItem(FRPGItemSlot ItemSlot, URPGItem* Item);
 
@@ -91,14 +109,26 @@ public:
 	UFUNCTION(BlueprintCallable, Category = Inventory)
 	void FillEmptySlots();
 
-	/** Manually save the inventory, this is called from add/remove functions automatically */
+	/** Manually save the entire inventory right away. Add/remove functions save the changed items automatically after InventorySaveDelay */
 	UFUNCTION(BlueprintCallable, Category = Inventory)
 	bool SaveInventory();
 
-	/** Loads inventory from save game on game instance, this will replace arrays */
+	/** Writes any inventory changes that are waiting for InventorySaveDelay right away */
+	UFUNCTION(BlueprintCallable, Category = Inventory)
+	bool FlushInventorySave();
+
+	/** Loads inventory from save game on game instance, this will replace arrays. If loading async, OnInventoryLoaded is called once the items are loaded */
 	UFUNCTION(BlueprintCallable, Category = Inventory)
 	bool LoadInventory();
 
+	/** Returns true while an async inventory load is in progress. The inventory can't be changed on the server until it finishes */
+	UFUNCTION(BlueprintPure, Category = Inventory)
+	bool IsLoadingInventory() const;
+
+	/** Returns the average number of bytes sent to the owning client per inventory change. Only measured on the server */
+	UFUNCTION(BlueprintPure, Category = Inventory)
+	float GetInventoryBytesPerChange() const;
+
 	// Implement IRPGInventoryInterface
 	virtual const TMap<URPGItem*, FRPGItemData>& GetInventoryDataMap() const override
 	{
@@ -122,6 +152,65 @@ public:
 	}
 
 protected:
+	/** Storage behind InventoryData and SlottedItems, grouped by item type so type and slot queries don't scan the whole inventory */
+	UPROPERTY(Transient)
+	FRPGInventory Inventory;
+
+	/** Changes the item data in both Inventory and InventoryData. Removing also empties the slot of the item, which is returned */
+	void SetInventoryItemData(URPGItem* Item, const FRPGItemData& ItemData);
+	FRPGItemSlot RemoveInventoryItemData(URPGItem* Item);
+
+	/** Puts the item in the slot in both Inventory and SlottedItems, optionally notifying every slot that changed. Returns false if the slot is invalid */
+	bool SetSlottedItemData(const FRPGItemSlot& ItemSlot, URPGItem* Item, bool bNotify = true);
+
+	/** Empties the inventory and creates empty slots */
+	void ResetInventory(const TMap<FPrimaryAssetType, int32>& SlotsPerType);
+
+	/** The inventory as the server sees it, only replicated to the owning client. Only entries that changed are sent */
+	UPROPERTY(Replicated)
+	FRPGReplicatedInventory ReplicatedInventory;
+
+	/** The latest slot prediction the server has handled. Replicated together with the inventory changes it caused */
+	UPROPERTY(ReplicatedUsing = OnRep_AcknowledgedSlotPrediction)
+	int32 AcknowledgedSlotPrediction;
+
+	/** A slot change made on the client before the server handled it */
+	struct FSlotPrediction
+	{
+		int32 Key;
+		FRPGItemSlot ItemSlot;
+		URPGItem* Item;
+	};
+
+	/** Client slot changes the server hasn't acknowledged yet, in the order they were made */
+	TArray<FSlotPrediction> PendingSlotPredictions;
+	int32 LastSlotPrediction;
+
+	/** Sets the slot on the server and acknowledges the prediction, whether or not the change was allowed */
+	UFUNCTION(Server, Reliable)
+	void ServerSetSlottedItem(FRPGItemSlot ItemSlot, URPGItem* Item, int32 PredictionKey);
+
+	UFUNCTION()
+	void OnRep_AcknowledgedSlotPrediction();
+
+	/** Server only, updates the replicated entry of an item after its data or slot changed */
+	void UpdateReplicatedItem(URPGItem* Item);
+
+	/** Server only, set from ResetInventory until SyncReplicatedInventory so the entries are only updated once the inventory is rebuilt */
+	bool bRebuildingInventory;
+
+	/** Server only, makes the replicated entries match the rebuilt inventory. Entries that didn't change aren't sent again */
+	void SyncReplicatedInventory();
+
+	/** Client only, applies the item data of an entry received from the server */
+	void HandleReplicatedInventoryEntryChanged(const FRPGReplicatedInventoryEntry& Entry, bool bRemoved);
+
+	/** Client only, called once all entries of a replication update have been applied */
+	void HandleReplicatedInventoryReceived();
+
+	/** Client only, sets the slots to the replicated ones with the pending predictions on top */
+	void ApplyReplicatedSlots();
+
 	/** Auto slots a specific item, returns true if anything changed */
 	bool FillEmptySlotWithItem(URPGItem* NewItem);
 
@@ -132,4 +221,23 @@ protected:
 
 	/** Called when a global save game as been loaded */
 	void HandleSaveGameLoaded(URPGSaveGame* NewSaveGame);
+
+	/** Called when the async inventory load batch completes */
+	void HandleInventoryAssetsLoaded();
+
+	/** Copies items and slots from the save game, looking items up with the given function. Returns true if any slots were found */
+	bool CopyInventoryFromSaveGame(URPGSaveGame& SaveGame, TFunctionRef<URPGItem*(const FPrimaryAssetId&)> GetItem);
+
+	/** The in-flight async inventory load */
+	TSharedPtr<FStreamableHandle> InventoryLoadHandle;
+
+	/** Starts the save timer if it isn't running yet, so the changes made until it fires are written together */
+	void RequestSaveInventory();
+
+	/** Items and slots changed since the last save, only these are written to the save game */
+	UPROPERTY(Transient)
+	TSet<URPGItem*> DirtyItems;
+	TSet<FRPGItemSlot> DirtySlots;
+
+	FTimerHandle InventorySaveTimerHandle;
 };
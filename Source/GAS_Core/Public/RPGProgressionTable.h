@@ -0,0 +1,68 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "GAS_Core.h"
+
+class UCurveTable;
+
+/**
+ * Per-level values of a curve table, baked into one dense array when it is loaded so lookups don't evaluate curves
+ * Values are stored level by level, so all rows of one level are next to each other
+ */
+class GAS_CORE_API FRPGProgressionTable
+{
+public:
+	/**
+	 * Bakes every row of the table for levels 1 to the highest level with a value.
+	 * Levels without a value are interpolated linearly from their neighbours, or hold the nearest value past the ends, and are logged.
+	 * Rows without any value are logged and skipped. Returns false if no row could be baked
+	 */
+	bool Bake(const UCurveTable& CurveTable);
+
+	/** Returns the index of the row, or INDEX_NONE */
+	int32 FindRowIndex(FName RowName) const
+	{
+		const int32* RowIndex = RowIndices.Find(RowName);
+		return RowIndex ? *RowIndex : INDEX_NONE;
+	}
+
+	/** Returns the value of the row at the level, interpolating linearly between whole levels. Levels outside the table are clamped */
+	float GetValue(int32 RowIndex, float Level) const;
+
+	/** Returns the values of all rows at a whole level, indexed by row index. Levels outside the table are clamped */
+	TArrayView<const float> GetLevelValues(int32 Level) const
+	{
+		if (MaxLevel <= 0)
+		{
+			return TArrayView<const float>();
+		}
+
+		const int32 LevelIndex = FMath::Clamp(Level, 1, MaxLevel) - 1;
+		return MakeArrayView(Values.GetData() + LevelIndex * RowNames.Num(), RowNames.Num());
+	}
+
+	const TArray<FName>& GetRowNames() const
+	{
+		return RowNames;
+	}
+
+	int32 GetMaxLevel() const
+	{
+		return MaxLevel;
+	}
+
+	FName GetTableName() const
+	{
+		return TableName;
+	}
+
+private:
+	FName TableName;
+	TArray<FName> RowNames;
+	TMap<FName, int32> RowIndices;
+
+	/** Values of level L are at [(L - 1) * RowNames.Num(), L * RowNames.Num()) */
+	TArray<float> Values;
+	int32 MaxLevel = 0;
+};
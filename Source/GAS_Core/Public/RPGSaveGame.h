@@ -51,6 +51,30 @@ public:
 	UPROPERTY(VisibleAnywhere, BlueprintReadWrite, Category = SaveGame)
 	FString UserId;
 
+	/**
+	 * Chunked save format, used by RPGGameInstanceBase instead of saving the whole object through GameplayStatics.
+	 * A snapshot has a header and a checksummed section per map, and is followed by an append-only log of changes,
+	 * so saving a single item change only appends a few bytes. Both remember what was written, so changes are found by diffing against it.
+	 */
+
+	/** Writes the full save game as a snapshot tagged with SaveId */
+	void WriteSnapshot(const FGuid& SaveId, TArray<uint8>& OutBytes);
+
+	/** Writes a change log block for everything that changed since the last write or read. Returns false if nothing changed */
+	bool WriteChanges(const FGuid& SaveId, TArray<uint8>& OutBytes);
+
+	/** Reads a snapshot written by WriteSnapshot, applying version fixups. Returns false if the snapshot is invalid or corrupt */
+	bool ReadSnapshot(const TArray<uint8>& Bytes, FGuid& OutSaveId);
+
+	/** Applies the change log blocks of the snapshot with SaveId. Returns false if reading stopped early at a corrupt or truncated block */
+	bool ApplyChangeLog(const TArray<uint8>& Bytes, const FGuid& SaveId);
+
+	/** Returns true if this was written or read in the chunked format, so WriteChanges can be used */
+	bool HasWrittenState() const
+	{
+		return bHasWrittenState;
+	}
+
 protected:
 	/** Deprecated way of storing items, this is read in but not saved out */
 	UPROPERTY()
@@ -62,4 +86,16 @@ protected:
 
 	/** Overridden to allow version fixups */
 	virtual void Serialize(FArchive& Ar) override;
+
+	/** Converts data loaded from an older SavedDataVersion */
+	void ApplyVersionFixups();
+
+	/** Remembers the current data as what is on disk */
+	void SetWrittenState();
+
+	/** What was last written or read in the chunked format, changes are relative to this */
+	TMap<FPrimaryAssetId, FRPGItemData> WrittenInventoryData;
+	TMap<FRPGItemSlot, FPrimaryAssetId> WrittenSlottedItems;
+	FString WrittenUserId;
+	bool bHasWrittenState = false;
 };